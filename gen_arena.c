@@ -0,0 +1,634 @@
+/**********************************************************************
+ * gen_arena.c -- Per-thread bump arena for GMP temporaries.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- Each thread owns a list of chunks.  Allocation bumps an
+ *           offset in the current chunk; realloc of the most recent
+ *           block grows it in place, and free of the most recent
+ *           block pops it.  Anything else is left until fnArena_end,
+ *           which rewinds every chunk.  The chunks themselves are
+ *           kept, so after the first key the hot loop makes no calls
+ *           into the system allocator.
+ *
+ *           Blocks that were obtained from the system allocator
+ *           (outside of a scope) are always returned to it, so
+ *           long lived values such as the random state are safe.
+ *
+ *           Secure mode maps every chunk with mmap and remembers the
+ *           high water mark of each one during a key.  fnArena_end
+ *           then clears that prefix in one pass, so the candidates,
+ *           p - 1, phi and d never outlive the key.  System blocks
+ *           are wiped one by one, which only happens outside of the
+ *           hot loop.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <gmp.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "gen_arena.h"
+
+
+     /******** #defines and typedefs  ********/
+#define ARENA_ALIGN      (16)
+#define ROUND_UP(n)      (((n) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+#define HUGE_PAGE_SIZE   (2 * 1024 * 1024)
+
+typedef struct ARENA_CHUNK {
+  struct ARENA_CHUNK  *pNext;         /* next chunk in the list        */
+  size_t               nSize;         /* usable bytes in pBase         */
+  size_t               nUsed;         /* bump offset                   */
+  size_t               nHigh;         /* high water of nUsed, secure   */
+  size_t               nMapped;       /* mmap length, secure mode only */
+  unsigned char       *pBase;         /* start of the usable bytes     */
+} ARENA_CHUNK;
+
+typedef struct {
+  ARENA_CHUNK   *pHead;               /* first chunk of this thread    */
+  ARENA_CHUNK   *pCur;                /* chunk being carved            */
+  void          *pLast;               /* most recent block             */
+  size_t         nLastSize;           /* its rounded size              */
+  size_t         nInUse;              /* bytes used in this scope      */
+  int            nDepth;              /* nesting of begin / end        */
+  ARENA_STATS    stats;               /* this thread's counters        */
+} ARENA;
+
+
+     /******** globals in this file   ********/
+static __thread ARENA   arena;
+static size_t           nArenaChunkSize = ARENA_CHUNK_DEFAULT;
+static int              flArenaStats    = 0;
+static int              flArenaSecure   = 0;
+static int              flArenaHuge     = 0;
+static int              flArenaLock     = 0;
+static int              flArenaOn       = 0;
+static ARENA_STATS      statsTotal;        /* folded in by fnArena_end */
+static pthread_mutex_t  mtxStats = PTHREAD_MUTEX_INITIALIZER;
+
+static void *(*pfnSysAlloc)   (size_t);
+static void *(*pfnSysRealloc) (void *, size_t, size_t);
+static void  (*pfnSysFree)    (void *, size_t);
+
+
+     /******** functions in this file ********/
+static void         *fnArena_alloc (size_t nSize);
+static void         *fnArena_realloc (void *ptr, size_t nOld, size_t nNew);
+static void          fnArena_free (void *ptr, size_t nSize);
+static ARENA_CHUNK  *fnArena_owner (void *ptr);
+static ARENA_CHUNK  *fnArena_new_chunk (size_t nSize);
+static void          fnArena_drop_chunk (ARENA_CHUNK *pChunk);
+static void         *fnArena_carve (size_t nSize);
+static void          fnArena_fold_stats (ARENA_STATS *pDst, \
+                     const ARENA_STATS *pSrc);
+
+
+
+/************************************************************************
+ * fnArena_install -- Register the arena with GMP.  Must be called
+ *                    before any GMP value is created.
+ *
+ * Remark - nChunkSize of 0 selects ARENA_CHUNK_DEFAULT.  nFlags is
+ *          a combination of the ARENA_F_ values; huge pages and
+ *          mlock only apply together with ARENA_F_SECURE.
+ ***********************************************************************/
+void fnArena_install (size_t nChunkSize, int nFlags)
+{
+  if (flArenaOn)
+    return;
+
+  if (nChunkSize != 0)
+    nArenaChunkSize = ROUND_UP (nChunkSize);
+  flArenaStats  = (nFlags & ARENA_F_STATS) != 0;
+  flArenaSecure = (nFlags & ARENA_F_SECURE) != 0;
+  flArenaHuge   = flArenaSecure && (nFlags & ARENA_F_HUGEPAGES) != 0;
+  flArenaLock   = flArenaSecure && (nFlags & ARENA_F_MLOCK) != 0;
+
+  /* 1. Remember the allocator GMP was using, for the fallback path */
+  mp_get_memory_functions (&pfnSysAlloc, &pfnSysRealloc, &pfnSysFree);
+
+  /* 2. Route everything through the arena */
+  mp_set_memory_functions (fnArena_alloc, fnArena_realloc, fnArena_free);
+  flArenaOn = 1;
+}
+
+
+
+/************************************************************************
+ * fnArena_installed -- Nonzero when the arena is registered with GMP.
+ ***********************************************************************/
+int fnArena_installed (void)
+{
+  return flArenaOn;
+}
+
+
+
+/************************************************************************
+ * fnArena_begin -- Start a key scope on the calling thread.
+ *
+ * Remark - Scopes nest; only the outermost fnArena_end rewinds.
+ ***********************************************************************/
+void fnArena_begin (void)
+{
+  if (!flArenaOn)
+    return;
+
+  if (arena.nDepth++ == 0) {
+    arena.pCur      = arena.pHead;
+    arena.pLast     = NULL;
+    arena.nLastSize = 0;
+    arena.nInUse    = 0;
+  }
+}
+
+
+
+/************************************************************************
+ * fnArena_end -- Finish a key scope.  Every block carved since the
+ *                matching fnArena_begin becomes invalid.
+ ***********************************************************************/
+void fnArena_end (void)
+{
+  ARENA_CHUNK  *pChunk;
+
+
+  if (!flArenaOn || arena.nDepth == 0)
+    return;
+  if (--arena.nDepth != 0)
+    return;
+
+  /* 1. Wipe what this key touched and rewind all chunks, */
+  /*    they stay with the thread                          */
+  for (pChunk = arena.pHead; pChunk != NULL; pChunk = pChunk->pNext) {
+    if (flArenaSecure && pChunk->nHigh != 0) {
+      fnArena_wipe (pChunk->pBase, pChunk->nHigh);
+      if (flArenaStats)
+        arena.stats.nWipedBytes += pChunk->nHigh;
+      pChunk->nHigh = 0;
+    }
+    pChunk->nUsed = 0;
+  }
+  arena.pCur  = arena.pHead;
+  arena.pLast = NULL;
+
+  /* 2. Fold this thread's counters into the totals */
+  if (flArenaStats) {
+    arena.stats.nResets++;
+    pthread_mutex_lock (&mtxStats);
+    fnArena_fold_stats (&statsTotal, &arena.stats);
+    pthread_mutex_unlock (&mtxStats);
+    memset (&arena.stats, 0, sizeof (arena.stats));
+  }
+}
+
+
+
+/************************************************************************
+ * fnArena_leave -- Step out of the current scope for a moment, so
+ *                  that values which must outlive the key (caches,
+ *                  scratch space) come from the system allocator.
+ *                  Returns what fnArena_reenter needs.
+ ***********************************************************************/
+int fnArena_leave (void)
+{
+  int  nDepth = arena.nDepth;
+
+
+  arena.nDepth = 0;
+  return nDepth;
+}
+
+
+
+/************************************************************************
+ * fnArena_reenter -- Undo fnArena_leave.
+ ***********************************************************************/
+void fnArena_reenter (int nDepth)
+{
+  arena.nDepth = nDepth;
+}
+
+
+
+/************************************************************************
+ * fnArena_thread_release -- Give the calling thread's chunks back to
+ *                           the system.  Call before a thread exits.
+ ***********************************************************************/
+void fnArena_thread_release (void)
+{
+  ARENA_CHUNK  *pChunk, *pNext;
+
+
+  if (!flArenaOn)
+    return;
+
+  for (pChunk = arena.pHead; pChunk != NULL; pChunk = pNext) {
+    pNext = pChunk->pNext;
+    fnArena_drop_chunk (pChunk);
+  }
+
+  if (flArenaStats) {
+    pthread_mutex_lock (&mtxStats);
+    fnArena_fold_stats (&statsTotal, &arena.stats);
+    pthread_mutex_unlock (&mtxStats);
+  }
+  memset (&arena, 0, sizeof (arena));
+}
+
+
+
+/************************************************************************
+ * fnArena_get_stats -- Totals over all finished scopes and threads.
+ ***********************************************************************/
+void fnArena_get_stats (ARENA_STATS *pStats)
+{
+  pthread_mutex_lock (&mtxStats);
+  *pStats = statsTotal;
+  pthread_mutex_unlock (&mtxStats);
+}
+
+
+
+/************************************************************************
+ * fnArena_print_stats -- Human readable form of fnArena_get_stats.
+ ***********************************************************************/
+void fnArena_print_stats (FILE *fp)
+{
+  ARENA_STATS  st;
+
+
+  fnArena_get_stats (&st);
+
+  fprintf (fp, "\n  --> Arena statistics <--\n");
+  fprintf (fp, "      keys (scopes):          %lu\n", st.nResets);
+  fprintf (fp, "      allocations:            %lu\n", st.nAllocs);
+  fprintf (fp, "      reallocations:          %lu  (%lu in place)\n", \
+           st.nReallocs, st.nReallocsInPlace);
+  fprintf (fp, "      frees:                  %lu  (%lu popped)\n", \
+           st.nFrees, st.nFreesPopped);
+  fprintf (fp, "      bytes requested:        %lu\n", \
+           (unsigned long) st.nBytes);
+  fprintf (fp, "      peak bytes of one key:  %lu\n", \
+           (unsigned long) st.nPeakBytes);
+  fprintf (fp, "      chunks from system:     %lu\n", st.nSysAllocs);
+  fprintf (fp, "      calls outside a scope:  %lu\n", st.nSysFallbacks);
+  if (flArenaSecure)
+    fprintf (fp, "      bytes wiped:            %lu\n", \
+             (unsigned long) st.nWipedBytes);
+}
+
+
+
+/************************************************************************
+ * fnArena_wipe -- Clear nSize bytes in a way the compiler cannot
+ *                 drop as a dead store.
+ *
+ * Remark - Uses 16 byte SSE2 stores when ptr and nSize allow it,
+ *          which is always the case for arena chunks.
+ ***********************************************************************/
+void fnArena_wipe (void *ptr, size_t nSize)
+{
+  unsigned char  *p = (unsigned char *) ptr;
+#ifdef __SSE2__
+  __m128i         zero = _mm_setzero_si128 ();
+
+
+  /* 1. Head bytes up to 16 byte alignment */
+  while (nSize > 0 && ((size_t) p & 15) != 0) {
+    *p++ = 0;
+    nSize--;
+  }
+
+  /* 2. Four vector stores per round */
+  for (; nSize >= 64; p += 64, nSize -= 64) {
+    _mm_store_si128 ((__m128i *) (p +  0), zero);
+    _mm_store_si128 ((__m128i *) (p + 16), zero);
+    _mm_store_si128 ((__m128i *) (p + 32), zero);
+    _mm_store_si128 ((__m128i *) (p + 48), zero);
+  }
+  for (; nSize >= 16; p += 16, nSize -= 16)
+    _mm_store_si128 ((__m128i *) p, zero);
+#endif
+
+  /* 3. Whatever is left */
+  memset (p, 0, nSize);
+
+  /* 4. The stores must happen even though nobody reads the bytes */
+  __asm__ __volatile__ ("" : : "r" (ptr) : "memory");
+}
+
+
+
+/************************************************************************
+ * fnArena_new_chunk -- Get a chunk with nSize usable bytes.
+ *
+ * Remark - Secure chunks are their own mapping so that they can be
+ *          locked, kept out of core dumps and put on huge pages.
+ *          A failed MAP_HUGETLB falls back to normal pages with a
+ *          transparent huge page hint, a failed mlock is reported
+ *          once and otherwise ignored.
+ ***********************************************************************/
+static ARENA_CHUNK *fnArena_new_chunk (size_t nSize)
+{
+  static int     flLockWarned = 0;
+  ARENA_CHUNK   *pChunk;
+  size_t         nHead, nMap, nPage;
+  void          *pMap = MAP_FAILED;
+
+
+  nHead = ROUND_UP (sizeof (ARENA_CHUNK));
+
+  /* 1. Ordinary mode, one block from the system allocator */
+  if (!flArenaSecure) {
+    pChunk = (ARENA_CHUNK *) pfnSysAlloc (nHead + nSize);
+    memset (pChunk, 0, sizeof (ARENA_CHUNK));
+    pChunk->nSize = nSize;
+    pChunk->pBase = (unsigned char *) pChunk + nHead;
+    return pChunk;
+  }
+
+  /* 2. Secure mode, a private mapping */
+  nPage = flArenaHuge ? HUGE_PAGE_SIZE : (size_t) sysconf (_SC_PAGESIZE);
+  nMap  = (nHead + nSize + nPage - 1) & ~(nPage - 1);
+#ifdef MAP_HUGETLB
+  if (flArenaHuge)
+    pMap = mmap (NULL, nMap, PROT_READ | PROT_WRITE, \
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  if (pMap == MAP_FAILED) {
+    pMap = mmap (NULL, nMap, PROT_READ | PROT_WRITE, \
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pMap == MAP_FAILED) {
+      fprintf (stderr, "   ### ERROR: cannot map secure arena chunk\n");
+      abort ();
+    }
+#ifdef MADV_HUGEPAGE
+    if (flArenaHuge)
+      madvise (pMap, nMap, MADV_HUGEPAGE);
+#endif
+  }
+#ifdef MADV_DONTDUMP
+  madvise (pMap, nMap, MADV_DONTDUMP);
+#endif
+  if (flArenaLock && mlock (pMap, nMap) != 0 && !flLockWarned) {
+    flLockWarned = 1;
+    fprintf (stderr, "   ### WARNING: mlock of secure arena failed\n");
+  }
+
+  pChunk = (ARENA_CHUNK *) pMap;
+  pChunk->nSize   = nMap - nHead;
+  pChunk->nMapped = nMap;
+  pChunk->pBase   = (unsigned char *) pMap + nHead;
+  return pChunk;
+}
+
+
+
+/************************************************************************
+ * fnArena_drop_chunk -- Return a chunk to the system.
+ ***********************************************************************/
+static void fnArena_drop_chunk (ARENA_CHUNK *pChunk)
+{
+  size_t  nMapped = pChunk->nMapped;
+
+
+  if (nMapped == 0) {
+    pfnSysFree (pChunk, ROUND_UP (sizeof (ARENA_CHUNK)) + pChunk->nSize);
+    return;
+  }
+
+  fnArena_wipe (pChunk->pBase, pChunk->nHigh);
+  if (flArenaLock)
+    munlock (pChunk, nMapped);
+  munmap (pChunk, nMapped);
+}
+
+
+
+/************************************************************************
+ * fnArena_owner -- Chunk of this thread holding ptr, or NULL.
+ *
+ * Remark - The list is short (usually a single chunk).
+ ***********************************************************************/
+static ARENA_CHUNK *fnArena_owner (void *ptr)
+{
+  ARENA_CHUNK    *pChunk;
+  unsigned char  *p = (unsigned char *) ptr;
+
+
+  for (pChunk = arena.pHead; pChunk != NULL; pChunk = pChunk->pNext)
+    if (p >= pChunk->pBase && p < pChunk->pBase + pChunk->nSize)
+      return pChunk;
+
+  return NULL;
+}
+
+
+
+/************************************************************************
+ * fnArena_carve -- Bump allocate nSize bytes, moving on to the next
+ *                  chunk (or a new one) when the current is full.
+ ***********************************************************************/
+static void *fnArena_carve (size_t nSize)
+{
+  ARENA_CHUNK  *pChunk, *pPrev;
+  size_t        nChunk;
+  void         *ptr;
+
+
+  nSize = ROUND_UP (nSize);
+
+  /* 1. Find a chunk with room, starting at the current one */
+  pPrev = NULL;
+  for (pChunk = arena.pCur; pChunk != NULL; pChunk = pChunk->pNext) {
+    if (pChunk->nSize - pChunk->nUsed >= nSize)
+      break;
+    pPrev = pChunk;
+  }
+
+  /* 2. None left, so take a new chunk from the system */
+  if (pChunk == NULL) {
+    nChunk = nSize > nArenaChunkSize ? nSize : nArenaChunkSize;
+    pChunk = fnArena_new_chunk (nChunk);
+    if (pPrev != NULL)
+      pPrev->pNext = pChunk;
+    else if (arena.pHead == NULL)
+      arena.pHead = pChunk;
+    else {
+      for (pPrev = arena.pHead; pPrev->pNext != NULL; pPrev = pPrev->pNext)
+        ;
+      pPrev->pNext = pChunk;
+    }
+    if (flArenaStats)
+      arena.stats.nSysAllocs++;
+  }
+
+  /* 3. Bump */
+  ptr = pChunk->pBase + pChunk->nUsed;
+  pChunk->nUsed += nSize;
+  if (pChunk->nUsed > pChunk->nHigh)
+    pChunk->nHigh = pChunk->nUsed;
+  arena.pCur      = pChunk;
+  arena.pLast     = ptr;
+  arena.nLastSize = nSize;
+  arena.nInUse   += nSize;
+
+  if (flArenaStats && arena.nInUse > arena.stats.nPeakBytes)
+    arena.stats.nPeakBytes = arena.nInUse;
+
+  return ptr;
+}
+
+
+
+/************************************************************************
+ * fnArena_alloc -- GMP allocate function.
+ ***********************************************************************/
+static void *fnArena_alloc (size_t nSize)
+{
+  if (arena.nDepth == 0) {
+    if (flArenaStats)
+      arena.stats.nSysFallbacks++;
+    return pfnSysAlloc (nSize);
+  }
+
+  if (flArenaStats) {
+    arena.stats.nAllocs++;
+    arena.stats.nBytes += nSize;
+  }
+
+  return fnArena_carve (nSize);
+}
+
+
+
+/************************************************************************
+ * fnArena_realloc -- GMP reallocate function.
+ *
+ * Remark - GMP always passes the old size, so a copy never needs to
+ *          know where the block came from beyond fnArena_owner.
+ ***********************************************************************/
+static void *fnArena_realloc (void *ptr, size_t nOld, size_t nNew)
+{
+  ARENA_CHUNK  *pChunk;
+  void         *pNew;
+  size_t        nGrow;
+
+
+  pChunk = arena.pHead != NULL ? fnArena_owner (ptr) : NULL;
+
+  /* 1. A system block stays a system block, in secure mode */
+  /*    the old copy is wiped before it is released           */
+  if (pChunk == NULL) {
+    if (flArenaStats)
+      arena.stats.nSysFallbacks++;
+    if (!flArenaSecure)
+      return pfnSysRealloc (ptr, nOld, nNew);
+    pNew = pfnSysAlloc (nNew);
+    memcpy (pNew, ptr, nOld < nNew ? nOld : nNew);
+    fnArena_wipe (ptr, nOld);
+    pfnSysFree (ptr, nOld);
+    return pNew;
+  }
+
+  if (flArenaStats) {
+    arena.stats.nReallocs++;
+    if (nNew > nOld)
+      arena.stats.nBytes += nNew - nOld;
+  }
+
+  /* 2. Shrinking, or still fits in the rounded block */
+  if (ROUND_UP (nNew) <= ROUND_UP (nOld)) {
+    if (flArenaStats)
+      arena.stats.nReallocsInPlace++;
+    return ptr;
+  }
+
+  /* 3. The most recent block can grow where it is */
+  if (ptr == arena.pLast) {
+    nGrow = ROUND_UP (nNew) - arena.nLastSize;
+    if (pChunk->nSize - pChunk->nUsed >= nGrow) {
+      pChunk->nUsed   += nGrow;
+      if (pChunk->nUsed > pChunk->nHigh)
+        pChunk->nHigh = pChunk->nUsed;
+      arena.nLastSize += nGrow;
+      arena.nInUse    += nGrow;
+      if (flArenaStats) {
+        arena.stats.nReallocsInPlace++;
+        if (arena.nInUse > arena.stats.nPeakBytes)
+          arena.stats.nPeakBytes = arena.nInUse;
+      }
+      return ptr;
+    }
+  }
+
+  /* 4. Otherwise move it */
+  pNew = fnArena_carve (nNew);
+  memcpy (pNew, ptr, nOld);
+
+  return pNew;
+}
+
+
+
+/************************************************************************
+ * fnArena_free -- GMP free function.
+ ***********************************************************************/
+static void fnArena_free (void *ptr, size_t nSize)
+{
+  ARENA_CHUNK  *pChunk;
+
+
+  pChunk = arena.pHead != NULL ? fnArena_owner (ptr) : NULL;
+  if (pChunk == NULL) {
+    if (flArenaStats)
+      arena.stats.nSysFallbacks++;
+    if (flArenaSecure)
+      fnArena_wipe (ptr, nSize);
+    pfnSysFree (ptr, nSize);
+    return;
+  }
+
+  if (flArenaStats)
+    arena.stats.nFrees++;
+
+  /* 1. Pop the most recent block, the rest waits for fnArena_end */
+  if (ptr == arena.pLast) {
+    pChunk->nUsed -= arena.nLastSize;
+    arena.nInUse  -= arena.nLastSize;
+    arena.pLast    = NULL;
+    if (flArenaStats)
+      arena.stats.nFreesPopped++;
+  }
+}
+
+
+
+/************************************************************************
+ * fnArena_fold_stats -- Add pSrc into pDst, peak is a maximum.
+ ***********************************************************************/
+static void fnArena_fold_stats (ARENA_STATS *pDst, const ARENA_STATS *pSrc)
+{
+  pDst->nAllocs          += pSrc->nAllocs;
+  pDst->nReallocs        += pSrc->nReallocs;
+  pDst->nReallocsInPlace += pSrc->nReallocsInPlace;
+  pDst->nFrees           += pSrc->nFrees;
+  pDst->nFreesPopped     += pSrc->nFreesPopped;
+  pDst->nSysAllocs       += pSrc->nSysAllocs;
+  pDst->nSysFallbacks    += pSrc->nSysFallbacks;
+  pDst->nResets          += pSrc->nResets;
+  pDst->nBytes           += pSrc->nBytes;
+  pDst->nWipedBytes      += pSrc->nWipedBytes;
+  if (pSrc->nPeakBytes > pDst->nPeakBytes)
+    pDst->nPeakBytes = pSrc->nPeakBytes;
+}
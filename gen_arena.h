@@ -0,0 +1,63 @@
+/**********************************************************************
+ * gen_arena.h -- Per-thread bump arena for the GMP temporaries used
+ *                while one key is being generated.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- The arena is registered with mp_set_memory_functions.
+ *           Between fnArena_begin and fnArena_end every GMP allocation
+ *           made by the calling thread is carved from that thread's
+ *           chunks, and fnArena_end rewinds them all at once.
+ *           Outside of a scope the system allocator is used.
+ *
+ *           With ARENA_F_SECURE the chunks are mapped separately
+ *           (optionally on huge pages and locked in memory) and the
+ *           used part of every chunk is wiped once when the key is
+ *           finished, instead of wiping each block as it is freed.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_ARENA_H
+#define GEN_ARENA_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+
+     /******** #defines and typedefs  ********/
+#define ARENA_CHUNK_DEFAULT  (256 * 1024)   /* bytes per arena chunk */
+
+#define ARENA_F_STATS        (0x01)   /* keep allocation counters      */
+#define ARENA_F_SECURE       (0x02)   /* wipe key material at the end  */
+#define ARENA_F_HUGEPAGES    (0x04)   /* secure chunks on huge pages   */
+#define ARENA_F_MLOCK        (0x08)   /* secure chunks never swapped   */
+
+typedef struct {
+  unsigned long  nAllocs;             /* blocks handed out             */
+  unsigned long  nReallocs;           /* realloc requests              */
+  unsigned long  nReallocsInPlace;    /* ... satisfied without a copy  */
+  unsigned long  nFrees;              /* free requests                 */
+  unsigned long  nFreesPopped;        /* ... that gave space back      */
+  unsigned long  nSysAllocs;          /* chunks taken from the system  */
+  unsigned long  nSysFallbacks;       /* GMP calls outside any scope   */
+  unsigned long  nResets;             /* scopes ended (keys finished)  */
+  size_t         nBytes;              /* bytes requested in scopes     */
+  size_t         nPeakBytes;          /* largest arena use of one key  */
+  size_t         nWipedBytes;         /* bytes cleared by secure mode  */
+} ARENA_STATS;
+
+
+     /******** functions in gen_arena.c ********/
+void  fnArena_install (size_t nChunkSize, int nFlags);
+int   fnArena_installed (void);
+void  fnArena_begin (void);
+void  fnArena_end (void);
+int   fnArena_leave (void);
+void  fnArena_reenter (int nDepth);
+void  fnArena_thread_release (void);
+void  fnArena_get_stats (ARENA_STATS *pStats);
+void  fnArena_print_stats (FILE *fp);
+void  fnArena_wipe (void *ptr, size_t nSize);
+
+#endif
@@ -0,0 +1,400 @@
+/**********************************************************************
+ * gen_async.c -- Asynchronous key generation for programs built
+ *                around an event loop.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- The requests of every caller share one pool of workers
+ *           (gen_pool.c), so a thousand outstanding requests still
+ *           use nThreads threads.  A worker makes the key inside its
+ *           arena scope and copies the numbers into the future, whose
+ *           mpz_t were sized for the key when it was queued, so
+ *           nothing the caller keeps is ever allocated in the arena.
+ *
+ *           Futures without a callback are handed back as the daemon
+ *           does (gen_daemon.c): a list under the mutex and a poke of
+ *           the eventfd, whose counter only wakes the loop.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+#include "gen_arena.h"
+#include "gen_memprof.h"
+#include "gen_bulk.h"
+#include "gen_pool.h"
+#include "gen_cancel.h"
+#include "gen_async.h"
+
+
+     /******** #defines and typedefs  ********/
+struct KEY_FUTURE {
+  ASYNC_KEYGEN     *pAsync;
+  KEY_PARAMS        params;
+  long              nSeq;             /* request number, for the seed */
+  KEY_CALLBACK      pfnDone;
+  void             *pArg;
+  int               flDone;
+  int               flListed;         /* on the done list             */
+  int               nStatus;          /* KEYGEN_STATUS once done      */
+  CANCEL_TOKEN      tok;
+  KEY_FUTURE       *pNext;            /* done list                    */
+  mpz_t             mpzE, mpzN, mpzP1, mpzP2, mpzD;
+};
+
+struct ASYNC_KEYGEN {
+  POOL             *pPool;
+  unsigned long     nSeed;            /* seed S                       */
+  long              nSeq;             /* requests queued so far       */
+  int               nMaxPending;
+  int               nPending;         /* queued or running            */
+  int               fdEvent;          /* readable: done list not empty */
+  KEY_FUTURE       *pDoneHead;        /* finished, oldest first       */
+  KEY_FUTURE       *pDoneTail;
+  pthread_mutex_t   mtx;
+  pthread_cond_t    cvDone;           /* some future finished         */
+};
+
+
+     /******** functions in this file ********/
+static void  fnAsync_job (void *pArg);
+
+
+
+
+/************************************************************************
+ * fnAsync_create -- A generator with nThreads workers and room for
+ *                   nMaxPending outstanding requests.  NULL on failure.
+ ***********************************************************************/
+ASYNC_KEYGEN *fnAsync_create (int nThreads, int nMaxPending, \
+              unsigned long nSeed)
+{
+  ASYNC_KEYGEN  *pAsync;
+
+
+  pAsync = (ASYNC_KEYGEN *) calloc (1, sizeof (ASYNC_KEYGEN));
+  pAsync->fdEvent = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (pAsync->fdEvent < 0) {
+    perror ("eventfd");
+    free (pAsync);
+    return NULL;
+  }
+  pAsync->nSeed       = nSeed;
+  pAsync->nMaxPending = nMaxPending > 0 ? nMaxPending : 1;
+  pthread_mutex_init (&pAsync->mtx, NULL);
+  pthread_cond_init (&pAsync->cvDone, NULL);
+  pAsync->pPool = fnPool_create (nThreads > 0 ? nThreads : 1, \
+                                 fnWorker_init, fnWorker_exit);
+
+  return pAsync;
+}
+
+
+
+/************************************************************************
+ * fnAsync_destroy -- Finish the outstanding requests and free the
+ *                    generator.  Free its futures first.
+ ***********************************************************************/
+void fnAsync_destroy (ASYNC_KEYGEN *pAsync)
+{
+  fnPool_destroy (pAsync->pPool);
+  close (pAsync->fdEvent);
+  pthread_cond_destroy (&pAsync->cvDone);
+  pthread_mutex_destroy (&pAsync->mtx);
+  free (pAsync);
+}
+
+
+
+/************************************************************************
+ * fnAsync_fd -- The eventfd to poll for futures without a callback.
+ ***********************************************************************/
+int fnAsync_fd (const ASYNC_KEYGEN *pAsync)
+{
+  return pAsync->fdEvent;
+}
+
+
+
+/************************************************************************
+ * fnAsync_keypair -- Queue one key.  Returns its future, or NULL with
+ *                    errno EAGAIN (too many pending) or EINVAL.
+ *
+ * Remark - pfnDone, when given, runs on a worker thread with pArg.
+ ***********************************************************************/
+KEY_FUTURE *fnAsync_keypair (ASYNC_KEYGEN *pAsync, \
+            const KEY_PARAMS *pParams, KEY_CALLBACK pfnDone, void *pArg)
+{
+  KEY_FUTURE  *pFut;
+  int          nBits = pParams->nBitLen;
+
+
+  if (nBits < ASYNC_MIN_BITS || nBits > ASYNC_MAX_BITS || nBits % 2 != 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  /* 1. A place in the queue */
+  pthread_mutex_lock (&pAsync->mtx);
+  if (pAsync->nPending >= pAsync->nMaxPending) {
+    pthread_mutex_unlock (&pAsync->mtx);
+    errno = EAGAIN;
+    return NULL;
+  }
+  pAsync->nPending++;
+  pFut = (KEY_FUTURE *) calloc (1, sizeof (KEY_FUTURE));
+  pFut->nSeq = pAsync->nSeq++;
+  pthread_mutex_unlock (&pAsync->mtx);
+
+  /* 2. Results sized for the key, so the worker never reallocates */
+  pFut->pAsync  = pAsync;
+  pFut->params  = *pParams;
+  pFut->pfnDone = pfnDone;
+  pFut->pArg    = pArg;
+  fnCancel_init (&pFut->tok, pParams->nTimeoutMs);
+  mpz_init2 (pFut->mpzE, 256 + GMP_NUMB_BITS);
+  mpz_init2 (pFut->mpzN, nBits + GMP_NUMB_BITS);
+  mpz_init2 (pFut->mpzP1, nBits / 2 + GMP_NUMB_BITS);
+  mpz_init2 (pFut->mpzP2, nBits / 2 + GMP_NUMB_BITS);
+  mpz_init2 (pFut->mpzD, nBits + GMP_NUMB_BITS);
+
+  fnPool_submit (pAsync->pPool, fnAsync_job, pFut);
+
+  return pFut;
+}
+
+
+
+/************************************************************************
+ * fnAsync_next_done -- The oldest finished future without a callback
+ *                      that has not been taken yet, or NULL.
+ ***********************************************************************/
+KEY_FUTURE *fnAsync_next_done (ASYNC_KEYGEN *pAsync)
+{
+  KEY_FUTURE  *pFut;
+  uint64_t     nCount;
+
+
+  /* The counter only wakes the loop, the list says what is done */
+  if (read (pAsync->fdEvent, &nCount, sizeof (nCount)) < 0 && errno != EAGAIN)
+    perror ("eventfd");
+
+  pthread_mutex_lock (&pAsync->mtx);
+  if ((pFut = pAsync->pDoneHead) != NULL) {
+    pAsync->pDoneHead = pFut->pNext;
+    if (pAsync->pDoneHead == NULL)
+      pAsync->pDoneTail = NULL;
+    pFut->pNext    = NULL;
+    pFut->flListed = 0;
+  }
+  pthread_mutex_unlock (&pAsync->mtx);
+
+  return pFut;
+}
+
+
+
+/************************************************************************
+ * fnAsync_pending -- Requests queued or running.
+ ***********************************************************************/
+int fnAsync_pending (ASYNC_KEYGEN *pAsync)
+{
+  int  nPending;
+
+
+  pthread_mutex_lock (&pAsync->mtx);
+  nPending = pAsync->nPending;
+  pthread_mutex_unlock (&pAsync->mtx);
+
+  return nPending;
+}
+
+
+
+/************************************************************************
+ * fnFuture_poll -- 1 if the key is done, 0 if not.  Never blocks.
+ ***********************************************************************/
+int fnFuture_poll (KEY_FUTURE *pFut)
+{
+  return __atomic_load_n (&pFut->flDone, __ATOMIC_ACQUIRE);
+}
+
+
+
+/************************************************************************
+ * fnFuture_wait -- Block until the key is done.
+ ***********************************************************************/
+void fnFuture_wait (KEY_FUTURE *pFut)
+{
+  ASYNC_KEYGEN  *pAsync = pFut->pAsync;
+
+
+  pthread_mutex_lock (&pAsync->mtx);
+  while (!pFut->flDone)
+    pthread_cond_wait (&pAsync->cvDone, &pAsync->mtx);
+  pthread_mutex_unlock (&pAsync->mtx);
+}
+
+
+
+/************************************************************************
+ * fnFuture_arg -- The pArg the future was queued with.
+ ***********************************************************************/
+void *fnFuture_arg (const KEY_FUTURE *pFut)
+{
+  return pFut->pArg;
+}
+
+
+
+/************************************************************************
+ * fnFuture_cancel -- Ask the worker to give up on the key.  Returns at
+ *                    once; the future still completes, wait for it or
+ *                    free it as usual.
+ ***********************************************************************/
+void fnFuture_cancel (KEY_FUTURE *pFut)
+{
+  fnCancel_request (&pFut->tok);
+}
+
+
+
+/************************************************************************
+ * fnFuture_status -- KEYGEN_OK when the future holds a key, else why
+ *                    not.  Waits for the key if need be.
+ ***********************************************************************/
+int fnFuture_status (KEY_FUTURE *pFut)
+{
+  fnFuture_wait (pFut);
+  return pFut->nStatus;
+}
+
+
+
+/************************************************************************
+ * fnFuture_get -- Copy out the key, waiting for it if need be.
+ *                 Returns fnFuture_status; nothing is copied unless
+ *                 it is KEYGEN_OK.
+ ***********************************************************************/
+int fnFuture_get (KEY_FUTURE *pFut, mpz_t mpzE, mpz_t mpzN, \
+    mpz_t mpzP1, mpz_t mpzP2, mpz_t mpzD)
+{
+  fnFuture_wait (pFut);
+  if (pFut->nStatus != KEYGEN_OK)
+    return pFut->nStatus;
+
+  mpz_set (mpzE, pFut->mpzE);
+  mpz_set (mpzN, pFut->mpzN);
+  mpz_set (mpzP1, pFut->mpzP1);
+  mpz_set (mpzP2, pFut->mpzP2);
+  mpz_set (mpzD, pFut->mpzD);
+
+  return KEYGEN_OK;
+}
+
+
+
+/************************************************************************
+ * fnFuture_free -- Wait for the key if need be and free the future,
+ *                  taking it off the done list if it is still there.
+ ***********************************************************************/
+void fnFuture_free (KEY_FUTURE *pFut)
+{
+  ASYNC_KEYGEN  *pAsync = pFut->pAsync;
+  KEY_FUTURE   **ppLink, *pPrev = NULL;
+
+
+  fnFuture_wait (pFut);
+
+  pthread_mutex_lock (&pAsync->mtx);
+  if (pFut->flListed) {
+    for (ppLink = &pAsync->pDoneHead; *ppLink != pFut; \
+         pPrev = *ppLink, ppLink = &(*ppLink)->pNext)
+      ;
+    *ppLink = pFut->pNext;
+    if (pAsync->pDoneTail == pFut)
+      pAsync->pDoneTail = pPrev;
+  }
+  pthread_mutex_unlock (&pAsync->mtx);
+
+  mpz_clears (pFut->mpzE, pFut->mpzN, pFut->mpzP1, pFut->mpzP2, \
+              pFut->mpzD, NULL);
+  free (pFut);
+}
+
+
+
+/************************************************************************
+ * fnAsync_job -- Pool task: the same steps as main for one future.
+ ***********************************************************************/
+static void fnAsync_job (void *pArg)
+{
+  KEY_FUTURE    *pFut   = (KEY_FUTURE *) pArg;
+  ASYNC_KEYGEN  *pAsync = pFut->pAsync;
+  KEY_CALLBACK   pfnDone = pFut->pfnDone;
+  mpz_t          mpzP1, mpzP2, mpzE, mpzD;
+  uint64_t       nOne = 1;
+  int            nStatus;
+
+
+  /* 1. The key, in this worker's arena scope */
+  fnArena_begin ();
+  fnBulk_seed_key (pAsync->nSeed, pFut->nSeq);
+  fnCancel_use (&pFut->tok);
+  mpz_inits (mpzP1, mpzP2, mpzE, mpzD, NULL);
+
+  fnMemprof_phase (MEM_PHASE_E);
+  fnMake_exponent_e (mpzE, &pFut->params.ePolicy);
+  if (pFut->params.nPrime == PRIME_SAFE)
+    nStatus = fnGenerate_safe_keypair (mpzP1, mpzP2, mpzD, mpzE, \
+                                       pFut->params.nBitLen);
+  else
+    nStatus = fnGenerate_keypair (mpzP1, mpzP2, mpzD, mpzE, \
+                                  pFut->params.nBitLen);
+
+  fnMemprof_phase (MEM_PHASE_OUTPUT);
+  if (nStatus == KEYGEN_OK) {
+    mpz_set (pFut->mpzE, mpzE);             /* preallocated, no arena */
+    mpz_mul (pFut->mpzN, mpzP1, mpzP2);
+    mpz_set (pFut->mpzP1, mpzP1);
+    mpz_set (pFut->mpzP2, mpzP2);
+    mpz_set (pFut->mpzD, mpzD);
+  }
+
+  mpz_clears (mpzP1, mpzP2, mpzE, mpzD, NULL);
+  fnArena_end ();
+  fnCancel_use (NULL);
+  fnMemprof_key_done ();
+
+  /* 2. Done: on the list, or to the callback.  Once the mutex is */
+  /*    released a listed future may be taken and freed          */
+  pthread_mutex_lock (&pAsync->mtx);
+  pAsync->nPending--;
+  pFut->nStatus = nStatus;
+  if (pfnDone == NULL) {
+    pFut->flListed = 1;
+    if (pAsync->pDoneTail != NULL)
+      pAsync->pDoneTail->pNext = pFut;
+    else
+      pAsync->pDoneHead = pFut;
+    pAsync->pDoneTail = pFut;
+  }
+  __atomic_store_n (&pFut->flDone, 1, __ATOMIC_RELEASE);
+  pthread_cond_broadcast (&pAsync->cvDone);
+  pthread_mutex_unlock (&pAsync->mtx);
+
+  if (pfnDone != NULL)
+    pfnDone (pFut, pFut->pArg);
+  else if (write (pAsync->fdEvent, &nOne, sizeof (nOne)) != sizeof (nOne))
+    return;                             /* counter full, loop is awake */
+}
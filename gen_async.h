@@ -0,0 +1,71 @@
+/**********************************************************************
+ * gen_async.h -- Asynchronous key generation for programs built
+ *                around an event loop.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- fnAsync_keypair queues a request on a fixed pool of
+ *           workers and returns a KEY_FUTURE at once; the caller
+ *           never blocks on a prime search.  Completion is reported
+ *           one of two ways:
+ *
+ *             - with a KEY_CALLBACK, which runs on the worker thread
+ *               as soon as the key is done and owns the future, or
+ *             - without one, the future goes on the done list and the
+ *               eventfd of fnAsync_fd becomes readable.  The loop
+ *               adds that fd to its poll set and takes finished
+ *               futures with fnAsync_next_done.
+ *
+ *           fnFuture_poll and fnFuture_wait work either way.  At most
+ *           nMaxPending requests are outstanding, beyond that
+ *           fnAsync_keypair fails with EAGAIN.
+ *
+ *           Request k of an ASYNC_KEYGEN uses the seed S + k * 2^{64},
+ *           as key k of a bulk run would.
+ *
+ *           fnFuture_cancel, or nTimeoutMs running out, stops the
+ *           prime search at its next check (gen_cancel.h); the future
+ *           is then done with fnFuture_status KEYGEN_CANCELLED or
+ *           KEYGEN_DEADLINE and holds no key.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_ASYNC_H
+#define GEN_ASYNC_H
+
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+
+
+     /******** #defines and typedefs  ********/
+#define ASYNC_MIN_BITS      (128)        /* smallest nlen accepted       */
+#define ASYNC_MAX_BITS      (16384)      /* largest nlen accepted        */
+
+typedef struct ASYNC_KEYGEN  ASYNC_KEYGEN;
+typedef struct KEY_FUTURE    KEY_FUTURE;
+
+typedef void  (*KEY_CALLBACK) (KEY_FUTURE *pFut, void *pArg);
+
+
+     /******** functions in gen_async.c ********/
+ASYNC_KEYGEN  *fnAsync_create (int nThreads, int nMaxPending, \
+               unsigned long nSeed);
+void           fnAsync_destroy (ASYNC_KEYGEN *pAsync);
+int            fnAsync_fd (const ASYNC_KEYGEN *pAsync);
+KEY_FUTURE    *fnAsync_keypair (ASYNC_KEYGEN *pAsync, \
+               const KEY_PARAMS *pParams, KEY_CALLBACK pfnDone, void *pArg);
+KEY_FUTURE    *fnAsync_next_done (ASYNC_KEYGEN *pAsync);
+int            fnAsync_pending (ASYNC_KEYGEN *pAsync);
+
+int            fnFuture_poll (KEY_FUTURE *pFut);
+void           fnFuture_wait (KEY_FUTURE *pFut);
+void          *fnFuture_arg (const KEY_FUTURE *pFut);
+void           fnFuture_cancel (KEY_FUTURE *pFut);
+int            fnFuture_status (KEY_FUTURE *pFut);
+int            fnFuture_get (KEY_FUTURE *pFut, mpz_t mpzE, mpz_t mpzN, \
+               mpz_t mpzP1, mpz_t mpzP2, mpz_t mpzD);
+void           fnFuture_free (KEY_FUTURE *pFut);
+
+#endif
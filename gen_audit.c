@@ -0,0 +1,373 @@
+/**********************************************************************
+ * gen_audit.c -- Audit mode: test every key of an archived bulk file
+ *                again, on a pool of workers.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- The file is mapped, not read, and cut into blocks of
+ *           AUDIT_BLOCK bytes.  One draining task per worker takes
+ *           the next block from a shared counter, as in gen_batch.c,
+ *           and checks the lines that start inside it; a line that
+ *           runs past the end of a block belongs to the block it
+ *           started in.  The pages are only read, so the workers
+ *           share them without a lock.
+ *
+ *           A key costs two primality tests of nlen / 2 bits, about
+ *           a millisecond at 2048 bits; the parsing and the other
+ *           checks are a few percent of that.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+#include "gen_pool.h"
+#include "gen_cancel.h"
+#include "gen_audit.h"
+
+
+     /******** #defines and typedefs  ********/
+enum {                                /* the checks, cheapest first   */
+  AUDIT_FIELDS, AUDIT_SIZE, AUDIT_N, AUDIT_E, AUDIT_DIFF, AUDIT_GCD,
+  AUDIT_D_INV, AUDIT_D_SIZE, AUDIT_P_PRIME, AUDIT_Q_PRIME, AUDIT_CHECKS
+};
+
+typedef struct {
+  const char       *pchMap;           /* the mapped file              */
+  size_t            nLen;
+  long              nBlocks;
+  long              nNext;            /* next block, shared           */
+  int               nReps;
+  unsigned long     nEMin;            /* least e allowed              */
+  char              achERange[64];    /* that range, for the report   */
+  FILE             *fpOut;            /* report, under mutex          */
+  pthread_mutex_t   mutex;
+  long              nKeys;            /* totals, under mutex          */
+  long              nFailed;
+  long              anFail[AUDIT_CHECKS];
+} AUDIT_RUN;
+
+typedef struct {                      /* one worker's numbers         */
+  mpz_t   mpzE, mpzN, mpzP, mpzQ, mpzD;
+  mpz_t   mpzP1, mpzQ1, mpzT, mpzL;
+  char   *pchLine;                    /* copy of the current line     */
+  size_t  nLineMax;
+} AUDIT_KEY;
+
+
+     /******** globals in this file   ********/
+static const char  *apszCheck[AUDIT_CHECKS] = {
+  "fields", "size", "n", "e", "diff", "gcd", "d_inv", "d_size",
+  "p_prime", "q_prime"
+};
+
+
+     /******** functions in this file ********/
+static void  fnAudit_drain (void *pArg);
+static int   fnAudit_line (AUDIT_RUN *pRun, AUDIT_KEY *pKey, \
+             const char *pchLine, size_t nLen, long *pnIndex);
+static void  fnAudit_fail (AUDIT_RUN *pRun, long nIndex, size_t nOffset, \
+             int nMask);
+
+
+
+/************************************************************************
+ * fnAudit_run -- Check every key of pOpts->pszFile and write the
+ *                report.  Returns 0 if every key passed, 1 if one
+ *                failed or the file could not be read.
+ ***********************************************************************/
+int fnAudit_run (const AUDIT_OPTS *pOpts)
+{
+  AUDIT_RUN    run;
+  POOL        *pPool;
+  struct stat  st;
+  long long    nStart;
+  double       dSecs;
+  int          fd, i, nThreads;
+
+
+  memset (&run, 0, sizeof (run));
+  run.nReps = pOpts->nReps > 0 ? pOpts->nReps : AUDIT_REPS_DEFAULT;
+  run.nEMin = pOpts->nEMin > 0 ? pOpts->nEMin : AUDIT_E_MIN_FIPS;
+  if (run.nEMin == AUDIT_E_MIN_FIPS)
+    sprintf (run.achERange, "FIPS 186-4 B.3.1: odd, 2^16 < e < 2^256");
+  else
+    sprintf (run.achERange, "odd, %lu <= e < 2^256", run.nEMin);
+  pthread_mutex_init (&run.mutex, NULL);
+
+  /* 1. Map the key file; an empty file has no keys */
+  fd = open (pOpts->pszFile, O_RDONLY);
+  if (fd < 0 || fstat (fd, &st) != 0) {
+    perror (pOpts->pszFile);
+    if (fd >= 0)
+      close (fd);
+    return 1;
+  }
+  run.nLen = (size_t) st.st_size;
+  if (run.nLen > 0) {
+    run.pchMap = (const char *) mmap (NULL, run.nLen, PROT_READ, \
+                                      MAP_PRIVATE, fd, 0);
+    if (run.pchMap == MAP_FAILED) {
+      perror ("mmap");
+      close (fd);
+      return 1;
+    }
+    madvise ((void *) run.pchMap, run.nLen, MADV_SEQUENTIAL);
+  }
+  close (fd);
+  run.nBlocks = (long) ((run.nLen + AUDIT_BLOCK - 1) / AUDIT_BLOCK);
+
+  run.fpOut = stdout;
+  if (pOpts->pszOut != NULL && (run.fpOut = fopen (pOpts->pszOut, "w")) \
+      == NULL) {
+    perror (pOpts->pszOut);
+    if (run.nLen > 0)
+      munmap ((void *) run.pchMap, run.nLen);
+    return 1;
+  }
+
+  /* 2. One draining task per worker */
+  nThreads = pOpts->nThreads > 0 ? pOpts->nThreads : 1;
+  nStart = fnCancel_now_ns ();
+  pPool = fnPool_create (nThreads, fnWorker_init, fnWorker_exit);
+  for (i = 0; i < nThreads; i++)
+    fnPool_submit (pPool, fnAudit_drain, &run);
+  fnPool_destroy (pPool);
+  dSecs = (fnCancel_now_ns () - nStart) / 1e9;
+
+  /* 3. The summary line */
+  fprintf (run.fpOut, "{\"keys\":%ld,\"passed\":%ld,\"failed\":%ld," \
+           "\"bad_lines\":%ld,\"threads\":%d,\"reps\":%d,\"e_range\":\"%s\"," \
+           "\"seconds\":%.3f,\"keys_per_second\":%.1f,\"fail_counts\":{", \
+           run.nKeys, run.nKeys - run.nFailed, run.nFailed, \
+           run.anFail[AUDIT_FIELDS], nThreads, run.nReps, run.achERange, \
+           dSecs, dSecs > 0 ? run.nKeys / dSecs : 0.0);
+  for (i = 0; i < AUDIT_CHECKS; i++)
+    fprintf (run.fpOut, "%s\"%s\":%ld", i == 0 ? "" : ",", apszCheck[i], \
+             run.anFail[i]);
+  fprintf (run.fpOut, "}}\n");
+
+  if (run.fpOut != stdout)
+    fclose (run.fpOut);
+  else
+    fflush (stdout);
+  if (run.nLen > 0)
+    munmap ((void *) run.pchMap, run.nLen);
+  pthread_mutex_destroy (&run.mutex);
+
+  return run.nFailed == 0 ? 0 : 1;
+}
+
+
+
+/************************************************************************
+ * fnAudit_drain -- Pool task: blocks of the file until none are left.
+ ***********************************************************************/
+static void fnAudit_drain (void *pArg)
+{
+  AUDIT_RUN   *pRun = (AUDIT_RUN *) pArg;
+  AUDIT_KEY    key;
+  const char  *pchEol;
+  size_t       nPos, nEnd, nEol;
+  long         nBlock, nIndex, nKeys = 0, nFailed = 0;
+  long         anFail[AUDIT_CHECKS];
+  int          i, nMask;
+
+
+  memset (anFail, 0, sizeof (anFail));
+  mpz_inits (key.mpzE, key.mpzN, key.mpzP, key.mpzQ, key.mpzD, \
+             key.mpzP1, key.mpzQ1, key.mpzT, key.mpzL, NULL);
+  key.nLineMax = 4096;
+  key.pchLine  = (char *) malloc (key.nLineMax);
+
+  while ((nBlock = __atomic_fetch_add (&pRun->nNext, 1, __ATOMIC_RELAXED))
+         < pRun->nBlocks) {
+
+    /* 1. The first line that starts in this block */
+    nPos = (size_t) nBlock * AUDIT_BLOCK;
+    nEnd = nPos + AUDIT_BLOCK < pRun->nLen ? nPos + AUDIT_BLOCK : pRun->nLen;
+    if (nPos > 0 && pRun->pchMap[nPos - 1] != '\n') {
+      pchEol = memchr (pRun->pchMap + nPos, '\n', pRun->nLen - nPos);
+      nPos = pchEol == NULL ? pRun->nLen : \
+             (size_t) (pchEol - pRun->pchMap) + 1;
+    }
+
+    /* 2. Every line starting before the end, to its newline */
+    while (nPos < nEnd) {
+      pchEol = memchr (pRun->pchMap + nPos, '\n', pRun->nLen - nPos);
+      nEol = pchEol == NULL ? pRun->nLen : (size_t) (pchEol - pRun->pchMap);
+      if (nEol > nPos) {
+        nMask = fnAudit_line (pRun, &key, pRun->pchMap + nPos, nEol - nPos, \
+                              &nIndex);
+        if (nMask >= 0) {
+          nKeys++;
+          if (nMask != 0) {
+            nFailed++;
+            for (i = 0; i < AUDIT_CHECKS; i++)
+              if (nMask & (1 << i))
+                anFail[i]++;
+            fnAudit_fail (pRun, nIndex, nPos, nMask);
+          }
+        }
+      }
+      nPos = nEol + 1;
+    }
+  }
+
+  /* 3. This worker's counts into the totals */
+  pthread_mutex_lock (&pRun->mutex);
+  pRun->nKeys   += nKeys;
+  pRun->nFailed += nFailed;
+  for (i = 0; i < AUDIT_CHECKS; i++)
+    pRun->anFail[i] += anFail[i];
+  pthread_mutex_unlock (&pRun->mutex);
+
+  free (key.pchLine);
+  mpz_clears (key.mpzE, key.mpzN, key.mpzP, key.mpzQ, key.mpzD, \
+              key.mpzP1, key.mpzQ1, key.mpzT, key.mpzL, NULL);
+}
+
+
+
+/************************************************************************
+ * fnAudit_line -- Check the key on one line.  Returns the mask of the
+ *                 checks it failed, 0 if it passed, or -1 for a line
+ *                 with nothing on it.
+ *
+ * Remark - *pnIndex is the key index, or -1 if it did not parse.
+ ***********************************************************************/
+static int fnAudit_line (AUDIT_RUN *pRun, AUDIT_KEY *pKey, \
+    const char *pchLine, size_t nLen, long *pnIndex)
+{
+  char          *apszField[7], *pszSave, *pch;
+  unsigned long  nHalf;
+  long           nBits;
+  int            i, nMask = 0;
+
+
+  *pnIndex = -1;
+
+  /* 1. A copy of the line with a terminator, split on blanks */
+  if (nLen + 1 > pKey->nLineMax) {
+    pKey->nLineMax = 2 * (nLen + 1);
+    pKey->pchLine  = (char *) realloc (pKey->pchLine, pKey->nLineMax);
+  }
+  memcpy (pKey->pchLine, pchLine, nLen);
+  pKey->pchLine[nLen] = '\0';
+
+  pch = strtok_r (pKey->pchLine, " \t\r", &pszSave);
+  if (pch == NULL)
+    return -1;
+  for (i = 0; i < 7 && pch != NULL; i++) {
+    apszField[i] = pch;
+    pch = strtok_r (NULL, " \t\r", &pszSave);
+  }
+  if (i < 7 || pch != NULL)
+    return 1 << AUDIT_FIELDS;
+
+  /* 2. index and bits in decimal, the numbers in hexadecimal */
+  *pnIndex = strtol (apszField[0], &pch, 10);
+  if (*pch != '\0')
+    *pnIndex = -1;
+  nBits = strtol (apszField[1], &pch, 10);
+  if (*pnIndex < 0 || *pch != '\0' || nBits <= 0 || nBits % 2 != 0 || \
+      mpz_set_str (pKey->mpzE, apszField[2], 16) != 0 || \
+      mpz_set_str (pKey->mpzN, apszField[3], 16) != 0 || \
+      mpz_set_str (pKey->mpzP, apszField[4], 16) != 0 || \
+      mpz_set_str (pKey->mpzQ, apszField[5], 16) != 0 || \
+      mpz_set_str (pKey->mpzD, apszField[6], 16) != 0)
+    return 1 << AUDIT_FIELDS;
+  nHalf = (unsigned long) nBits / 2;
+
+  /* 3. Sizes, n = p q and the range of e */
+  if (mpz_sizeinbase (pKey->mpzN, 2) != (size_t) nBits || \
+      mpz_sizeinbase (pKey->mpzP, 2) != nHalf || \
+      mpz_sizeinbase (pKey->mpzQ, 2) != nHalf)
+    nMask |= 1 << AUDIT_SIZE;
+
+  mpz_mul (pKey->mpzT, pKey->mpzP, pKey->mpzQ);
+  if (mpz_cmp (pKey->mpzT, pKey->mpzN) != 0)
+    nMask |= 1 << AUDIT_N;
+
+  if (mpz_even_p (pKey->mpzE) || mpz_cmp_ui (pKey->mpzE, pRun->nEMin) < 0 || \
+      mpz_sizeinbase (pKey->mpzE, 2) > 256)
+    nMask |= 1 << AUDIT_E;
+
+  /* 4. |p - q| > 2^{nlen / 2 - 100}, as fnCreate_pseudo_prime asks */
+  mpz_sub (pKey->mpzT, pKey->mpzP, pKey->mpzQ);
+  mpz_abs (pKey->mpzT, pKey->mpzT);
+  mpz_set_ui (pKey->mpzL, 0);
+  mpz_setbit (pKey->mpzL, nHalf <= 100 ? 0 : nHalf - 100);
+  if (mpz_cmp (pKey->mpzT, pKey->mpzL) <= 0)
+    nMask |= 1 << AUDIT_DIFF;
+
+  /* 5. gcd (e, p - 1) = gcd (e, q - 1) = 1 */
+  mpz_sub_ui (pKey->mpzP1, pKey->mpzP, 1);
+  mpz_sub_ui (pKey->mpzQ1, pKey->mpzQ, 1);
+  mpz_gcd (pKey->mpzT, pKey->mpzE, pKey->mpzP1);
+  if (mpz_cmp_ui (pKey->mpzT, 1) != 0)
+    nMask |= 1 << AUDIT_GCD;
+  mpz_gcd (pKey->mpzT, pKey->mpzE, pKey->mpzQ1);
+  if (mpz_cmp_ui (pKey->mpzT, 1) != 0)
+    nMask |= 1 << AUDIT_GCD;
+
+  /* 6. e d = 1 mod lambda, and d above 2^{nlen / 2} */
+  mpz_lcm (pKey->mpzL, pKey->mpzP1, pKey->mpzQ1);
+  mpz_mul (pKey->mpzT, pKey->mpzE, pKey->mpzD);
+  if (mpz_sgn (pKey->mpzL) == 0)
+    nMask |= 1 << AUDIT_D_INV;
+  else {
+    mpz_mod (pKey->mpzT, pKey->mpzT, pKey->mpzL);
+    if (mpz_cmp_ui (pKey->mpzT, 1) != 0)
+      nMask |= 1 << AUDIT_D_INV;
+  }
+  if (mpz_sizeinbase (pKey->mpzD, 2) <= nHalf)
+    nMask |= 1 << AUDIT_D_SIZE;
+
+  /* 7. The primality tests last, only for a key that got this far */
+  if (nMask == 0) {
+    if (mpz_probab_prime_p (pKey->mpzP, pRun->nReps) == 0)
+      nMask |= 1 << AUDIT_P_PRIME;
+    if (mpz_probab_prime_p (pKey->mpzQ, pRun->nReps) == 0)
+      nMask |= 1 << AUDIT_Q_PRIME;
+  }
+
+  return nMask;
+}
+
+
+
+/************************************************************************
+ * fnAudit_fail -- One report line for a key that failed.
+ ***********************************************************************/
+static void fnAudit_fail (AUDIT_RUN *pRun, long nIndex, size_t nOffset, \
+    int nMask)
+{
+  int  i, nCount = 0;
+
+
+  pthread_mutex_lock (&pRun->mutex);
+  if (nIndex >= 0)
+    fprintf (pRun->fpOut, "{\"index\":%ld,", nIndex);
+  else
+    fprintf (pRun->fpOut, "{\"index\":null,");
+  fprintf (pRun->fpOut, "\"offset\":%zu,\"fail\":[", nOffset);
+  for (i = 0; i < AUDIT_CHECKS; i++)
+    if (nMask & (1 << i))
+      fprintf (pRun->fpOut, "%s\"%s\"", nCount++ == 0 ? "" : ",", \
+               apszCheck[i]);
+  fprintf (pRun->fpOut, "]");
+  if (nMask & (1 << AUDIT_E))
+    fprintf (pRun->fpOut, ",\"e_range\":\"%s\"", pRun->achERange);
+  fprintf (pRun->fpOut, "}\n");
+  pthread_mutex_unlock (&pRun->mutex);
+}
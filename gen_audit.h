@@ -0,0 +1,54 @@
+/**********************************************************************
+ * gen_audit.h -- Audit mode: test every key of an archived bulk file
+ *                again, on a pool of workers.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- The file holds the lines of bulk mode, 'index bits e n p
+ *           q d' with the numbers in hexadecimal.  Each key is checked
+ *           for
+ *
+ *             fields    seven fields that parse
+ *             size      n of nlen bits, p and q of nlen / 2
+ *             n         n = p q
+ *             e         odd, nEMin <= e < 2^{256}; nEMin is 65537
+ *                       (FIPS 186-4 B.3.1, e > 2^{16}) unless the run
+ *                       allows a smaller e, as -e 3 keys need
+ *             diff      |p - q| > 2^{nlen / 2 - 100}
+ *             gcd       gcd (e, p - 1) = gcd (e, q - 1) = 1
+ *             d_inv     e d = 1 mod lcm (p - 1, q - 1)
+ *             d_size    d > 2^{nlen / 2}, the bound of
+ *                       fnCompute_exponent_d
+ *             p_prime   p a probable prime
+ *             q_prime   q a probable prime
+ *
+ *           cheapest first; the primality tests run only on a key
+ *           that passed the others.  The report is JSON, one line per
+ *           key that failed and a summary line at the end.  A key
+ *           that fails e names the range it was held to.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_AUDIT_H
+#define GEN_AUDIT_H
+
+
+     /******** #defines and typedefs  ********/
+#define AUDIT_REPS_DEFAULT  (24)        /* BPSW alone in GMP 6.2        */
+#define AUDIT_BLOCK         (1 << 20)   /* bytes of file per task step  */
+#define AUDIT_E_MIN_FIPS    (65537UL)   /* least e of FIPS 186-4 B.3.1  */
+
+typedef struct {
+  const char     *pszFile;            /* the key file                 */
+  int             nThreads;           /* audit threads                */
+  int             nReps;              /* mpz_probab_prime_p reps      */
+  unsigned long   nEMin;              /* least e, 0 is the FIPS one   */
+  const char     *pszOut;             /* report file, NULL is stdout  */
+} AUDIT_OPTS;
+
+
+     /******** functions in gen_audit.c ********/
+int  fnAudit_run (const AUDIT_OPTS *pOpts);
+
+#endif
@@ -0,0 +1,290 @@
+/**********************************************************************
+ * gen_batch.c -- Many keys in one call, for programs that link the
+ *                generator as a library.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- The call runs in four steps: check the requests and size
+ *           the results, make one PRIME_TABLE per prime length and
+ *           type, order the keys dearest first, and let one draining
+ *           task per worker take keys from the front of that order,
+ *           as the job file mode does (gen_jobs.c).
+ *
+ *           The order only needs to be about right.  A key costs
+ *           about nlen^3 for the exponentiations times the nlen
+ *           candidates per prime, and a safe prime needs about nlen
+ *           times as many candidates again.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+#include "gen_arena.h"
+#include "gen_memprof.h"
+#include "gen_bulk.h"
+#include "gen_pool.h"
+#include "gen_cancel.h"
+#include "gen_primes.h"
+#include "gen_pct.h"
+#include "gen_dedup.h"
+#include "gen_batch.h"
+
+
+     /******** #defines and typedefs  ********/
+typedef struct {
+  int              nHalfBits;         /* prime length                 */
+  int              nPrime;            /* PRIME_TYPE                   */
+  PRIME_TABLE     *pTab;
+} BATCH_SIZE;
+
+typedef struct {
+  const KEY_PARAMS  *aReqs;
+  KEY_PAIR          *aKeys;
+  unsigned long      nSeed;
+  BATCH_SIZE        *aSizes;
+  int                nSizes;
+  int               *pnSize;          /* request -> aSizes index      */
+  int               *pnOrder;         /* requests, dearest first      */
+  double            *pdCost;          /* for fnBatch_by_cost          */
+  int                nTodo;           /* entries in pnOrder           */
+  int                nNext;           /* next position, shared        */
+  CANCEL_TOKEN      *pTokens;         /* one per request              */
+} BATCH_RUN;
+
+
+     /******** globals in this file   ********/
+static const double  *pdSortCost;           /* for fnBatch_by_cost  */
+
+
+     /******** functions in this file ********/
+static int   fnBatch_size (BATCH_RUN *pRun, const KEY_PARAMS *pReq);
+static int   fnBatch_by_cost (const void *pA, const void *pB);
+static void  fnBatch_drain (void *pArg);
+static int   fnBatch_key (const BATCH_RUN *pRun, int nIndex);
+
+
+
+/************************************************************************
+ * fnBatch_generate -- Make the key of every aReqs[i] into aKeys[i]
+ *                     on nThreads workers, seed nSeed.  Returns the
+ *                     number of keys whose nStatus is not KEYGEN_OK.
+ *
+ * Remark - aKeys is initialised here, free it with fnBatch_clear
+ *          whatever came back.
+ ***********************************************************************/
+int fnBatch_generate (const KEY_PARAMS *aReqs, KEY_PAIR *aKeys, \
+    int nCount, int nThreads, unsigned long nSeed)
+{
+  BATCH_RUN    run;
+  POOL        *pPool;
+  KEY_PAIR    *pKey;
+  double       dBits;
+  int          i, nBits, nFailed = 0;
+
+
+  memset (&run, 0, sizeof (run));
+  run.aReqs   = aReqs;
+  run.aKeys   = aKeys;
+  run.nSeed   = nSeed;
+  run.aSizes  = (BATCH_SIZE *) calloc (nCount + 1, sizeof (BATCH_SIZE));
+  run.pnSize  = (int *) malloc ((nCount + 1) * sizeof (int));
+  run.pnOrder = (int *) malloc ((nCount + 1) * sizeof (int));
+  run.pdCost  = (double *) malloc ((nCount + 1) * sizeof (double));
+  run.pTokens = (CANCEL_TOKEN *) malloc ((nCount + 1) * sizeof (CANCEL_TOKEN));
+
+  /* 1. Results sized for their keys, so no worker reallocates them */
+  /*    in its arena scope; bad requests are settled here           */
+  for (i = 0; i < nCount; i++) {
+    pKey  = &aKeys[i];
+    nBits = aReqs[i].nBitLen;
+    if (nBits < BATCH_MIN_BITS || nBits > BATCH_MAX_BITS || nBits % 2 != 0)
+      nBits = 0;
+    mpz_init2 (pKey->mpzE, 256 + GMP_NUMB_BITS);
+    mpz_init2 (pKey->mpzN, nBits + GMP_NUMB_BITS);
+    mpz_init2 (pKey->mpzP1, nBits / 2 + GMP_NUMB_BITS);
+    mpz_init2 (pKey->mpzP2, nBits / 2 + GMP_NUMB_BITS);
+    mpz_init2 (pKey->mpzD, nBits + GMP_NUMB_BITS);
+    fnCancel_init (&run.pTokens[i], aReqs[i].nTimeoutMs);
+    if (nBits == 0) {
+      pKey->nStatus = -1;
+      nFailed++;
+      continue;
+    }
+
+    /* 2. The shared table of its size, the first time it is seen */
+    run.pnSize[i] = fnBatch_size (&run, &aReqs[i]);
+    dBits = nBits;
+    run.pdCost[i] = dBits * dBits * dBits * dBits * \
+                    (aReqs[i].nPrime == PRIME_SAFE ? dBits : 1.0);
+    run.pnOrder[run.nTodo++] = i;
+  }
+
+  /* 3. Dearest first, then request order */
+  pdSortCost = run.pdCost;
+  qsort (run.pnOrder, run.nTodo, sizeof (int), fnBatch_by_cost);
+
+  /* 4. One draining task per worker */
+  if (nThreads <= 0)
+    nThreads = 1;
+  pPool = fnPool_create (nThreads, fnWorker_init, fnWorker_exit);
+  for (i = 0; i < nThreads; i++)
+    fnPool_submit (pPool, fnBatch_drain, &run);
+  fnPool_destroy (pPool);
+
+  for (i = 0; i < run.nTodo; i++)
+    if (aKeys[run.pnOrder[i]].nStatus != KEYGEN_OK)
+      nFailed++;
+
+  for (i = 0; i < run.nSizes; i++)
+    fnPrimes_table_free (run.aSizes[i].pTab);
+  free (run.aSizes);
+  free (run.pnSize);
+  free (run.pnOrder);
+  free (run.pdCost);
+  free (run.pTokens);
+
+  return nFailed;
+}
+
+
+
+/************************************************************************
+ * fnBatch_clear -- Free what fnBatch_generate put in aKeys.
+ ***********************************************************************/
+void fnBatch_clear (KEY_PAIR *aKeys, int nCount)
+{
+  int  i;
+
+
+  for (i = 0; i < nCount; i++)
+    mpz_clears (aKeys[i].mpzE, aKeys[i].mpzN, aKeys[i].mpzP1, \
+                aKeys[i].mpzP2, aKeys[i].mpzD, NULL);
+}
+
+
+
+/************************************************************************
+ * fnBatch_size -- Index in pRun->aSizes of the table for pReq, made
+ *                 if this is the first request of its kind.
+ ***********************************************************************/
+static int fnBatch_size (BATCH_RUN *pRun, const KEY_PARAMS *pReq)
+{
+  BATCH_SIZE  *pSize;
+  int          i, nHalfBits = pReq->nBitLen / 2;
+
+
+  for (i = 0; i < pRun->nSizes; i++)
+    if (pRun->aSizes[i].nHalfBits == nHalfBits && \
+        pRun->aSizes[i].nPrime == pReq->nPrime)
+      return i;
+
+  pSize = &pRun->aSizes[pRun->nSizes];
+  pSize->nHalfBits = nHalfBits;
+  pSize->nPrime    = pReq->nPrime;
+  pSize->pTab      = fnPrimes_table (nHalfBits, pReq->nPrime);
+
+  return pRun->nSizes++;
+}
+
+
+
+/************************************************************************
+ * fnBatch_by_cost -- qsort order of request indices, dearest first,
+ *                    then request order.
+ ***********************************************************************/
+static int fnBatch_by_cost (const void *pA, const void *pB)
+{
+  int  nA = *(const int *) pA;
+  int  nB = *(const int *) pB;
+
+
+  if (pdSortCost[nA] != pdSortCost[nB])
+    return pdSortCost[nA] > pdSortCost[nB] ? -1 : 1;
+  return nA - nB;
+}
+
+
+
+/************************************************************************
+ * fnBatch_drain -- Pool task: keys from the front of the order until
+ *                  none are left.
+ ***********************************************************************/
+static void fnBatch_drain (void *pArg)
+{
+  BATCH_RUN  *pRun = (BATCH_RUN *) pArg;
+  int         nPos, nIndex;
+
+
+  while ((nPos = __atomic_fetch_add (&pRun->nNext, 1, __ATOMIC_RELAXED))
+         < pRun->nTodo) {
+    nIndex = pRun->pnOrder[nPos];
+    pRun->aKeys[nIndex].nStatus = fnBatch_key (pRun, nIndex);
+  }
+}
+
+
+
+/************************************************************************
+ * fnBatch_key -- The same steps as main for request nIndex, with the
+ *                primes from the shared table.  Returns KEYGEN_STATUS.
+ ***********************************************************************/
+static int fnBatch_key (const BATCH_RUN *pRun, int nIndex)
+{
+  const KEY_PARAMS  *pReq  = &pRun->aReqs[nIndex];
+  const PRIME_TABLE *pTab  = pRun->aSizes[pRun->pnSize[nIndex]].pTab;
+  KEY_PAIR          *pKey  = &pRun->aKeys[nIndex];
+  mpz_t              mpzP1, mpzP2, mpzE, mpzD;
+  int                nStatus, nTry;
+
+
+  fnArena_begin ();
+  fnBulk_seed_key (pRun->nSeed, nIndex);
+  fnCancel_use (&pRun->pTokens[nIndex]);
+  mpz_inits (mpzP1, mpzP2, mpzE, mpzD, NULL);
+
+  /* 1. e, then p, then q far enough from p */
+  fnMemprof_phase (MEM_PHASE_E);
+  fnMake_exponent_e (mpzE, &pReq->ePolicy);
+
+  fnMemprof_phase (MEM_PHASE_P);
+  nStatus = fnPrimes_find (pTab, mpzP1, mpzE, NULL, NUMTESTS);
+  for (nTry = 1; nStatus == KEYGEN_OK && fnDedup_add (mpzP1); nTry++)
+    nStatus = nTry >= DEDUP_TRIES ? KEYGEN_EXHAUSTED : \
+              fnPrimes_find (pTab, mpzP1, mpzE, NULL, NUMTESTS);
+
+  fnMemprof_phase (MEM_PHASE_Q);
+  if (nStatus == KEYGEN_OK)
+    nStatus = fnPrimes_find (pTab, mpzP2, mpzE, mpzP1, NUMTESTS);
+  for (nTry = 1; nStatus == KEYGEN_OK && fnDedup_add (mpzP2); nTry++)
+    nStatus = nTry >= DEDUP_TRIES ? KEYGEN_EXHAUSTED : \
+              fnPrimes_find (pTab, mpzP2, mpzE, mpzP1, NUMTESTS);
+
+  /* 2. d, and the key into its preallocated place */
+  fnMemprof_phase (MEM_PHASE_D);
+  if (nStatus == KEYGEN_OK) {
+    fnCompute_exponent_d (mpzP1, mpzE, mpzP2, mpzD, pReq->nBitLen / 2);
+    if (fnPct_enabled ())
+      nStatus = fnPct_check (mpzE, mpzP1, mpzP2, mpzD);
+  }
+  if (nStatus == KEYGEN_OK) {
+
+    fnMemprof_phase (MEM_PHASE_OUTPUT);
+    mpz_set (pKey->mpzE, mpzE);
+    mpz_mul (pKey->mpzN, mpzP1, mpzP2);
+    mpz_set (pKey->mpzP1, mpzP1);
+    mpz_set (pKey->mpzP2, mpzP2);
+    mpz_set (pKey->mpzD, mpzD);
+  }
+
+  mpz_clears (mpzP1, mpzP2, mpzE, mpzD, NULL);
+  fnArena_end ();
+  fnCancel_use (NULL);
+  fnMemprof_key_done ();
+
+  return nStatus;
+}
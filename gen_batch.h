@@ -0,0 +1,46 @@
+/**********************************************************************
+ * gen_batch.h -- Many keys in one call, for programs that link the
+ *                generator as a library.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- fnBatch_generate fills aKeys[i] for every aReqs[i] and
+ *           returns when the last key is done.  Requests of the same
+ *           prime length and type share one PRIME_TABLE (gen_primes.h),
+ *           made once for the call, and every prime is found by
+ *           sieving a window of candidates with it before any
+ *           primality test.  The workers take the dearest keys first,
+ *           so none of them sits idle while one finishes a big key.
+ *
+ *           Key i uses the seed S + i * 2^{64}, whatever thread makes
+ *           it, so the batch depends only on S and the requests.  The
+ *           primes are not those of fnCreate_pseudo_prime for the
+ *           same seed, that search draws every candidate at random.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_BATCH_H
+#define GEN_BATCH_H
+
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+
+
+     /******** #defines and typedefs  ********/
+#define BATCH_MIN_BITS      (128)        /* smallest nlen accepted       */
+#define BATCH_MAX_BITS      (16384)      /* largest nlen accepted        */
+
+typedef struct {
+  int            nStatus;             /* KEYGEN_STATUS, -1 bad request */
+  mpz_t          mpzE, mpzN, mpzP1, mpzP2, mpzD;
+} KEY_PAIR;
+
+
+     /******** functions in gen_batch.c ********/
+int   fnBatch_generate (const KEY_PARAMS *aReqs, KEY_PAIR *aKeys, \
+      int nCount, int nThreads, unsigned long nSeed);
+void  fnBatch_clear (KEY_PAIR *aKeys, int nCount);
+
+#endif
@@ -0,0 +1,531 @@
+/**********************************************************************
+ * gen_batchgcd.c -- Batch GCD of a corpus of moduli, to find keys
+ *                   that share a prime.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- gen_batchgcd [-t THREADS] [--tmp=DIR] FILE...
+ *
+ *           Each line of a FILE is either a bulk line 'index bits e n
+ *           p q d' or a bare modulus, in hexadecimal.  Every pair of
+ *           moduli with a common factor is printed as
+ *
+ *               FILE:ID FILE:ID factor
+ *
+ *           with ID the key index of a bulk line or the line number,
+ *           from 0, of a bare modulus, and the factor in hexadecimal
+ *           (n itself for a modulus that appears twice).  The exit
+ *           status is 1 if there was such a pair.
+ *
+ *           Bernstein's batch GCD: a product tree of the moduli, then
+ *           a remainder tree down from the root, R = R_parent mod N^2
+ *           at every node, and at leaf n the gcd of (R mod n^2) / n
+ *           with n.  It is more than 1 exactly when n shares a factor
+ *           with another modulus.  Only those few moduli are then
+ *           compared pair by pair.
+ *
+ *           The nodes of one level are shared out among the workers
+ *           of a gen_pool.h pool; the few nodes near the root are one
+ *           large GMP product each and keep one worker busy apiece.
+ *           Every level lives in a mapping of its own, anonymous or,
+ *           with --tmp, an unlinked file in DIR, so a corpus larger
+ *           than RAM is paged out to DIR.  The tree is about log2 m
+ *           times the size of the moduli, a product level is dropped
+ *           as soon as the remainders below it are made.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <gmp.h>
+
+#include "gen_pool.h"
+
+
+     /******** #defines and typedefs  ********/
+#define GCD_MAX_LEVELS   (64)
+#define GCD_LINE_MAX     (16384)      /* longest line, bytes          */
+
+typedef enum {
+  GCD_PRODUCT,                        /* node = child 2j * child 2j+1 */
+  GCD_REMAINDER,                      /* node = parent mod node^2     */
+  GCD_LEAVES                          /* flag the moduli that share   */
+} GCD_OP;
+
+typedef struct {                      /* one level of a tree          */
+  long        nNodes;
+  long       *pnSize;                 /* limbs of each node           */
+  size_t     *pnOff;                  /* first limb of each node      */
+  mp_limb_t  *pLimbs;                 /* the mapping                  */
+  size_t      nMapLen;                /* bytes mapped                 */
+} GCD_LEVEL;
+
+typedef struct {                      /* one level's work for the pool */
+  GCD_OP      nOp;
+  GCD_LEVEL  *pDst;                   /* made here                    */
+  GCD_LEVEL  *pSrc;                   /* children or parents          */
+  GCD_LEVEL  *pProd;                  /* products of pDst's shape     */
+  char       *pflHit;                 /* GCD_LEAVES, shares a factor  */
+  long        nNodes;
+  long        nNext;                  /* next node, shared            */
+} GCD_STEP;
+
+
+     /******** globals in this file   ********/
+static const char  *pszTmpDir;              /* --tmp, NULL anonymous */
+
+
+     /******** functions in this file ********/
+static long   fnGcd_read (char **apszFiles, int nFiles, GCD_LEVEL *pLeaves, \
+              long **ppnId, int **ppnFile);
+static int    fnGcd_modulus (const char *pchLine, size_t nLen, \
+              const char **ppchHex, size_t *pnHex, long *pnId, long nLine);
+static int    fnGcd_map (GCD_LEVEL *pLevel, long nNodes);
+static void   fnGcd_unmap (GCD_LEVEL *pLevel);
+static mpz_srcptr fnGcd_node (mpz_t mpzView, const GCD_LEVEL *pLevel, \
+              long j);
+static void   fnGcd_store (GCD_LEVEL *pLevel, long j, mpz_t mpzX);
+static void   fnGcd_run_step (POOL *pPool, int nThreads, GCD_STEP *pStep);
+static void   fnGcd_drain (void *pArg);
+
+
+
+/*************** main -- entry point **********************/
+int main (int argc, char *argv[])
+{
+  GCD_LEVEL         aProd[GCD_MAX_LEVELS];
+  GCD_LEVEL         aRem[2];
+  GCD_LEVEL        *pRem, *pNext;
+  GCD_STEP          step;
+  POOL             *pPool;
+  struct timespec   tsStart, tsEnd;
+  mpz_t             mpzA, mpzB, mpzG;
+  mpz_srcptr        pA, pB;
+  long             *pnId, *pnHit, nModuli, nHits = 0, nPairs = 0;
+  long              i, j;
+  int              *pnFile, nThreads = 1, nLevels, k, nArg;
+  char             *pflHit;
+  double            dSecs;
+
+
+  /* 0. Options, then the files */
+  for (nArg = 1; nArg < argc && argv[nArg][0] == '-'; nArg++) {
+    if (strcmp (argv[nArg], "-t") == 0 && nArg + 1 < argc)
+      nThreads = (int) strtol (argv[++nArg], NULL, 10);
+    else if (strncmp (argv[nArg], "--tmp=", 6) == 0)
+      pszTmpDir = argv[nArg] + 6;
+    else
+      break;
+  }
+  if (nArg >= argc || nThreads <= 0) {
+    fprintf (stderr, "Usage: %s [-t THREADS] [--tmp=DIR] FILE...\n", \
+             argv[0]);
+    return 2;
+  }
+
+  clock_gettime (CLOCK_MONOTONIC, &tsStart);
+  memset (aProd, 0, sizeof (aProd));
+  memset (aRem, 0, sizeof (aRem));
+  nModuli = fnGcd_read (argv + nArg, argc - nArg, &aProd[0], &pnId, &pnFile);
+  if (nModuli < 0)
+    return 2;
+  pflHit = (char *) calloc (nModuli + 1, 1);
+  pPool  = fnPool_create (nThreads, NULL, NULL);
+
+  /* 1. The product tree, level by level up to the root */
+  for (nLevels = 1; aProd[nLevels - 1].nNodes > 1; nLevels++) {
+    memset (&step, 0, sizeof (step));
+    step.nOp    = GCD_PRODUCT;
+    step.pSrc   = &aProd[nLevels - 1];
+    step.pDst   = &aProd[nLevels];
+    step.nNodes = (step.pSrc->nNodes + 1) / 2;
+    step.pDst->pnOff = (size_t *) malloc ((step.nNodes + 1) * sizeof (size_t));
+    for (j = 0; j < step.nNodes; j++)
+      step.pDst->pnOff[j] = step.pSrc->pnSize[2 * j] + \
+          (2 * j + 1 < step.pSrc->nNodes ? step.pSrc->pnSize[2 * j + 1] : 0);
+    if (fnGcd_map (step.pDst, step.nNodes) != 0)
+      return 2;
+    fnGcd_run_step (pPool, nThreads, &step);
+  }
+
+  /* 2. The remainder tree down from the root, which is its own  */
+  /*    remainder; a level of products goes once it is used      */
+  pRem = &aProd[nLevels - 1];
+  for (k = nLevels - 2; k >= 0 && nModuli > 1; k--) {
+    memset (&step, 0, sizeof (step));
+    step.nOp    = k > 0 ? GCD_REMAINDER : GCD_LEAVES;
+    step.pSrc   = pRem;
+    step.pProd  = &aProd[k];
+    step.pflHit = pflHit;
+    step.nNodes = aProd[k].nNodes;
+    pNext = &aRem[k % 2];
+    if (k > 0) {
+      step.pDst = pNext;
+      pNext->pnOff = (size_t *) malloc ((step.nNodes + 1) * sizeof (size_t));
+      for (j = 0; j < step.nNodes; j++)
+        pNext->pnOff[j] = 2 * aProd[k].pnSize[j];
+      if (fnGcd_map (pNext, step.nNodes) != 0)
+        return 2;
+    }
+    fnGcd_run_step (pPool, nThreads, &step);
+    if (pRem != &aProd[k + 1])
+      fnGcd_unmap (pRem);
+    fnGcd_unmap (&aProd[k + 1]);
+    pRem = pNext;
+  }
+  fnPool_destroy (pPool);
+
+  /* 3. The moduli that share something, pair by pair */
+  pnHit = (long *) malloc ((nModuli + 1) * sizeof (long));
+  for (i = 0; i < nModuli; i++)
+    if (pflHit[i])
+      pnHit[nHits++] = i;
+  mpz_init (mpzG);
+  for (i = 0; i < nHits; i++) {
+    pA = fnGcd_node (mpzA, &aProd[0], pnHit[i]);
+    for (j = i + 1; j < nHits; j++) {
+      pB = fnGcd_node (mpzB, &aProd[0], pnHit[j]);
+      mpz_gcd (mpzG, pA, pB);
+      if (mpz_cmp_ui (mpzG, 1) == 0)
+        continue;
+      gmp_printf ("%s:%ld %s:%ld %Zx\n", argv[nArg + pnFile[pnHit[i]]], \
+                  pnId[pnHit[i]], argv[nArg + pnFile[pnHit[j]]], \
+                  pnId[pnHit[j]], mpzG);
+      nPairs++;
+    }
+  }
+  fflush (stdout);
+  clock_gettime (CLOCK_MONOTONIC, &tsEnd);
+  dSecs = (tsEnd.tv_sec - tsStart.tv_sec) + \
+          (tsEnd.tv_nsec - tsStart.tv_nsec) / 1e9;
+
+  /* 4. Report */
+  fprintf (stderr, "\n  --> %ld moduli, %d levels, %.3f s on %d threads <--\n", \
+           nModuli, nLevels, dSecs, nThreads);
+  fprintf (stderr, "      %ld moduli share a factor, %ld pairs\n", \
+           nHits, nPairs);
+
+  mpz_clear (mpzG);
+  fnGcd_unmap (&aProd[0]);
+  free (pnHit);
+  free (pflHit);
+  free (pnId);
+  free (pnFile);
+
+  return nPairs != 0;
+}
+
+
+
+/************************************************************************
+ * fnGcd_read -- The moduli of all the files into pLeaves, with the
+ *               file and ID of each.  Returns how many, or -1.
+ *
+ * Remark - Two passes over the mapped files: the first counts the
+ *          moduli and their limbs so the leaf level is mapped once at
+ *          its full size, the second fills it.
+ ***********************************************************************/
+static long fnGcd_read (char **apszFiles, int nFiles, GCD_LEVEL *pLeaves, \
+    long **ppnId, int **ppnFile)
+{
+  const char  **apchMap;
+  size_t       *anLen;
+  struct stat   st;
+  const char   *pchHex, *pchEol;
+  char          achHex[GCD_LINE_MAX + 1];
+  size_t        nPos, nEol, nHex;
+  long          nId, nLine, nCount, nBad = 0;
+  mpz_t         mpzN;
+  int           fd, f, nPass;
+
+
+  /* 1. Map every file */
+  apchMap = (const char **) calloc (nFiles, sizeof (char *));
+  anLen   = (size_t *) calloc (nFiles, sizeof (size_t));
+  for (f = 0; f < nFiles; f++) {
+    fd = open (apszFiles[f], O_RDONLY);
+    if (fd < 0 || fstat (fd, &st) != 0) {
+      perror (apszFiles[f]);
+      return -1;
+    }
+    anLen[f]   = (size_t) st.st_size;
+    apchMap[f] = NULL;
+    if (anLen[f] > 0) {
+      apchMap[f] = (const char *) mmap (NULL, anLen[f], PROT_READ, \
+                                        MAP_PRIVATE, fd, 0);
+      if (apchMap[f] == MAP_FAILED) {
+        perror ("mmap");
+        return -1;
+      }
+      madvise ((void *) apchMap[f], anLen[f], MADV_SEQUENTIAL);
+    }
+    close (fd);
+  }
+
+  /* 2. Pass 0 sizes the leaves, pass 1 fills them */
+  mpz_init (mpzN);
+  pLeaves->pnOff = (size_t *) malloc (4096 * sizeof (size_t));
+  for (nPass = 0; nPass < 2; nPass++) {
+    nCount = 0;
+    for (f = 0; f < nFiles; f++)
+      for (nPos = 0, nLine = 0; nPos < anLen[f]; nPos = nEol + 1, nLine++) {
+        pchEol = memchr (apchMap[f] + nPos, '\n', anLen[f] - nPos);
+        nEol = pchEol == NULL ? anLen[f] : (size_t) (pchEol - apchMap[f]);
+        if (!fnGcd_modulus (apchMap[f] + nPos, nEol - nPos, &pchHex, &nHex, \
+                            &nId, nLine))
+          continue;
+        memcpy (achHex, pchHex, nHex);
+        achHex[nHex] = '\0';
+        if (mpz_set_str (mpzN, achHex, 16) != 0 || mpz_cmp_ui (mpzN, 1) <= 0) {
+          if (nPass == 0) {
+            fprintf (stderr, "%s:%ld: not a modulus\n", apszFiles[f], nLine);
+            nBad++;
+          }
+          continue;
+        }
+        if (nPass == 0)
+          pLeaves->pnOff[nCount] = mpz_size (mpzN);
+        else {
+          fnGcd_store (pLeaves, nCount, mpzN);
+          (*ppnId)[nCount]   = nId;
+          (*ppnFile)[nCount] = f;
+        }
+        nCount++;
+        if (nPass == 0 && nCount % 4096 == 0)
+          pLeaves->pnOff = (size_t *) realloc (pLeaves->pnOff, \
+                           (nCount + 4096) * sizeof (size_t));
+      }
+    if (nPass == 0) {
+      if (fnGcd_map (pLeaves, nCount) != 0)
+        return -1;
+      *ppnId   = (long *) malloc ((nCount + 1) * sizeof (long));
+      *ppnFile = (int *) malloc ((nCount + 1) * sizeof (int));
+    }
+  }
+  mpz_clear (mpzN);
+
+  for (f = 0; f < nFiles; f++)
+    if (anLen[f] > 0)
+      munmap ((void *) apchMap[f], anLen[f]);
+  free (apchMap);
+  free (anLen);
+  if (nBad > 0)
+    fprintf (stderr, "   ### %ld lines skipped\n", nBad);
+
+  return nCount;
+}
+
+
+
+/************************************************************************
+ * fnGcd_modulus -- Find the modulus on a line: the fourth of the seven
+ *                  fields of a bulk line, or the only field.  Returns
+ *                  1 if there is one, with the ID of the line.
+ ***********************************************************************/
+static int fnGcd_modulus (const char *pchLine, size_t nLen, \
+    const char **ppchHex, size_t *pnHex, long *pnId, long nLine)
+{
+  const char  *apchField[8];
+  size_t       anField[8];
+  size_t       i = 0;
+  int          nFields = 0;
+
+
+  while (i < nLen && nFields < 8) {
+    while (i < nLen && (pchLine[i] == ' ' || pchLine[i] == '\t' || \
+                        pchLine[i] == '\r'))
+      i++;
+    if (i >= nLen)
+      break;
+    apchField[nFields] = pchLine + i;
+    while (i < nLen && pchLine[i] != ' ' && pchLine[i] != '\t' && \
+           pchLine[i] != '\r')
+      i++;
+    anField[nFields] = (size_t) (pchLine + i - apchField[nFields]);
+    nFields++;
+  }
+
+  if (nFields == 1) {
+    *ppchHex = apchField[0];
+    *pnHex   = anField[0];
+    *pnId    = nLine;
+  }
+  else if (nFields == 7) {
+    *ppchHex = apchField[3];
+    *pnHex   = anField[3];
+    *pnId    = strtol (apchField[0], NULL, 10);
+  }
+  else
+    return 0;
+
+  return *pnHex > 0 && *pnHex <= GCD_LINE_MAX;
+}
+
+
+
+/************************************************************************
+ * fnGcd_map -- Map a level of nNodes nodes.  On entry pnOff[j] holds
+ *              the most limbs node j can need, on return its first
+ *              limb.  Returns 0, or -1.
+ *
+ * Remark - With --tmp the level is an unlinked file in that
+ *          directory, so the kernel can write it out instead of
+ *          holding it in RAM.
+ ***********************************************************************/
+static int fnGcd_map (GCD_LEVEL *pLevel, long nNodes)
+{
+  char     achPath[4096];
+  size_t   nTotal = 0, nCap;
+  void    *pMap;
+  long     j;
+  int      fd = -1;
+
+
+  /* 1. Capacities into offsets */
+  for (j = 0; j < nNodes; j++) {
+    nCap = pLevel->pnOff[j];
+    pLevel->pnOff[j] = nTotal;
+    nTotal += nCap;
+  }
+  pLevel->nNodes  = nNodes;
+  pLevel->pnSize  = (long *) calloc (nNodes + 1, sizeof (long));
+  pLevel->nMapLen = (nTotal + 1) * sizeof (mp_limb_t);
+
+  /* 2. Anonymous, or the file */
+  if (pszTmpDir == NULL)
+    pMap = mmap (NULL, pLevel->nMapLen, PROT_READ | PROT_WRITE, \
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  else {
+    snprintf (achPath, sizeof (achPath), "%s/batchgcd.XXXXXX", pszTmpDir);
+    if ((fd = mkstemp (achPath)) < 0) {
+      perror (achPath);
+      return -1;
+    }
+    unlink (achPath);
+    if (ftruncate (fd, (off_t) pLevel->nMapLen) != 0) {
+      perror ("ftruncate");
+      close (fd);
+      return -1;
+    }
+    pMap = mmap (NULL, pLevel->nMapLen, PROT_READ | PROT_WRITE, \
+                 MAP_SHARED, fd, 0);
+    close (fd);
+  }
+  if (pMap == MAP_FAILED) {
+    perror ("mmap");
+    return -1;
+  }
+  pLevel->pLimbs = (mp_limb_t *) pMap;
+
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnGcd_unmap -- Let a level go.
+ ***********************************************************************/
+static void fnGcd_unmap (GCD_LEVEL *pLevel)
+{
+  if (pLevel->pLimbs != NULL)
+    munmap (pLevel->pLimbs, pLevel->nMapLen);
+  free (pLevel->pnSize);
+  free (pLevel->pnOff);
+  memset (pLevel, 0, sizeof (*pLevel));
+}
+
+
+
+/************************************************************************
+ * fnGcd_node -- Read only view of node j, where it lies.
+ ***********************************************************************/
+static mpz_srcptr fnGcd_node (mpz_t mpzView, const GCD_LEVEL *pLevel, long j)
+{
+  return mpz_roinit_n (mpzView, pLevel->pLimbs + pLevel->pnOff[j], \
+                       pLevel->pnSize[j]);
+}
+
+
+
+/************************************************************************
+ * fnGcd_store -- mpzX into node j, which was sized for it.
+ ***********************************************************************/
+static void fnGcd_store (GCD_LEVEL *pLevel, long j, mpz_t mpzX)
+{
+  pLevel->pnSize[j] = (long) mpz_size (mpzX);
+  memcpy (pLevel->pLimbs + pLevel->pnOff[j], mpz_limbs_read (mpzX), \
+          mpz_size (mpzX) * sizeof (mp_limb_t));
+}
+
+
+
+/************************************************************************
+ * fnGcd_run_step -- One level on the pool, one draining task per
+ *                   worker, and wait for it.
+ ***********************************************************************/
+static void fnGcd_run_step (POOL *pPool, int nThreads, GCD_STEP *pStep)
+{
+  int  i;
+
+
+  for (i = 0; i < nThreads; i++)
+    fnPool_submit (pPool, fnGcd_drain, pStep);
+  fnPool_wait (pPool);
+}
+
+
+
+/************************************************************************
+ * fnGcd_drain -- Pool task: nodes of the level until none are left.
+ ***********************************************************************/
+static void fnGcd_drain (void *pArg)
+{
+  GCD_STEP    *pStep = (GCD_STEP *) pArg;
+  mpz_t        mpzV1, mpzV2, mpzT, mpzSq;
+  mpz_srcptr   p1, p2;
+  long         j;
+
+
+  mpz_inits (mpzT, mpzSq, NULL);
+  while ((j = __atomic_fetch_add (&pStep->nNext, 1, __ATOMIC_RELAXED))
+         < pStep->nNodes) {
+    switch (pStep->nOp) {
+
+      /* 1. Product of the two children, or the lone last one */
+      case GCD_PRODUCT:
+        p1 = fnGcd_node (mpzV1, pStep->pSrc, 2 * j);
+        if (2 * j + 1 < pStep->pSrc->nNodes) {
+          p2 = fnGcd_node (mpzV2, pStep->pSrc, 2 * j + 1);
+          mpz_mul (mpzT, p1, p2);
+        }
+        else
+          mpz_set (mpzT, p1);
+        fnGcd_store (pStep->pDst, j, mpzT);
+        break;
+
+      /* 2. The parent's remainder mod the square of this node;  */
+      /*    at a leaf n, gcd ((R mod n^2) / n, n) > 1 if n shares */
+      default:
+        p1 = fnGcd_node (mpzV1, pStep->pSrc, j / 2);
+        p2 = fnGcd_node (mpzV2, pStep->pProd, j);
+        mpz_mul (mpzSq, p2, p2);
+        mpz_mod (mpzT, p1, mpzSq);
+        if (pStep->nOp == GCD_REMAINDER)
+          fnGcd_store (pStep->pDst, j, mpzT);
+        else {
+          mpz_divexact (mpzT, mpzT, p2);
+          mpz_gcd (mpzT, mpzT, p2);
+          pStep->pflHit[j] = mpz_cmp_ui (mpzT, 1) != 0;
+        }
+        break;
+    }
+  }
+  mpz_clears (mpzT, mpzSq, NULL);
+}
@@ -0,0 +1,528 @@
+/**********************************************************************
+ * gen_bulk.c -- Bulk generation of many keys on worker threads.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- Workers take the next key index from a shared counter,
+ *           reseed their own random state for that index and run
+ *           the same steps as main.  A key whose search fails is
+ *           drawn again (fnBulk_make_key).  A finished key is
+ *           written as one line
+ *
+ *               index bits e n p q d
+ *
+ *           with the numbers in hexadecimal (or base64, see
+ *           gen_encode.c, or decimal, see gen_decimal.c), and
+ *           handed to the
+ *           output stage in gen_writer.c, so no worker ever waits
+ *           for the disk.  Lines appear in completion order.
+ *
+ *           With a checkpoint file, workers format into a window of
+ *           slots by key index and whoever completes the oldest key
+ *           passes the run of finished lines to the writer.  Every
+ *           nCkptEvery keys the index and the output length are
+ *           noted and the writer is told to write what it holds;
+ *           once it has that many bytes on disk the checkpoint file
+ *           is replaced.  A worker more than a window ahead of the
+ *           oldest key waits.
+ *
+ *           With a key ring (gen_shm.c) the limbs of each key go
+ *           straight to a consumer process instead, nothing is
+ *           formatted.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+#include "gen_arena.h"
+#include "gen_memprof.h"
+#include "gen_writer.h"
+#include "gen_encode.h"
+#include "gen_decimal.h"
+#include "gen_shm.h"
+#include "gen_checkpoint.h"
+#include "gen_pct.h"
+#include "gen_dedup.h"
+#include "gen_bulk.h"
+
+
+     /******** #defines and typedefs  ********/
+#define BULK_WINDOW      (64)        /* ordered keys in flight, least  */
+#define BULK_CANDS       (64)        /* checkpoints waiting for disk   */
+
+typedef struct {
+  const BULK_OPTS  *pOpts;
+  WRITER           *pWriter;
+  SHM_RING         *pRing;            /* instead of pWriter           */
+  long              nNext;            /* next key index, shared       */
+  int               nFailed;          /* a record could not be put    */
+  long              nRedrawn;         /* keys drawn again             */
+
+  /* ordered output, only with a checkpoint file */
+  BOOL              flOrdered;
+  pthread_mutex_t   mtx;
+  pthread_cond_t    cvWindow;         /* nNextOut moved               */
+  int               nWindow;
+  char            **ppchSlots;        /* record of key i at i % nWindow */
+  size_t           *pnSlotLen;        /* 0 while not finished         */
+  long              nNextOut;         /* oldest key not yet written   */
+  off_t             nOutOff;          /* file length up to nNextOut   */
+  long              anCandNext[BULK_CANDS];  /* checkpoints not yet   */
+  off_t             anCandOff[BULK_CANDS];   /* on disk, oldest first */
+  int               nCands;
+  CHECKPOINT        ckpt;
+  long              nCkpts;           /* checkpoints written          */
+} BULK_RUN;
+
+
+     /******** functions in this file ********/
+static void   *fnBulk_worker (void *pArg);
+static void    fnBulk_emit (BULK_RUN *pRun, long nIndex, size_t nLen);
+static void    fnBulk_checkpoint (BULK_RUN *pRun, long nNext, off_t nOff);
+static void    fnBulk_seed_draw (unsigned long nSeed, long nIndex, int nDraw);
+
+
+
+
+/************************************************************************
+ * fnBulk_run -- Generate pOpts->nCount keys and write them out.
+ *               Returns 0 on success.
+ ***********************************************************************/
+int fnBulk_run (const BULK_OPTS *pOpts)
+{
+  BULK_RUN         run;
+  WRITER_STATS     ws;
+  pthread_t       *pThreads;
+  struct timespec  tsStart, tsEnd;
+  double           dSecs;
+  char             achE[32];
+  int              i, nThreads, nRet;
+  long             nKeys;
+  SHM_HEADER      *pHdr;
+  uint64_t         nFullWaits = 0;
+
+
+  nThreads = pOpts->nThreads > 0 ? pOpts->nThreads : 1;
+  memset (&run, 0, sizeof (run));
+  run.pOpts = pOpts;
+  run.nNext = pOpts->nFirst;
+
+  /* 1. Output stage first, it owns the file */
+  if (pOpts->pszShm != NULL)
+    run.pRing = fnShm_create (pOpts->pszShm, pOpts->nBitLen, \
+                              pOpts->nShmSlots > 0 ? pOpts->nShmSlots : \
+                                                     SHM_SLOTS_DEFAULT);
+  else
+    run.pWriter = fnWriter_open_at (pOpts->pszOut, pOpts->nWriterFlags, \
+                                    pOpts->nBufSize, pOpts->nBufs, \
+                                    pOpts->flResume ? pOpts->nStartOff : -1);
+  if (run.pWriter == NULL && run.pRing == NULL)
+    return 1;
+
+  /* 1a. With a checkpoint file, the window of ordered records and */
+  /*     the checkpoint of where we start                          */
+  if (pOpts->pszCheckpoint != NULL && run.pWriter != NULL) {
+    run.flOrdered = 1;
+    run.nWindow   = 8 * nThreads > BULK_WINDOW ? 8 * nThreads : BULK_WINDOW;
+    run.ppchSlots = (char **) malloc (run.nWindow * sizeof (char *));
+    run.pnSlotLen = (size_t *) calloc (run.nWindow, sizeof (size_t));
+    for (i = 0; i < run.nWindow; i++)
+      run.ppchSlots[i] = (char *) malloc (KEY_RECORD_LEN (pOpts->nBitLen));
+    pthread_mutex_init (&run.mtx, NULL);
+    pthread_cond_init (&run.cvWindow, NULL);
+    run.nNextOut = pOpts->nFirst;
+    run.nOutOff  = pOpts->flResume ? pOpts->nStartOff : 0;
+
+    run.ckpt.nBitLen = pOpts->nBitLen;
+    run.ckpt.nSeed   = pOpts->nSeed;
+    run.ckpt.ePolicy = pOpts->ePolicy;
+    run.ckpt.nCount  = pOpts->nCount;
+    run.ckpt.nFormat = pOpts->nFormat;
+    snprintf (run.ckpt.achOut, sizeof (run.ckpt.achOut), "%s", pOpts->pszOut);
+    fnBulk_checkpoint (&run, run.nNextOut, run.nOutOff);
+    if (pOpts->flResume)
+      fprintf (stderr, "   resuming at key %ld of %ld, offset %lld\n", \
+               pOpts->nFirst, pOpts->nCount, (long long) pOpts->nStartOff);
+  }
+
+  /* 2. Workers */
+  clock_gettime (CLOCK_MONOTONIC, &tsStart);
+  pThreads = (pthread_t *) malloc (nThreads * sizeof (pthread_t));
+  for (i = 0; i < nThreads; i++)
+    pthread_create (&pThreads[i], NULL, fnBulk_worker, &run);
+  for (i = 0; i < nThreads; i++)
+    pthread_join (pThreads[i], NULL);
+  free (pThreads);
+
+  /* 3. Drain the output */
+  nRet = 0;
+  if (run.pRing != NULL) {
+    pHdr = fnShm_header (run.pRing);
+    nFullWaits = pHdr->nFullWaits;
+    fnShm_close (run.pRing);
+  }
+  else
+    nRet = fnWriter_close (run.pWriter, &ws);
+  clock_gettime (CLOCK_MONOTONIC, &tsEnd);
+  dSecs = (tsEnd.tv_sec - tsStart.tv_sec) + \
+          (tsEnd.tv_nsec - tsStart.tv_nsec) / 1e9;
+
+  /* 3a. Everything is on disk now, the last checkpoint says so */
+  if (run.flOrdered) {
+    if (nRet == 0 && !run.nFailed)
+      fnBulk_checkpoint (&run, run.nNextOut, run.nOutOff);
+    for (i = 0; i < run.nWindow; i++)
+      free (run.ppchSlots[i]);
+    free (run.ppchSlots);
+    free (run.pnSlotLen);
+    pthread_cond_destroy (&run.cvWindow);
+    pthread_mutex_destroy (&run.mtx);
+  }
+
+  nKeys = pOpts->nCount - pOpts->nFirst;
+  fprintf (stderr, "\n  --> Bulk run: %ld keys of %d bits on %d thread%s <--\n", \
+           nKeys, pOpts->nBitLen, nThreads, nThreads == 1 ? "" : "s");
+  fprintf (stderr, "      %.3f s, %.2f keys/s\n", dSecs, \
+           dSecs > 0 ? nKeys / dSecs : 0.0);
+  fnFormat_e_policy (&pOpts->ePolicy, achE, sizeof (achE));
+  fprintf (stderr, "      e %s, about %.0f multiplications per public " \
+           "operation\n", achE, fnCost_e_policy (&pOpts->ePolicy));
+  if (run.nRedrawn > 0)
+    fprintf (stderr, "      %ld key%s drawn again after a failed search\n", \
+             run.nRedrawn, run.nRedrawn == 1 ? "" : "s");
+  if (fnPct_enabled ())
+    fnPct_report (stderr);
+  if (fnDedup_enabled ())
+    fnDedup_report (stderr);
+  if (run.pRing != NULL)
+    fprintf (stderr, "      key ring %s, producers waited %lu times\n", \
+             pOpts->pszShm, (unsigned long) nFullWaits);
+  else
+    fnWriter_print_stats (stderr, &ws);
+  if (run.flOrdered)
+    fprintf (stderr, "      %ld checkpoints to %s, next key %ld\n", \
+             run.nCkpts, pOpts->pszCheckpoint, run.ckpt.nNext);
+
+  return (nRet != 0 || run.nFailed) ? 1 : 0;
+}
+
+
+
+/************************************************************************
+ * fnBulk_seed_key -- Reseed the calling thread's random state for key
+ *                    nIndex of a run seeded with nSeed.
+ ***********************************************************************/
+void fnBulk_seed_key (unsigned long nSeed, long nIndex)
+{
+  fnBulk_seed_draw (nSeed, nIndex, 0);
+}
+
+
+
+/************************************************************************
+ * fnBulk_seed_draw -- Reseed for draw nDraw of key nIndex, with the
+ *                     seed S + nIndex * 2^{64} + nDraw * 2^{128}.
+ ***********************************************************************/
+static void fnBulk_seed_draw (unsigned long nSeed, long nIndex, int nDraw)
+{
+  mpz_t  mpzSeed;
+
+
+  mpz_init_set_ui (mpzSeed, (unsigned long) nDraw);
+  mpz_mul_2exp (mpzSeed, mpzSeed, 64);
+  mpz_add_ui (mpzSeed, mpzSeed, (unsigned long) nIndex);
+  mpz_mul_2exp (mpzSeed, mpzSeed, 64);
+  mpz_add_ui (mpzSeed, mpzSeed, nSeed);
+  gmp_randseed (rndState, mpzSeed);
+  mpz_clear (mpzSeed);
+}
+
+
+
+/************************************************************************
+ * fnBulk_make_key -- e, p, q and d of key nIndex of a run seeded with
+ *                    nSeed, of safe primes if flSafe.  Returns the
+ *                    KEYGEN_STATUS of the last draw, and in *pnRedrawn
+ *                    how many draws went before it.
+ *
+ * Remark - A search that runs out of candidates, or a key that fails
+ *          the PCT, is bad luck of that one key and no fault of the
+ *          run.  The key is drawn again from e on, draw k with the
+ *          seed of fnBulk_seed_draw, so the output still depends
+ *          only on the seed.  Draw 0 is the seed of fnBulk_seed_key,
+ *          keys that never fail are unchanged.  After KEY_DRAWS_MAX
+ *          draws something is broken and the status is passed on.
+ ***********************************************************************/
+int fnBulk_make_key (unsigned long nSeed, long nIndex, \
+    const E_POLICY *pPolicy, int nBitLen, BOOL flSafe, mpz_t mpzE, \
+    mpz_t mpzP1, mpz_t mpzP2, mpz_t mpzD, int *pnRedrawn)
+{
+  int  nStatus, k;
+
+
+  for (k = 0; ; k++) {
+    fnBulk_seed_draw (nSeed, nIndex, k);
+    fnMemprof_phase (MEM_PHASE_E);
+    fnMake_exponent_e (mpzE, pPolicy);
+
+    if (flSafe)
+      nStatus = fnGenerate_safe_keypair (mpzP1, mpzP2, mpzD, mpzE, nBitLen);
+    else
+      nStatus = fnGenerate_keypair (mpzP1, mpzP2, mpzD, mpzE, nBitLen);
+    if ((nStatus != KEYGEN_EXHAUSTED && nStatus != KEYGEN_PCT_FAILED) || \
+        k + 1 == KEY_DRAWS_MAX)
+      break;
+  }
+
+  *pnRedrawn = k;
+  return nStatus;
+}
+
+
+
+/************************************************************************
+ * fnBulk_worker -- Thread body: keys until the counter runs out.
+ ***********************************************************************/
+static void *fnBulk_worker (void *pArg)
+{
+  BULK_RUN         *pRun  = (BULK_RUN *) pArg;
+  const BULK_OPTS  *pOpts = pRun->pOpts;
+  mpz_t             mpzP1, mpzP2, mpzE, mpzD, mpzN;
+  char             *pchRec;
+  char              achTag[24];
+  KEY_FMT           fmt;
+  size_t            nLen;
+  long              nIndex;
+  int               nStatus, nRedrawn;
+
+
+  /* 1. Per thread state, outside any arena scope */
+  fnWorker_init ();
+  pchRec = (char *) malloc (KEY_RECORD_LEN (pOpts->nBitLen));
+  fnKeyfmt_init (&fmt, pOpts->nFormat, pOpts->nBitLen);
+
+  while ((nIndex = __atomic_fetch_add (&pRun->nNext, 1, __ATOMIC_RELAXED))
+         < pOpts->nCount) {
+    /* 1a. Ordered output: no more than a window ahead */
+    if (pRun->flOrdered) {
+      pthread_mutex_lock (&pRun->mtx);
+      while (nIndex >= pRun->nNextOut + pRun->nWindow && !pRun->nFailed)
+        pthread_cond_wait (&pRun->cvWindow, &pRun->mtx);
+      pthread_mutex_unlock (&pRun->mtx);
+      if (pRun->nFailed)
+        break;
+    }
+
+    /* 2. Same steps as main for key nIndex */
+    fnArena_begin ();
+    mpz_inits (mpzP1, mpzP2, mpzE, mpzD, mpzN, NULL);
+    nStatus = fnBulk_make_key (pOpts->nSeed, nIndex, &pOpts->ePolicy, \
+                               pOpts->nBitLen, 0, mpzE, mpzP1, mpzP2, \
+                               mpzD, &nRedrawn);
+    if (nRedrawn > 0)
+      __atomic_add_fetch (&pRun->nRedrawn, 1, __ATOMIC_RELAXED);
+
+    /* 3. Serialize and hand over, the copy is the only cost here */
+    fnMemprof_phase (MEM_PHASE_OUTPUT);
+    if (nStatus != KEYGEN_OK) {
+      fprintf (stderr, "   ### FAILURE creating prime for key %ld\n", nIndex);
+      pRun->nFailed = 1;
+      if (pRun->flOrdered) {
+        pthread_mutex_lock (&pRun->mtx);
+        pthread_cond_broadcast (&pRun->cvWindow);
+        pthread_mutex_unlock (&pRun->mtx);
+      }
+    }
+    else if (pRun->pRing != NULL)
+      fnShm_put_key (pRun->pRing, nIndex, pOpts->nBitLen, mpzE, mpzP1, \
+                     mpzP2, mpzD);
+    else if (pRun->flOrdered) {
+      mpz_mul (mpzN, mpzP1, mpzP2);
+      sprintf (achTag, "%ld", nIndex);
+      nLen = fnKeyfmt_record (pRun->ppchSlots[nIndex % pRun->nWindow], \
+                              &fmt, achTag, pOpts->nBitLen, mpzE, mpzN, \
+                              mpzP1, mpzP2, mpzD);
+      fnBulk_emit (pRun, nIndex, nLen);
+    }
+    else {
+      mpz_mul (mpzN, mpzP1, mpzP2);
+      sprintf (achTag, "%ld", nIndex);
+      nLen = fnKeyfmt_record (pchRec, &fmt, achTag, pOpts->nBitLen, mpzE, \
+                              mpzN, mpzP1, mpzP2, mpzD);
+      if (fnWriter_put (pRun->pWriter, pchRec, nLen) != 0)
+        pRun->nFailed = 1;
+    }
+
+    mpz_clears (mpzP1, mpzP2, mpzE, mpzD, mpzN, NULL);
+    fnArena_end ();
+    fnMemprof_key_done ();
+    if (pRun->nFailed)
+      break;
+  }
+
+  /* 4. Per thread clean up */
+  free (pchRec);
+  fnKeyfmt_clear (&fmt);
+  fnWorker_exit ();
+
+  return NULL;
+}
+
+
+
+/************************************************************************
+ * fnBulk_emit -- Key nIndex sits formatted in its slot.  Write out
+ *                every finished key from the oldest on, and note a
+ *                checkpoint every nCkptEvery keys.
+ ***********************************************************************/
+static void fnBulk_emit (BULK_RUN *pRun, long nIndex, size_t nLen)
+{
+  const BULK_OPTS  *pOpts = pRun->pOpts;
+  long              nEvery;
+  off_t             nDone;
+  int               nSlot, i, nLast;
+  BOOL              flNoted = 0;
+
+
+  nEvery = pOpts->nCkptEvery > 0 ? pOpts->nCkptEvery : CKPT_EVERY_DEFAULT;
+  pthread_mutex_lock (&pRun->mtx);
+  pRun->pnSlotLen[nIndex % pRun->nWindow] = nLen;
+
+  /* 1. The run of finished keys from the oldest one */
+  while (pRun->pnSlotLen[nSlot = pRun->nNextOut % pRun->nWindow] != 0) {
+    if (fnWriter_put (pRun->pWriter, pRun->ppchSlots[nSlot], \
+                      pRun->pnSlotLen[nSlot]) != 0)
+      pRun->nFailed = 1;
+    pRun->nOutOff += pRun->pnSlotLen[nSlot];
+    pRun->pnSlotLen[nSlot] = 0;
+    pRun->nNextOut++;
+
+    if (pRun->nNextOut % nEvery == 0) {
+      if (pRun->nCands == BULK_CANDS) {     /* disk is slow, drop oldest */
+        memmove (pRun->anCandNext, pRun->anCandNext + 1, \
+                 (BULK_CANDS - 1) * sizeof (long));
+        memmove (pRun->anCandOff, pRun->anCandOff + 1, \
+                 (BULK_CANDS - 1) * sizeof (off_t));
+        pRun->nCands--;
+      }
+      pRun->anCandNext[pRun->nCands] = pRun->nNextOut;
+      pRun->anCandOff[pRun->nCands]  = pRun->nOutOff;
+      pRun->nCands++;
+      flNoted = 1;
+    }
+  }
+  pthread_cond_broadcast (&pRun->cvWindow);
+
+  /*    A checkpoint does not wait for a full buffer */
+  if (flNoted && fnWriter_sync (pRun->pWriter) != 0)
+    pRun->nFailed = 1;
+
+  /* 2. The newest noted checkpoint whose bytes are all on disk */
+  if (pRun->nCands > 0) {
+    nDone = fnWriter_done_offset (pRun->pWriter);
+    for (nLast = -1, i = 0; i < pRun->nCands && pRun->anCandOff[i] <= nDone; i++)
+      nLast = i;
+    if (nLast >= 0) {
+      fnBulk_checkpoint (pRun, pRun->anCandNext[nLast], pRun->anCandOff[nLast]);
+      pRun->nCands -= nLast + 1;
+      memmove (pRun->anCandNext, pRun->anCandNext + nLast + 1, \
+               pRun->nCands * sizeof (long));
+      memmove (pRun->anCandOff, pRun->anCandOff + nLast + 1, \
+               pRun->nCands * sizeof (off_t));
+    }
+  }
+  pthread_mutex_unlock (&pRun->mtx);
+}
+
+
+
+/************************************************************************
+ * fnBulk_checkpoint -- Keys before nNext are in the first nOff bytes
+ *                      of the output, say so in the checkpoint file.
+ ***********************************************************************/
+static void fnBulk_checkpoint (BULK_RUN *pRun, long nNext, off_t nOff)
+{
+  pRun->ckpt.nNext   = nNext;
+  pRun->ckpt.nOffset = nOff;
+  if (fnCheckpoint_write (pRun->pOpts->pszCheckpoint, &pRun->ckpt) == 0)
+    pRun->nCkpts++;
+}
+
+
+
+/************************************************************************
+ * fnKeyfmt_init -- Formatting state for keys of up to nMaxBits.
+ *                  Call outside of an arena scope.
+ ***********************************************************************/
+void fnKeyfmt_init (KEY_FMT *pFmt, int nFormat, int nMaxBits)
+{
+  if (nMaxBits < 256)
+    nMaxBits = 256;                        /* room for a random e */
+
+  pFmt->nFormat    = nFormat;
+  pFmt->nMaxBits   = nMaxBits;
+  pFmt->pchScratch = (unsigned char *) malloc (nMaxBits / 8 + 64);
+  pFmt->pDecTab    = NULL;
+  if (nFormat == FMT_DECIMAL) {
+    pFmt->pDecTab = fnDecimal_table (nMaxBits);
+    fnDecimal_scratch_init (&pFmt->decScratch, pFmt->pDecTab);
+  }
+}
+
+
+
+/************************************************************************
+ * fnKeyfmt_clear -- Release what fnKeyfmt_init allocated.
+ ***********************************************************************/
+void fnKeyfmt_clear (KEY_FMT *pFmt)
+{
+  free (pFmt->pchScratch);
+  if (pFmt->pDecTab != NULL)
+    fnDecimal_scratch_clear (&pFmt->decScratch);
+  pFmt->pchScratch = NULL;
+  pFmt->pDecTab    = NULL;
+}
+
+
+
+/************************************************************************
+ * fnKeyfmt_record -- One output line 'tag bits e n p q d' for a key.
+ *                    Returns its length, pchBuf holds KEY_RECORD_LEN.
+ *
+ * Remark - FMT_DEFAULT is hexadecimal.  Base64 and decimal of all
+ *          five numbers together still fit the length sized for hex.
+ ***********************************************************************/
+size_t fnKeyfmt_record (char *pchBuf, KEY_FMT *pFmt, const char *pszTag, \
+       int nBitLen, mpz_t mpzE, mpz_t mpzN, mpz_t mpzP1, mpz_t mpzP2, \
+       mpz_t mpzD)
+{
+  char     *p = pchBuf;
+  mpz_ptr   apVals[5];
+  int       i;
+
+
+  apVals[0] = mpzE;
+  apVals[1] = mpzN;
+  apVals[2] = mpzP1;
+  apVals[3] = mpzP2;
+  apVals[4] = mpzD;
+
+  p += sprintf (p, "%s %d", pszTag, nBitLen);
+  for (i = 0; i < 5; i++) {
+    *p++ = ' ';
+    if (pFmt->nFormat == FMT_DECIMAL)
+      p += fnDecimal_format (p, apVals[i], pFmt->pDecTab, &pFmt->decScratch);
+    else
+      p += fnEncode_mpz (p, pFmt->pchScratch, apVals[i], pFmt->nFormat);
+  }
+  *p++ = '\n';
+
+  return (size_t) (p - pchBuf);
+}
@@ -0,0 +1,79 @@
+/**********************************************************************
+ * gen_bulk.h -- Bulk generation of many keys on worker threads.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- Key i of a run seeded with S uses the random seed
+ *           S + i * 2^{64}, so key 0 is the key the interactive
+ *           program prints for seed S, and every key can be
+ *           reproduced on its own.  A key whose search fails is
+ *           drawn again with S + i * 2^{64} + k * 2^{128}, k = 1,
+ *           2, ..., so that stays true.
+ *
+ *           With a checkpoint file the lines are written in index
+ *           order, so the output only depends on the seed, and the
+ *           run can be stopped and resumed (gen_checkpoint.h).
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_BULK_H
+#define GEN_BULK_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+#include "gen_decimal.h"
+
+
+     /******** #defines and typedefs  ********/
+typedef struct {
+  int             nBitLen;            /* modulus length               */
+  unsigned long   nSeed;              /* run seed S                   */
+  E_POLICY        ePolicy;            /* e of every key               */
+  long            nCount;             /* keys to generate             */
+  int             nThreads;           /* key generation threads       */
+  const char     *pszOut;             /* output file, NULL is stdout  */
+  int             nWriterFlags;       /* WRITER_F_ options            */
+  size_t          nBufSize;           /* output buffer size, bytes    */
+  int             nBufs;              /* number of output buffers     */
+  int             nFormat;            /* OUT_FORMAT of the numbers    */
+  const char     *pszShm;             /* key ring instead of a file   */
+  int             nShmSlots;          /* slots in the key ring        */
+  const char     *pszCheckpoint;      /* progress file, orders output */
+  long            nCkptEvery;         /* keys between checkpoints     */
+  int             flResume;           /* continue at nFirst, nStartOff */
+  long            nFirst;             /* first key index to generate  */
+  off_t           nStartOff;          /* output length before nFirst  */
+} BULK_OPTS;
+
+typedef struct {
+  int               nFormat;          /* OUT_FORMAT                   */
+  int               nMaxBits;         /* largest modulus to format    */
+  unsigned char    *pchScratch;       /* big-endian bytes of a value  */
+  const DEC_TABLE  *pDecTab;          /* shared powers of ten         */
+  DEC_SCRATCH       decScratch;       /* this thread's quotients      */
+} KEY_FMT;
+
+#define KEY_DRAWS_MAX   (64)   /* draws of one key, fnBulk_make_key */
+
+                   /* longest record of a key of nBits, any format */
+#define KEY_RECORD_LEN(nBits)   (5 * ((nBits) / 4 + 2) + 160)
+
+
+     /******** functions in gen_bulk.c ********/
+int   fnBulk_run (const BULK_OPTS *pOpts);
+void  fnBulk_seed_key (unsigned long nSeed, long nIndex);
+int   fnBulk_make_key (unsigned long nSeed, long nIndex, \
+      const E_POLICY *pPolicy, int nBitLen, BOOL flSafe, mpz_t mpzE, \
+      mpz_t mpzP1, mpz_t mpzP2, mpz_t mpzD, int *pnRedrawn);
+
+void    fnKeyfmt_init (KEY_FMT *pFmt, int nFormat, int nMaxBits);
+void    fnKeyfmt_clear (KEY_FMT *pFmt);
+size_t  fnKeyfmt_record (char *pchBuf, KEY_FMT *pFmt, const char *pszTag, \
+        int nBitLen, mpz_t mpzE, mpz_t mpzN, mpz_t mpzP1, mpz_t mpzP2, \
+        mpz_t mpzD);
+
+#endif
@@ -0,0 +1,95 @@
+/**********************************************************************
+ * gen_cancel.c -- Cancellation tokens and deadlines for the prime
+ *                 searches.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- A check is one load of the flag and, with a deadline, one
+ *           clock_gettime, which the vDSO answers without a system
+ *           call.  Both are small next to testing one candidate.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "gen_pair_pseudo.h"
+#include "gen_cancel.h"
+
+
+     /******** globals in this file   ********/
+static __thread const CANCEL_TOKEN  *pCancelTok;   /* this thread's */
+
+
+
+
+/************************************************************************
+ * fnCancel_init -- A token that is not cancelled and expires
+ *                  nTimeoutMs from now (never for 0).
+ ***********************************************************************/
+void fnCancel_init (CANCEL_TOKEN *pTok, long nTimeoutMs)
+{
+  pTok->flCancelled = 0;
+  pTok->nDeadlineNs = nTimeoutMs > 0 ? \
+                      fnCancel_now_ns () + nTimeoutMs * 1000000LL : 0;
+}
+
+
+
+/************************************************************************
+ * fnCancel_request -- Cancel the work running under pTok.  Any thread.
+ ***********************************************************************/
+void fnCancel_request (CANCEL_TOKEN *pTok)
+{
+  __atomic_store_n (&pTok->flCancelled, 1, __ATOMIC_RELAXED);
+}
+
+
+
+/************************************************************************
+ * fnCancel_use -- Make pTok (or NULL, none) the calling thread's token.
+ *                 Returns the one it replaces.
+ ***********************************************************************/
+const CANCEL_TOKEN *fnCancel_use (const CANCEL_TOKEN *pTok)
+{
+  const CANCEL_TOKEN  *pOld = pCancelTok;
+
+
+  pCancelTok = pTok;
+  return pOld;
+}
+
+
+
+/************************************************************************
+ * fnCancel_check -- KEYGEN_OK, or why the search must stop.
+ ***********************************************************************/
+int fnCancel_check (void)
+{
+  const CANCEL_TOKEN  *pTok = pCancelTok;
+
+
+  if (pTok == NULL)
+    return KEYGEN_OK;
+  if (__atomic_load_n (&pTok->flCancelled, __ATOMIC_RELAXED))
+    return KEYGEN_CANCELLED;
+  if (pTok->nDeadlineNs != 0 && fnCancel_now_ns () >= pTok->nDeadlineNs)
+    return KEYGEN_DEADLINE;
+
+  return KEYGEN_OK;
+}
+
+
+
+/************************************************************************
+ * fnCancel_now_ns -- CLOCK_MONOTONIC in nanoseconds.
+ ***********************************************************************/
+long long fnCancel_now_ns (void)
+{
+  struct timespec  ts;
+
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
@@ -0,0 +1,38 @@
+/**********************************************************************
+ * gen_cancel.h -- Cancellation tokens and deadlines for the prime
+ *                 searches.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- A thread making a key installs a CANCEL_TOKEN with
+ *           fnCancel_use, as it owns its rndState.  The searches call
+ *           fnCancel_check between candidates, between the sieve
+ *           windows and between the primality tests of a candidate,
+ *           and give up with KEYGEN_CANCELLED or KEYGEN_DEADLINE.
+ *           Any thread may cancel a token; the deadline is absolute,
+ *           on CLOCK_MONOTONIC.  Without a token nothing is checked.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_CANCEL_H
+#define GEN_CANCEL_H
+
+#include "gen_pair_pseudo.h"
+
+
+     /******** #defines and typedefs  ********/
+typedef struct {
+  int          flCancelled;           /* set by fnCancel_request      */
+  long long    nDeadlineNs;           /* CLOCK_MONOTONIC, 0 is none   */
+} CANCEL_TOKEN;
+
+
+     /******** functions in gen_cancel.c ********/
+void                 fnCancel_init (CANCEL_TOKEN *pTok, long nTimeoutMs);
+void                 fnCancel_request (CANCEL_TOKEN *pTok);
+const CANCEL_TOKEN  *fnCancel_use (const CANCEL_TOKEN *pTok);
+int                  fnCancel_check (void);
+long long            fnCancel_now_ns (void);
+
+#endif
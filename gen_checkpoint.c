@@ -0,0 +1,144 @@
+/**********************************************************************
+ * gen_checkpoint.c -- Progress of a bulk run, kept in a small text
+ *                     file so that the run can be resumed.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- The file is one 'name value' pair per line:
+ *
+ *               version 1
+ *               bits 2048
+ *               seed 42
+ *               e random
+ *               count 1000000
+ *               format 2
+ *               next 51000
+ *               offset 79150123
+ *               out keys.txt
+ *
+ *           Writing it costs one small write and a rename, and the
+ *           bulk run only does so every few thousand keys.  There is
+ *           no fsync: the checkpoint survives the program being
+ *           killed, not the machine losing power.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gen_checkpoint.h"
+
+
+
+
+/************************************************************************
+ * fnCheckpoint_write -- Replace the checkpoint file pszPath with
+ *                       pCkpt.  Returns 0 on success.
+ ***********************************************************************/
+int fnCheckpoint_write (const char *pszPath, const CHECKPOINT *pCkpt)
+{
+  char   achTmp[CKPT_PATH_MAX + 8];
+  char   achE[32];
+  FILE  *fp;
+  int    nRet;
+
+
+  /* 1. Write the new contents beside the old file */
+  snprintf (achTmp, sizeof (achTmp), "%s.tmp", pszPath);
+  if ((fp = fopen (achTmp, "w")) == NULL) {
+    perror (achTmp);
+    return -1;
+  }
+  fprintf (fp, "version %d\n", CKPT_VERSION);
+  fprintf (fp, "bits %d\n", pCkpt->nBitLen);
+  fprintf (fp, "seed %lu\n", pCkpt->nSeed);
+  fnFormat_e_policy (&pCkpt->ePolicy, achE, sizeof (achE));
+  fprintf (fp, "e %s\n", achE);
+  fprintf (fp, "count %ld\n", pCkpt->nCount);
+  fprintf (fp, "format %d\n", pCkpt->nFormat);
+  fprintf (fp, "next %ld\n", pCkpt->nNext);
+  fprintf (fp, "offset %lld\n", (long long) pCkpt->nOffset);
+  fprintf (fp, "out %s\n", pCkpt->achOut);
+  nRet = ferror (fp);
+  if (fclose (fp) != 0 || nRet != 0) {
+    perror (achTmp);
+    return -1;
+  }
+
+  /* 2. And put it in place in one step */
+  if (rename (achTmp, pszPath) != 0) {
+    perror (pszPath);
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnCheckpoint_read -- Read the checkpoint file pszPath into pCkpt.
+ *                      Returns 0 on success, complains otherwise.
+ ***********************************************************************/
+int fnCheckpoint_read (const char *pszPath, CHECKPOINT *pCkpt)
+{
+  char        achLine[CKPT_PATH_MAX + 32];
+  char       *pchVal;
+  FILE       *fp;
+  int         nVersion = 0, nSeen = 0;
+  size_t      nLen;
+
+
+  if ((fp = fopen (pszPath, "r")) == NULL) {
+    perror (pszPath);
+    return -1;
+  }
+  memset (pCkpt, 0, sizeof (*pCkpt));
+
+  /* 1. One 'name value' per line, unknown names are an error */
+  while (fgets (achLine, sizeof (achLine), fp) != NULL) {
+    nLen = strlen (achLine);
+    if (nLen > 0 && achLine[nLen - 1] == '\n')
+      achLine[--nLen] = '\0';
+    if ((pchVal = strchr (achLine, ' ')) == NULL)
+      break;
+    *pchVal++ = '\0';
+
+    if (strcmp (achLine, "version") == 0)
+      nVersion = atoi (pchVal);
+    else if (strcmp (achLine, "bits") == 0)
+      pCkpt->nBitLen = atoi (pchVal);
+    else if (strcmp (achLine, "seed") == 0)
+      pCkpt->nSeed = strtoul (pchVal, NULL, 10);
+    else if (strcmp (achLine, "e") == 0) {
+      if (fnParse_e_policy (pchVal, &pCkpt->ePolicy) != 0)
+        break;
+    }
+    else if (strcmp (achLine, "count") == 0)
+      pCkpt->nCount = strtol (pchVal, NULL, 10);
+    else if (strcmp (achLine, "format") == 0)
+      pCkpt->nFormat = atoi (pchVal);
+    else if (strcmp (achLine, "next") == 0)
+      pCkpt->nNext = strtol (pchVal, NULL, 10);
+    else if (strcmp (achLine, "offset") == 0)
+      pCkpt->nOffset = (off_t) strtoll (pchVal, NULL, 10);
+    else if (strcmp (achLine, "out") == 0)
+      snprintf (pCkpt->achOut, sizeof (pCkpt->achOut), "%s", pchVal);
+    else
+      break;
+    nSeen++;
+  }
+  fclose (fp);
+
+  /* 2. All nine lines, of this version */
+  if (nSeen != 9 || nVersion != CKPT_VERSION || pCkpt->nBitLen <= 0 || \
+      pCkpt->nNext < 0 || pCkpt->nNext > pCkpt->nCount || \
+      pCkpt->nOffset < 0 || pCkpt->achOut[0] == '\0') {
+    fprintf (stderr, "%s: not a usable checkpoint\n", pszPath);
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,48 @@
+/**********************************************************************
+ * gen_checkpoint.h -- Progress of a bulk run, kept in a small text
+ *                     file so that the run can be resumed.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- A checkpoint says: keys 0 .. nNext - 1 are in the output
+ *           file, which is exactly nOffset bytes long up to them.
+ *           The random stream of key i is seeded with S + i * 2^{64}
+ *           (see gen_bulk.h), so the key index is also the position
+ *           of the random stream and nothing more must be kept.
+ *
+ *           The file is written next to itself and renamed over the
+ *           old one, a reader never sees half of it.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_CHECKPOINT_H
+#define GEN_CHECKPOINT_H
+
+#include <sys/types.h>
+
+#include "gen_pair_pseudo.h"
+
+
+     /******** #defines and typedefs  ********/
+#define CKPT_VERSION        (1)
+#define CKPT_EVERY_DEFAULT  (1000)       /* keys between checkpoints     */
+#define CKPT_PATH_MAX       (1024)
+
+typedef struct {
+  int             nBitLen;            /* parameters of the run        */
+  unsigned long   nSeed;
+  E_POLICY        ePolicy;
+  long            nCount;
+  int             nFormat;
+  char            achOut[CKPT_PATH_MAX];  /* output file              */
+  long            nNext;              /* first key not in the file    */
+  off_t           nOffset;            /* length of the file up to it  */
+} CHECKPOINT;
+
+
+     /******** functions in gen_checkpoint.c ********/
+int  fnCheckpoint_write (const char *pszPath, const CHECKPOINT *pCkpt);
+int  fnCheckpoint_read (const char *pszPath, CHECKPOINT *pCkpt);
+
+#endif
@@ -0,0 +1,488 @@
+/**********************************************************************
+ * gen_client.c -- Client and load generator for the key generation
+ *                 daemon (gen_pair_pseudo --daemon=PATH).
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- gen_client PATH keypair NLEN [E]   one key, in hex
+ *           gen_client PATH prime BITS         one prime, in hex
+ *           gen_client PATH stats              the daemon's counters
+ *           gen_client PATH load [options]     many requests from
+ *                                              many connections
+ *
+ *           The load generator runs one thread per connection, each
+ *           keeping up to DEPTH requests in flight, and reports
+ *           throughput and latency percentiles.  BUSY answers are
+ *           counted and retried after a short pause.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "gen_daemon.h"
+
+
+     /******** #defines and typedefs  ********/
+#define E_POLICY_FIXED     (0)       /* as E_KIND in gen_pair_pseudo.h */
+#define E_POLICY_RANDOM    (1)
+#define BUSY_PAUSE_US      (10000)   /* wait before retrying a BUSY    */
+
+typedef struct {
+  const char  *pszPath;
+  int          nOp;                   /* DOP_KEYPAIR or DOP_PRIME     */
+  int          nBits;
+  int          nEKind;
+  unsigned     nValE;
+  int          nFlags;                /* DF_ flags                    */
+  int          nDepth;                /* requests in flight per conn  */
+  long         nPerConn;              /* requests per connection      */
+} LOAD_OPTS;
+
+typedef struct {
+  const LOAD_OPTS  *pOpts;
+  double           *adLatency;        /* ms, one per answered request */
+  long              nDone, nBusy, nBad;
+  int               nFailed;
+} LOAD_CONN;
+
+
+     /******** globals in this file   ********/
+char  *program_name;
+
+
+     /******** functions in this file ********/
+static int     fnClient_connect (const char *pszPath);
+static int     fnClient_full (int fd, void *pBuf, size_t nLen, int flWrite);
+static int     fnClient_request (int fd, const DAEMON_REQ *pReq);
+static char   *fnClient_answer (int fd, DAEMON_RESP *pResp);
+static void    fnClient_print (const DAEMON_RESP *pResp, const char *pchPay);
+static int     fnClient_load (LOAD_OPTS *pOpts, int nConns);
+static void   *fnClient_load_conn (void *pArg);
+static double  fnClient_now_ms (void);
+static int     fnClient_cmp (const void *pA, const void *pB);
+static void    fnClient_usage (void);
+
+
+
+/*************** main -- entry point **********************/
+int main (int argc, char *argv[])
+{
+  static struct option  longOpts[] = {
+    { "conns",  required_argument, NULL, 'c' },
+    { "count",  required_argument, NULL, 'n' },
+    { "bits",   required_argument, NULL, 'b' },
+    { "e",      required_argument, NULL, 'e' },
+    { "prime",  no_argument,       NULL, 'p' },
+    { "batch",  no_argument,       NULL, 'B' },
+    { "depth",  required_argument, NULL, 'd' },
+    { NULL,     0,                 NULL,  0  }
+  };
+  LOAD_OPTS    load;
+  DAEMON_REQ   req;
+  DAEMON_RESP  resp;
+  char        *pchPay;
+  int          fd, chOpt, nConns = 4;
+  long         nTotal = 100;
+
+
+  program_name = argv[0];
+  if (argc < 3) {
+    fnClient_usage ();
+    return 1;
+  }
+
+  memset (&req, 0, sizeof (req));
+  req.nMagic = DAEMON_MAGIC;
+  req.nId    = 1;
+  req.nEKind = E_POLICY_FIXED;
+  req.nValE  = 65537;
+
+  /* 1. One request, one answer */
+  if (strcmp (argv[2], "load") != 0) {
+    if (strcmp (argv[2], "keypair") == 0 && argc >= 4) {
+      req.nOp   = DOP_KEYPAIR;
+      req.nBits = atoi (argv[3]);
+      if (argc >= 5 && strcmp (argv[4], "random") == 0)
+        req.nEKind = E_POLICY_RANDOM;
+      else if (argc >= 5)
+        req.nValE = strtoul (argv[4], NULL, 10);
+    }
+    else if (strcmp (argv[2], "prime") == 0 && argc >= 4) {
+      req.nOp   = DOP_PRIME;
+      req.nBits = atoi (argv[3]);
+    }
+    else if (strcmp (argv[2], "stats") == 0)
+      req.nOp = DOP_STATS;
+    else {
+      fnClient_usage ();
+      return 1;
+    }
+
+    if ((fd = fnClient_connect (argv[1])) < 0)
+      return 1;
+    if (fnClient_request (fd, &req) != 0 ||
+        (pchPay = fnClient_answer (fd, &resp)) == NULL) {
+      fprintf (stderr, "%s: lost the daemon\n", program_name);
+      return 1;
+    }
+    fnClient_print (&resp, pchPay);
+    free (pchPay);
+    close (fd);
+    return resp.nStatus == DST_OK ? 0 : 2;
+  }
+
+  /* 2. Load generator */
+  memset (&load, 0, sizeof (load));
+  load.pszPath = argv[1];
+  load.nOp     = DOP_KEYPAIR;
+  load.nBits   = 1024;
+  load.nEKind  = E_POLICY_FIXED;
+  load.nValE   = 65537;
+  load.nDepth  = 1;
+  optind = 3;
+  while ((chOpt = getopt_long (argc, argv, "c:n:b:e:pBd:", longOpts, \
+                               NULL)) != -1) {
+    switch (chOpt) {
+      case 'c':
+        nConns = atoi (optarg);
+        break;
+      case 'n':
+        nTotal = strtol (optarg, NULL, 10);
+        break;
+      case 'b':
+        load.nBits = atoi (optarg);
+        break;
+      case 'e':
+        if (strcmp (optarg, "random") == 0)
+          load.nEKind = E_POLICY_RANDOM;
+        else
+          load.nValE = strtoul (optarg, NULL, 10);
+        break;
+      case 'p':
+        load.nOp = DOP_PRIME;
+        break;
+      case 'B':
+        load.nFlags |= DF_BATCH;
+        break;
+      case 'd':
+        load.nDepth = atoi (optarg);
+        break;
+      default:
+        fnClient_usage ();
+        return 1;
+    }
+  }
+  if (nConns < 1)
+    nConns = 1;
+  if (load.nDepth < 1)
+    load.nDepth = 1;
+  load.nPerConn = (nTotal + nConns - 1) / nConns;
+
+  return fnClient_load (&load, nConns);
+}
+
+
+
+/************************************************************************
+ * fnClient_connect -- Connect to the daemon's socket.
+ ***********************************************************************/
+static int fnClient_connect (const char *pszPath)
+{
+  struct sockaddr_un  sun;
+  int                 fd;
+
+
+  memset (&sun, 0, sizeof (sun));
+  sun.sun_family = AF_UNIX;
+  strncpy (sun.sun_path, pszPath, sizeof (sun.sun_path) - 1);
+
+  fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect (fd, (struct sockaddr *) &sun, sizeof (sun)) != 0) {
+    perror (pszPath);
+    if (fd >= 0)
+      close (fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+
+
+/************************************************************************
+ * fnClient_full -- Read or write exactly nLen bytes.  Returns 0.
+ ***********************************************************************/
+static int fnClient_full (int fd, void *pBuf, size_t nLen, int flWrite)
+{
+  char     *p = (char *) pBuf;
+  ssize_t   n;
+
+
+  while (nLen > 0) {
+    n = flWrite ? send (fd, p, nLen, MSG_NOSIGNAL) : read (fd, p, nLen);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    p    += n;
+    nLen -= n;
+  }
+
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnClient_request -- Send one request.
+ ***********************************************************************/
+static int fnClient_request (int fd, const DAEMON_REQ *pReq)
+{
+  return fnClient_full (fd, (void *) pReq, sizeof (*pReq), 1);
+}
+
+
+
+/************************************************************************
+ * fnClient_answer -- Read one answer.  Returns its payload (malloc'd,
+ *                    at least one byte), or NULL if the daemon is gone.
+ ***********************************************************************/
+static char *fnClient_answer (int fd, DAEMON_RESP *pResp)
+{
+  char  *pchPay;
+
+
+  if (fnClient_full (fd, pResp, sizeof (*pResp), 0) != 0 ||
+      pResp->nMagic != DAEMON_MAGIC)
+    return NULL;
+
+  pchPay = (char *) malloc (pResp->nLen + 1);
+  if (fnClient_full (fd, pchPay, pResp->nLen, 0) != 0) {
+    free (pchPay);
+    return NULL;
+  }
+  pchPay[pResp->nLen] = '\0';
+
+  return pchPay;
+}
+
+
+
+/************************************************************************
+ * fnClient_print -- Numbers in hex, one per line, or the stats text.
+ ***********************************************************************/
+static void fnClient_print (const DAEMON_RESP *pResp, const char *pchPay)
+{
+  static const char  *apszKey[5] = { "e", "n", "p", "q", "d" };
+  const unsigned char *p = (const unsigned char *) pchPay;
+  uint32_t             nBytes, k;
+  int                  i;
+
+
+  if (pResp->nStatus != DST_OK) {
+    printf ("%s\n", pResp->nStatus == DST_BUSY ? "busy" : \
+            pResp->nStatus == DST_FAILED ? "failed" : "bad request");
+    return;
+  }
+  if (pResp->nOp == DOP_STATS) {
+    printf ("%s\n", pchPay);
+    return;
+  }
+
+  for (i = 0; i < pResp->nCount; i++) {
+    memcpy (&nBytes, p, sizeof (nBytes));
+    p += sizeof (nBytes);
+    printf ("%s ", pResp->nCount == 5 ? apszKey[i] : "p");
+    for (k = 0; k < nBytes; k++)
+      printf (k == 0 ? "%x" : "%02x", p[k]);
+    printf ("\n");
+    p += nBytes;
+  }
+}
+
+
+
+/************************************************************************
+ * fnClient_load -- Run the load and print the summary.
+ ***********************************************************************/
+static int fnClient_load (LOAD_OPTS *pOpts, int nConns)
+{
+  LOAD_CONN  *aConns;
+  pthread_t  *pThreads;
+  double     *adAll, dStart, dSecs;
+  long        nDone = 0, nBusy = 0, nBad = 0, j;
+  int         i, nFailed = 0;
+
+
+  aConns   = (LOAD_CONN *) calloc (nConns, sizeof (LOAD_CONN));
+  pThreads = (pthread_t *) malloc (nConns * sizeof (pthread_t));
+
+  dStart = fnClient_now_ms ();
+  for (i = 0; i < nConns; i++) {
+    aConns[i].pOpts     = pOpts;
+    aConns[i].adLatency = (double *) malloc (pOpts->nPerConn * sizeof (double));
+    pthread_create (&pThreads[i], NULL, fnClient_load_conn, &aConns[i]);
+  }
+  for (i = 0; i < nConns; i++)
+    pthread_join (pThreads[i], NULL);
+  dSecs = (fnClient_now_ms () - dStart) / 1000.0;
+
+  /* Latencies of every connection together */
+  for (i = 0; i < nConns; i++)
+    nDone += aConns[i].nDone;
+  adAll = (double *) malloc ((nDone + 1) * sizeof (double));
+  for (nDone = 0, i = 0; i < nConns; i++) {
+    for (j = 0; j < aConns[i].nDone; j++)
+      adAll[nDone++] = aConns[i].adLatency[j];
+    nBusy   += aConns[i].nBusy;
+    nBad    += aConns[i].nBad;
+    nFailed |= aConns[i].nFailed;
+    free (aConns[i].adLatency);
+  }
+  qsort (adAll, nDone, sizeof (double), fnClient_cmp);
+
+  printf ("\n  --> Load: %d connection%s, depth %d, %d bit %s <--\n", \
+          nConns, nConns == 1 ? "" : "s", pOpts->nDepth, pOpts->nBits, \
+          pOpts->nOp == DOP_PRIME ? "primes" : "keys");
+  printf ("      answered %ld, busy %ld, bad %ld in %.3f s, %.2f/s\n", \
+          nDone, nBusy, nBad, dSecs, dSecs > 0 ? nDone / dSecs : 0.0);
+  if (nDone > 0)
+    printf ("      latency ms: p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n", \
+            adAll[nDone / 2], adAll[nDone * 9 / 10], adAll[nDone * 99 / 100], \
+            adAll[nDone - 1]);
+
+  free (adAll);
+  free (pThreads);
+  free (aConns);
+
+  return nFailed ? 1 : 0;
+}
+
+
+
+/************************************************************************
+ * fnClient_load_conn -- Thread body: one connection's share.
+ ***********************************************************************/
+static void *fnClient_load_conn (void *pArg)
+{
+  LOAD_CONN        *pC = (LOAD_CONN *) pArg;
+  const LOAD_OPTS  *pOpts = pC->pOpts;
+  DAEMON_REQ        req;
+  DAEMON_RESP       resp;
+  double           *adSent;               /* send time by request id */
+  char             *pchPay;
+  long              nSent = 0, nOut = 0;
+  int               fd;
+
+
+  if ((fd = fnClient_connect (pOpts->pszPath)) < 0) {
+    pC->nFailed = 1;
+    return NULL;
+  }
+  adSent = (double *) malloc (pOpts->nPerConn * sizeof (double));
+
+  memset (&req, 0, sizeof (req));
+  req.nMagic = DAEMON_MAGIC;
+  req.nOp    = pOpts->nOp;
+  req.nFlags = pOpts->nFlags;
+  req.nEKind = pOpts->nEKind;
+  req.nValE  = pOpts->nValE;
+  req.nBits  = pOpts->nBits;
+
+  while (pC->nDone + pC->nBad < pOpts->nPerConn) {
+    /* 1. Keep the pipe full */
+    while (nOut < pOpts->nDepth && nSent < pOpts->nPerConn) {
+      req.nId = (uint32_t) nSent;
+      adSent[nSent++] = fnClient_now_ms ();
+      if (fnClient_request (fd, &req) != 0)
+        goto lost;
+      nOut++;
+    }
+
+    /* 2. Take an answer; a BUSY one is sent again */
+    if ((pchPay = fnClient_answer (fd, &resp)) == NULL)
+      goto lost;
+    free (pchPay);
+    if (resp.nStatus == DST_BUSY) {
+      pC->nBusy++;
+      usleep (BUSY_PAUSE_US);
+      req.nId = resp.nId;
+      if (fnClient_request (fd, &req) != 0)
+        goto lost;
+      continue;
+    }
+    nOut--;
+    if (resp.nStatus == DST_OK)
+      pC->adLatency[pC->nDone++] = fnClient_now_ms () - adSent[resp.nId];
+    else
+      pC->nBad++;
+  }
+
+  free (adSent);
+  close (fd);
+  return NULL;
+
+lost:
+  fprintf (stderr, "%s: lost the daemon\n", program_name);
+  pC->nFailed = 1;
+  free (adSent);
+  close (fd);
+  return NULL;
+}
+
+
+
+/************************************************************************
+ * fnClient_now_ms -- Monotonic clock in milliseconds.
+ ***********************************************************************/
+static double fnClient_now_ms (void)
+{
+  struct timespec  ts;
+
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+
+
+/************************************************************************
+ * fnClient_cmp -- qsort order of latencies.
+ ***********************************************************************/
+static int fnClient_cmp (const void *pA, const void *pB)
+{
+  double  a = *(const double *) pA, b = *(const double *) pB;
+
+
+  return a < b ? -1 : a > b;
+}
+
+
+
+/************************************************************************
+ * fnClient_usage -- What the arguments are.
+ ***********************************************************************/
+static void fnClient_usage (void)
+{
+  printf ("Usage: %s PATH keypair NLEN [E|random]\n", program_name);
+  printf ("       %s PATH prime BITS\n", program_name);
+  printf ("       %s PATH stats\n", program_name);
+  printf ("       %s PATH load [options]\n", program_name);
+  printf ("  -c, --conns=N    connections, one thread each (default 4)\n");
+  printf ("  -n, --count=N    requests in all (default 100)\n");
+  printf ("  -b, --bits=N     nlen, or prime length with --prime (1024)\n");
+  printf ("  -e, --e=E        public exponent or 'random' (65537)\n");
+  printf ("  -p, --prime      ask for primes instead of keypairs\n");
+  printf ("  -B, --batch      mark requests as background (DF_BATCH)\n");
+  printf ("  -d, --depth=N    requests in flight per connection (1)\n");
+}
@@ -0,0 +1,129 @@
+/**********************************************************************
+ * gen_consume.c -- Example consumer of the shared memory key ring
+ *                  (gen_pair_pseudo -n COUNT --shm=PATH).
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- gen_consume PATH [--check] [--print]
+ *
+ *           Takes keys off the ring until the producer is done and
+ *           reports the rate.  The numbers are read where they lie,
+ *           through read only mpz_t views.  --check verifies
+ *           n = p * q and e * d = 1 mod (p - 1)(q - 1) for every key,
+ *           --print writes 'index bits e n p q d' in hexadecimal as
+ *           bulk mode would.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <gmp.h>
+
+#include "gen_shm.h"
+
+
+     /******** #defines and typedefs  ********/
+#define ATTACH_WAIT_MS   (30000)     /* for the producer to start      */
+
+
+     /******** functions in this file ********/
+static int  fnConsume_check (const SHM_KEY *pKey, mpz_t mpzT, mpz_t mpzPhi);
+
+
+
+/*************** main -- entry point **********************/
+int main (int argc, char *argv[])
+{
+  SHM_RING         *pRing;
+  SHM_HEADER       *pHdr;
+  SHM_KEY          *pKey;
+  mpz_t             mpzView, mpzT, mpzPhi;
+  struct timespec   tsStart, tsEnd;
+  double            dSecs;
+  long              nKeys = 0, nBad = 0;
+  int               i, flCheck = 0, flPrint = 0;
+
+
+  if (argc < 2) {
+    fprintf (stderr, "Usage: %s PATH [--check] [--print]\n", argv[0]);
+    return 1;
+  }
+  for (i = 2; i < argc; i++) {
+    if (strcmp (argv[i], "--check") == 0)
+      flCheck = 1;
+    else if (strcmp (argv[i], "--print") == 0)
+      flPrint = 1;
+  }
+
+  if ((pRing = fnShm_attach (argv[1], ATTACH_WAIT_MS)) == NULL)
+    return 1;
+  pHdr = fnShm_header (pRing);
+  mpz_inits (mpzT, mpzPhi, NULL);
+
+  /* 1. Take keys until the producer closes the ring */
+  clock_gettime (CLOCK_MONOTONIC, &tsStart);
+  while ((pKey = fnShm_next (pRing)) != NULL) {
+    if (flCheck && fnConsume_check (pKey, mpzT, mpzPhi) != 0) {
+      fprintf (stderr, "   ### key %lu fails the check\n", \
+               (unsigned long) pKey->nIndex);
+      nBad++;
+    }
+    if (flPrint) {
+      printf ("%lu %u", (unsigned long) pKey->nIndex, pKey->nBitLen);
+      for (i = 0; i < SHM_NUMS; i++)
+        gmp_printf (" %Zx", fnShm_key_num (mpzView, pKey, (SHM_NUM) i));
+      printf ("\n");
+    }
+    fnShm_release (pRing, pKey);
+    nKeys++;
+  }
+  clock_gettime (CLOCK_MONOTONIC, &tsEnd);
+  dSecs = (tsEnd.tv_sec - tsStart.tv_sec) + \
+          (tsEnd.tv_nsec - tsStart.tv_nsec) / 1e9;
+
+  /* 2. Report */
+  fprintf (stderr, "\n  --> Consumed %ld keys of %u bits in %.3f s <--\n", \
+           nKeys, pHdr->nBitLen, dSecs);
+  fprintf (stderr, "      consumer slept %lu times, producers %lu times\n", \
+           (unsigned long) pHdr->nEmptyWaits, (unsigned long) pHdr->nFullWaits);
+  if (flCheck)
+    fprintf (stderr, "      %ld bad keys\n", nBad);
+
+  mpz_clears (mpzT, mpzPhi, NULL);
+  fnShm_close (pRing);
+
+  return nBad != 0;
+}
+
+
+
+/************************************************************************
+ * fnConsume_check -- n = p q and e d = 1 mod phi.  Returns 0 if so.
+ ***********************************************************************/
+static int fnConsume_check (const SHM_KEY *pKey, mpz_t mpzT, mpz_t mpzPhi)
+{
+  mpz_t        vE, vN, vP, vQ, vD;
+  mpz_srcptr   pE, pN, pP, pQ, pD;
+
+
+  pE = fnShm_key_num (vE, pKey, SHM_E);
+  pN = fnShm_key_num (vN, pKey, SHM_N);
+  pP = fnShm_key_num (vP, pKey, SHM_P);
+  pQ = fnShm_key_num (vQ, pKey, SHM_Q);
+  pD = fnShm_key_num (vD, pKey, SHM_D);
+
+  mpz_mul (mpzT, pP, pQ);
+  if (mpz_cmp (mpzT, pN) != 0)
+    return -1;
+
+  mpz_sub (mpzPhi, mpzT, pP);              /* (p - 1)(q - 1) = n - p - q + 1 */
+  mpz_sub (mpzPhi, mpzPhi, pQ);
+  mpz_add_ui (mpzPhi, mpzPhi, 1);
+  mpz_mul (mpzT, pE, pD);
+  mpz_mod (mpzT, mpzT, mpzPhi);
+
+  return mpz_cmp_ui (mpzT, 1) == 0 ? 0 : -1;
+}
@@ -0,0 +1,966 @@
+/**********************************************************************
+ * gen_daemon.c -- Key generation daemon on a Unix domain socket.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- One thread runs an epoll loop over the listening socket,
+ *           the client connections and an eventfd; the worker pool
+ *           (gen_pool.c) does all of the prime searching.  Workers
+ *           put finished jobs on a list and poke the eventfd, so the
+ *           loop thread is the only one that touches connections and
+ *           the prime pools.
+ *
+ *           For every prime size in use a pool of primes made with
+ *           e = 65537 is kept topped up by low priority refill jobs.
+ *           A prime request is answered from the pool at once.  A
+ *           keypair request with a fixed e that the pooled primes
+ *           allow takes the two newest primes off the pool, and a
+ *           high priority job computes d and the PCT, so the loop
+ *           only sends the answer.  Anything else becomes a high
+ *           priority job, which a free worker takes before any
+ *           refill.  When the pool is dry, DF_BATCH requests and
+ *           requests beyond nMaxPending queued jobs get DST_BUSY.
+ *
+ *           Refill jobs never take every worker when there are two
+ *           or more, so an interactive job waits for at most one
+ *           prime search to finish.
+ *
+ *           Each job carries a CANCEL_TOKEN (gen_cancel.h).  An
+ *           interactive job has the nDeadlineMs deadline and is
+ *           cancelled when its connection closes; one that gives up
+ *           is answered DST_FAILED.  Refill jobs are cancelled at
+ *           shutdown so the workers can be joined at once.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+#include "gen_arena.h"
+#include "gen_memprof.h"
+#include "gen_encode.h"
+#include "gen_bulk.h"
+#include "gen_pool.h"
+#include "gen_cancel.h"
+#include "gen_pct.h"
+#include "gen_dedup.h"
+#include "gen_daemon.h"
+
+
+     /******** #defines and typedefs  ********/
+#define DAEMON_MAX_CONN      (256)
+#define DAEMON_IN_BUF        (64 * sizeof (DAEMON_REQ))
+#define DAEMON_TAG_LISTEN    (DAEMON_MAX_CONN)
+#define DAEMON_TAG_EVENT     (DAEMON_MAX_CONN + 1)
+#define DAEMON_POOL_E        (65537)     /* e the pooled primes allow  */
+
+typedef enum {
+  JOB_KEYPAIR = 0,                    /* interactive, answered        */
+  JOB_PRIME,                          /* interactive, answered        */
+  JOB_POOLED,                         /* keypair of two pooled primes */
+  JOB_REFILL                          /* background, into a pool      */
+} JOB_KIND;
+
+typedef struct {
+  int        nBits;                   /* prime length                 */
+  int        nCount;                  /* primes ready                 */
+  int        nRefilling;              /* refill jobs out              */
+  mpz_t     *aPrimes;                 /* nPoolSize, preallocated      */
+} PRIME_POOL;
+
+typedef struct {
+  int             fd;                 /* -1 when the slot is free     */
+  unsigned        nGen;               /* bumped when the slot is reused */
+  unsigned char   achIn[DAEMON_IN_BUF];
+  size_t          nIn;
+  char           *pchOut;             /* answers not yet sent         */
+  size_t          nOutLen, nOutOff, nOutCap;
+  int             flWantOut;          /* EPOLLOUT is registered       */
+  int             flClose;            /* close once pchOut is sent    */
+} DCONN;
+
+typedef struct DAEMON_RUN  DAEMON_RUN;
+
+typedef struct DJOB {
+  struct DJOB   *pNext;               /* finished list                */
+  struct DJOB   *pOutPrev, *pOutNext; /* jobs out, loop thread only   */
+  CANCEL_TOKEN   tok;
+  int            nStatus;             /* KEYGEN_STATUS                */
+  DAEMON_RUN    *pRun;
+  JOB_KIND       nKind;
+  int            nConn;
+  unsigned       nGen;
+  DAEMON_REQ     req;
+  long           nSeq;                /* seed index                   */
+  PRIME_POOL    *pPool;               /* JOB_REFILL, JOB_POOLED       */
+  mpz_t          mpzPrime;            /* JOB_REFILL result, or p      */
+  mpz_t          mpzPrime2;           /* JOB_POOLED q                 */
+  char          *pchResp;             /* answer, header and payload   */
+  size_t         nRespLen;
+} DJOB;
+
+struct DAEMON_RUN {
+  const DAEMON_OPTS  *pOpts;
+  POOL               *pWorkers;
+  int                 fdListen, fdEpoll, fdEvent;
+  DCONN               aConns[DAEMON_MAX_CONN];
+  PRIME_POOL          aPools[DAEMON_MAX_SIZES];
+  int                 nPools;
+  long                nSeq;           /* next job's seed index        */
+  int                 nPending;       /* interactive jobs out         */
+  int                 nRefillJobs;    /* refill jobs out              */
+  int                 nMaxRefill;
+  long                nServed, nFromPool, nBusy, nBad, nRefills;
+  long                nFailed;        /* jobs that gave up            */
+  DJOB               *pOut;           /* every job on the workers     */
+  pthread_mutex_t     mtx;            /* guards pDone                 */
+  DJOB               *pDone;
+};
+
+
+     /******** globals in this file   ********/
+static volatile sig_atomic_t  flDaemonStop = 0;
+
+
+     /******** functions in this file ********/
+static void         fnDaemon_on_signal (int nSig);
+static int          fnDaemon_listen (const char *pszPath);
+static void         fnDaemon_accept (DAEMON_RUN *pRun);
+static void         fnDaemon_read (DAEMON_RUN *pRun, int nConn);
+static void         fnDaemon_request (DAEMON_RUN *pRun, int nConn, \
+                    const DAEMON_REQ *pReq);
+static void         fnDaemon_send (DAEMON_RUN *pRun, int nConn, \
+                    const char *pchBuf, size_t nLen);
+static void         fnDaemon_flush (DAEMON_RUN *pRun, int nConn);
+static void         fnDaemon_close (DAEMON_RUN *pRun, int nConn);
+static void         fnDaemon_status (DAEMON_RUN *pRun, int nConn, \
+                    const DAEMON_REQ *pReq, int nStatus);
+static PRIME_POOL  *fnDaemon_pool (DAEMON_RUN *pRun, int nBits);
+static void         fnDaemon_refill (DAEMON_RUN *pRun);
+static int          fnDaemon_from_pool (DAEMON_RUN *pRun, int nConn, \
+                    const DAEMON_REQ *pReq, PRIME_POOL *pPool);
+static void         fnDaemon_submit (DAEMON_RUN *pRun, JOB_KIND nKind, \
+                    int nConn, const DAEMON_REQ *pReq, PRIME_POOL *pPool);
+static void         fnDaemon_job (void *pArg);
+static void         fnDaemon_finished (DAEMON_RUN *pRun);
+static char        *fnDaemon_pack (const DAEMON_REQ *pReq, int nCount, \
+                    mpz_ptr *apVals, size_t *pnLen);
+
+
+
+/************************************************************************
+ * fnDaemon_run -- Serve pOpts->pszPath until SIGINT or SIGTERM.
+ *                 Returns 0 after a clean shutdown.
+ ***********************************************************************/
+int fnDaemon_run (const DAEMON_OPTS *pOpts)
+{
+  DAEMON_RUN          *pRun;
+  DJOB                *pJob;
+  struct epoll_event   ev, aEvents[64];
+  struct sigaction     sa;
+  int                  i, n, nTag;
+
+
+  pRun = (DAEMON_RUN *) calloc (1, sizeof (DAEMON_RUN));
+  pRun->pOpts = pOpts;
+  pthread_mutex_init (&pRun->mtx, NULL);
+  for (i = 0; i < DAEMON_MAX_CONN; i++)
+    pRun->aConns[i].fd = -1;
+
+  /* 1. Stop cleanly on SIGINT / SIGTERM, never die of SIGPIPE */
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_handler = fnDaemon_on_signal;
+  sigaction (SIGINT, &sa, NULL);
+  sigaction (SIGTERM, &sa, NULL);
+  signal (SIGPIPE, SIG_IGN);
+
+  /* 2. Socket, eventfd and the epoll set */
+  pRun->fdListen = fnDaemon_listen (pOpts->pszPath);
+  if (pRun->fdListen < 0) {
+    free (pRun);
+    return 1;
+  }
+  pRun->fdEvent = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  pRun->fdEpoll = epoll_create1 (EPOLL_CLOEXEC);
+
+  ev.events   = EPOLLIN;
+  ev.data.u32 = DAEMON_TAG_LISTEN;
+  epoll_ctl (pRun->fdEpoll, EPOLL_CTL_ADD, pRun->fdListen, &ev);
+  ev.data.u32 = DAEMON_TAG_EVENT;
+  epoll_ctl (pRun->fdEpoll, EPOLL_CTL_ADD, pRun->fdEvent, &ev);
+
+  /* 3. Workers, and the pools asked for on the command line */
+  pRun->pWorkers   = fnPool_create (pOpts->nThreads, fnWorker_init, \
+                                    fnWorker_exit);
+  pRun->nMaxRefill = pOpts->nThreads > 1 ? pOpts->nThreads - 1 : 1;
+  for (i = 0; i < pOpts->nPoolBits; i++)
+    fnDaemon_pool (pRun, pOpts->anPoolBits[i] / 2);
+  fnDaemon_refill (pRun);
+
+  fprintf (stderr, "%s: serving %s with %d thread%s\n", program_name, \
+           pOpts->pszPath, pOpts->nThreads, pOpts->nThreads == 1 ? "" : "s");
+
+  /* 4. Event loop */
+  while (!flDaemonStop) {
+    n = epoll_wait (pRun->fdEpoll, aEvents, 64, -1);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror ("epoll_wait");
+      break;
+    }
+
+    for (i = 0; i < n; i++) {
+      nTag = (int) aEvents[i].data.u32;
+      if (nTag == DAEMON_TAG_LISTEN)
+        fnDaemon_accept (pRun);
+      else if (nTag == DAEMON_TAG_EVENT)
+        fnDaemon_finished (pRun);
+      else if (pRun->aConns[nTag].fd >= 0) {
+        if (aEvents[i].events & (EPOLLERR | EPOLLHUP))
+          fnDaemon_close (pRun, nTag);
+        else {
+          if (aEvents[i].events & EPOLLOUT)
+            fnDaemon_flush (pRun, nTag);
+          if (pRun->aConns[nTag].fd >= 0 && (aEvents[i].events & EPOLLIN))
+            fnDaemon_read (pRun, nTag);
+        }
+      }
+    }
+  }
+
+  /* 5. Shut down: no new work, cancel what the workers have */
+  fprintf (stderr, "\n  --> Daemon: %ld answered, %ld from the pool, " \
+           "%ld busy, %ld bad, %ld failed, %ld refills <--\n", \
+           pRun->nServed, pRun->nFromPool, pRun->nBusy, pRun->nBad, \
+           pRun->nFailed, pRun->nRefills);
+  close (pRun->fdListen);
+  unlink (pOpts->pszPath);
+  for (i = 0; i < DAEMON_MAX_CONN; i++)
+    if (pRun->aConns[i].fd >= 0)
+      fnDaemon_close (pRun, i);
+  for (pJob = pRun->pOut; pJob != NULL; pJob = pJob->pOutNext)
+    fnCancel_request (&pJob->tok);
+
+  fnPool_destroy (pRun->pWorkers);
+  fnDaemon_finished (pRun);
+  for (i = 0; i < pRun->nPools; i++) {
+    for (n = 0; n < pOpts->nPoolSize; n++)
+      mpz_clear (pRun->aPools[i].aPrimes[n]);
+    free (pRun->aPools[i].aPrimes);
+  }
+
+  close (pRun->fdEvent);
+  close (pRun->fdEpoll);
+  pthread_mutex_destroy (&pRun->mtx);
+  free (pRun);
+
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnDaemon_on_signal -- SIGINT / SIGTERM, epoll_wait returns EINTR.
+ ***********************************************************************/
+static void fnDaemon_on_signal (int nSig)
+{
+  (void) nSig;
+  flDaemonStop = 1;
+}
+
+
+
+/************************************************************************
+ * fnDaemon_listen -- Bind and listen on pszPath.  A stale socket
+ *                    left by an earlier run is removed first.
+ ***********************************************************************/
+static int fnDaemon_listen (const char *pszPath)
+{
+  struct sockaddr_un  sun;
+  struct stat         st;
+  int                 fd;
+
+
+  if (strlen (pszPath) >= sizeof (sun.sun_path)) {
+    fprintf (stderr, "%s: socket path too long\n", program_name);
+    return -1;
+  }
+  if (stat (pszPath, &st) == 0 && S_ISSOCK (st.st_mode))
+    unlink (pszPath);
+
+  memset (&sun, 0, sizeof (sun));
+  sun.sun_family = AF_UNIX;
+  strcpy (sun.sun_path, pszPath);
+
+  fd = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0 || bind (fd, (struct sockaddr *) &sun, sizeof (sun)) != 0 ||
+      listen (fd, 128) != 0) {
+    perror (pszPath);
+    if (fd >= 0)
+      close (fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+
+
+/************************************************************************
+ * fnDaemon_accept -- Take every waiting connection.
+ ***********************************************************************/
+static void fnDaemon_accept (DAEMON_RUN *pRun)
+{
+  struct epoll_event  ev;
+  int                 fd, i;
+
+
+  while ((fd = accept4 (pRun->fdListen, NULL, NULL, \
+                        SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    for (i = 0; i < DAEMON_MAX_CONN && pRun->aConns[i].fd >= 0; i++)
+      ;
+    if (i == DAEMON_MAX_CONN) {
+      close (fd);                          /* no room, refuse */
+      continue;
+    }
+
+    pRun->aConns[i].fd  = fd;
+    pRun->aConns[i].nIn = 0;
+    ev.events   = EPOLLIN;
+    ev.data.u32 = i;
+    epoll_ctl (pRun->fdEpoll, EPOLL_CTL_ADD, fd, &ev);
+  }
+}
+
+
+
+/************************************************************************
+ * fnDaemon_read -- Read what the client sent and act on every whole
+ *                  request in it.
+ ***********************************************************************/
+static void fnDaemon_read (DAEMON_RUN *pRun, int nConn)
+{
+  DCONN       *pC = &pRun->aConns[nConn];
+  DAEMON_REQ   req;
+  ssize_t      n;
+  size_t       nOff;
+
+
+  while (pC->fd >= 0 && !pC->flClose) {
+    n = read (pC->fd, pC->achIn + pC->nIn, sizeof (pC->achIn) - pC->nIn);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+      fnDaemon_close (pRun, nConn);        /* client went away */
+      return;
+    }
+    if (n < 0)
+      return;
+    pC->nIn += n;
+
+    for (nOff = 0; nOff + sizeof (req) <= pC->nIn && !pC->flClose; \
+         nOff += sizeof (req)) {
+      memcpy (&req, pC->achIn + nOff, sizeof (req));
+      fnDaemon_request (pRun, nConn, &req);
+      if (pC->fd < 0)
+        return;
+    }
+    memmove (pC->achIn, pC->achIn + nOff, pC->nIn - nOff);
+    pC->nIn -= nOff;
+  }
+}
+
+
+
+/************************************************************************
+ * fnDaemon_request -- Answer one request now, or queue a job for it.
+ ***********************************************************************/
+static void fnDaemon_request (DAEMON_RUN *pRun, int nConn, \
+            const DAEMON_REQ *pReq)
+{
+  PRIME_POOL  *pPool;
+  DAEMON_RESP  resp;
+  E_POLICY     ePolicy;
+  char         achText[512];
+  int          nPrimeBits, i, nLen;
+  BOOL         flValid;
+
+
+  /* 1. Garbage on the stream, answer and hang up */
+  if (pReq->nMagic != DAEMON_MAGIC) {
+    pRun->nBad++;
+    fnDaemon_status (pRun, nConn, pReq, DST_BAD_REQUEST);
+    pRun->aConns[nConn].flClose = 1;
+    fnDaemon_flush (pRun, nConn);
+    return;
+  }
+
+  /* 2. Stats are a line of text */
+  if (pReq->nOp == DOP_STATS) {
+    nLen = sprintf (achText, "answered %ld pool %ld busy %ld bad %ld " \
+                    "failed %ld refills %ld pending %d", pRun->nServed, \
+                    pRun->nFromPool, pRun->nBusy, pRun->nBad, \
+                    pRun->nFailed, pRun->nRefills, pRun->nPending);
+    for (i = 0; i < pRun->nPools; i++)
+      nLen += sprintf (achText + nLen, " p%d:%d", pRun->aPools[i].nBits, \
+                       pRun->aPools[i].nCount);
+    memset (&resp, 0, sizeof (resp));
+    resp.nMagic = DAEMON_MAGIC;
+    resp.nOp    = DOP_STATS;
+    resp.nId    = pReq->nId;
+    resp.nLen   = nLen;
+    fnDaemon_send (pRun, nConn, (char *) &resp, sizeof (resp));
+    fnDaemon_send (pRun, nConn, achText, nLen);
+    return;
+  }
+
+  /* 3. Check the sizes and e */
+  nPrimeBits = pReq->nOp == DOP_KEYPAIR ? (int) pReq->nBits / 2 : \
+                                          (int) pReq->nBits;
+  flValid = (pReq->nOp == DOP_KEYPAIR || pReq->nOp == DOP_PRIME) &&
+            nPrimeBits >= DAEMON_MIN_BITS / 2 &&
+            nPrimeBits <= DAEMON_MAX_BITS / 2 &&
+            (pReq->nOp == DOP_PRIME || pReq->nBits % 2 == 0);
+  if (pReq->nOp == DOP_KEYPAIR) {
+    ePolicy.nKind = pReq->nEKind;
+    ePolicy.nValE = pReq->nValE;
+    flValid = flValid && fnValid_e_policy (&ePolicy);
+  }
+  if (!flValid) {
+    pRun->nBad++;
+    fnDaemon_status (pRun, nConn, pReq, DST_BAD_REQUEST);
+    return;
+  }
+
+  /* 4. From the pool if it can be done, else a job unless we */
+  /*    are backed up                                          */
+  pPool = fnDaemon_pool (pRun, nPrimeBits);
+  if (pPool != NULL && fnDaemon_from_pool (pRun, nConn, pReq, pPool) == 0)
+    pRun->nFromPool++;
+  else if ((pReq->nFlags & DF_BATCH) ||
+           pRun->nPending >= pRun->pOpts->nMaxPending) {
+    pRun->nBusy++;
+    fnDaemon_status (pRun, nConn, pReq, DST_BUSY);
+  }
+  else
+    fnDaemon_submit (pRun, pReq->nOp == DOP_KEYPAIR ? JOB_KEYPAIR : \
+                     JOB_PRIME, nConn, pReq, NULL);
+
+  fnDaemon_refill (pRun);
+}
+
+
+
+/************************************************************************
+ * fnDaemon_from_pool -- Answer from pooled primes.  Returns -1 when
+ *                       the pool cannot serve this request.
+ *
+ * Remark - Pooled primes p have gcd (p - 1, 65537) = 1.  Another
+ *          fixed e is checked against both primes, a random e always
+ *          needs a job.  The |p - q| bound of FIPS 186-3 B.3.3 step
+ *          5.4 is checked as fnCreate_pseudo_prime does.  Two primes
+ *          too close together are dropped, else every later keypair
+ *          of this size would fail on them too; primes the e does not
+ *          allow stay for the next request.  d and the PCT are left
+ *          to a JOB_POOLED.
+ ***********************************************************************/
+static int fnDaemon_from_pool (DAEMON_RUN *pRun, int nConn, \
+           const DAEMON_REQ *pReq, PRIME_POOL *pPool)
+{
+  mpz_t     mpzT;
+  mpz_ptr   apVals[1];
+  mpz_ptr   pP, pQ;
+  char     *pchResp;
+  size_t    nLen;
+  int       nRet = 0;
+
+
+  /* 1. A prime is just handed out */
+  if (pReq->nOp == DOP_PRIME) {
+    if (pPool->nCount < 1)
+      return -1;
+    apVals[0] = pPool->aPrimes[--pPool->nCount];
+    pchResp = fnDaemon_pack (pReq, 1, apVals, &nLen);
+    fnDaemon_send (pRun, nConn, pchResp, nLen);
+    free (pchResp);
+    pRun->nServed++;
+    return 0;
+  }
+
+  if (pPool->nCount < 2 || pReq->nEKind != E_POLICY_FIXED)
+    return -1;
+
+  /* 2. A keypair takes the two newest primes, if e allows them */
+  pP = pPool->aPrimes[pPool->nCount - 1];
+  pQ = pPool->aPrimes[pPool->nCount - 2];
+  mpz_init (mpzT);
+
+  if (pReq->nValE != DAEMON_POOL_E) {
+    mpz_sub_ui (mpzT, pP, 1);
+    if (mpz_gcd_ui (NULL, mpzT, pReq->nValE) != 1)
+      nRet = -1;
+    mpz_sub_ui (mpzT, pQ, 1);
+    if (mpz_gcd_ui (NULL, mpzT, pReq->nValE) != 1)
+      nRet = -1;
+  }
+
+  /* 3. Too close together, no e will do, drop them */
+  mpz_sub (mpzT, pP, pQ);
+  mpz_abs (mpzT, mpzT);
+  if (nRet == 0 && mpz_sizeinbase (mpzT, 2) <= \
+      (size_t) (pPool->nBits > 100 ? pPool->nBits - 100 : 0)) {
+    pPool->nCount -= 2;
+    nRet = -1;
+  }
+  mpz_clear (mpzT);
+
+  /* 4. d and the PCT on a worker */
+  if (nRet == 0)
+    fnDaemon_submit (pRun, JOB_POOLED, nConn, pReq, pPool);
+
+  return nRet;
+}
+
+
+
+/************************************************************************
+ * fnDaemon_pool -- The pool of nBits primes, made on first use.
+ *                  NULL when DAEMON_MAX_SIZES pools exist already.
+ ***********************************************************************/
+static PRIME_POOL *fnDaemon_pool (DAEMON_RUN *pRun, int nBits)
+{
+  PRIME_POOL  *pPool;
+  int          i;
+
+
+  for (i = 0; i < pRun->nPools; i++)
+    if (pRun->aPools[i].nBits == nBits)
+      return &pRun->aPools[i];
+  if (pRun->nPools == DAEMON_MAX_SIZES || pRun->pOpts->nPoolSize <= 0)
+    return NULL;
+
+  /* Room for every prime up front, so that filling a slot never */
+  /* allocates                                                   */
+  pPool = &pRun->aPools[pRun->nPools++];
+  pPool->nBits   = nBits;
+  pPool->aPrimes = (mpz_t *) malloc (pRun->pOpts->nPoolSize * sizeof (mpz_t));
+  for (i = 0; i < pRun->pOpts->nPoolSize; i++)
+    mpz_init2 (pPool->aPrimes[i], nBits + GMP_NUMB_BITS);
+
+  return pPool;
+}
+
+
+
+/************************************************************************
+ * fnDaemon_refill -- Queue refill jobs for pools below their target,
+ *                    up to nMaxRefill in all.
+ ***********************************************************************/
+static void fnDaemon_refill (DAEMON_RUN *pRun)
+{
+  PRIME_POOL  *pPool;
+  int          i, flMore = 1;
+
+
+  /* Round robin, one job per pool per pass */
+  while (flMore && pRun->nRefillJobs < pRun->nMaxRefill) {
+    flMore = 0;
+    for (i = 0; i < pRun->nPools && pRun->nRefillJobs < pRun->nMaxRefill; \
+         i++) {
+      pPool = &pRun->aPools[i];
+      if (pPool->nCount + pPool->nRefilling < pRun->pOpts->nPoolSize) {
+        fnDaemon_submit (pRun, JOB_REFILL, -1, NULL, pPool);
+        flMore = 1;
+      }
+    }
+  }
+}
+
+
+
+/************************************************************************
+ * fnDaemon_submit -- Queue one job on the workers.
+ ***********************************************************************/
+static void fnDaemon_submit (DAEMON_RUN *pRun, JOB_KIND nKind, int nConn, \
+            const DAEMON_REQ *pReq, PRIME_POOL *pPool)
+{
+  DJOB  *pJob;
+
+
+  pJob = (DJOB *) calloc (1, sizeof (DJOB));
+  pJob->pRun  = pRun;
+  pJob->nKind = nKind;
+  pJob->nSeq  = pRun->nSeq++;
+  pJob->nConn = nConn;
+  pJob->pOutNext = pRun->pOut;
+  if (pRun->pOut != NULL)
+    pRun->pOut->pOutPrev = pJob;
+  pRun->pOut = pJob;
+
+  if (nKind == JOB_REFILL) {
+    pJob->pPool = pPool;
+    fnCancel_init (&pJob->tok, 0);
+    mpz_init2 (pJob->mpzPrime, pPool->nBits + GMP_NUMB_BITS);
+    pPool->nRefilling++;
+    pRun->nRefillJobs++;
+    fnPool_submit_prio (pRun->pWorkers, POOL_PRIO_LOW, fnDaemon_job, pJob);
+  }
+  else {
+    pJob->nGen = pRun->aConns[nConn].nGen;
+    pJob->req  = *pReq;
+    fnCancel_init (&pJob->tok, pRun->pOpts->nDeadlineMs);
+    pRun->nPending++;
+    if (nKind == JOB_POOLED) {             /* the two newest primes */
+      pJob->pPool = pPool;
+      mpz_init2 (pJob->mpzPrime, pPool->nBits + GMP_NUMB_BITS);
+      mpz_init2 (pJob->mpzPrime2, pPool->nBits + GMP_NUMB_BITS);
+      mpz_swap (pJob->mpzPrime, pPool->aPrimes[--pPool->nCount]);
+      mpz_swap (pJob->mpzPrime2, pPool->aPrimes[--pPool->nCount]);
+    }
+    fnPool_submit_prio (pRun->pWorkers, POOL_PRIO_HIGH, fnDaemon_job, pJob);
+  }
+}
+
+
+
+/************************************************************************
+ * fnDaemon_job -- Pool task, runs on a worker.
+ ***********************************************************************/
+static void fnDaemon_job (void *pArg)
+{
+  DJOB        *pJob = (DJOB *) pArg;
+  DAEMON_RUN  *pRun = pJob->pRun;
+  mpz_t        mpzP1, mpzP2, mpzE, mpzD, mpzN;
+  mpz_ptr      apVals[5];
+  E_POLICY     ePolicy;
+  uint64_t     nOne = 1;
+
+
+  fnArena_begin ();
+  fnBulk_seed_key (pRun->pOpts->nSeed, pJob->nSeq);
+  fnCancel_use (&pJob->tok);
+  mpz_inits (mpzP1, mpzP2, mpzE, mpzD, mpzN, NULL);
+
+  /* 1. The same steps as main, or one prime of them */
+  if (pJob->nKind == JOB_KEYPAIR) {
+    ePolicy.nKind = pJob->req.nEKind;
+    ePolicy.nValE = pJob->req.nValE;
+    fnMemprof_phase (MEM_PHASE_E);
+    fnMake_exponent_e (mpzE, &ePolicy);
+    pJob->nStatus = fnGenerate_keypair (mpzP1, mpzP2, mpzD, mpzE, \
+                                        pJob->req.nBits);
+
+    fnMemprof_phase (MEM_PHASE_OUTPUT);
+    if (pJob->nStatus == KEYGEN_OK) {
+      mpz_mul (mpzN, mpzP1, mpzP2);
+      apVals[0] = mpzE;
+      apVals[1] = mpzN;
+      apVals[2] = mpzP1;
+      apVals[3] = mpzP2;
+      apVals[4] = mpzD;
+      pJob->pchResp = fnDaemon_pack (&pJob->req, 5, apVals, \
+                                     &pJob->nRespLen);
+    }
+  }
+
+  /*    d of two pooled primes, checked as fnGenerate_keypair does */
+  else if (pJob->nKind == JOB_POOLED) {
+    mpz_set_ui (mpzE, pJob->req.nValE);
+    fnMemprof_phase (MEM_PHASE_D);
+    fnCompute_exponent_d (pJob->mpzPrime, mpzE, pJob->mpzPrime2, mpzD, \
+                          pJob->pPool->nBits);
+    pJob->nStatus = fnPct_enabled () ? fnPct_check (mpzE, pJob->mpzPrime, \
+                                       pJob->mpzPrime2, mpzD) : KEYGEN_OK;
+
+    fnMemprof_phase (MEM_PHASE_OUTPUT);
+    if (pJob->nStatus == KEYGEN_OK) {
+      mpz_mul (mpzN, pJob->mpzPrime, pJob->mpzPrime2);
+      apVals[0] = mpzE;
+      apVals[1] = mpzN;
+      apVals[2] = pJob->mpzPrime;
+      apVals[3] = pJob->mpzPrime2;
+      apVals[4] = mpzD;
+      pJob->pchResp = fnDaemon_pack (&pJob->req, 5, apVals, \
+                                     &pJob->nRespLen);
+    }
+  }
+  else {
+    mpz_set_ui (mpzE, DAEMON_POOL_E);
+    fnMemprof_phase (MEM_PHASE_P);
+    pJob->nStatus = fnDedup_find (fnCreate_pseudo_prime, mpzP1, mpzE, \
+                    mpzP2, pJob->nKind == JOB_REFILL ? pJob->pPool->nBits : \
+                    (int) pJob->req.nBits, NUMTESTS, 0);
+
+    fnMemprof_phase (MEM_PHASE_OUTPUT);
+    if (pJob->nStatus != KEYGEN_OK)
+      ;                                    /* nothing to hand back */
+    else if (pJob->nKind == JOB_REFILL)
+      mpz_set (pJob->mpzPrime, mpzP1);     /* preallocated, no arena */
+    else {
+      apVals[0] = mpzP1;
+      pJob->pchResp = fnDaemon_pack (&pJob->req, 1, apVals, &pJob->nRespLen);
+    }
+  }
+
+  mpz_clears (mpzP1, mpzP2, mpzE, mpzD, mpzN, NULL);
+  fnArena_end ();
+  fnCancel_use (NULL);
+  fnMemprof_key_done ();
+
+  /* 2. Hand it back to the loop thread */
+  pthread_mutex_lock (&pRun->mtx);
+  pJob->pNext = pRun->pDone;
+  pRun->pDone = pJob;
+  pthread_mutex_unlock (&pRun->mtx);
+  if (write (pRun->fdEvent, &nOne, sizeof (nOne)) != sizeof (nOne))
+    return;                             /* counter full, loop is awake */
+}
+
+
+
+/************************************************************************
+ * fnDaemon_finished -- Loop thread: deliver finished jobs, put
+ *                      refilled primes in their pools.
+ ***********************************************************************/
+static void fnDaemon_finished (DAEMON_RUN *pRun)
+{
+  DJOB      *pJob, *pNext;
+  DCONN     *pC;
+  uint64_t   nCount;
+
+
+  /* The counter only wakes the loop, the list says what is done */
+  if (read (pRun->fdEvent, &nCount, sizeof (nCount)) < 0 && errno != EAGAIN)
+    perror ("eventfd");
+
+  pthread_mutex_lock (&pRun->mtx);
+  pJob = pRun->pDone;
+  pRun->pDone = NULL;
+  pthread_mutex_unlock (&pRun->mtx);
+
+  for (; pJob != NULL; pJob = pNext) {
+    pNext = pJob->pNext;
+
+    if (pJob->pOutPrev != NULL)
+      pJob->pOutPrev->pOutNext = pJob->pOutNext;
+    else
+      pRun->pOut = pJob->pOutNext;
+    if (pJob->pOutNext != NULL)
+      pJob->pOutNext->pOutPrev = pJob->pOutPrev;
+    if (pJob->nKind == JOB_POOLED) {
+      mpz_clears (pJob->mpzPrime, pJob->mpzPrime2, NULL);
+      pC = &pRun->aConns[pJob->nConn];
+
+      /*    The primes failed the PCT and are gone, search anew */
+      if (pJob->nStatus == KEYGEN_PCT_FAILED && !flDaemonStop &&
+               pC->fd >= 0 && pC->nGen == pJob->nGen) {
+        pRun->nPending--;
+        fnDaemon_submit (pRun, JOB_KEYPAIR, pJob->nConn, &pJob->req, NULL);
+        free (pJob);
+        continue;
+      }
+    }
+    if (pJob->nStatus != KEYGEN_OK)
+      pRun->nFailed++;
+
+    if (pJob->nKind == JOB_REFILL) {
+      pJob->pPool->nRefilling--;
+      pRun->nRefillJobs--;
+      if (pJob->nStatus == KEYGEN_OK) {
+        pRun->nRefills++;
+        if (pJob->pPool->nCount < pRun->pOpts->nPoolSize)
+          mpz_swap (pJob->pPool->aPrimes[pJob->pPool->nCount++], \
+                    pJob->mpzPrime);
+      }
+      mpz_clear (pJob->mpzPrime);
+    }
+    else {
+      pRun->nPending--;
+      pC = &pRun->aConns[pJob->nConn];
+      if (pC->fd >= 0 && pC->nGen == pJob->nGen) {
+        if (pJob->nStatus == KEYGEN_OK)
+          fnDaemon_send (pRun, pJob->nConn, pJob->pchResp, pJob->nRespLen);
+        else
+          fnDaemon_status (pRun, pJob->nConn, &pJob->req, DST_FAILED);
+        pRun->nServed++;
+      }
+      free (pJob->pchResp);
+    }
+    free (pJob);
+  }
+
+  if (!flDaemonStop)
+    fnDaemon_refill (pRun);
+}
+
+
+
+/************************************************************************
+ * fnDaemon_pack -- Answer with nCount numbers.  Returns a malloc'd
+ *                  buffer of *pnLen bytes.
+ ***********************************************************************/
+static char *fnDaemon_pack (const DAEMON_REQ *pReq, int nCount, \
+             mpz_ptr *apVals, size_t *pnLen)
+{
+  DAEMON_RESP   resp;
+  char         *pchBuf, *p;
+  size_t        nMax = sizeof (resp);
+  uint32_t      nBytes;
+  int           i;
+
+
+  for (i = 0; i < nCount; i++)
+    nMax += sizeof (uint32_t) + (mpz_size (apVals[i]) + 1) * sizeof (mp_limb_t);
+  pchBuf = (char *) malloc (nMax);
+
+  p = pchBuf + sizeof (resp);
+  for (i = 0; i < nCount; i++) {
+    nBytes = (uint32_t) fnEncode_bytes_be ((unsigned char *) p + \
+                                           sizeof (uint32_t), apVals[i]);
+    memcpy (p, &nBytes, sizeof (nBytes));
+    p += sizeof (uint32_t) + nBytes;
+  }
+
+  memset (&resp, 0, sizeof (resp));
+  resp.nMagic  = DAEMON_MAGIC;
+  resp.nStatus = DST_OK;
+  resp.nOp     = pReq->nOp;
+  resp.nCount  = (uint8_t) nCount;
+  resp.nId     = pReq->nId;
+  resp.nLen    = (uint32_t) (p - pchBuf - sizeof (resp));
+  memcpy (pchBuf, &resp, sizeof (resp));
+
+  *pnLen = (size_t) (p - pchBuf);
+  return pchBuf;
+}
+
+
+
+/************************************************************************
+ * fnDaemon_status -- Answer with a status and no payload.
+ ***********************************************************************/
+static void fnDaemon_status (DAEMON_RUN *pRun, int nConn, \
+            const DAEMON_REQ *pReq, int nStatus)
+{
+  DAEMON_RESP  resp;
+
+
+  memset (&resp, 0, sizeof (resp));
+  resp.nMagic  = DAEMON_MAGIC;
+  resp.nStatus = (uint8_t) nStatus;
+  resp.nOp     = pReq->nOp;
+  resp.nId     = pReq->nId;
+  fnDaemon_send (pRun, nConn, (char *) &resp, sizeof (resp));
+}
+
+
+
+/************************************************************************
+ * fnDaemon_send -- Queue bytes for a connection and try to send them.
+ ***********************************************************************/
+static void fnDaemon_send (DAEMON_RUN *pRun, int nConn, \
+            const char *pchBuf, size_t nLen)
+{
+  DCONN  *pC = &pRun->aConns[nConn];
+
+
+  if (pC->nOutLen + nLen > pC->nOutCap) {
+    pC->nOutCap = 2 * (pC->nOutLen + nLen);
+    pC->pchOut  = (char *) realloc (pC->pchOut, pC->nOutCap);
+  }
+  memcpy (pC->pchOut + pC->nOutLen, pchBuf, nLen);
+  pC->nOutLen += nLen;
+
+  if (!pC->flWantOut)
+    fnDaemon_flush (pRun, nConn);
+}
+
+
+
+/************************************************************************
+ * fnDaemon_flush -- Send what is queued; wait for EPOLLOUT if the
+ *                   socket is full.
+ ***********************************************************************/
+static void fnDaemon_flush (DAEMON_RUN *pRun, int nConn)
+{
+  DCONN               *pC = &pRun->aConns[nConn];
+  struct epoll_event   ev;
+  ssize_t              n;
+  int                  flWant;
+
+
+  while (pC->nOutOff < pC->nOutLen) {
+    n = send (pC->fd, pC->pchOut + pC->nOutOff, pC->nOutLen - pC->nOutOff, \
+              MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && errno == EAGAIN)
+      break;
+    if (n <= 0) {
+      fnDaemon_close (pRun, nConn);
+      return;
+    }
+    pC->nOutOff += n;
+  }
+
+  if (pC->nOutOff == pC->nOutLen) {
+    pC->nOutOff = pC->nOutLen = 0;
+    if (pC->flClose) {
+      fnDaemon_close (pRun, nConn);
+      return;
+    }
+  }
+
+  flWant = pC->nOutLen > 0;
+  if (flWant != pC->flWantOut) {
+    ev.events   = EPOLLIN | (flWant ? EPOLLOUT : 0);
+    ev.data.u32 = nConn;
+    epoll_ctl (pRun->fdEpoll, EPOLL_CTL_MOD, pC->fd, &ev);
+    pC->flWantOut = flWant;
+  }
+}
+
+
+
+/************************************************************************
+ * fnDaemon_close -- Drop a connection.  Jobs still out for it are
+ *                   cancelled, and thrown away when they finish
+ *                   (nGen changes).
+ ***********************************************************************/
+static void fnDaemon_close (DAEMON_RUN *pRun, int nConn)
+{
+  DCONN  *pC = &pRun->aConns[nConn];
+  DJOB   *pJob;
+
+
+  for (pJob = pRun->pOut; pJob != NULL; pJob = pJob->pOutNext)
+    if (pJob->nKind != JOB_REFILL && pJob->nConn == nConn && \
+        pJob->nGen == pC->nGen)
+      fnCancel_request (&pJob->tok);
+
+  epoll_ctl (pRun->fdEpoll, EPOLL_CTL_DEL, pC->fd, NULL);
+  close (pC->fd);
+  free (pC->pchOut);
+
+  pC->fd      = -1;
+  pC->nGen++;
+  pC->nIn     = 0;
+  pC->pchOut  = NULL;
+  pC->nOutLen = pC->nOutOff = pC->nOutCap = 0;
+  pC->flWantOut = pC->flClose = 0;
+}
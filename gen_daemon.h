@@ -0,0 +1,87 @@
+/**********************************************************************
+ * gen_daemon.h -- Key generation daemon on a Unix domain socket, and
+ *                 its binary protocol (shared with gen_client.c).
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- A client sends fixed size DAEMON_REQ records and gets one
+ *           DAEMON_RESP header back for each, followed by nLen bytes
+ *           of payload: nCount numbers, each a 32 bit byte count and
+ *           the big-endian bytes of the number.  Integers in the
+ *           headers are in host byte order, the socket is local.
+ *
+ *           A keypair answer holds e, n, p, q, d; a prime answer one
+ *           prime; a stats answer one line of text (nCount 0).
+ *           Answers on one connection may come in any order, match
+ *           them by nId.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_DAEMON_H
+#define GEN_DAEMON_H
+
+#include <stdint.h>
+
+
+     /******** #defines and typedefs  ********/
+#define DAEMON_MAGIC         (0x31445047u)  /* "GPD1"                  */
+#define DAEMON_MAX_BITS      (16384)        /* largest nlen served     */
+#define DAEMON_MIN_BITS      (128)
+#define DAEMON_POOL_DEFAULT  (16)           /* primes kept per size    */
+#define DAEMON_MAX_SIZES     (8)            /* sizes with a pool       */
+
+typedef enum {
+  DOP_KEYPAIR = 1,                    /* nBits is nlen                */
+  DOP_PRIME,                          /* nBits is the prime's length  */
+  DOP_STATS
+} DAEMON_OP;
+
+typedef enum {
+  DST_OK = 0,
+  DST_BUSY,                           /* try again later              */
+  DST_BAD_REQUEST,
+  DST_FAILED                          /* deadline passed or no prime  */
+} DAEMON_STATUS;
+
+#define DF_BATCH             (0x01)   /* background client: answer   */
+                                      /* BUSY rather than queue when */
+                                      /* the pool is dry             */
+
+typedef struct {
+  uint32_t  nMagic;
+  uint8_t   nOp;                      /* DAEMON_OP                    */
+  uint8_t   nFlags;                   /* DF_ flags                    */
+  uint8_t   nEKind;                   /* E_KIND (gen_pair_pseudo.h)   */
+  uint8_t   nPad;
+  uint32_t  nId;                      /* echoed in the answer         */
+  uint32_t  nBits;
+  uint32_t  nValE;                    /* E_POLICY_FIXED only          */
+} DAEMON_REQ;
+
+typedef struct {
+  uint32_t  nMagic;
+  uint8_t   nStatus;                  /* DAEMON_STATUS                */
+  uint8_t   nOp;
+  uint8_t   nCount;                   /* numbers in the payload       */
+  uint8_t   nPad;
+  uint32_t  nId;
+  uint32_t  nLen;                     /* payload bytes                */
+} DAEMON_RESP;
+
+typedef struct {
+  const char     *pszPath;            /* socket to listen on          */
+  unsigned long   nSeed;              /* job k uses S + k * 2^{64}    */
+  int             nThreads;           /* key generation threads       */
+  int             nPoolSize;          /* primes kept per size         */
+  int             nMaxPending;        /* queued interactive jobs      */
+  long            nDeadlineMs;        /* per interactive job, 0 none  */
+  int             anPoolBits[DAEMON_MAX_SIZES];  /* nlen to fill first */
+  int             nPoolBits;
+} DAEMON_OPTS;
+
+
+     /******** functions in gen_daemon.c ********/
+int  fnDaemon_run (const DAEMON_OPTS *pOpts);
+
+#endif
@@ -0,0 +1,213 @@
+/**********************************************************************
+ * gen_decimal.c -- Decimal text of big numbers with a cached table
+ *                  of powers of ten.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- Divide and conquer: a number below 10^{19 * 2^{i+1}} is
+ *           split by 10^{19 * 2^i} into a high and a low half of
+ *           19 * 2^i digits each, down to pieces of a few limbs
+ *           which mpn_get_str converts directly.  Low halves are
+ *           padded with zeros, the leading part is not.
+ *
+ *           The tables and the scratch values must outlive a key,
+ *           so they are made outside of any arena scope.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <gmp.h>
+
+#include "gen_arena.h"
+#include "gen_decimal.h"
+
+
+     /******** globals in this file   ********/
+static DEC_TABLE        *pTables = NULL;    /* cache, one per bit length */
+static pthread_mutex_t   mtxTables = PTHREAD_MUTEX_INITIALIZER;
+
+
+     /******** functions in this file ********/
+static char  *fnDecimal_leaf (char *p, mpz_t mpzX, size_t nWidth);
+static char  *fnDecimal_rec (char *p, mpz_t mpzX, int nLevel, int flPad, \
+              const DEC_TABLE *pTab, DEC_SCRATCH *pS);
+
+
+
+/************************************************************************
+ * fnDecimal_table -- Table for numbers below 2^nBits, built on first
+ *                    use and kept for the rest of the run.
+ *
+ * Remark - A cached table for a larger bit length is good enough.
+ ***********************************************************************/
+const DEC_TABLE *fnDecimal_table (int nBits)
+{
+  DEC_TABLE  *pTab;
+  int         i, nDepth;
+
+
+  pthread_mutex_lock (&mtxTables);
+
+  /* 1. Already there? */
+  for (pTab = pTables; pTab != NULL; pTab = pTab->pNext)
+    if (pTab->nBits >= nBits)
+      break;
+
+  /* 2. Square until the top power exceeds 2^nBits */
+  if (pTab == NULL) {
+    nDepth = fnArena_leave ();
+    pTab = (DEC_TABLE *) calloc (1, sizeof (DEC_TABLE));
+    pTab->nBits = nBits;
+    mpz_init (pTab->apow[0]);
+    mpz_ui_pow_ui (pTab->apow[0], 10, DEC_LEAF_DIGITS);
+    for (i = 1; i < DEC_MAX_LEVELS &&
+                mpz_sizeinbase (pTab->apow[i - 1], 2) <= (size_t) nBits; i++) {
+      mpz_init (pTab->apow[i]);
+      mpz_mul (pTab->apow[i], pTab->apow[i - 1], pTab->apow[i - 1]);
+    }
+    pTab->nLevels = i;
+    pTab->pNext   = pTables;
+    pTables       = pTab;
+    fnArena_reenter (nDepth);
+  }
+
+  pthread_mutex_unlock (&mtxTables);
+  return pTab;
+}
+
+
+
+/************************************************************************
+ * fnDecimal_scratch_init -- Quotient and remainder space for every
+ *                           level of pTab, allocated once.
+ ***********************************************************************/
+void fnDecimal_scratch_init (DEC_SCRATCH *pS, const DEC_TABLE *pTab)
+{
+  int  i, nDepth;
+
+
+  nDepth = fnArena_leave ();
+  pS->nLevels = pTab->nLevels;
+  for (i = 0; i < pS->nLevels; i++) {
+    mpz_init2 (pS->aq[i], mpz_sizeinbase (pTab->apow[i], 2) + GMP_LIMB_BITS);
+    mpz_init2 (pS->ar[i], mpz_sizeinbase (pTab->apow[i], 2) + GMP_LIMB_BITS);
+  }
+  fnArena_reenter (nDepth);
+}
+
+
+
+/************************************************************************
+ * fnDecimal_scratch_clear -- Release the scratch values.
+ ***********************************************************************/
+void fnDecimal_scratch_clear (DEC_SCRATCH *pS)
+{
+  int  i;
+
+
+  for (i = 0; i < pS->nLevels; i++)
+    mpz_clears (pS->aq[i], pS->ar[i], NULL);
+  pS->nLevels = 0;
+}
+
+
+
+/************************************************************************
+ * fnDecimal_format -- Decimal digits of mpzX into pchDst, which holds
+ *                     DEC_TEXT_LEN (pTab->nBits) bytes.  Returns the
+ *                     length; no terminator is written.
+ *
+ * Remark - mpzX must be below 2^pTab->nBits.  A minus sign is
+ *          written for negative numbers.
+ ***********************************************************************/
+size_t fnDecimal_format (char *pchDst, mpz_t mpzX, const DEC_TABLE *pTab, \
+       DEC_SCRATCH *pS)
+{
+  char  *p = pchDst;
+  int    nSign = mpz_sgn (mpzX);
+
+
+  if (nSign == 0) {
+    *p = '0';
+    return 1;
+  }
+
+  /* 1. Work on |x|, the top level leaves room for any such value */
+  if (nSign < 0) {
+    *p++ = '-';
+    mpz_neg (mpzX, mpzX);
+  }
+  p = fnDecimal_rec (p, mpzX, pTab->nLevels - 2, 0, pTab, pS);
+  if (nSign < 0)
+    mpz_neg (mpzX, mpzX);
+
+  return (size_t) (p - pchDst);
+}
+
+
+
+/************************************************************************
+ * fnDecimal_rec -- Digits of mpzX < 10^{19 * 2^{nLevel+1}}, exactly
+ *                  that many when flPad is set.
+ ***********************************************************************/
+static char *fnDecimal_rec (char *p, mpz_t mpzX, int nLevel, int flPad, \
+       const DEC_TABLE *pTab, DEC_SCRATCH *pS)
+{
+  /* 1. Small enough for the base case */
+  if (nLevel < DEC_LEAF_LEVEL)
+    return fnDecimal_leaf (p, mpzX, \
+                           flPad ? (size_t) DEC_LEAF_DIGITS << (nLevel + 1) : 0);
+
+  /* 2. The leading part skips the levels it does not reach */
+  if (!flPad && mpz_cmp (mpzX, pTab->apow[nLevel]) < 0)
+    return fnDecimal_rec (p, mpzX, nLevel - 1, 0, pTab, pS);
+
+  /* 3. Split into high and low halves */
+  mpz_tdiv_qr (pS->aq[nLevel], pS->ar[nLevel], mpzX, pTab->apow[nLevel]);
+  p = fnDecimal_rec (p, pS->aq[nLevel], nLevel - 1, flPad, pTab, pS);
+  p = fnDecimal_rec (p, pS->ar[nLevel], nLevel - 1, 1, pTab, pS);
+
+  return p;
+}
+
+
+
+/************************************************************************
+ * fnDecimal_leaf -- Base case: digits of a value of a few limbs,
+ *                   zero padded to nWidth (0 means no padding).
+ *
+ * Remark - mpn_get_str converts a copy of the limbs straight into
+ *          digit values; below DEC_LEAF_LEVEL that beats splitting.
+ ***********************************************************************/
+static char *fnDecimal_leaf (char *p, mpz_t mpzX, size_t nWidth)
+{
+  mp_limb_t       aLimbs[DEC_LEAF_LIMBS + 1];
+  unsigned char   achDig[DEC_LEAF_LIMBS * GMP_LIMB_BITS / 3 + 2];
+  size_t          nLimbs = mpz_size (mpzX);
+  size_t          n, i;
+
+
+  /* 1. Zero has no limbs */
+  if (nLimbs == 0) {
+    n = 0;
+  }
+  else {
+    memcpy (aLimbs, mpz_limbs_read (mpzX), nLimbs * sizeof (mp_limb_t));
+    n = mpn_get_str (achDig, 10, aLimbs, (mp_size_t) nLimbs);
+  }
+
+  /* 2. Leading zeros for a low half, a lone 0 for the value zero */
+  for (i = n; i < nWidth; i++)
+    *p++ = '0';
+  if (n == 0 && nWidth == 0)
+    *p++ = '0';
+
+  for (i = 0; i < n; i++)
+    *p++ = (char) ('0' + achDig[i]);
+
+  return p;
+}
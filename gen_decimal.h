@@ -0,0 +1,53 @@
+/**********************************************************************
+ * gen_decimal.h -- Decimal text of big numbers with a cached table
+ *                  of powers of ten.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- mpz_get_str rebuilds its table of powers of the base on
+ *           every call.  Here the table 10^{19 * 2^i} is built once
+ *           per bit length and shared by all threads and keys of a
+ *           run; only the quotient / remainder scratch is per thread.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_DECIMAL_H
+#define GEN_DECIMAL_H
+
+#include <stddef.h>
+#include <gmp.h>
+
+
+     /******** #defines and typedefs  ********/
+#define DEC_LEAF_DIGITS   (19)        /* 10^19 < 2^64, one word        */
+#define DEC_MAX_LEVELS    (24)        /* enough for 2^{10^8} and more  */
+#define DEC_LEAF_LEVEL    (3)               /* split no further below this   */
+#define DEC_LEAF_LIMBS    ((DEC_LEAF_DIGITS << DEC_LEAF_LEVEL) / 19 + 2)
+
+                          /* room for the digits of an nBits number */
+#define DEC_TEXT_LEN(nBits)   ((size_t) (nBits) * 30103 / 100000 + 2)
+
+typedef struct DEC_TABLE {
+  int                nBits;           /* numbers below 2^nBits          */
+  int                nLevels;         /* entries used in apow           */
+  mpz_t              apow[DEC_MAX_LEVELS];   /* 10^{19 * 2^i}           */
+  struct DEC_TABLE  *pNext;           /* cache list                     */
+} DEC_TABLE;
+
+typedef struct {
+  int    nLevels;                     /* levels initialized             */
+  mpz_t  aq[DEC_MAX_LEVELS];          /* quotient at each level         */
+  mpz_t  ar[DEC_MAX_LEVELS];          /* remainder at each level        */
+} DEC_SCRATCH;
+
+
+     /******** functions in gen_decimal.c ********/
+const DEC_TABLE  *fnDecimal_table (int nBits);
+void              fnDecimal_scratch_init (DEC_SCRATCH *pS, \
+                  const DEC_TABLE *pTab);
+void              fnDecimal_scratch_clear (DEC_SCRATCH *pS);
+size_t            fnDecimal_format (char *pchDst, mpz_t mpzX, \
+                  const DEC_TABLE *pTab, DEC_SCRATCH *pS);
+
+#endif
@@ -0,0 +1,379 @@
+/**********************************************************************
+ * gen_dedup.c -- Persistent index of every prime handed out, so that
+ *                no run hands out the same prime twice.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- The fingerprint is a 64 bit mix of the prime's limbs; its
+ *           low bits pick the block, a second mix gives the nK bit
+ *           positions, nine bits each.  Adding a prime is the lookup:
+ *           the prime was there already if every one of its bits was
+ *           set, otherwise the words that lack one get an atomic OR.
+ *
+ *           For n primes at a rate p a plain Bloom filter needs
+ *           -n ln p / (ln 2)^2 bits and ln 2 times bits per prime
+ *           probes.  Blocking keeps the probes in one cache line but
+ *           fills the blocks unevenly, which 20% more bits make up;
+ *           the block count is then rounded up to a power of two.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+#include "gen_cancel.h"
+#include "gen_dedup.h"
+
+
+     /******** #defines and typedefs  ********/
+#define DEDUP_WORDS   (DEDUP_BLOCK_BITS / 64)   /* words per block    */
+#define DEDUP_SLACK   (1.2)                     /* for the blocking   */
+
+typedef struct {                      /* one mapped index file        */
+  DEDUP_HEADER  *pHdr;
+  uint64_t      *pnWords;             /* the blocks, after pHdr       */
+  size_t         nMapLen;
+} DEDUP_MAP;
+
+
+     /******** globals in this file   ********/
+static DEDUP_MAP  dmIndex;                  /* open before any worker */
+static BOOL       flDedup;
+static long       nDedupAdded, nDedupSeen;
+static long long  nDedupNs;                 /* time in fnDedup_add   */
+
+
+     /******** functions in this file ********/
+static int       fnDedup_map (DEDUP_MAP *pMap, const char *pszPath, \
+                 BOOL flWrite, long nCapacity, double dFpRate);
+static uint64_t  fnDedup_mix (uint64_t z);
+
+
+
+/************************************************************************
+ * fnDedup_open -- Map the index at pszPath, made for nCapacity primes
+ *                 at a false positive rate dFpRate if it does not
+ *                 exist yet.  Returns 0, or -1 with a message.
+ *
+ * Remark - An existing file keeps the geometry it was made with.
+ ***********************************************************************/
+int fnDedup_open (const char *pszPath, long nCapacity, double dFpRate)
+{
+  if (fnDedup_map (&dmIndex, pszPath, 1, nCapacity, dFpRate) != 0)
+    return -1;
+  flDedup = 1;
+
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnDedup_close -- Unmap the index.  The bits are already in the
+ *                  file's pages, nothing is written here.
+ ***********************************************************************/
+void fnDedup_close (void)
+{
+  if (!flDedup)
+    return;
+  flDedup = 0;
+  munmap (dmIndex.pHdr, dmIndex.nMapLen);
+  memset (&dmIndex, 0, sizeof (dmIndex));
+}
+
+
+
+/************************************************************************
+ * fnDedup_enabled -- Is an index open?
+ ***********************************************************************/
+BOOL fnDedup_enabled (void)
+{
+  return flDedup;
+}
+
+
+
+/************************************************************************
+ * fnDedup_add -- Add mpzPrime to the index.  Returns 1 if it was
+ *                there already (or a false positive says so), 0 if it
+ *                is new or no index is open.
+ ***********************************************************************/
+BOOL fnDedup_add (mpz_t mpzPrime)
+{
+  const mp_limb_t  *pLimbs;
+  uint64_t         *pnBlock, nH, nOld, anMask[DEDUP_WORDS];
+  long long         nStart;
+  size_t            i, nSize;
+  unsigned          nBit, k;
+  BOOL              flNew = 0;
+
+
+  if (!flDedup)
+    return 0;
+  nStart = fnCancel_now_ns ();
+
+  /* 1. The fingerprint, and its block */
+  pLimbs = mpz_limbs_read (mpzPrime);
+  nSize  = mpz_size (mpzPrime);
+  nH = 0x9e3779b97f4a7c15ULL ^ nSize;
+  for (i = 0; i < nSize; i++)
+    nH = fnDedup_mix (nH ^ (uint64_t) pLimbs[i]);
+  pnBlock = dmIndex.pnWords + (nH & (dmIndex.pHdr->nBlocks - 1)) * DEDUP_WORDS;
+
+  /* 2. nK bits of the block, nine bits of the second mix for each, */
+  /*    gathered per word; only a word that lacks one is written     */
+  memset (anMask, 0, sizeof (anMask));
+  nH = fnDedup_mix (nH);
+  for (k = 0; k < dmIndex.pHdr->nK; k++) {
+    if (k > 0 && k % 7 == 0)
+      nH = fnDedup_mix (nH);
+    nBit = (unsigned) (nH & (DEDUP_BLOCK_BITS - 1));
+    nH >>= 9;
+    anMask[nBit >> 6] |= 1ULL << (nBit & 63);
+  }
+  for (k = 0; k < DEDUP_WORDS; k++) {
+    nOld = __atomic_load_n (&pnBlock[k], __ATOMIC_RELAXED);
+    if ((nOld & anMask[k]) != anMask[k]) {
+      __atomic_fetch_or (&pnBlock[k], anMask[k], __ATOMIC_RELAXED);
+      flNew = 1;
+    }
+  }
+
+  if (flNew) {
+    __atomic_fetch_add (&dmIndex.pHdr->nPrimes, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add (&nDedupAdded, 1, __ATOMIC_RELAXED);
+  }
+  else
+    __atomic_fetch_add (&nDedupSeen, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add (&nDedupNs, fnCancel_now_ns () - nStart, \
+                      __ATOMIC_RELAXED);
+
+  return !flNew;
+}
+
+
+
+/************************************************************************
+ * fnDedup_primes -- Primes added to the index by every run so far.
+ *                   More primes seen than that are false positives.
+ ***********************************************************************/
+long fnDedup_primes (void)
+{
+  return flDedup ? (long) __atomic_load_n (&dmIndex.pHdr->nPrimes, \
+                                           __ATOMIC_RELAXED) : 0;
+}
+
+
+
+/************************************************************************
+ * fnDedup_find -- pfnFind, again as long as the prime it found is in
+ *                 the index.  Returns KEYGEN_STATUS, KEYGEN_EXHAUSTED
+ *                 after DEDUP_TRIES primes that were all seen.
+ *
+ * Remark - Without an index this is one call of pfnFind.
+ ***********************************************************************/
+int fnDedup_find (PRIME_ENGINE_FN pfnFind, mpz_t mpzPrime, mpz_t mpzE, \
+    mpz_t mpzCompare, int nNumBits, int nNumTests, BOOL flTestDiff)
+{
+  int  nStatus, nTry;
+
+
+  nStatus = pfnFind (mpzPrime, mpzE, mpzCompare, nNumBits, nNumTests, \
+                     flTestDiff);
+  for (nTry = 1; nStatus == KEYGEN_OK && fnDedup_add (mpzPrime); nTry++)
+    nStatus = nTry >= DEDUP_TRIES ? KEYGEN_EXHAUSTED : \
+              pfnFind (mpzPrime, mpzE, mpzCompare, nNumBits, nNumTests, \
+                       flTestDiff);
+
+  return nStatus;
+}
+
+
+
+/************************************************************************
+ * fnDedup_merge -- OR the blocks of the index at pszSrc into the one
+ *                  at pszDst.  Returns 0, or -1 with a message.
+ *
+ * Remark - Both must have the same geometry.  Other runs may be
+ *          adding to pszDst meanwhile.  The prime count of the
+ *          result counts a prime both shards saw twice.
+ ***********************************************************************/
+int fnDedup_merge (const char *pszDst, const char *pszSrc)
+{
+  DEDUP_MAP  dmDst, dmSrc;
+  uint64_t   i, nWords;
+  int        nRet = 0;
+
+
+  /* 1. Both files, which must exist */
+  if (fnDedup_map (&dmDst, pszDst, 1, 0, 0.0) != 0)
+    return -1;
+  if (fnDedup_map (&dmSrc, pszSrc, 0, 0, 0.0) != 0) {
+    munmap (dmDst.pHdr, dmDst.nMapLen);
+    return -1;
+  }
+
+  /* 2. The same blocks and bits per prime, then the OR */
+  if (dmDst.pHdr->nBlocks != dmSrc.pHdr->nBlocks || \
+      dmDst.pHdr->nK != dmSrc.pHdr->nK) {
+    fprintf (stderr, "   ### %s and %s differ in size, cannot merge\n", \
+             pszDst, pszSrc);
+    nRet = -1;
+  }
+  else {
+    nWords = dmDst.pHdr->nBlocks * DEDUP_WORDS;
+    for (i = 0; i < nWords; i++)
+      if (dmSrc.pnWords[i] != 0)
+        __atomic_fetch_or (&dmDst.pnWords[i], dmSrc.pnWords[i], \
+                           __ATOMIC_RELAXED);
+    __atomic_fetch_add (&dmDst.pHdr->nPrimes, dmSrc.pHdr->nPrimes, \
+                        __ATOMIC_RELAXED);
+    fprintf (stderr, "  --> %s merged into %s, %lu primes <--\n", pszSrc, \
+             pszDst, (unsigned long) dmDst.pHdr->nPrimes);
+  }
+
+  munmap (dmDst.pHdr, dmDst.nMapLen);
+  munmap (dmSrc.pHdr, dmSrc.nMapLen);
+
+  return nRet;
+}
+
+
+
+/************************************************************************
+ * fnDedup_report -- What this run added and dropped, and the false
+ *                   positive rate of the index as it stands.
+ *
+ * Remark - The rate is the mean over the blocks of (bits set / block
+ *          bits)^nK, which reads the whole file once.
+ ***********************************************************************/
+void fnDedup_report (FILE *fp)
+{
+  DEDUP_HEADER  *pHdr = dmIndex.pHdr;
+  uint64_t       b;
+  double         dRate = 0.0;
+  long           nLookups = nDedupAdded + nDedupSeen;
+  int            i, nSet;
+
+
+  if (!flDedup)
+    return;
+  for (b = 0; b < pHdr->nBlocks; b++) {
+    for (i = 0, nSet = 0; i < DEDUP_WORDS; i++)
+      nSet += __builtin_popcountll (dmIndex.pnWords[b * DEDUP_WORDS + i]);
+    dRate += pow ((double) nSet / DEDUP_BLOCK_BITS, pHdr->nK);
+  }
+  dRate /= pHdr->nBlocks;
+
+  fprintf (fp, "      prime index: %ld added, %ld dropped as seen, " \
+           "%.0f ns per lookup\n", nDedupAdded, nDedupSeen, \
+           nLookups > 0 ? (double) nDedupNs / nLookups : 0.0);
+  fprintf (fp, "      %lu primes of %lu in the index, false positive " \
+           "rate %.2g\n", (unsigned long) pHdr->nPrimes, \
+           (unsigned long) pHdr->nCapacity, dRate);
+}
+
+
+
+/************************************************************************
+ * fnDedup_map -- Map an index file, made for nCapacity primes at
+ *                dFpRate if it is empty or new and nCapacity > 0.
+ *                Returns 0, or -1 with a message.
+ ***********************************************************************/
+static int fnDedup_map (DEDUP_MAP *pMap, const char *pszPath, \
+    BOOL flWrite, long nCapacity, double dFpRate)
+{
+  DEDUP_HEADER   *pHdr;
+  struct stat     st;
+  double          dBits;
+  uint64_t        nBlocks = 1;
+  unsigned        nK;
+  int             fd;
+
+
+  memset (pMap, 0, sizeof (*pMap));
+  fd = open (pszPath, flWrite ? O_RDWR | (nCapacity > 0 ? O_CREAT : 0) : \
+             O_RDONLY, 0644);
+  if (fd < 0 || fstat (fd, &st) != 0) {
+    perror (pszPath);
+    if (fd >= 0)
+      close (fd);
+    return -1;
+  }
+
+  /* 1. A new file: the geometry for nCapacity primes at dFpRate */
+  if (st.st_size == 0 && flWrite && nCapacity > 0) {
+    if (dFpRate <= 0.0 || dFpRate >= 1.0)
+      dFpRate = DEDUP_FP_DEFAULT;
+    dBits = -nCapacity * log (dFpRate) / (M_LN2 * M_LN2);
+    nK = (unsigned) (dBits / nCapacity * M_LN2 + 0.5);
+    nK = nK < 1 ? 1 : nK > DEDUP_K_MAX ? DEDUP_K_MAX : nK;
+    while (nBlocks * DEDUP_BLOCK_BITS < dBits * DEDUP_SLACK)
+      nBlocks *= 2;
+    st.st_size = (off_t) ((nBlocks + 1) * (DEDUP_BLOCK_BITS / 8));
+    if (ftruncate (fd, st.st_size) != 0) {
+      perror ("ftruncate");
+      close (fd);
+      return -1;
+    }
+  }
+  else
+    nK = 0;
+
+  /* 2. The mapping, shared with every other run */
+  pMap->nMapLen = (size_t) st.st_size;
+  pHdr = (DEDUP_HEADER *) (st.st_size < (off_t) sizeof (DEDUP_HEADER) ? \
+         MAP_FAILED : mmap (NULL, pMap->nMapLen, PROT_READ | \
+         (flWrite ? PROT_WRITE : 0), MAP_SHARED, fd, 0));
+  close (fd);
+  if (pHdr == MAP_FAILED) {
+    fprintf (stderr, "   ### %s is not a prime index\n", pszPath);
+    return -1;
+  }
+  if (nK != 0) {
+    pHdr->nVersion  = DEDUP_VERSION;
+    pHdr->nK        = nK;
+    pHdr->nLimbBits = GMP_NUMB_BITS;
+    pHdr->nBlocks   = nBlocks;
+    pHdr->nCapacity = (uint64_t) nCapacity;
+    pHdr->dFpRate   = dFpRate;
+    __atomic_store_n (&pHdr->nMagic, DEDUP_MAGIC, __ATOMIC_RELEASE);
+  }
+
+  /* 3. Ours, and whole */
+  if (pHdr->nMagic != DEDUP_MAGIC || pHdr->nVersion != DEDUP_VERSION || \
+      pHdr->nLimbBits != GMP_NUMB_BITS || pHdr->nK < 1 || \
+      pHdr->nK > DEDUP_K_MAX || pHdr->nBlocks == 0 || \
+      (pHdr->nBlocks & (pHdr->nBlocks - 1)) != 0 || \
+      pMap->nMapLen != (pHdr->nBlocks + 1) * (DEDUP_BLOCK_BITS / 8)) {
+    fprintf (stderr, "   ### %s is not a prime index of this build\n", \
+             pszPath);
+    munmap (pHdr, pMap->nMapLen);
+    return -1;
+  }
+  pMap->pHdr    = pHdr;
+  pMap->pnWords = (uint64_t *) (pHdr + 1);
+
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnDedup_mix -- The splitmix64 finalizer.
+ ***********************************************************************/
+static uint64_t fnDedup_mix (uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
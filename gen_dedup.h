@@ -0,0 +1,80 @@
+/**********************************************************************
+ * gen_dedup.h -- Persistent index of every prime handed out, so that
+ *                no run hands out the same prime twice.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- The index is a blocked Bloom filter in a file that every
+ *           run maps shared: a DEDUP_HEADER, then nBlocks blocks of
+ *           one cache line.  A prime's fingerprint picks one block
+ *           and nK bits in it, so a lookup touches one line of the
+ *           file.  The bits are set with atomic ORs, any number of
+ *           threads and processes use one file at once.
+ *
+ *           With the index open, a prime that leaves the search
+ *           (fnDedup_find) is looked up and added in one step; if it
+ *           was there already it is dropped and the search runs
+ *           again.  A false positive costs one more search, never a
+ *           key.  The file is sized at creation for nCapacity primes
+ *           at a false positive rate dFpRate; beyond that the rate
+ *           rises, fnDedup_report prints the rate of the file as it
+ *           stands.
+ *
+ *           Filters made by shards with the same geometry are merged
+ *           with fnDedup_merge, the OR of their blocks.
+ *
+ *           A prime is in the index from the moment it is found, not
+ *           from the moment its key is safe on disk.  A bulk run
+ *           resumed from a checkpoint would make its lost keys again
+ *           and find their primes taken, so main refuses --dedup with
+ *           --checkpoint rather than give a resumed file that differs
+ *           from an uninterrupted one.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_DEDUP_H
+#define GEN_DEDUP_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+#include "gen_engine.h"
+
+
+     /******** #defines and typedefs  ********/
+#define DEDUP_MAGIC          (0x50554444u)  /* "DDUP"                   */
+#define DEDUP_VERSION        (1)
+#define DEDUP_BLOCK_BITS     (512)          /* one cache line           */
+#define DEDUP_K_MAX          (16)           /* bits per prime           */
+#define DEDUP_FP_DEFAULT     (1e-9)
+#define DEDUP_CAP_DEFAULT    (10000000L)    /* primes, 64 MB at 1e-9    */
+#define DEDUP_TRIES          (16)           /* searches for a new prime */
+
+typedef struct {
+  uint32_t  nMagic;
+  uint32_t  nVersion;
+  uint32_t  nK;                       /* bits set per prime           */
+  uint32_t  nLimbBits;                /* GMP_NUMB_BITS of the maker   */
+  uint64_t  nBlocks;                  /* a power of two               */
+  uint64_t  nCapacity;                /* primes it was sized for      */
+  double    dFpRate;                  /* at nCapacity                 */
+  uint64_t  nPrimes;                  /* added, all runs              */
+  uint64_t  anPad[2];                 /* header is one block          */
+} DEDUP_HEADER;
+
+
+     /******** functions in gen_dedup.c ********/
+int    fnDedup_open (const char *pszPath, long nCapacity, double dFpRate);
+void   fnDedup_close (void);
+BOOL   fnDedup_enabled (void);
+BOOL   fnDedup_add (mpz_t mpzPrime);
+long   fnDedup_primes (void);
+int    fnDedup_find (PRIME_ENGINE_FN pfnFind, mpz_t mpzPrime, mpz_t mpzE, \
+       mpz_t mpzCompare, int nNumBits, int nNumTests, BOOL flTestDiff);
+int    fnDedup_merge (const char *pszDst, const char *pszSrc);
+void   fnDedup_report (FILE *fp);
+
+#endif
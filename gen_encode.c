@@ -0,0 +1,280 @@
+/**********************************************************************
+ * gen_encode.c -- Hexadecimal and base64 text of big numbers.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- Hex uses SSE2, which every x86-64 processor has: the two
+ *           nibbles of 16 bytes are split, interleaved and turned
+ *           into digits with one compare.  Base64 follows W. Mula's
+ *           SSSE3 method (one pshufb to spread 12 bytes over 16,
+ *           two multiplies to move the 6 bit fields, one pshufb to
+ *           look up the alphabet offsets); it is chosen at run time.
+ *           The scalar loops handle tails and other processors.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <gmp.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#define HAVE_X86_SIMD
+#endif
+
+#include "gen_encode.h"
+
+
+     /******** globals in this file   ********/
+static const char  achHex[] = "0123456789abcdef";
+static const char  achB64[] = \
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char  achB64Url[] = \
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+
+     /******** functions in this file ********/
+#ifdef HAVE_X86_SIMD
+static size_t  fnEncode_base64_ssse3 (char *pchDst, \
+               const unsigned char *pchSrc, size_t nLen, int flUrl);
+#endif
+
+
+
+/************************************************************************
+ * fnEncode_parse_format -- OUT_FORMAT for a name, or -1.
+ ***********************************************************************/
+int fnEncode_parse_format (const char *pszName)
+{
+  if (strcmp (pszName, "hex") == 0)
+    return FMT_HEX;
+  if (strcmp (pszName, "base64") == 0)
+    return FMT_BASE64;
+  if (strcmp (pszName, "base64url") == 0)
+    return FMT_BASE64URL;
+  if (strcmp (pszName, "dec") == 0)
+    return FMT_DECIMAL;
+
+  return -1;
+}
+
+
+
+/************************************************************************
+ * fnEncode_bytes_be -- Magnitude of mpzX as big-endian bytes without
+ *                      leading zeros.  Returns the number of bytes.
+ *
+ * Remark - pchDst needs mpz_size (mpzX) * sizeof (mp_limb_t) bytes.
+ *          Zero gives a single 0 byte.
+ ***********************************************************************/
+size_t fnEncode_bytes_be (unsigned char *pchDst, mpz_t mpzX)
+{
+  const mp_limb_t  *pLimbs = mpz_limbs_read (mpzX);
+  size_t            nLimbs = mpz_size (mpzX);
+  unsigned char    *p = pchDst;
+  mp_limb_t         l;
+  int               k;
+
+
+  if (nLimbs == 0) {
+    *p = 0;
+    return 1;
+  }
+
+  /* 1. Top limb, skipping its leading zero bytes */
+  l = pLimbs[nLimbs - 1];
+  for (k = sizeof (mp_limb_t) - 1; k > 0 && (l >> (8 * k)) == 0; k--)
+    ;
+  for (; k >= 0; k--)
+    *p++ = (unsigned char) (l >> (8 * k));
+
+  /* 2. The rest, whole limbs, most significant first */
+  while (--nLimbs > 0) {
+    l = pLimbs[nLimbs - 1];
+#if GMP_LIMB_BITS == 64 && defined(__GNUC__)
+    l = __builtin_bswap64 (l);
+    memcpy (p, &l, 8);
+    p += 8;
+#else
+    for (k = sizeof (mp_limb_t) - 1; k >= 0; k--)
+      *p++ = (unsigned char) (l >> (8 * k));
+#endif
+  }
+
+  return (size_t) (p - pchDst);
+}
+
+
+
+/************************************************************************
+ * fnEncode_hex -- Two lower case hex digits per byte.  Returns the
+ *                 number of characters; no terminator is written.
+ ***********************************************************************/
+size_t fnEncode_hex (char *pchDst, const unsigned char *pchSrc, size_t nLen)
+{
+  size_t   i = 0;
+#ifdef HAVE_X86_SIMD
+  __m128i  mask  = _mm_set1_epi8 (0x0f);
+  __m128i  nine  = _mm_set1_epi8 (9);
+  __m128i  zero  = _mm_set1_epi8 ('0');
+  __m128i  alpha = _mm_set1_epi8 ('a' - '0' - 10);
+  __m128i  v, hi, lo, a, b;
+
+
+  /* 1. 16 bytes to 32 digits per round */
+  for (; i + 16 <= nLen; i += 16) {
+    v  = _mm_loadu_si128 ((const __m128i *) (pchSrc + i));
+    hi = _mm_and_si128 (_mm_srli_epi16 (v, 4), mask);
+    lo = _mm_and_si128 (v, mask);
+    a  = _mm_unpacklo_epi8 (hi, lo);
+    b  = _mm_unpackhi_epi8 (hi, lo);
+    a  = _mm_add_epi8 (a, _mm_add_epi8 (zero, \
+                       _mm_and_si128 (_mm_cmpgt_epi8 (a, nine), alpha)));
+    b  = _mm_add_epi8 (b, _mm_add_epi8 (zero, \
+                       _mm_and_si128 (_mm_cmpgt_epi8 (b, nine), alpha)));
+    _mm_storeu_si128 ((__m128i *) (pchDst + 2 * i), a);
+    _mm_storeu_si128 ((__m128i *) (pchDst + 2 * i + 16), b);
+  }
+#endif
+
+  /* 2. Tail */
+  for (; i < nLen; i++) {
+    pchDst[2 * i]     = achHex[pchSrc[i] >> 4];
+    pchDst[2 * i + 1] = achHex[pchSrc[i] & 15];
+  }
+
+  return 2 * nLen;
+}
+
+
+
+/************************************************************************
+ * fnEncode_base64 -- RFC 4648 base64 of nLen bytes.  flUrl selects
+ *                    the URL alphabet without padding.  Returns the
+ *                    number of characters; no terminator is written.
+ ***********************************************************************/
+size_t fnEncode_base64 (char *pchDst, const unsigned char *pchSrc, \
+       size_t nLen, int flUrl)
+{
+  const char  *pszAlpha = flUrl ? achB64Url : achB64;
+  char        *p = pchDst;
+  size_t       i = 0;
+  unsigned     w;
+
+
+#ifdef HAVE_X86_SIMD
+  /* 1. Whole 12 byte groups on processors with SSSE3 */
+  if (__builtin_cpu_supports ("ssse3")) {
+    i  = fnEncode_base64_ssse3 (p, pchSrc, nLen, flUrl);
+    p += i / 3 * 4;
+  }
+#endif
+
+  /* 2. Three bytes at a time */
+  for (; i + 3 <= nLen; i += 3) {
+    w = ((unsigned) pchSrc[i] << 16) | ((unsigned) pchSrc[i + 1] << 8) | \
+        pchSrc[i + 2];
+    *p++ = pszAlpha[(w >> 18) & 63];
+    *p++ = pszAlpha[(w >> 12) & 63];
+    *p++ = pszAlpha[(w >>  6) & 63];
+    *p++ = pszAlpha[w & 63];
+  }
+
+  /* 3. One or two bytes left */
+  if (i < nLen) {
+    w = (unsigned) pchSrc[i] << 16;
+    if (i + 1 < nLen)
+      w |= (unsigned) pchSrc[i + 1] << 8;
+    *p++ = pszAlpha[(w >> 18) & 63];
+    *p++ = pszAlpha[(w >> 12) & 63];
+    if (i + 1 < nLen)
+      *p++ = pszAlpha[(w >> 6) & 63];
+    else if (!flUrl)
+      *p++ = '=';
+    if (!flUrl)
+      *p++ = '=';
+  }
+
+  return (size_t) (p - pchDst);
+}
+
+
+
+/************************************************************************
+ * fnEncode_mpz -- Text of mpzX in nFormat.  Returns its length; no
+ *                 terminator is written.
+ *
+ * Remark - FMT_HEX gives exactly what mpz_get_str (..., 16, ...)
+ *          gives for a non negative number.  pchScratch needs
+ *          mpz_size (mpzX) * sizeof (mp_limb_t) bytes.  FMT_DECIMAL
+ *          is not handled here, it needs the tables of gen_decimal.c.
+ ***********************************************************************/
+size_t fnEncode_mpz (char *pchDst, unsigned char *pchScratch, mpz_t mpzX, \
+       int nFormat)
+{
+  size_t  nBytes, nLen;
+
+
+  nBytes = fnEncode_bytes_be (pchScratch, mpzX);
+
+  if (nFormat == FMT_BASE64 || nFormat == FMT_BASE64URL)
+    return fnEncode_base64 (pchDst, pchScratch, nBytes, \
+                            nFormat == FMT_BASE64URL);
+
+  /* 1. Hex, without the leading zero nibble */
+  nLen = fnEncode_hex (pchDst, pchScratch, nBytes);
+  if (nLen > 1 && pchDst[0] == '0') {
+    memmove (pchDst, pchDst + 1, nLen - 1);
+    nLen--;
+  }
+
+  return nLen;
+}
+
+
+
+#ifdef HAVE_X86_SIMD
+/************************************************************************
+ * fnEncode_base64_ssse3 -- Encode whole 12 byte groups while 16 bytes
+ *                          can be loaded.  Returns the bytes consumed.
+ ***********************************************************************/
+__attribute__ ((target ("ssse3")))
+static size_t fnEncode_base64_ssse3 (char *pchDst, \
+       const unsigned char *pchSrc, size_t nLen, int flUrl)
+{
+  __m128i  spread, shiftLut, v, t0, t1, t2, t3, idx, r, less;
+  size_t   i;
+
+
+  spread   = _mm_set_epi8 (10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+  shiftLut = _mm_setr_epi8 ('a' - 26, '0' - 52, '0' - 52, '0' - 52, \
+                            '0' - 52, '0' - 52, '0' - 52, '0' - 52, \
+                            '0' - 52, '0' - 52, '0' - 52, \
+                            (flUrl ? '-' : '+') - 62, \
+                            (flUrl ? '_' : '/') - 63, 'A', 0, 0);
+
+  for (i = 0; i + 16 <= nLen; i += 12, pchDst += 16) {
+    /* 1. Bytes a b c of each group to the lane b a c b */
+    v  = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (pchSrc + i)), \
+                           spread);
+
+    /* 2. Move the four 6 bit fields into separate bytes */
+    t0 = _mm_and_si128 (v, _mm_set1_epi32 (0x0fc0fc00));
+    t1 = _mm_mulhi_epu16 (t0, _mm_set1_epi32 (0x04000040));
+    t2 = _mm_and_si128 (v, _mm_set1_epi32 (0x003f03f0));
+    t3 = _mm_mullo_epi16 (t2, _mm_set1_epi32 (0x01000010));
+    idx = _mm_or_si128 (t1, t3);
+
+    /* 3. Offset to add, by range of the index */
+    r    = _mm_subs_epu8 (idx, _mm_set1_epi8 (51));
+    less = _mm_cmpgt_epi8 (_mm_set1_epi8 (26), idx);
+    r    = _mm_or_si128 (r, _mm_and_si128 (less, _mm_set1_epi8 (13)));
+    r    = _mm_shuffle_epi8 (shiftLut, r);
+    _mm_storeu_si128 ((__m128i *) pchDst, _mm_add_epi8 (r, idx));
+  }
+
+  return i;
+}
+#endif
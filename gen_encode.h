@@ -0,0 +1,45 @@
+/**********************************************************************
+ * gen_encode.h -- Hexadecimal and base64 text of big numbers,
+ *                 straight from the limbs into caller buffers.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- The number is first laid out as big-endian bytes (the
+ *           form PEM and JWK want), then encoded 16 or 12 bytes at
+ *           a time with SSE2 / SSSE3 where the processor has them.
+ *           Nothing is allocated.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_ENCODE_H
+#define GEN_ENCODE_H
+
+#include <stddef.h>
+#include <gmp.h>
+
+
+     /******** #defines and typedefs  ********/
+typedef enum {
+  FMT_DEFAULT = 0,                    /* whatever the mode used before */
+  FMT_HEX,                            /* lower case, no leading zeros  */
+  FMT_BASE64,                         /* RFC 4648, padded (PEM)        */
+  FMT_BASE64URL,                      /* URL alphabet, unpadded (JWK)  */
+  FMT_DECIMAL                         /* see gen_decimal.c             */
+} OUT_FORMAT;
+
+                              /* worst case text length of nBytes */
+#define ENCODE_HEX_LEN(nBytes)     (2 * (nBytes))
+#define ENCODE_B64_LEN(nBytes)     (4 * (((nBytes) + 2) / 3))
+
+
+     /******** functions in gen_encode.c ********/
+int     fnEncode_parse_format (const char *pszName);
+size_t  fnEncode_bytes_be (unsigned char *pchDst, mpz_t mpzX);
+size_t  fnEncode_hex (char *pchDst, const unsigned char *pchSrc, size_t nLen);
+size_t  fnEncode_base64 (char *pchDst, const unsigned char *pchSrc, \
+        size_t nLen, int flUrl);
+size_t  fnEncode_mpz (char *pchDst, unsigned char *pchScratch, mpz_t mpzX, \
+        int nFormat);
+
+#endif
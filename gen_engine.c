@@ -0,0 +1,554 @@
+/**********************************************************************
+ * gen_engine.c -- Prime search engines behind fnGenerate_keypair, and
+ *                 an A/B harness to compare two of them.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- The sieve engine keeps one PRIME_TABLE per prime length
+ *           for the rest of the run, made on first use outside of
+ *           the arena scope, as gen_decimal.c keeps its power tables.
+ *
+ *           The compat engine draws the same numbers as the legacy one
+ *           and so accepts the same primes, but makes its bounds once
+ *           per prime instead of once per candidate, compares n with
+ *           the square root bound instead of squaring it, and drops
+ *           candidates with a factor below 2^{14} before
+ *           mpz_probab_prime_p, which would have said no to them
+ *           anyway, about a fifth fewer exponentiations at 1024
+ *           bits.  fnEngine_kat holds it, and legacy, to keys of the
+ *           old program.
+ *
+ *           The harness makes prime k of both engines from the seed
+ *           S + k * 2^{64}, alternating which engine goes first, on
+ *           the calling thread alone, so that the latencies are those
+ *           of the search and nothing else.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+#include "gen_arena.h"
+#include "gen_bulk.h"
+#include "gen_cancel.h"
+#include "gen_primes.h"
+#include "gen_engine.h"
+
+
+     /******** #defines and typedefs  ********/
+#define ENGINE_MAX_TABLES   (16)         /* prime lengths cached         */
+#define ENGINE_NAME_MAX     (32)
+#define ENGINE_SMALL_LIMIT  (16384)      /* compat screens primes below  */
+#define ENGINE_SMALL_MAX    (1900)       /* odd primes below it          */
+
+typedef struct {                      /* a key of the old program      */
+  int            nBitLen;
+  unsigned long  nSeed;               /* for gmp_randseed_ui           */
+  unsigned long  nValE;               /* 0 is a random e               */
+  const char    *pszE, *pszP, *pszQ, *pszD;     /* hex                 */
+} ENGINE_KAT;
+
+typedef struct {
+  const PRIME_ENGINE  *pEngine;
+  double              *adMs;          /* latency of every prime       */
+  long                 nCands;        /* candidates tested, all       */
+  long                 nFailed;
+  double               dSecs;
+} AB_SIDE;
+
+
+     /******** globals in this file   ********/
+static int  fnEngine_sieve (mpz_t mpzPrime, mpz_t mpzE, mpz_t mpzCompare, \
+            int nNumBits, int nNumTests, BOOL flTestDiff);
+static int  fnEngine_compat (mpz_t mpzPrime, mpz_t mpzE, mpz_t mpzCompare, \
+            int nNumBits, int nNumTests, BOOL flTestDiff);
+
+static const PRIME_ENGINE  aEngines[] = {
+  { "legacy", "every candidate at random (FIPS 186-3 B.3.3)",
+    fnCreate_pseudo_prime },
+  { "sieve",  "first survivor of a sieved window after a random start",
+    fnEngine_sieve },
+  { "compat", "the primes of legacy, found with less work per candidate",
+    fnEngine_compat },
+  { NULL,     NULL, NULL }
+};
+
+static const ENGINE_KAT  aKats[] = {
+  { 512, 1, 65537, "10001",
+    "ce65bfce799892a61acd2e2d383a3eddc991ba54fca71df5e60a50c2b23a40b9",
+    "bed8afb94f6b286ea6def65907e0fe851a640526fb0600a3de4e5c76dec118f7",
+    "440b477f48a879297c7835257db7900940d697bcebcd3544119cb7621a909949"
+    "12c898891ef8194bc8df2bfe581058b4f1736d0deb624015255165440a249be1" },
+  { 512, 42, 65537, "10001",
+    "f4a089252579b138be8f835395a7e9e5f975b3d6751f8dc79885ed746c16ea27",
+    "d6b37a9cfc83b738a3f032ac22f8e30859e2543a7392abffe231fdd4d097f457",
+    "7424f0bf746210e7e03082a2a70f10b7c01ea24c3c9f45af6196709354b18688"
+    "16e5146866054806156fad9c9469b555377730cafc16863f4be7a3a153715575" },
+  { 1024, 1, 0,
+    "873c25963be270e2e2cc865b9790e46f061972675da0d7d2c6edf0ce8277b93b",
+    "ccc38e7ae61ccb811f447a3506571068ef358d970f847633daaad460a8ef9049"
+    "36c2b5979588d94b50abdbdd8572475fd74c02a7582e86cfad274bc7f051b0e9",
+    "d12a3686ab7c8cb19c49790d83ed176a3ef0cce4fd313d8d2fe36615d385ea44"
+    "286831c6b14c0e6f5d0f66f8a171768580907ecb12cc278551ab3fa9befceb6d",
+    "2bd207dd135a67be802193413b0c2fc76974e21c9ced3beeef437485efbd8a7f"
+    "ca026ad95f0743922e988dc57c9ac4dfaf470ca01d4612362a42a94ffb03ffb0"
+    "339313cbc7ac36912da98f3f941df88ba7f6551a60c334fb46f84640b00ffaa8"
+    "442cf8f884169d95fc7ea958f60808376af59ba6338f2b556fa92517a542c013" }
+};
+
+static unsigned long   anSmall[ENGINE_SMALL_MAX];   /* odd primes     */
+static unsigned long   anProd[ENGINE_SMALL_MAX];    /* word products  */
+static int             anEnd[ENGINE_SMALL_MAX];     /* past each      */
+static int             nSmall, nProds;
+static pthread_once_t  onceSmall = PTHREAD_ONCE_INIT;
+
+static const PRIME_ENGINE  *pEngine = &aEngines[0];
+static PRIME_TABLE         *apTables[ENGINE_MAX_TABLES];
+static pthread_mutex_t      mtxTables = PTHREAD_MUTEX_INITIALIZER;
+
+
+     /******** functions in this file ********/
+static const PRIME_TABLE  *fnEngine_table (int nNumBits);
+static void                fnEngine_small_init (void);
+static BOOL                fnEngine_small_factor (mpz_t n);
+static int                 fnEngine_kat_one (const ENGINE_KAT *pKat);
+static int                 fnEngine_cmp (const void *pA, const void *pB);
+static void                fnEngine_report (const AB_SIDE *pSide, long nCount);
+
+
+
+/************************************************************************
+ * fnEngine_find -- The engine called pszName, or NULL.
+ ***********************************************************************/
+const PRIME_ENGINE *fnEngine_find (const char *pszName)
+{
+  int  i;
+
+
+  for (i = 0; aEngines[i].pszName != NULL; i++)
+    if (strcmp (aEngines[i].pszName, pszName) == 0)
+      return &aEngines[i];
+
+  return NULL;
+}
+
+
+
+/************************************************************************
+ * fnEngine_select -- Make pszName the engine of the run.  Returns -1
+ *                    if there is no such engine.
+ ***********************************************************************/
+int fnEngine_select (const char *pszName)
+{
+  const PRIME_ENGINE  *pFound;
+
+
+  if ((pFound = fnEngine_find (pszName)) == NULL)
+    return -1;
+
+  pEngine = pFound;
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnEngine_current -- The engine of the run.
+ ***********************************************************************/
+const PRIME_ENGINE *fnEngine_current (void)
+{
+  return pEngine;
+}
+
+
+
+/************************************************************************
+ * fnEngine_list -- The engines, one per line, for the usage text.
+ ***********************************************************************/
+void fnEngine_list (FILE *fp)
+{
+  int  i;
+
+
+  for (i = 0; aEngines[i].pszName != NULL; i++)
+    fprintf (fp, "                     %-8s %s\n", aEngines[i].pszName, \
+             aEngines[i].pszText);
+}
+
+
+
+/************************************************************************
+ * fnEngine_kat -- Make the keys of aKats with the legacy and compat
+ *                 engines and compare them to those of the old
+ *                 program.  Returns the number of keys that differ.
+ *
+ * Remark - Uses the calling thread's rndState and leaves the engine
+ *          of the run as it found it.
+ ***********************************************************************/
+int fnEngine_kat (void)
+{
+  static const char  *apszNames[] = { "legacy", "compat" };
+  const PRIME_ENGINE *pSaved = pEngine;
+  int                 i, j, nBad, nFailed = 0;
+
+
+  gmp_randinit_default (rndState);
+  for (j = 0; j < 2; j++) {
+    pEngine = fnEngine_find (apszNames[j]);
+    nBad    = 0;
+    for (i = 0; i < (int) (sizeof (aKats) / sizeof (aKats[0])); i++)
+      nBad += fnEngine_kat_one (&aKats[i]);
+    printf ("  %-8s %d of %d known keys reproduced\n", apszNames[j], \
+            (int) (sizeof (aKats) / sizeof (aKats[0])) - nBad, \
+            (int) (sizeof (aKats) / sizeof (aKats[0])));
+    nFailed += nBad;
+  }
+  gmp_randclear (rndState);
+  pEngine = pSaved;
+
+  return nFailed;
+}
+
+
+
+/************************************************************************
+ * fnEngine_ab -- Make nCount primes for keys of nBitLen bits with both
+ *                engines of pszPair ('a,b') and print their figures
+ *                side by side.  Returns the exit status.
+ ***********************************************************************/
+int fnEngine_ab (const char *pszPair, int nBitLen, long nCount, \
+    const E_POLICY *pPolicy, unsigned long nSeed)
+{
+  AB_SIDE           aSides[2];
+  AB_SIDE          *pSide;
+  char              achName[ENGINE_NAME_MAX];
+  const char       *pchComma;
+  mpz_t             mpzE, mpzPrime;
+  struct timespec   tsStart, tsEnd;
+  long              k;
+  int               j, s, nStatus;
+
+
+  /* 1. The two engines */
+  pchComma = strchr (pszPair, ',');
+  if (pchComma == NULL || pchComma - pszPair >= ENGINE_NAME_MAX) {
+    fprintf (stderr, "%s: --ab wants two engines, as 'legacy,sieve'\n", \
+             program_name);
+    return 1;
+  }
+  memcpy (achName, pszPair, pchComma - pszPair);
+  achName[pchComma - pszPair] = '\0';
+  memset (aSides, 0, sizeof (aSides));
+  aSides[0].pEngine = fnEngine_find (achName);
+  aSides[1].pEngine = fnEngine_find (pchComma + 1);
+  for (j = 0; j < 2; j++)
+    if (aSides[j].pEngine == NULL) {
+      fprintf (stderr, "%s: no engine '%s'\n", program_name, \
+               j == 0 ? achName : pchComma + 1);
+      return 1;
+    }
+  for (j = 0; j < 2; j++)
+    aSides[j].adMs = (double *) malloc (nCount * sizeof (double));
+
+  /* 2. Prime k of both on the same seed, taking turns to go first */
+  fnWorker_init ();
+  mpz_init (mpzE);
+  mpz_init2 (mpzPrime, nBitLen / 2 + GMP_NUMB_BITS);
+  for (k = 0; k < nCount; k++) {
+    for (s = 0; s < 2; s++) {
+      pSide = &aSides[(k + s) % 2];
+      fnArena_begin ();
+      fnBulk_seed_key (nSeed, k);
+      fnMake_exponent_e (mpzE, pPolicy);
+      nCandidates = 0;
+
+      clock_gettime (CLOCK_MONOTONIC, &tsStart);
+      nStatus = pSide->pEngine->pfnFind (mpzPrime, mpzE, NULL, nBitLen / 2, \
+                                         NUMTESTS, 0);
+      clock_gettime (CLOCK_MONOTONIC, &tsEnd);
+      fnArena_end ();
+
+      pSide->adMs[k] = (tsEnd.tv_sec - tsStart.tv_sec) * 1e3 + \
+                       (tsEnd.tv_nsec - tsStart.tv_nsec) / 1e6;
+      pSide->dSecs  += pSide->adMs[k] / 1e3;
+      pSide->nCands += nCandidates;
+      if (nStatus != KEYGEN_OK)
+        pSide->nFailed++;
+    }
+  }
+  mpz_clears (mpzE, mpzPrime, NULL);
+  fnWorker_exit ();
+
+  /* 3. Side by side */
+  printf ("\n  --> A/B: %ld primes of %d bits each, seed %lu <--\n", \
+          nCount, nBitLen / 2, nSeed);
+  printf ("      %-8s %10s %10s %9s %9s %9s %9s %6s\n", "engine", \
+          "primes/s", "cand/prime", "p50 ms", "p90 ms", "p99 ms", \
+          "max ms", "failed");
+  for (j = 0; j < 2; j++)
+    fnEngine_report (&aSides[j], nCount);
+  if (aSides[0].dSecs > 0 && aSides[1].dSecs > 0)
+    printf ("      %s takes %.2f times the time of %s\n", \
+            aSides[1].pEngine->pszName, aSides[1].dSecs / aSides[0].dSecs, \
+            aSides[0].pEngine->pszName);
+
+  for (j = 0; j < 2; j++)
+    free (aSides[j].adMs);
+
+  return (aSides[0].nFailed || aSides[1].nFailed) ? 1 : 0;
+}
+
+
+
+/************************************************************************
+ * fnEngine_sieve -- The sieve engine, fnPrimes_find with the cached
+ *                   table of nNumBits.
+ ***********************************************************************/
+static int fnEngine_sieve (mpz_t mpzPrime, mpz_t mpzE, mpz_t mpzCompare, \
+           int nNumBits, int nNumTests, BOOL flTestDiff)
+{
+  return fnPrimes_find (fnEngine_table (nNumBits), mpzPrime, mpzE, \
+                        flTestDiff ? mpzCompare : NULL, nNumTests);
+}
+
+
+
+/************************************************************************
+ * fnEngine_compat -- fnCreate_pseudo_prime, step for step on the same
+ *                    random numbers, with the fixed work of each
+ *                    candidate done once.  See the remark at the top.
+ ***********************************************************************/
+static int fnEngine_compat (mpz_t mpzPrime, mpz_t mpzE, mpz_t mpzCompare, \
+           int nNumBits, int nNumTests, BOOL flTestDiff)
+{
+  mpz_t          n, temp, mpzLow, mpzDiff;
+  unsigned long  nSmallE;
+  int            i = 0;                    /* counted as legacy does */
+  int            nStatus;
+
+
+  /* 1. Bounds of the prime: n^2 >= 2^{2 nNumBits - 1} is the same */
+  /*    as n >= ceil (sqrt (2^{2 nNumBits - 1})), and |p - q| must  */
+  /*    exceed 2^{nNumBits - 100}                                   */
+  mpz_init2 (n, nNumBits + GMP_NUMB_BITS);
+  mpz_init2 (temp, 2 * nNumBits + GMP_NUMB_BITS);
+  mpz_inits (mpzLow, mpzDiff, NULL);
+  mpz_setbit (temp, 2 * nNumBits - 1);
+  mpz_sqrtrem (mpzLow, temp, temp);
+  if (mpz_sgn (temp) != 0)
+    mpz_add_ui (mpzLow, mpzLow, 1);
+  mpz_setbit (mpzDiff, nNumBits <= 100 ? 0 : nNumBits - 100);
+  pthread_once (&onceSmall, fnEngine_small_init);
+  nSmallE = fnSmall_prime_e (mpzE);
+
+  /* 2. The candidates of fnCreate_pseudo_prime in its order */
+  while (1) {
+    if ((nStatus = fnCancel_check ()) != KEYGEN_OK)
+      break;
+
+    mpz_urandomb (n, rndState, nNumBits - 1);
+    mpz_setbit (n, nNumBits - 1);
+    mpz_setbit (n, 0);                     /* even n + 1 */
+
+    if (flTestDiff) {
+      mpz_sub (temp, n, mpzCompare);
+      if (mpz_cmpabs (temp, mpzDiff) <= 0)
+        continue;
+    }
+    if (mpz_cmp (n, mpzLow) < 0)
+      continue;
+
+    if (nSmallE != 0 ? mpz_fdiv_ui (n, nSmallE) != 1 : \
+        (mpz_sub_ui (temp, n, 1), mpz_gcd (temp, temp, mpzE), \
+         mpz_cmp_ui (temp, 1) == 0)) {
+      if (!fnEngine_small_factor (n)) {
+        nCandidates++;
+        if (mpz_probab_prime_p (n, nNumTests) >= 1)
+          break;
+      }
+    }
+
+    if (++i >= 5 * nNumBits) {
+      nStatus = KEYGEN_EXHAUSTED;
+      break;
+    }
+  }
+
+  /* 3. The result, as the caller's */
+  if (nStatus == KEYGEN_OK)
+    mpz_set (mpzPrime, n);
+  mpz_clears (n, temp, mpzLow, mpzDiff, NULL);
+
+  return nStatus;
+}
+
+
+
+/************************************************************************
+ * fnEngine_small_init -- The odd primes below ENGINE_SMALL_LIMIT, and
+ *                        their products in runs that fit a word.
+ ***********************************************************************/
+static void fnEngine_small_init (void)
+{
+  unsigned char  *pchComp;
+  unsigned long   nS, nProd;
+  long            nM;
+  int             i;
+
+
+  pchComp = (unsigned char *) calloc (ENGINE_SMALL_LIMIT, 1);
+  for (nS = 3; nS < ENGINE_SMALL_LIMIT; nS += 2) {
+    if (pchComp[nS])
+      continue;
+    anSmall[nSmall++] = nS;
+    for (nM = nS * nS; nM < ENGINE_SMALL_LIMIT; nM += 2 * nS)
+      pchComp[nM] = 1;
+  }
+  free (pchComp);
+
+  for (i = 0; i < nSmall; nProds++) {
+    nProd = anSmall[i++];
+    while (i < nSmall && nProd <= ULONG_MAX / anSmall[i])
+      nProd *= anSmall[i++];
+    anProd[nProds] = nProd;
+    anEnd[nProds]  = i;
+  }
+}
+
+
+
+/************************************************************************
+ * fnEngine_small_factor -- Does n, larger than every anSmall, have a
+ *                          factor among them?  One division of n per
+ *                          word sized product of them.
+ ***********************************************************************/
+static BOOL fnEngine_small_factor (mpz_t n)
+{
+  unsigned long  nRem;
+  int            i = 0, j;
+
+
+  if (mpz_cmp_ui (n, ENGINE_SMALL_LIMIT) <= 0)
+    return 0;
+
+  for (j = 0; j < nProds; j++) {
+    nRem = mpz_fdiv_ui (n, anProd[j]);
+    for (; i < anEnd[j]; i++)
+      if (nRem % anSmall[i] == 0)
+        return 1;
+  }
+
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnEngine_kat_one -- One key of aKats with the current engine, as
+ *                     main makes it.  Returns 0 if it matches.
+ ***********************************************************************/
+static int fnEngine_kat_one (const ENGINE_KAT *pKat)
+{
+  E_POLICY  ePolicy;
+  mpz_t     mpzE, mpzP1, mpzP2, mpzD, mpzWant;
+  int       nBad;
+
+
+  mpz_inits (mpzE, mpzP1, mpzP2, mpzD, mpzWant, NULL);
+  gmp_randseed_ui (rndState, pKat->nSeed);
+  ePolicy.nKind = pKat->nValE != 0 ? E_POLICY_FIXED : E_POLICY_RANDOM;
+  ePolicy.nValE = pKat->nValE;
+  fnMake_exponent_e (mpzE, &ePolicy);
+
+  nBad = fnGenerate_keypair (mpzP1, mpzP2, mpzD, mpzE, pKat->nBitLen) \
+         != KEYGEN_OK;
+  mpz_set_str (mpzWant, pKat->pszE, 16);
+  nBad |= mpz_cmp (mpzE, mpzWant) != 0;
+  mpz_set_str (mpzWant, pKat->pszP, 16);
+  nBad |= mpz_cmp (mpzP1, mpzWant) != 0;
+  mpz_set_str (mpzWant, pKat->pszQ, 16);
+  nBad |= mpz_cmp (mpzP2, mpzWant) != 0;
+  mpz_set_str (mpzWant, pKat->pszD, 16);
+  nBad |= mpz_cmp (mpzD, mpzWant) != 0;
+  if (nBad)
+    fprintf (stderr, "%s: %s engine, key of %d bits with seed %lu differs\n", \
+             program_name, pEngine->pszName, pKat->nBitLen, pKat->nSeed);
+
+  mpz_clears (mpzE, mpzP1, mpzP2, mpzD, mpzWant, NULL);
+  return nBad;
+}
+
+
+
+/************************************************************************
+ * fnEngine_table -- The probable prime table of nNumBits, made on
+ *                   first use and kept for the rest of the run.
+ ***********************************************************************/
+static const PRIME_TABLE *fnEngine_table (int nNumBits)
+{
+  static int    anBits[ENGINE_MAX_TABLES];
+  PRIME_TABLE  *pTab = NULL;
+  int           i, nDepth;
+
+
+  pthread_mutex_lock (&mtxTables);
+
+  for (i = 0; i < ENGINE_MAX_TABLES && apTables[i] != NULL; i++)
+    if (anBits[i] == nNumBits) {
+      pTab = apTables[i];
+      break;
+    }
+
+  if (pTab == NULL) {
+    nDepth = fnArena_leave ();
+    pTab   = fnPrimes_table (nNumBits, PRIME_PROBABLE);
+    fnArena_reenter (nDepth);
+    if (i == ENGINE_MAX_TABLES) {          /* full, drop the oldest */
+      fnPrimes_table_free (apTables[0]);
+      memmove (apTables, apTables + 1, (i - 1) * sizeof (PRIME_TABLE *));
+      memmove (anBits, anBits + 1, (i - 1) * sizeof (int));
+      i--;
+    }
+    apTables[i] = pTab;
+    anBits[i]   = nNumBits;
+  }
+
+  pthread_mutex_unlock (&mtxTables);
+  return pTab;
+}
+
+
+
+/************************************************************************
+ * fnEngine_cmp -- qsort order of latencies.
+ ***********************************************************************/
+static int fnEngine_cmp (const void *pA, const void *pB)
+{
+  double  dA = *(const double *) pA, dB = *(const double *) pB;
+
+
+  return dA < dB ? -1 : dA > dB;
+}
+
+
+
+/************************************************************************
+ * fnEngine_report -- One line of the A/B table.
+ ***********************************************************************/
+static void fnEngine_report (const AB_SIDE *pSide, long nCount)
+{
+  qsort (pSide->adMs, nCount, sizeof (double), fnEngine_cmp);
+  printf ("      %-8s %10.2f %10.1f %9.2f %9.2f %9.2f %9.2f %6ld\n", \
+          pSide->pEngine->pszName, \
+          pSide->dSecs > 0 ? nCount / pSide->dSecs : 0.0, \
+          (double) pSide->nCands / nCount, pSide->adMs[nCount / 2], \
+          pSide->adMs[nCount * 9 / 10], pSide->adMs[nCount * 99 / 100], \
+          pSide->adMs[nCount - 1], pSide->nFailed);
+}
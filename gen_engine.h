@@ -0,0 +1,60 @@
+/**********************************************************************
+ * gen_engine.h -- Prime search engines behind fnGenerate_keypair, and
+ *                 an A/B harness to compare two of them.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- An engine finds one probable prime with the contract of
+ *           fnCreate_pseudo_prime: nNumBits bits, p^2 >= 2^{2 nNumBits
+ *           - 1}, gcd (p - 1, e) = 1 and, with flTestDiff, far enough
+ *           from mpzCompare.  It draws from the thread's rndState,
+ *           honours its CANCEL_TOKEN, adds the numbers it put through
+ *           a primality test to nCandidates and returns a
+ *           KEYGEN_STATUS.
+ *
+ *             legacy   fnCreate_pseudo_prime, every candidate at
+ *                      random (the default, output as before)
+ *             sieve    the first survivor of a sieved window after a
+ *                      random start (gen_primes.c)
+ *             compat   the primes of legacy for the same random state,
+ *                      found faster (--compat=legacy); fnEngine_kat
+ *                      checks both against keys of the old program
+ *
+ *           A new engine is one more entry in the table of
+ *           gen_engine.c.  fnEngine_select is called before any
+ *           worker starts, the choice holds for the whole run.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_ENGINE_H
+#define GEN_ENGINE_H
+
+#include <stdio.h>
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+
+
+     /******** #defines and typedefs  ********/
+typedef int  (*PRIME_ENGINE_FN) (mpz_t mpzPrime, mpz_t mpzE, \
+             mpz_t mpzCompare, int nNumBits, int nNumTests, BOOL flTestDiff);
+
+typedef struct {
+  const char       *pszName;
+  const char       *pszText;          /* one line for the usage text  */
+  PRIME_ENGINE_FN   pfnFind;
+} PRIME_ENGINE;
+
+
+     /******** functions in gen_engine.c ********/
+const PRIME_ENGINE  *fnEngine_find (const char *pszName);
+int                  fnEngine_select (const char *pszName);
+const PRIME_ENGINE  *fnEngine_current (void);
+void                 fnEngine_list (FILE *fp);
+int                  fnEngine_kat (void);
+int                  fnEngine_ab (const char *pszPair, int nBitLen, \
+                     long nCount, const E_POLICY *pPolicy, \
+                     unsigned long nSeed);
+
+#endif
@@ -0,0 +1,599 @@
+/**********************************************************************
+ * gen_jobs.c -- Job file mode: a batch of key jobs of mixed sizes,
+ *               run largest first so the batch ends on time.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- Before anything runs, each job gets an estimated cost per
+ *           key.  The modular exponentiation is what a prime search
+ *           spends its time on, so one is timed for every prime size
+ *           in the file, and the prime density gives how many a key
+ *           needs:
+ *
+ *             probable  2 [ (b ln 2 / 2) (1.123 / ln b) + C ] t(b)
+ *             safe      2 [ X^2 + X (C + 1) + C ] t(b),
+ *                       X = 1.123 b ln 2 / (2 ln L)
+ *
+ *           b bits per prime, t(b) one exponentiation.  An odd
+ *           candidate is prime with probability 2 / (b ln 2); GMP
+ *           trial divides up to b and only 1.123 / ln b of the
+ *           candidates reach an exponentiation.  Safe candidates
+ *           survive our sieve to L = SAFE_SIEVE_LIMIT and need both
+ *           p and q prime: X^2 Fermat tests of q, and each of the X
+ *           primes q among them is confirmed before p is tried, one
+ *           p in X being prime.  C is the cost of confirming a prime
+ *           with NUMTESTS rounds, in exponentiations.  For safe keys
+ *           of 512 to 2048 bits this is within a third of timed runs.
+ *
+ *           The keys of all jobs are then ordered by that cost,
+ *           largest first, and every worker of the pool takes the
+ *           next key from the front of the list (longest processing
+ *           time first).  The small keys fill in at the end, so no
+ *           thread is left with a long key while the others idle.
+ *           The plan's finishing time is printed before the run and
+ *           the measured costs per job after it.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+#include "gen_arena.h"
+#include "gen_memprof.h"
+#include "gen_writer.h"
+#include "gen_bulk.h"
+#include "gen_pool.h"
+#include "gen_pct.h"
+#include "gen_dedup.h"
+#include "gen_jobs.h"
+
+
+     /******** #defines and typedefs  ********/
+#define JOB_CONFIRM_POWM   (30)         /* NUMTESTS rounds, GMP 6.2     */
+#define JOB_CAL_NSEC       (10000000L)  /* time spent per prime size    */
+#define JOB_CAL_SEED       (12345)
+
+typedef struct {
+  int           nLine;                /* in the job file              */
+  int           nBitLen;
+  long          nCount;
+  E_POLICY      ePolicy;
+  int           nPrime;               /* PRIME_TYPE                   */
+  long          nFirst;               /* file order index of key 0    */
+  double        dKeyCost;             /* estimated seconds per key    */
+  double        dSecs;                /* measured, all its keys       */
+} JOB;
+
+typedef struct {
+  const JOBS_OPTS  *pOpts;
+  JOB              *pJobs;
+  int               nJobs;
+  int              *pnOrder;          /* jobs, largest key first      */
+  long             *pnStart;          /* first list position of each  */
+  long              nTotal;           /* keys in the batch            */
+  long              nNext;            /* next list position, shared   */
+  WRITER           *pWriter;
+  int               nFailed;          /* a record could not be put    */
+  long              nRedrawn;         /* keys drawn again             */
+  pthread_mutex_t   mtx;              /* dSecs of the jobs            */
+} JOBS_RUN;
+
+
+     /******** globals in this file   ********/
+static int                nJobsFormat;       /* for the worker hook   */
+static int                nJobsMaxBits;
+static __thread KEY_FMT   jobsFmt;           /* each worker's own     */
+static __thread char     *pchJobsRec;
+static JOB               *pSortJobs;         /* for fnJobs_by_cost    */
+
+
+     /******** functions in this file ********/
+static int     fnJobs_read (const char *pszFile, JOB **ppJobs, int *pnJobs);
+static int     fnJobs_parse (char *pszLine, BOOL flFirst, JOB *pJob, \
+               const char **ppszErr);
+static int     fnJobs_json_value (const char *pszLine, const char *pszKey, \
+               char *pchVal, size_t nSize);
+static void    fnJobs_estimate (JOB *pJobs, int nJobs);
+static double  fnJobs_powm_cost (int nBits, gmp_randstate_t rs);
+static double  fnJobs_plan (const JOBS_RUN *pRun, int nThreads);
+static int     fnJobs_by_cost (const void *pA, const void *pB);
+static void    fnJobs_worker_init (void);
+static void    fnJobs_worker_exit (void);
+static void    fnJobs_drain (void *pArg);
+
+
+
+/************************************************************************
+ * fnJobs_run -- Make every key of the job file pOpts->pszFile.
+ *               Returns 0 on success.
+ ***********************************************************************/
+int fnJobs_run (const JOBS_OPTS *pOpts)
+{
+  JOBS_RUN         run;
+  WRITER_STATS     ws;
+  POOL            *pPool;
+  JOB             *pJob;
+  struct timespec  tsStart, tsEnd;
+  double           dSecs, dPlan;
+  char             achE[32];
+  int              i, nThreads, nRet;
+
+
+  memset (&run, 0, sizeof (run));
+  run.pOpts = pOpts;
+  nThreads  = pOpts->nThreads > 0 ? pOpts->nThreads : 1;
+
+  /* 1. Read the jobs and give each key a number in file order */
+  if (fnJobs_read (pOpts->pszFile, &run.pJobs, &run.nJobs) != 0)
+    return 1;
+  nJobsMaxBits = 0;
+  for (i = 0; i < run.nJobs; i++) {
+    run.pJobs[i].nFirst = run.nTotal;
+    run.nTotal += run.pJobs[i].nCount;
+    if (run.pJobs[i].nBitLen > nJobsMaxBits)
+      nJobsMaxBits = run.pJobs[i].nBitLen;
+  }
+
+  /* 2. Cost of a key of each job, and the order: largest first */
+  fnJobs_estimate (run.pJobs, run.nJobs);
+  run.pnOrder = (int *) malloc (run.nJobs * sizeof (int));
+  run.pnStart = (long *) malloc ((run.nJobs + 1) * sizeof (long));
+  for (i = 0; i < run.nJobs; i++)
+    run.pnOrder[i] = i;
+  pSortJobs = run.pJobs;
+  qsort (run.pnOrder, run.nJobs, sizeof (int), fnJobs_by_cost);
+  run.pnStart[0] = 0;
+  for (i = 0; i < run.nJobs; i++)
+    run.pnStart[i + 1] = run.pnStart[i] + run.pJobs[run.pnOrder[i]].nCount;
+
+  dPlan = fnJobs_plan (&run, nThreads);
+  fprintf (stderr, "   %d jobs, %ld keys on %d thread%s, estimated %.2f s\n", \
+           run.nJobs, run.nTotal, nThreads, nThreads == 1 ? "" : "s", dPlan);
+
+  /* 3. Output stage, then one draining task per worker */
+  run.pWriter = fnWriter_open (pOpts->pszOut, pOpts->nWriterFlags, \
+                               pOpts->nBufSize, pOpts->nBufs);
+  if (run.pWriter == NULL) {
+    free (run.pJobs);
+    free (run.pnOrder);
+    free (run.pnStart);
+    return 1;
+  }
+  pthread_mutex_init (&run.mtx, NULL);
+  nJobsFormat = pOpts->nFormat;
+
+  clock_gettime (CLOCK_MONOTONIC, &tsStart);
+  pPool = fnPool_create (nThreads, fnJobs_worker_init, fnJobs_worker_exit);
+  for (i = 0; i < nThreads; i++)
+    fnPool_submit (pPool, fnJobs_drain, &run);
+  fnPool_destroy (pPool);
+  nRet = fnWriter_close (run.pWriter, &ws);
+  clock_gettime (CLOCK_MONOTONIC, &tsEnd);
+  dSecs = (tsEnd.tv_sec - tsStart.tv_sec) + \
+          (tsEnd.tv_nsec - tsStart.tv_nsec) / 1e9;
+
+  /* 4. Report, the plan against what happened */
+  fprintf (stderr, "\n  --> Job file %s: %ld keys on %d thread%s <--\n", \
+           pOpts->pszFile, run.nTotal, nThreads, nThreads == 1 ? "" : "s");
+  fprintf (stderr, "      %.3f s, estimated %.3f s\n", dSecs, dPlan);
+  if (run.nRedrawn > 0)
+    fprintf (stderr, "      %ld key%s drawn again after a failed search\n", \
+             run.nRedrawn, run.nRedrawn == 1 ? "" : "s");
+  if (fnPct_enabled ())
+    fnPct_report (stderr);
+  if (fnDedup_enabled ())
+    fnDedup_report (stderr);
+  fprintf (stderr, "      %5s %6s %8s %-8s %-9s %12s %12s\n", "line", \
+           "bits", "count", "e", "prime", "est s/key", "s/key");
+  for (i = 0; i < run.nJobs; i++) {
+    pJob = &run.pJobs[run.pnOrder[i]];
+    fprintf (stderr, "      %5d %6d %8ld ", pJob->nLine, pJob->nBitLen, \
+             pJob->nCount);
+    fnFormat_e_policy (&pJob->ePolicy, achE, sizeof (achE));
+    fprintf (stderr, "%-8s ", achE);
+    fprintf (stderr, "%-9s %12.4f %12.4f\n", \
+             pJob->nPrime == PRIME_SAFE ? "safe" : "probable", \
+             pJob->dKeyCost, pJob->dSecs / pJob->nCount);
+  }
+  fnWriter_print_stats (stderr, &ws);
+
+  pthread_mutex_destroy (&run.mtx);
+  free (run.pJobs);
+  free (run.pnOrder);
+  free (run.pnStart);
+
+  return (nRet != 0 || run.nFailed) ? 1 : 0;
+}
+
+
+
+/************************************************************************
+ * fnJobs_read -- Parse the job file.  Returns 0, or -1 after naming
+ *                the first bad line.
+ ***********************************************************************/
+static int fnJobs_read (const char *pszFile, JOB **ppJobs, int *pnJobs)
+{
+  FILE        *fp;
+  char         line[JOB_LINE_MAX + 2];
+  const char  *pszErr = NULL;
+  JOB         *pJobs = NULL;
+  int          nJobs = 0, nAlloc = 0, nLine = 0, nRet;
+
+
+  if ((fp = fopen (pszFile, "r")) == NULL) {
+    perror (pszFile);
+    return -1;
+  }
+
+  while (fgets (line, sizeof (line), fp) != NULL) {
+    nLine++;
+    if (nJobs == nAlloc) {
+      nAlloc = nAlloc ? 2 * nAlloc : 16;
+      pJobs  = (JOB *) realloc (pJobs, nAlloc * sizeof (JOB));
+    }
+    if (strchr (line, '\n') == NULL && !feof (fp)) {
+      pszErr = "line too long";
+      break;
+    }
+    nRet = fnJobs_parse (line, nJobs == 0, &pJobs[nJobs], &pszErr);
+    if (nRet < 0)
+      break;
+    if (nRet > 0)
+      pJobs[nJobs++].nLine = nLine;
+  }
+  fclose (fp);
+
+  if (pszErr == NULL && nJobs == 0)
+    pszErr = "no jobs";
+  if (pszErr != NULL) {
+    fprintf (stderr, "%s:%d: %s\n", pszFile, nLine, pszErr);
+    free (pJobs);
+    return -1;
+  }
+
+  *ppJobs = pJobs;
+  *pnJobs = nJobs;
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnJobs_parse -- One line of the job file.  Returns 1 for a job, 0
+ *                 for a line to skip and -1 with *ppszErr set.
+ *
+ * Remark - flFirst allows a CSV header before the first job.
+ ***********************************************************************/
+static int fnJobs_parse (char *pszLine, BOOL flFirst, JOB *pJob, \
+           const char **ppszErr)
+{
+  char   achBits[32], achCount[32], achE[80], achPrime[32];
+  char  *pch, *pchEnd, *apchField[4];
+  int    nFields = 0;
+
+
+  /* 1. Skip blank lines and comments */
+  for (pch = pszLine; isspace ((unsigned char) *pch); pch++)
+    ;
+  if (*pch == '\0' || *pch == '#')
+    return 0;
+
+  strcpy (achE, "random");
+  strcpy (achPrime, "probable");
+  achBits[0] = achCount[0] = '\0';
+
+  /* 2. JSON object, or CSV fields */
+  if (*pch == '{') {
+    if (fnJobs_json_value (pch, "size", achBits, sizeof (achBits)) != 0)
+      fnJobs_json_value (pch, "bits", achBits, sizeof (achBits));
+    fnJobs_json_value (pch, "count", achCount, sizeof (achCount));
+    fnJobs_json_value (pch, "e", achE, sizeof (achE));
+    fnJobs_json_value (pch, "prime", achPrime, sizeof (achPrime));
+  }
+  else {
+    for (apchField[nFields++] = pch; *pch != '\0'; pch++)
+      if (*pch == ',') {
+        *pch = '\0';
+        if (nFields == 4) {
+          *ppszErr = "more than 4 fields";
+          return -1;
+        }
+        apchField[nFields++] = pch + 1;
+      }
+    if (!isdigit ((unsigned char) *apchField[0]))
+      if (flFirst)
+        return 0;                              /* a header line */
+    sscanf (apchField[0], "%31s", achBits);
+    if (nFields > 1)
+      sscanf (apchField[1], "%31s", achCount);
+    if (nFields > 2)
+      sscanf (apchField[2], "%79s", achE);
+    if (nFields > 3)
+      sscanf (apchField[3], "%31s", achPrime);
+  }
+
+  /* 3. Check the values */
+  memset (pJob, 0, sizeof (*pJob));
+  pJob->nBitLen = (int) strtol (achBits, &pchEnd, 10);
+  if (achBits[0] == '\0' || *pchEnd != '\0' || pJob->nBitLen < JOB_MIN_BITS \
+      || pJob->nBitLen > JOB_MAX_BITS || pJob->nBitLen % 2 != 0) {
+    *ppszErr = "size must be even and in range";
+    return -1;
+  }
+  pJob->nCount = strtol (achCount, &pchEnd, 10);
+  if (achCount[0] == '\0' || *pchEnd != '\0' || pJob->nCount < 1) {
+    *ppszErr = "count must be a positive number";
+    return -1;
+  }
+  if (fnParse_e_policy (achE, &pJob->ePolicy) != 0) {
+    *ppszErr = "bad exponent";
+    return -1;
+  }
+  if (strcmp (achPrime, "safe") == 0)
+    pJob->nPrime = PRIME_SAFE;
+  else if (strcmp (achPrime, "probable") == 0)
+    pJob->nPrime = PRIME_PROBABLE;
+  else {
+    *ppszErr = "prime must be 'probable' or 'safe'";
+    return -1;
+  }
+
+  return 1;
+}
+
+
+
+/************************************************************************
+ * fnJobs_json_value -- The value of "pszKey" in a flat JSON object,
+ *                      without quotes.  Returns 0, or -1 if absent.
+ ***********************************************************************/
+static int fnJobs_json_value (const char *pszLine, const char *pszKey, \
+           char *pchVal, size_t nSize)
+{
+  const char  *pch;
+  char         achKey[40];
+  size_t       nLen = 0;
+  char         chEnd;
+
+
+  snprintf (achKey, sizeof (achKey), "\"%s\"", pszKey);
+  if ((pch = strstr (pszLine, achKey)) == NULL)
+    return -1;
+  for (pch += strlen (achKey); isspace ((unsigned char) *pch); pch++)
+    ;
+  if (*pch++ != ':')
+    return -1;
+  while (isspace ((unsigned char) *pch))
+    pch++;
+
+  if (*pch == '"') {
+    chEnd = '"';
+    pch++;
+  }
+  else
+    chEnd = ',';
+  while (*pch != '\0' && *pch != chEnd && *pch != '}' && \
+         (chEnd == '"' || !isspace ((unsigned char) *pch)) && nLen + 1 < nSize)
+    pchVal[nLen++] = *pch++;
+  pchVal[nLen] = '\0';
+
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnJobs_estimate -- Seconds per key of every job, from the prime
+ *                    density and a timed exponentiation per size.
+ ***********************************************************************/
+static void fnJobs_estimate (JOB *pJobs, int nJobs)
+{
+  gmp_randstate_t  rs;
+  double           adPowm[JOB_MAX_BITS / 2 + 1];
+  double           dB, dTests, dX;
+  int              i, nBits;
+
+
+  gmp_randinit_default (rs);
+  gmp_randseed_ui (rs, JOB_CAL_SEED);
+  for (i = 0; i <= JOB_MAX_BITS / 2; i++)
+    adPowm[i] = -1.0;
+
+  for (i = 0; i < nJobs; i++) {
+    nBits = pJobs[i].nBitLen / 2;
+    if (adPowm[nBits] < 0)
+      adPowm[nBits] = fnJobs_powm_cost (nBits, rs);
+    dB = nBits;
+
+    if (pJobs[i].nPrime == PRIME_SAFE) {
+      dX     = 1.123 * dB * M_LN2 / (2 * log ((double) SAFE_SIEVE_LIMIT));
+      dTests = dX * dX + dX * (JOB_CONFIRM_POWM + 1) + JOB_CONFIRM_POWM;
+    }
+    else
+      dTests = dB * M_LN2 / 2 * (1.123 / log (dB)) + JOB_CONFIRM_POWM;
+    pJobs[i].dKeyCost = 2 * dTests * adPowm[nBits];
+  }
+
+  gmp_randclear (rs);
+}
+
+
+
+/************************************************************************
+ * fnJobs_powm_cost -- Seconds for 2^{m-1} mod m, m odd of nBits.
+ ***********************************************************************/
+static double fnJobs_powm_cost (int nBits, gmp_randstate_t rs)
+{
+  mpz_t            mpzM, mpzX, mpzBase;
+  struct timespec  tsStart, tsNow;
+  long             nNsec = 0;
+  int              nReps = 0;
+
+
+  mpz_inits (mpzM, mpzX, NULL);
+  mpz_init_set_ui (mpzBase, 2);
+
+  /* 1. At least two, and as many as fit in JOB_CAL_NSEC */
+  clock_gettime (CLOCK_MONOTONIC, &tsStart);
+  while (nReps < 2 || nNsec < JOB_CAL_NSEC) {
+    mpz_urandomb (mpzM, rs, nBits);
+    mpz_setbit (mpzM, nBits - 1);
+    mpz_setbit (mpzM, 0);
+    mpz_sub_ui (mpzX, mpzM, 1);
+    mpz_powm (mpzX, mpzBase, mpzX, mpzM);
+    nReps++;
+    clock_gettime (CLOCK_MONOTONIC, &tsNow);
+    nNsec = (tsNow.tv_sec - tsStart.tv_sec) * 1000000000L + \
+            (tsNow.tv_nsec - tsStart.tv_nsec);
+  }
+
+  mpz_clears (mpzM, mpzX, mpzBase, NULL);
+
+  return nNsec / 1e9 / nReps;
+}
+
+
+
+/************************************************************************
+ * fnJobs_plan -- Finishing time of the largest first schedule on
+ *                nThreads, from the estimates.
+ ***********************************************************************/
+static double fnJobs_plan (const JOBS_RUN *pRun, int nThreads)
+{
+  double  *pdLoad, dCost, dMax;
+  long     k;
+  int      i, nFree, t;
+
+
+  pdLoad = (double *) calloc (nThreads, sizeof (double));
+
+  /* Every key goes to the thread that is free first */
+  for (i = 0; i < pRun->nJobs; i++) {
+    dCost = pRun->pJobs[pRun->pnOrder[i]].dKeyCost;
+    for (k = 0; k < pRun->pJobs[pRun->pnOrder[i]].nCount; k++) {
+      for (t = 1, nFree = 0; t < nThreads; t++)
+        if (pdLoad[t] < pdLoad[nFree])
+          nFree = t;
+      pdLoad[nFree] += dCost;
+    }
+  }
+
+  for (t = 0, dMax = 0.0; t < nThreads; t++)
+    if (pdLoad[t] > dMax)
+      dMax = pdLoad[t];
+  free (pdLoad);
+
+  return dMax;
+}
+
+
+
+/************************************************************************
+ * fnJobs_by_cost -- qsort order of job indices, dearest key first,
+ *                   then file order.
+ ***********************************************************************/
+static int fnJobs_by_cost (const void *pA, const void *pB)
+{
+  const JOB  *pJobA = &pSortJobs[*(const int *) pA];
+  const JOB  *pJobB = &pSortJobs[*(const int *) pB];
+
+
+  if (pJobA->dKeyCost != pJobB->dKeyCost)
+    return pJobA->dKeyCost > pJobB->dKeyCost ? -1 : 1;
+  return pJobA->nLine - pJobB->nLine;
+}
+
+
+
+/************************************************************************
+ * fnJobs_worker_init -- Pool hook, outside of any arena scope.
+ ***********************************************************************/
+static void fnJobs_worker_init (void)
+{
+  fnWorker_init ();
+  fnKeyfmt_init (&jobsFmt, nJobsFormat, nJobsMaxBits);
+  pchJobsRec = (char *) malloc (KEY_RECORD_LEN (nJobsMaxBits));
+}
+
+
+
+/************************************************************************
+ * fnJobs_worker_exit -- Pool hook.
+ ***********************************************************************/
+static void fnJobs_worker_exit (void)
+{
+  free (pchJobsRec);
+  fnKeyfmt_clear (&jobsFmt);
+  fnWorker_exit ();
+}
+
+
+
+/************************************************************************
+ * fnJobs_drain -- Pool task: keys from the front of the list until
+ *                 it is empty.
+ ***********************************************************************/
+static void fnJobs_drain (void *pArg)
+{
+  JOBS_RUN         *pRun = (JOBS_RUN *) pArg;
+  JOB              *pJob;
+  mpz_t             mpzP1, mpzP2, mpzE, mpzD, mpzN;
+  struct timespec   tsStart, tsEnd;
+  char              achTag[24];
+  size_t            nLen;
+  long              nPos, nIndex;
+  int               j, nStatus, nRedrawn;
+
+
+  while ((nPos = __atomic_fetch_add (&pRun->nNext, 1, __ATOMIC_RELAXED))
+         < pRun->nTotal && !pRun->nFailed) {
+    /* 1. Which job, and which of its keys */
+    for (j = 0; pRun->pnStart[j + 1] <= nPos; j++)
+      ;
+    pJob   = &pRun->pJobs[pRun->pnOrder[j]];
+    nIndex = pJob->nFirst + (nPos - pRun->pnStart[j]);
+
+    /* 2. Same steps as main for key nIndex */
+    clock_gettime (CLOCK_MONOTONIC, &tsStart);
+    fnArena_begin ();
+    mpz_inits (mpzP1, mpzP2, mpzE, mpzD, mpzN, NULL);
+    nStatus = fnBulk_make_key (pRun->pOpts->nSeed, nIndex, &pJob->ePolicy, \
+                               pJob->nBitLen, pJob->nPrime == PRIME_SAFE, \
+                               mpzE, mpzP1, mpzP2, mpzD, &nRedrawn);
+    if (nRedrawn > 0)
+      __atomic_add_fetch (&pRun->nRedrawn, 1, __ATOMIC_RELAXED);
+
+    fnMemprof_phase (MEM_PHASE_OUTPUT);
+    if (nStatus != KEYGEN_OK) {
+      fprintf (stderr, "   ### FAILURE creating prime for key %ld\n", nIndex);
+      pRun->nFailed = 1;
+    }
+    else {
+      mpz_mul (mpzN, mpzP1, mpzP2);
+      sprintf (achTag, "%ld", nIndex);
+      nLen = fnKeyfmt_record (pchJobsRec, &jobsFmt, achTag, pJob->nBitLen, \
+                              mpzE, mpzN, mpzP1, mpzP2, mpzD);
+      if (fnWriter_put (pRun->pWriter, pchJobsRec, nLen) != 0)
+        pRun->nFailed = 1;
+    }
+
+    mpz_clears (mpzP1, mpzP2, mpzE, mpzD, mpzN, NULL);
+    fnArena_end ();
+    fnMemprof_key_done ();
+    clock_gettime (CLOCK_MONOTONIC, &tsEnd);
+
+    /* 3. What the key really cost */
+    pthread_mutex_lock (&pRun->mtx);
+    pJob->dSecs += (tsEnd.tv_sec - tsStart.tv_sec) + \
+                   (tsEnd.tv_nsec - tsStart.tv_nsec) / 1e9;
+    pthread_mutex_unlock (&pRun->mtx);
+  }
+}
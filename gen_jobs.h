@@ -0,0 +1,55 @@
+/**********************************************************************
+ * gen_jobs.h -- Job file mode: a batch of key jobs of mixed sizes,
+ *               run largest first so the batch ends on time.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- One job per line, either CSV
+ *
+ *               size,count[,e[,prime]]
+ *
+ *           or JSON
+ *
+ *               {"size": 3072, "count": 100, "e": "f4", "prime": "safe"}
+ *
+ *           with e a number, 'f4' or 'random' (the default) and prime
+ *           'probable' (the default) or 'safe'.  Blank lines, lines
+ *           starting with '#' and a CSV header line are skipped.
+ *
+ *           Key k of the file, counting through the jobs in file
+ *           order, uses the seed S + k * 2^{64}, whatever order the
+ *           keys are made in.  The output lines are those of bulk
+ *           mode, 'k bits e n p q d', in completion order.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_JOBS_H
+#define GEN_JOBS_H
+
+#include <stddef.h>
+
+#include "gen_pair_pseudo.h"
+
+
+     /******** #defines and typedefs  ********/
+#define JOB_MIN_BITS       (128)        /* smallest nlen accepted       */
+#define JOB_MAX_BITS       (16384)      /* largest nlen accepted        */
+#define JOB_LINE_MAX       (512)        /* longest job line             */
+
+typedef struct {
+  const char     *pszFile;            /* the job file                 */
+  unsigned long   nSeed;              /* batch seed S                 */
+  int             nThreads;           /* key generation threads       */
+  int             nFormat;            /* OUT_FORMAT of the numbers    */
+  const char     *pszOut;             /* output file, NULL is stdout  */
+  int             nWriterFlags;       /* WRITER_F_ options            */
+  size_t          nBufSize;           /* output buffer size, bytes    */
+  int             nBufs;              /* number of output buffers     */
+} JOBS_OPTS;
+
+
+     /******** functions in gen_jobs.c ********/
+int  fnJobs_run (const JOBS_OPTS *pOpts);
+
+#endif
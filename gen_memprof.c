@@ -0,0 +1,262 @@
+/**********************************************************************
+ * gen_memprof.c -- Allocation accounting for key generation.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- Counters are updated with atomic adds so that worker
+ *           threads can share them.  Live bytes and their peak are
+ *           tracked over the whole process, since GMP hands the size
+ *           of every block back to the free function.
+ *
+ *           RSS figures, current and high water mark, both come from
+ *           /proc/self/status.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+
+#include "gen_memprof.h"
+
+
+     /******** #defines and typedefs  ********/
+#define ATOMIC_ADD(p, n)  __atomic_add_fetch ((p), (n), __ATOMIC_RELAXED)
+#define ATOMIC_GET(p)     __atomic_load_n ((p), __ATOMIC_RELAXED)
+
+
+     /******** globals in this file   ********/
+static __thread MEM_PHASE  nCurPhase = MEM_PHASE_OTHER;
+static MEM_COUNTS          counts[MEM_PHASE_COUNT];
+static long                nLiveBytes;     /* allocated, not yet freed */
+static long                nPeakLive;      /* maximum of nLiveBytes    */
+static unsigned long       nKeys;          /* finished keys            */
+static int                 flMemprofOn = 0;
+
+static const char         *phaseNames[MEM_PHASE_COUNT] = {
+  "other", "e", "p search", "q search", "d", "output"
+};
+
+static void *(*pfnNextAlloc)   (size_t);
+static void *(*pfnNextRealloc) (void *, size_t, size_t);
+static void  (*pfnNextFree)    (void *, size_t);
+
+
+     /******** functions in this file ********/
+static void  *fnMemprof_alloc (size_t nSize);
+static void  *fnMemprof_realloc (void *ptr, size_t nOld, size_t nNew);
+static void   fnMemprof_free (void *ptr, size_t nSize);
+static void   fnMemprof_live (long nDelta);
+static long   fnMemprof_status_kb (const char *pszKey);
+
+
+
+/************************************************************************
+ * fnMemprof_install -- Put the accounting layer in front of the
+ *                      current GMP memory functions.
+ *
+ * Remark - Call after fnArena_install, so that the arena is counted
+ *          as GMP sees it rather than chunk by chunk.
+ ***********************************************************************/
+void fnMemprof_install (void)
+{
+  if (flMemprofOn)
+    return;
+
+  mp_get_memory_functions (&pfnNextAlloc, &pfnNextRealloc, &pfnNextFree);
+  mp_set_memory_functions (fnMemprof_alloc, fnMemprof_realloc, \
+                           fnMemprof_free);
+  flMemprofOn = 1;
+}
+
+
+
+/************************************************************************
+ * fnMemprof_phase -- Charge the calling thread's allocations to
+ *                    nPhase from now on.  Returns the previous phase.
+ ***********************************************************************/
+MEM_PHASE fnMemprof_phase (MEM_PHASE nPhase)
+{
+  MEM_PHASE  nOld = nCurPhase;
+
+
+  nCurPhase = nPhase;
+  return nOld;
+}
+
+
+
+/************************************************************************
+ * fnMemprof_key_done -- Count one finished key, for the per key
+ *                       averages in the report.
+ ***********************************************************************/
+void fnMemprof_key_done (void)
+{
+  ATOMIC_ADD (&nKeys, 1);
+  nCurPhase = MEM_PHASE_OTHER;
+}
+
+
+
+/************************************************************************
+ * fnMemprof_get -- Snapshot of the counters of one phase.
+ ***********************************************************************/
+void fnMemprof_get (MEM_PHASE nPhase, MEM_COUNTS *pCounts)
+{
+  pCounts->nAllocs   = ATOMIC_GET (&counts[nPhase].nAllocs);
+  pCounts->nReallocs = ATOMIC_GET (&counts[nPhase].nReallocs);
+  pCounts->nFrees    = ATOMIC_GET (&counts[nPhase].nFrees);
+  pCounts->nBytes    = ATOMIC_GET (&counts[nPhase].nBytes);
+}
+
+
+
+/************************************************************************
+ * fnMemprof_rss_kb -- Current resident set size in KB, or -1.
+ ***********************************************************************/
+long fnMemprof_rss_kb (void)
+{
+  return fnMemprof_status_kb ("VmRSS:");
+}
+
+
+
+/************************************************************************
+ * fnMemprof_hwm_kb -- Resident set high water mark in KB, or -1.
+ ***********************************************************************/
+long fnMemprof_hwm_kb (void)
+{
+  return fnMemprof_status_kb ("VmHWM:");
+}
+
+
+
+/************************************************************************
+ * fnMemprof_status_kb -- The KB figure of line pszKey of
+ *                        /proc/self/status, or -1.
+ *
+ * Remark - getrusage counts ru_maxrss in its own way and can be below
+ *          the VmRSS of the same moment, so both figures come from
+ *          here.
+ ***********************************************************************/
+static long fnMemprof_status_kb (const char *pszKey)
+{
+  FILE    *fp;
+  char     achLine[128];
+  size_t   nKeyLen = strlen (pszKey);
+  long     nKb = -1;
+
+
+  fp = fopen ("/proc/self/status", "r");
+  if (fp == NULL)
+    return -1;
+  while (fgets (achLine, sizeof (achLine), fp) != NULL)
+    if (strncmp (achLine, pszKey, nKeyLen) == 0) {
+      if (sscanf (achLine + nKeyLen, "%ld", &nKb) != 1)
+        nKb = -1;
+      break;
+    }
+  fclose (fp);
+
+  return nKb;
+}
+
+
+
+/************************************************************************
+ * fnMemprof_report -- Print the totals per phase, per key averages
+ *                     and the RSS figures.
+ ***********************************************************************/
+void fnMemprof_report (FILE *fp)
+{
+  MEM_COUNTS     c, tot = { 0, 0, 0, 0 };
+  unsigned long  nK = ATOMIC_GET (&nKeys);
+  int            i;
+
+
+  fprintf (fp, "\n  --> Memory report (%lu key%s) <--\n", nK, \
+           nK == 1 ? "" : "s");
+  fprintf (fp, "      %-10s %12s %12s %12s %14s %12s\n", "phase", \
+           "allocs", "reallocs", "frees", "bytes", "bytes/key");
+
+  for (i = 0; i < MEM_PHASE_COUNT; i++) {
+    fnMemprof_get ((MEM_PHASE) i, &c);
+    fprintf (fp, "      %-10s %12lu %12lu %12lu %14lu %12lu\n", \
+             phaseNames[i], c.nAllocs, c.nReallocs, c.nFrees, c.nBytes, \
+             nK != 0 ? c.nBytes / nK : c.nBytes);
+    tot.nAllocs   += c.nAllocs;
+    tot.nReallocs += c.nReallocs;
+    tot.nFrees    += c.nFrees;
+    tot.nBytes    += c.nBytes;
+  }
+  fprintf (fp, "      %-10s %12lu %12lu %12lu %14lu %12lu\n", "total", \
+           tot.nAllocs, tot.nReallocs, tot.nFrees, tot.nBytes, \
+           nK != 0 ? tot.nBytes / nK : tot.nBytes);
+
+  fprintf (fp, "      live GMP bytes now:     %ld\n", ATOMIC_GET (&nLiveBytes));
+  fprintf (fp, "      peak live GMP bytes:    %ld\n", ATOMIC_GET (&nPeakLive));
+  fprintf (fp, "      RSS now:                %ld KB\n", fnMemprof_rss_kb ());
+  fprintf (fp, "      RSS high water mark:    %ld KB\n", fnMemprof_hwm_kb ());
+}
+
+
+
+/************************************************************************
+ * fnMemprof_live -- Move the live byte count and raise the peak.
+ ***********************************************************************/
+static void fnMemprof_live (long nDelta)
+{
+  long  nNow, nPeak;
+
+
+  nNow  = ATOMIC_ADD (&nLiveBytes, nDelta);
+  nPeak = ATOMIC_GET (&nPeakLive);
+  while (nNow > nPeak &&
+         !__atomic_compare_exchange_n (&nPeakLive, &nPeak, nNow, 1, \
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+
+
+
+/************************************************************************
+ * fnMemprof_alloc -- GMP allocate function.
+ ***********************************************************************/
+static void *fnMemprof_alloc (size_t nSize)
+{
+  ATOMIC_ADD (&counts[nCurPhase].nAllocs, 1);
+  ATOMIC_ADD (&counts[nCurPhase].nBytes, nSize);
+  fnMemprof_live ((long) nSize);
+
+  return pfnNextAlloc (nSize);
+}
+
+
+
+/************************************************************************
+ * fnMemprof_realloc -- GMP reallocate function.
+ ***********************************************************************/
+static void *fnMemprof_realloc (void *ptr, size_t nOld, size_t nNew)
+{
+  ATOMIC_ADD (&counts[nCurPhase].nReallocs, 1);
+  if (nNew > nOld)
+    ATOMIC_ADD (&counts[nCurPhase].nBytes, nNew - nOld);
+  fnMemprof_live ((long) nNew - (long) nOld);
+
+  return pfnNextRealloc (ptr, nOld, nNew);
+}
+
+
+
+/************************************************************************
+ * fnMemprof_free -- GMP free function.
+ ***********************************************************************/
+static void fnMemprof_free (void *ptr, size_t nSize)
+{
+  ATOMIC_ADD (&counts[nCurPhase].nFrees, 1);
+  fnMemprof_live (-(long) nSize);
+
+  pfnNextFree (ptr, nSize);
+}
@@ -0,0 +1,50 @@
+/**********************************************************************
+ * gen_memprof.h -- Allocation accounting for key generation, kept
+ *                  per phase of the key.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- The accounting layer wraps whatever memory functions GMP
+ *           is using when fnMemprof_install is called (the system
+ *           allocator or the arena), so it counts exactly what GMP
+ *           asks for.  The phase is per thread.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_MEMPROF_H
+#define GEN_MEMPROF_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+
+     /******** #defines and typedefs  ********/
+typedef enum {
+  MEM_PHASE_OTHER = 0,                /* setup, random state, ...      */
+  MEM_PHASE_E,                        /* public exponent e             */
+  MEM_PHASE_P,                        /* search for the first prime    */
+  MEM_PHASE_Q,                        /* search for the second prime   */
+  MEM_PHASE_D,                        /* private exponent d            */
+  MEM_PHASE_OUTPUT,                   /* printing / serializing        */
+  MEM_PHASE_COUNT
+} MEM_PHASE;
+
+typedef struct {
+  unsigned long  nAllocs;             /* allocate calls                */
+  unsigned long  nReallocs;           /* reallocate calls              */
+  unsigned long  nFrees;              /* free calls                    */
+  unsigned long  nBytes;              /* bytes requested, incl. growth */
+} MEM_COUNTS;
+
+
+     /******** functions in gen_memprof.c ********/
+void       fnMemprof_install (void);
+MEM_PHASE  fnMemprof_phase (MEM_PHASE nPhase);
+void       fnMemprof_key_done (void);
+void       fnMemprof_get (MEM_PHASE nPhase, MEM_COUNTS *pCounts);
+long       fnMemprof_rss_kb (void);
+long       fnMemprof_hwm_kb (void);
+void       fnMemprof_report (FILE *fp);
+
+#endif
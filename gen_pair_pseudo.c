@@ -13,6 +13,10 @@
  *           We use GMP functions for random bit and random number 
  *           generation instead of SHA-nnn hashes.
  *
+ *           Compiled with -DGEN_PAIR_LIB the file has no main, and
+ *           goes into libgen_pair.a for programs that call the
+ *           generator (gen_async.h, gen_batch.h) themselves.
+ *
  * $Id: gen_pair_pseudo.c,v 1.4 2022/10/07 03:47:20 jdeutsch Exp $
  *********************************************************************/
 
@@ -21,45 +25,554 @@
 #include <string.h>
 #include <time.h>
 #include <assert.h>
+#include <getopt.h>
+#include <pthread.h>
 #include <gmp.h>
 
+#include "gen_pair_pseudo.h"
+#include "gen_cancel.h"
+#include "gen_arena.h"
+#include "gen_memprof.h"
+#include "gen_writer.h"
+#include "gen_encode.h"
+#include "gen_decimal.h"
+#include "gen_bulk.h"
+#include "gen_checkpoint.h"
+#include "gen_jobs.h"
+#include "gen_stream.h"
+#include "gen_daemon.h"
+#include "gen_shm.h"
+#include "gen_primes.h"
+#include "gen_engine.h"
+#include "gen_pct.h"
+#include "gen_audit.h"
+#include "gen_range.h"
+#include "gen_dedup.h"
+
 
      /******** #defines and typedefs  ********/
-typedef int      BOOL;
-#define NUMTESTS (50)
+#define SOAK_SAMPLES    (20)        /* RSS samples in a soak test      */
+#define SOAK_DRIFT_PCT  (5)         /* RSS growth that counts as drift */
+#define SOAK_DRIFT_KB   (256)
 
 
      /******** globals in this file   ********/
-char            *program_name;      /* name of the program (for errors) */
-gmp_randstate_t  rndState;
+char                     *program_name;  /* name of the program (for errors) */
+__thread gmp_randstate_t  rndState;      /* one stream per thread            */
+__thread long             nCandidates;   /* primality tests, gen_engine.h    */
+
+static unsigned long     *pnSafePrimes;  /* odd primes below SAFE_SIEVE_LIMIT */
+static int                nSafePrimes;
+static pthread_once_t     onceSafe = PTHREAD_ONCE_INIT;
+
+#ifndef GEN_PAIR_LIB
+static struct option  longOpts[] = {
+  { "arena",        optional_argument, NULL, 'a' },
+  { "arena-stats",  no_argument,       NULL, 'A' },
+  { "secure-arena", no_argument,       NULL, 'S' },
+  { "hugepages",    no_argument,       NULL, 'H' },
+  { "mlock",        no_argument,       NULL, 'L' },
+  { "mem-report",   no_argument,       NULL, 'M' },
+  { "soak",         required_argument, NULL, 'K' },
+  { "bits",         required_argument, NULL, 'b' },
+  { "seed",         required_argument, NULL, 's' },
+  { "e",            required_argument, NULL, 'e' },
+  { "count",        required_argument, NULL, 'n' },
+  { "threads",      required_argument, NULL, 't' },
+  { "out",          required_argument, NULL, 'o' },
+  { "direct",       no_argument,       NULL, 'D' },
+  { "no-uring",     no_argument,       NULL, 'U' },
+  { "buffer",       required_argument, NULL, 'B' },
+  { "format",       required_argument, NULL, 'f' },
+  { "stream",       no_argument,       NULL, 'X' },
+  { "reorder",      no_argument,       NULL, 'R' },
+  { "daemon",       required_argument, NULL, 'Y' },
+  { "pool",         required_argument, NULL, 'P' },
+  { "pool-bits",    required_argument, NULL, 'G' },
+  { "max-pending",  required_argument, NULL, 'Q' },
+  { "deadline",     required_argument, NULL, 'T' },
+  { "shm",          required_argument, NULL, 'Z' },
+  { "shm-slots",    required_argument, NULL, 'W' },
+  { "checkpoint",   required_argument, NULL, 'C' },
+  { "checkpoint-every", required_argument, NULL, 'E' },
+  { "resume",       no_argument,       NULL, 'V' },
+  { "jobs",         required_argument, NULL, 'J' },
+  { "primes",       required_argument, NULL, 'I' },
+  { "safe",         no_argument,       NULL, 'F' },
+  { "engine",       required_argument, NULL, 'N' },
+  { "ab",           required_argument, NULL, 'O' },
+  { "compat",       required_argument, NULL, 'c' },
+  { "kat",          no_argument,       NULL, 'k' },
+  { "e-cost",       no_argument,       NULL, 'x' },
+  { "pct",          no_argument,       NULL, 'y' },
+  { "audit",        required_argument, NULL, 'u' },
+  { "audit-reps",   required_argument, NULL, 'r' },
+  { "audit-e-min",  required_argument, NULL, 'l' },
+  { "dedup",        required_argument, NULL, 'd' },
+  { "dedup-fp",     required_argument, NULL, 'g' },
+  { "dedup-capacity", required_argument, NULL, 'j' },
+  { "dedup-merge",  required_argument, NULL, 'm' },
+  { "enum",         required_argument, NULL, 'v' },
+  { "enum-reps",    required_argument, NULL, 'w' },
+  { "next-prime",   required_argument, NULL, 'z' },
+  { "help",         no_argument,       NULL, 'h' },
+  { NULL,           0,                 NULL,  0  }
+};
+#endif
 
 
      /******** functions in this file ********/
-BOOL  fnCreate_pseudo_prime (mpz_t mpzPrime, mpz_t mpzE, mpz_t mpzCompare, \
-      int nNumBits, int nNumTests, BOOL flTestDiff );
-BOOL  fnCompute_exponent_d (mpz_t mpzP1, mpz_t mpzE, mpz_t mpzP2, \
-      mpz_t mpzD, int nNumBits);
 BOOL  fnGet_key_length (int *pnNumBits);
 BOOL  fnGet_rand_seed (int *pnSeed);
-BOOL  fnGet_exponent_e (mpz_t mpzE);
+BOOL  fnGet_exponent_e (mpz_t mpzE, BOOL *pflRandom);
+BOOL  fnSoak_test (int nBitLen, const E_POLICY *pPolicy, long nKeys);
+void  fnPrint_e_costs (const E_POLICY *pPolicy);
+int   fnPrint_primes (int nNumBits, long nCount, const E_POLICY *pPolicy, \
+      int nPrime, unsigned long nSeed, int nFormat);
+int   fnPrint_range (const char *pszRange, const char *pszNext, \
+      const E_POLICY *pPolicy, int nNumTests, int nThreads, int nFormat);
+void  fnPrint_range_prime (mpz_t mpzPrime, void *pArg);
+void  fnPrint_number (mpz_t mpzX, int nFormat, int nBitLen);
+void  fnSafe_primes_init (void);
+void  fnUsage (void);
 
 
 
+#ifndef GEN_PAIR_LIB
 /*************** main -- entry point **********************/
-int main()
+int main(int argc, char *argv[])
 {
-  int     nBitLen;                         /* number of bits           */
-  int     nHalfLen;                        /* bit length / 2           */
+  int     nBitLen = 0;                     /* number of bits           */
   mpz_t   mpzP1, mpzP2, mpzE, mpzD, t;     /* two primes P, exponent E */
   mpz_t   mpzBoundE;                       /* upper bound for E        */
   int     nSeed;                           /* seed of random generator */
+  BOOL    flSeedSet = 0;                   /* seed given on the line   */
+  E_POLICY       ePolicy;                  /* e given on the line      */
+  BOOL    flESet = 0;
+  BULK_OPTS      bulk;                     /* bulk mode, nCount > 0    */
+  STREAM_OPTS    stream;                   /* co-process mode          */
+  BOOL    flStream = 0;
+  DAEMON_OPTS    daemon;                   /* socket server mode       */
+  CHECKPOINT     ckpt;                     /* run to resume            */
+  JOBS_OPTS      jobs;                     /* job file mode            */
+  AUDIT_OPTS     audit;                    /* key file audit mode      */
+  char   *pch;
+  int     chOpt;                           /* command line option      */
+  BOOL    flArena = 0;                     /* use the bump arena       */
+  int     nArenaFlags = 0;                 /* ARENA_F_ options         */
+  size_t  nChunkSize = 0;                  /* arena chunk size, bytes  */
+  BOOL    flMemReport = 0;                 /* print the memory report  */
+  long    nSoakKeys = 0;                   /* keys in the soak test    */
+  long    nPrimes = 0;                     /* primes mode, how many    */
+  int     nPrimeType = PRIME_PROBABLE;     /* primes mode, which kind  */
+  char   *pszAB = NULL;                    /* engines to compare       */
+  char   *pszDedup = NULL;                 /* prime index file         */
+  char   *pszDedupMerge = NULL;            /* index to merge into it   */
+  long    nDedupCap = DEDUP_CAP_DEFAULT;   /* primes a new index holds */
+  double  dDedupFp = DEDUP_FP_DEFAULT;     /* its false positive rate  */
+  char   *pszRange = NULL;                 /* interval to enumerate    */
+  char   *pszNextPrime = NULL;             /* number to start above    */
+  int     nRangeReps = NUMTESTS;           /* their primality reps     */
+  BOOL    flECost = 0;                     /* print the e policy costs */
+  BOOL    flRandomE;                       /* e drawn at random        */
+  int     nRet;                            /* bulk mode exit status    */
+  int     nFormat = FMT_DEFAULT;           /* how numbers are printed  */
+
+
+  /* 0. Command line options.  GMP allocators must be set up */
+  /*    before the first mpz_t is touched.                   */
+  program_name = argv[0];
+  memset (&bulk, 0, sizeof (bulk));
+  memset (&stream, 0, sizeof (stream));
+  memset (&daemon, 0, sizeof (daemon));
+  memset (&jobs, 0, sizeof (jobs));
+  memset (&audit, 0, sizeof (audit));
+  daemon.nPoolSize = DAEMON_POOL_DEFAULT;
+  while ((chOpt = getopt_long (argc, argv, "b:s:e:n:t:o:f:h", longOpts, \
+                               NULL)) != -1) {
+    switch (chOpt) {
+      case 'a':
+        flArena = 1;
+        if (optarg != NULL)
+          nChunkSize = (size_t) strtoul (optarg, NULL, 10) * 1024;
+        break;
+      case 'A':
+        flArena = 1;
+        nArenaFlags |= ARENA_F_STATS;
+        break;
+      case 'S':
+        flArena = 1;
+        nArenaFlags |= ARENA_F_SECURE;
+        break;
+      case 'H':
+        nArenaFlags |= ARENA_F_HUGEPAGES;
+        break;
+      case 'L':
+        nArenaFlags |= ARENA_F_MLOCK;
+        break;
+      case 'M':
+        flMemReport = 1;
+        break;
+      case 'K':
+        nSoakKeys = strtol (optarg, NULL, 10);
+        break;
+      case 'b':
+        nBitLen = atoi (optarg);
+        break;
+      case 's':
+        nSeed = atoi (optarg);
+        flSeedSet = 1;
+        break;
+      case 'e':
+        if (fnParse_e_policy (optarg, &ePolicy) != 0) {
+          fprintf (stderr, "%s: bad exponent '%s'\n", program_name, optarg);
+          return 1;
+        }
+        flESet = 1;
+        break;
+      case 'n':
+        bulk.nCount = strtol (optarg, NULL, 10);
+        break;
+      case 't':
+        bulk.nThreads = atoi (optarg);
+        break;
+      case 'o':
+        bulk.pszOut = optarg;
+        break;
+      case 'D':
+        bulk.nWriterFlags |= WRITER_F_DIRECT;
+        break;
+      case 'U':
+        bulk.nWriterFlags |= WRITER_F_NO_URING;
+        break;
+      case 'B':
+        bulk.nBufSize = (size_t) strtoul (optarg, NULL, 10) * 1024;
+        break;
+      case 'f':
+        if ((nFormat = fnEncode_parse_format (optarg)) < 0) {
+          fprintf (stderr, "%s: unknown format '%s'\n", program_name, optarg);
+          return 1;
+        }
+        break;
+      case 'X':
+        flStream = 1;
+        break;
+      case 'R':
+        stream.flReorder = 1;
+        break;
+      case 'Y':
+        daemon.pszPath = optarg;
+        break;
+      case 'P':
+        daemon.nPoolSize = atoi (optarg);
+        break;
+      case 'G':
+        for (pch = strtok (optarg, ","); pch != NULL && \
+             daemon.nPoolBits < DAEMON_MAX_SIZES; pch = strtok (NULL, ","))
+          daemon.anPoolBits[daemon.nPoolBits++] = atoi (pch);
+        break;
+      case 'Q':
+        daemon.nMaxPending = atoi (optarg);
+        break;
+      case 'T':
+        daemon.nDeadlineMs = stream.nDeadlineMs = strtol (optarg, NULL, 10);
+        break;
+      case 'Z':
+        bulk.pszShm = optarg;
+        break;
+      case 'W':
+        bulk.nShmSlots = atoi (optarg);
+        break;
+      case 'C':
+        bulk.pszCheckpoint = optarg;
+        break;
+      case 'E':
+        bulk.nCkptEvery = strtol (optarg, NULL, 10);
+        break;
+      case 'V':
+        bulk.flResume = 1;
+        break;
+      case 'J':
+        jobs.pszFile = optarg;
+        break;
+      case 'I':
+        nPrimes = strtol (optarg, NULL, 10);
+        break;
+      case 'F':
+        nPrimeType = PRIME_SAFE;
+        break;
+      case 'N':
+        if (fnEngine_select (optarg) != 0) {
+          fprintf (stderr, "%s: no engine '%s', there are\n", \
+                   program_name, optarg);
+          fnEngine_list (stderr);
+          return 1;
+        }
+        break;
+      case 'O':
+        pszAB = optarg;
+        break;
+      case 'c':
+        if (strcmp (optarg, "legacy") != 0) {
+          fprintf (stderr, "%s: --compat knows only 'legacy'\n", \
+                   program_name);
+          return 1;
+        }
+        fnEngine_select ("compat");
+        break;
+      case 'k':
+        return fnEngine_kat () == 0 ? 0 : 1;
+      case 'x':
+        flECost = 1;
+        break;
+      case 'y':
+        fnPct_enable (1);
+        break;
+      case 'u':
+        audit.pszFile = optarg;
+        break;
+      case 'r':
+        audit.nReps = (int) strtol (optarg, NULL, 10);
+        break;
+      case 'l':
+        audit.nEMin = strtoul (optarg, NULL, 0);
+        break;
+      case 'd':
+        pszDedup = optarg;
+        break;
+      case 'g':
+        dDedupFp = strtod (optarg, NULL);
+        break;
+      case 'j':
+        nDedupCap = strtol (optarg, NULL, 10);
+        break;
+      case 'm':
+        pszDedupMerge = optarg;
+        break;
+      case 'v':
+        pszRange = optarg;
+        break;
+      case 'w':
+        nRangeReps = (int) strtol (optarg, NULL, 10);
+        break;
+      case 'z':
+        pszNextPrime = optarg;
+        break;
+      case 'h':
+        fnUsage ();
+        return 0;
+      default:
+        fnUsage ();
+        return 1;
+    }
+  }
+
+  if (flArena)
+    fnArena_install (nChunkSize, nArenaFlags);
+  if (flMemReport)
+    fnMemprof_install ();
+
+  /* 0. The prime index, for every mode below, or a merge of two */
+  if (pszDedupMerge != NULL) {
+    if (pszDedup == NULL) {
+      fprintf (stderr, "%s: --dedup-merge needs --dedup=FILE\n", \
+               program_name);
+      return 1;
+    }
+    return fnDedup_merge (pszDedup, pszDedupMerge) == 0 ? 0 : 1;
+  }
+  /*     A prime goes into the index when it is found, before   */
+  /*     its key reaches a checkpoint; a resumed run would find */
+  /*     the primes of the keys it makes again there, and hand  */
+  /*     out other keys than the run that was stopped           */
+  if (pszDedup != NULL && bulk.pszCheckpoint != NULL) {
+    fprintf (stderr, "%s: --dedup cannot be used with --checkpoint\n", \
+             program_name);
+    return 1;
+  }
+  if (pszDedup != NULL) {
+    if (fnDedup_open (pszDedup, nDedupCap, dDedupFp) != 0)
+      return 1;
+    atexit (fnDedup_close);
+  }
+
+  /* 0a. Daemon and streaming modes take their requests from */
+  /*     a socket or stdin, there is nobody to answer the      */
+  /*     questions below                                       */
+  if (daemon.pszPath != NULL) {
+    daemon.nSeed       = flSeedSet ? (unsigned long) nSeed : \
+                                     (unsigned long) time (NULL);
+    daemon.nThreads    = bulk.nThreads > 0 ? bulk.nThreads : 2;
+    if (daemon.nMaxPending <= 0)
+      daemon.nMaxPending = 8 * daemon.nThreads;
+    nRet = fnDaemon_run (&daemon);
+    if (flMemReport)
+      fnMemprof_report (stderr);
+    if (nArenaFlags & ARENA_F_STATS)
+      fnArena_print_stats (stderr);
+    return nRet;
+  }
+
+  /* 0b. Streaming mode, requests on stdin */
+  if (flStream) {
+    stream.nSeed    = flSeedSet ? (unsigned long) nSeed : \
+                                  (unsigned long) time (NULL);
+    stream.nThreads = bulk.nThreads;
+    stream.nFormat  = nFormat;
+    nRet = fnStream_run (&stream, stdin, stdout);
+    if (flMemReport)
+      fnMemprof_report (stderr);
+    if (nArenaFlags & ARENA_F_STATS)
+      fnArena_print_stats (stderr);
+    return nRet;
+  }
+
+  /* 0c. Job file mode, the sizes come from the file */
+  if (jobs.pszFile != NULL) {
+    jobs.nSeed        = flSeedSet ? (unsigned long) nSeed : \
+                                    (unsigned long) time (NULL);
+    jobs.nThreads     = bulk.nThreads;
+    jobs.nFormat      = nFormat;
+    jobs.pszOut       = bulk.pszOut;
+    jobs.nWriterFlags = bulk.nWriterFlags;
+    jobs.nBufSize     = bulk.nBufSize;
+    jobs.nBufs        = bulk.nBufs;
+    nRet = fnJobs_run (&jobs);
+    if (flMemReport)
+      fnMemprof_report (stderr);
+    if (nArenaFlags & ARENA_F_STATS)
+      fnArena_print_stats (stderr);
+    return nRet;
+  }
+
+  /*     Audit mode, the keys come from the file too */
+  if (audit.pszFile != NULL) {
+    audit.nThreads = bulk.nThreads;
+    audit.pszOut   = bulk.pszOut;
+    return fnAudit_run (&audit);
+  }
+
+  /*     Enumeration and next prime, the numbers are on the line */
+  if (pszRange != NULL || pszNextPrime != NULL) {
+    if (flESet && ePolicy.nKind != E_POLICY_FIXED) {
+      fprintf (stderr, "%s: --enum and --next-prime take only a fixed " \
+               "-e\n", program_name);
+      return 1;
+    }
+    if (!flESet)
+      ePolicy.nKind = E_POLICY_RANDOM;
+    return fnPrint_range (pszRange, pszNextPrime, &ePolicy, nRangeReps, \
+                          bulk.nThreads, nFormat);
+  }
+
+  /* 0d. A checkpointed bulk run needs a file it can cut back to */
+  /*     the checkpoint, resuming takes everything from it         */
+  if (bulk.flResume && bulk.pszCheckpoint == NULL) {
+    fprintf (stderr, "%s: --resume needs --checkpoint=FILE\n", program_name);
+    return 1;
+  }
+  if (bulk.pszCheckpoint != NULL && !bulk.flResume && \
+      (bulk.nCount <= 0 || bulk.pszOut == NULL || \
+       strcmp (bulk.pszOut, "-") == 0 || bulk.pszShm != NULL)) {
+    fprintf (stderr, "%s: --checkpoint needs -n and -o FILE\n", program_name);
+    return 1;
+  }
+  if (bulk.flResume) {
+    if (fnCheckpoint_read (bulk.pszCheckpoint, &ckpt) != 0)
+      return 1;
+    if (ckpt.nNext == ckpt.nCount) {
+      fprintf (stderr, "%s: all %ld keys are in %s already\n", \
+               program_name, ckpt.nCount, ckpt.achOut);
+      return 0;
+    }
+    bulk.nBitLen   = ckpt.nBitLen;
+    bulk.nSeed     = ckpt.nSeed;
+    bulk.ePolicy   = ckpt.ePolicy;
+    bulk.nCount    = ckpt.nCount;
+    bulk.nFormat   = ckpt.nFormat;
+    bulk.pszOut    = ckpt.achOut;
+    bulk.pszShm    = NULL;
+    bulk.nFirst    = ckpt.nNext;
+    bulk.nStartOff = ckpt.nOffset;
+    nRet = fnBulk_run (&bulk);
+    if (flMemReport)
+      fnMemprof_report (stderr);
+    if (nArenaFlags & ARENA_F_STATS)
+      fnArena_print_stats (stderr);
+    return nRet;
+  }
 
+  /* 0e. Cost of the e policies, and of -e if it is another */
+  if (flECost) {
+    fnPrint_e_costs (flESet ? &ePolicy : NULL);
+    return 0;
+  }
+
+  /* 0f. Engine A/B harness, primes for keys of -b bits */
+  if (pszAB != NULL) {
+    if (!flESet) {
+      ePolicy.nKind = E_POLICY_FIXED;
+      ePolicy.nValE = 65537;
+    }
+    nRet = fnEngine_ab (pszAB, nBitLen > 0 ? nBitLen : 2048, \
+                        bulk.nCount > 0 ? bulk.nCount : 100, &ePolicy, \
+                        flSeedSet ? (unsigned long) nSeed : 1);
+    if (flMemReport)
+      fnMemprof_report (stderr);
+    if (nArenaFlags & ARENA_F_STATS)
+      fnArena_print_stats (stderr);
+    return nRet;
+  }
 
   /* 1. Get the key length */
-  fnGet_key_length (&nBitLen);
-  nHalfLen = nBitLen / 2;
+  if (nBitLen == 0)
+    fnGet_key_length (&nBitLen);
+
+  /* 2. Set up random number generator */
+  if (!flSeedSet)
+    fnGet_rand_seed (&nSeed);
+#ifdef DEBUG06
+  printf ("\t Random seed:  %d\n\n", nSeed);
+#endif
+
+  /* 2a. Bulk mode hands everything to the worker threads, */
+  /*     without --e every key draws its own random e        */
+  if (bulk.nCount > 0) {
+    bulk.nBitLen = nBitLen;
+    bulk.nFormat = nFormat;
+    bulk.nSeed   = (unsigned long) nSeed;
+    if (flESet)
+      bulk.ePolicy = ePolicy;
+    else
+      bulk.ePolicy.nKind = E_POLICY_RANDOM;
+    nRet = fnBulk_run (&bulk);
+    if (flMemReport)
+      fnMemprof_report (stderr);
+    if (nArenaFlags & ARENA_F_STATS)
+      fnArena_print_stats (stderr);
+    return nRet;
+  }
+
+  /* 2b. Primes mode, -b is the length of the primes and only */
+  /*     a fixed e is a condition on them                       */
+  if (nPrimes > 0) {
+    if (!flESet)
+      ePolicy.nKind = E_POLICY_RANDOM;
+    nRet = fnPrint_primes (nBitLen, nPrimes, &ePolicy, nPrimeType, \
+                           (unsigned long) nSeed, nFormat);
+    if (flMemReport)
+      fnMemprof_report (stderr);
+    if (nArenaFlags & ARENA_F_STATS)
+      fnArena_print_stats (stderr);
+    return nRet;
+  }
 
-  /* 2. Initialize the numbers */
+  gmp_randinit_default (rndState);          /* initialize random state */
+  gmp_randseed_ui (rndState, nSeed);        /* use something to give randomness */
+
+  /* 3. Initialize the numbers.  Everything from here to step 9 */
+  /*    is this key's and lives in the arena when there is one.  */
+  fnArena_begin ();
   mpz_inits(mpzP1, mpzP2, mpzE, mpzBoundE, mpzD, t, NULL);
   mpz_set_ui(mpzP1,0);
   mpz_set_ui(mpzP2,0);
@@ -68,56 +581,73 @@ int main()
   mpz_set_ui(mpzBoundE, 1);
   mpz_set_ui(t,1);
 
-  /* 3. Set up random number generator */
-  gmp_randinit_default (rndState);          /* initialize random state */
-  fnGet_rand_seed (&nSeed);
-#ifdef DEBUG06
-  printf ("\t Random seed:  %d\n\n", nSeed);
-#endif
-  gmp_randseed_ui (rndState, nSeed);        /* use something to give randomness */
-
   /* 4. Produce public exponent e */
-  fnGet_exponent_e (mpzE);
+  fnMemprof_phase (MEM_PHASE_E);
+  if (!flESet) {
+    fnGet_exponent_e (mpzE, &flRandomE);
+    ePolicy.nKind = flRandomE ? E_POLICY_RANDOM : E_POLICY_FIXED;
+    ePolicy.nValE = flRandomE ? 0 : mpz_get_ui (mpzE);
+  }
+  else
+    fnMake_exponent_e (mpzE, &ePolicy);
   										   
+  fnMemprof_phase (MEM_PHASE_OUTPUT);
   printf ("  The exponent e is: ");
-  mpz_out_str(stdout, 10, mpzE);
+  fnPrint_number (mpzE, nFormat, nBitLen);
   printf ("\n");
   
-  /* 5. Produce first pseudo random prime of bit length n/2 */
-  fnCreate_pseudo_prime (mpzP1, mpzE, mpzP2, nHalfLen, NUMTESTS, 0);
+  /* 5. Produce the two pseudo random primes of bit length n/2 */
+  /*    and the exponent d                                      */
+  if (fnGenerate_keypair (mpzP1, mpzP2, mpzD, mpzE, nBitLen) != KEYGEN_OK) {
+    printf ("   ### FAILURE creating prime\n");
+    exit(1);
+  }
 
+  /* 6. Print the first and second pseudo-prime */
+  fnMemprof_phase (MEM_PHASE_OUTPUT);
   printf ("  The first pseudo-prime is:  ");
-  mpz_out_str(stdout, 10, mpzP1);
+  fnPrint_number (mpzP1, nFormat, nBitLen);
   printf ("\n");
   printf ("  In binary it is:     ");
   mpz_out_str(stdout, 2, mpzP1);
   printf ("\n");
 
-
-  /* 6. Produce second pseudo random prime of bit length n/2 */
-  fnCreate_pseudo_prime (mpzP2, mpzE, mpzP1, nHalfLen, NUMTESTS, 1);
-
   printf ("  The second pseudo-prime is: ");
-  mpz_out_str(stdout, 10, mpzP2);
+  fnPrint_number (mpzP2, nFormat, nBitLen);
   printf ("\n");
   printf ("  In binary it is:     ");
   mpz_out_str(stdout, 2, mpzP2);
   printf ("\n");
 
-  /* 7. Find the exponent d  */
-  fnCompute_exponent_d (mpzP1, mpzE, mpzP2, mpzD, nHalfLen);
+  /* 7. The exponent d was found with the primes */
 
   /* 8. Print the exponent d */
   printf ("  The exponent d is:          ");
-  mpz_out_str(stdout, 10, mpzD);
+  fnPrint_number (mpzD, nFormat, nBitLen);
   printf ("\n");
 
   /* 9. Clean up the mpz_t handles or else we will leak memory */
   mpz_clears(mpzP1, mpzP2, mpzE, mpzBoundE, mpzD, t, NULL);
+  fnArena_end ();
+  fnMemprof_key_done ();
+
+  /* 10. Optionally keep going with the same parameters to watch */
+  /*     the memory footprint over a long run                    */
+  if (nSoakKeys > 0)
+    fnSoak_test (nBitLen, &ePolicy, nSoakKeys);
+
   gmp_randclear (rndState);
+
+  if (flMemReport)
+    fnMemprof_report (stdout);
+
+  if (nArenaFlags & ARENA_F_STATS)
+    fnArena_print_stats (stdout);
+  fnArena_thread_release ();
   
   return 0;
 }
+#endif
 
 
 
@@ -126,8 +656,11 @@ int main()
  *                          number of bits.  See FIPS 186-3 p. 55.
  *
  * Remark - Do the check for exponent D later.  See top of p. 53.
+ *          Returns KEYGEN_OK, KEYGEN_EXHAUSTED after 5 nNumBits
+ *          candidates, or what fnCancel_check said before a
+ *          candidate.
  ***********************************************************************/
-BOOL fnCreate_pseudo_prime (mpz_t mpzPrime, mpz_t mpzE, mpz_t mpzCompare, \
+int fnCreate_pseudo_prime (mpz_t mpzPrime, mpz_t mpzE, mpz_t mpzCompare, \
      int nNumBits, int nNumTests, BOOL flTestDiff )
 {
   mpz_t   n, nSq,  mpzOneShifted;      /* n, n squared, and 1 shifted */
@@ -135,10 +668,14 @@ BOOL fnCreate_pseudo_prime (mpz_t mpzPrime, mpz_t mpzE, mpz_t mpzCompare, \
   int     i = 0;                       /* number of iterations */
   int     retval;                      /* return value         */
   int     j;
+  int     nStatus = KEYGEN_OK;
+  unsigned long  nSmallE;              /* prime e, or 0        */
+  BOOL    flCoprime;
 
 
   /* 1. Initialize the numbers */
   mpz_inits(n, nSq, temp, mpzOneShifted, NULL);
+  nSmallE = fnSmall_prime_e (mpzE);
 
 
   /* 2. Produce pseudo random prime of bit length n            */
@@ -146,6 +683,9 @@ BOOL fnCreate_pseudo_prime (mpz_t mpzPrime, mpz_t mpzE, mpz_t mpzCompare, \
   /*    Re-set at the top of the loop each time.               */
 
   while (1) {
+                                  /* given up on by the caller? */
+    if ((nStatus = fnCancel_check ()) != KEYGEN_OK)
+      break;
                                   /* line 4.2 */                              
                       /* Reset variables each time through the loop. */
                       /* Set up large int with proper nmbr of bits . */
@@ -199,13 +739,19 @@ BOOL fnCreate_pseudo_prime (mpz_t mpzPrime, mpz_t mpzE, mpz_t mpzCompare, \
                                   /* compare to bounds for p */
     if (mpz_cmp (nSq, mpzOneShifted) < 0)
 	  continue;
-                                  /* line 4.5          */
-    mpz_set_ui (temp, 0);
-    mpz_sub_ui (temp, n, 1L);
-	mpz_gcd (temp, temp, mpzE);
+                                  /* line 4.5, for a prime e    */
+                                  /* gcd (n - 1, e) = 1 is n mod e != 1 */
+    if (nSmallE != 0)
+      flCoprime = mpz_fdiv_ui (n, nSmallE) != 1;
+    else {
+      mpz_sub_ui (temp, n, 1L);
+      mpz_gcd (temp, temp, mpzE);
+      flCoprime = mpz_cmp_ui (temp, 1) == 0;
+    }
 	                              /* check for relatively prime */
-	if (mpz_cmp_ui (temp, 1) == 0) {
+	if (flCoprime) {
                                   /* line 4.5.1 */
+      nCandidates++;
       retval = mpz_probab_prime_p (n, nNumTests);
                                   /* prob prime or prime */
       if (retval >= 1) 
@@ -215,13 +761,14 @@ BOOL fnCreate_pseudo_prime (mpz_t mpzPrime, mpz_t mpzE, mpz_t mpzCompare, \
 
     i++;
     if (i >= 5 * nNumBits) {
-	  printf ("   ### FAILURE creating prime\n");
-	  exit(1);
+      nStatus = KEYGEN_EXHAUSTED;
+      break;
 	}  
   }
   
   /* 3. copy over results to return them */
-  mpz_set (mpzPrime, n);    
+  if (nStatus == KEYGEN_OK)
+    mpz_set (mpzPrime, n);    
 #ifdef DEBUG03
   printf ("   ### The value of n:      ");
   mpz_out_str(stdout, 10, n);
@@ -234,7 +781,149 @@ BOOL fnCreate_pseudo_prime (mpz_t mpzPrime, mpz_t mpzE, mpz_t mpzCompare, \
   /* 4. Clean up the mpz_t handles or else we will leak memory */
   mpz_clears(n, nSq, temp, mpzOneShifted, NULL);
   
-  return 0;
+  return nStatus;
+}
+
+
+
+/************************************************************************
+ * fnCreate_safe_prime -- Create a safe prime p = 2q + 1, q prime, with
+ *                        the requisite number of bits and the same
+ *                        bounds as fnCreate_pseudo_prime.
+ *
+ * Remark - Candidates p = n + 4k, n = 3 mod 4, are sieved SAFE_WINDOW
+ *          at a time: k is struck out when p or q has an odd factor
+ *          below SAFE_SIEVE_LIMIT.  A survivor gets a Fermat test of
+ *          q before the full tests of q and p.  A prime e below
+ *          E_FOLD_MAX is sieved too, p = 1 mod e being the only
+ *          way gcd (p - 1, e) can fail.  There is no limit on
+ *          the tries, safe primes are rarer but always there; the
+ *          search only stops early for fnCancel_check.
+ ***********************************************************************/
+int fnCreate_safe_prime (mpz_t mpzPrime, mpz_t mpzE, mpz_t mpzCompare, \
+     int nNumBits, int nNumTests, BOOL flTestDiff)
+{
+  mpz_t           n, p, q, temp, mpzLow, mpzDiff;
+  mpz_t           mpzTwo;              /* Fermat base, not mpzPrime   */
+  unsigned char   achSieve[SAFE_WINDOW];  /* 1: candidate k struck out */
+  unsigned long   nPrime, nRes, nInv4;
+  unsigned long   nSmallE;             /* prime e struck out, or 0    */
+  int             i, k;
+  BOOL            flFound = 0;
+  int             nStatus = KEYGEN_OK;
+
+
+  /* 1. Odd primes for the sieve, made once, and the bounds */
+  pthread_once (&onceSafe, fnSafe_primes_init);
+  mpz_inits (n, p, q, temp, mpzLow, mpzDiff, NULL);
+  mpz_init_set_ui (mpzTwo, 2);
+  mpz_setbit (mpzLow, 2 * nNumBits - 1);   /* p^2 >= 2^{2 nNumBits - 1} */
+  mpz_sqrt (mpzLow, mpzLow);
+  mpz_add_ui (mpzLow, mpzLow, 1);
+  mpz_setbit (mpzDiff, nNumBits <= 100 ? 0 : nNumBits - 100);
+  nSmallE = fnSmall_prime_e (mpzE);
+
+  while (!flFound && (nStatus = fnCancel_check ()) == KEYGEN_OK) {
+    /* 2. Random start n = 3 mod 4 above the lower bound */
+    mpz_urandomb (n, rndState, nNumBits - 1);
+    mpz_setbit (n, nNumBits - 1);
+    mpz_setbit (n, 0);
+    mpz_setbit (n, 1);
+    if (mpz_cmp (n, mpzLow) < 0)
+      continue;
+
+    /* 3. Strike out k with s | n + 4k or s | (n + 4k - 1) / 2 */
+    memset (achSieve, 0, SAFE_WINDOW);
+    for (i = 0; i < nSafePrimes; i++) {
+      nPrime = pnSafePrimes[i];
+      nRes   = mpz_fdiv_ui (n, nPrime);
+      nInv4  = ((nPrime + 1) / 2) * ((nPrime + 1) / 2) % nPrime;
+      for (k = (int) ((nPrime - nRes) % nPrime * nInv4 % nPrime); \
+           k < SAFE_WINDOW; k += nPrime)
+        achSieve[k] = 1;
+      for (k = (int) ((nPrime + 1 - nRes) % nPrime * nInv4 % nPrime); \
+           k < SAFE_WINDOW; k += nPrime)
+        achSieve[k] = 1;
+    }
+                                  /* and p = 1 mod a prime e, which */
+                                  /* is gcd (p - 1, e) != 1         */
+    if (nSmallE != 0) {
+      nRes  = mpz_fdiv_ui (n, nSmallE);
+      nInv4 = ((nSmallE + 1) / 2) * ((nSmallE + 1) / 2) % nSmallE;
+      for (k = (int) ((nSmallE + 1 - nRes) % nSmallE * nInv4 % nSmallE); \
+           k < SAFE_WINDOW; k += nSmallE)
+        achSieve[k] = 1;
+    }
+
+    /* 4. Test the survivors */
+    for (k = 0; k < SAFE_WINDOW && !flFound; k++) {
+      if (achSieve[k])
+        continue;
+      if ((nStatus = fnCancel_check ()) != KEYGEN_OK)
+        break;
+      mpz_add_ui (p, n, 4UL * k);
+      if (mpz_sizeinbase (p, 2) != (size_t) nNumBits)
+        break;
+      if (flTestDiff) {
+        mpz_sub (temp, p, mpzCompare);
+        mpz_abs (temp, temp);
+        if (mpz_cmp (temp, mpzDiff) <= 0)
+          continue;
+      }
+      mpz_tdiv_q_2exp (q, p, 1);
+      mpz_sub_ui (temp, q, 1);
+      mpz_powm (temp, mpzTwo, temp, q);
+      if (mpz_cmp_ui (temp, 1) != 0)
+        continue;
+      if (nSmallE == 0) {
+        mpz_sub_ui (temp, p, 1);
+        mpz_gcd (temp, temp, mpzE);
+        if (mpz_cmp_ui (temp, 1) != 0)
+          continue;
+      }
+      if (mpz_probab_prime_p (q, nNumTests) == 0)
+        continue;
+      if ((nStatus = fnCancel_check ()) != KEYGEN_OK)
+        break;
+      if (mpz_probab_prime_p (p, nNumTests) >= 1)
+        flFound = 1;
+    }
+    if (nStatus != KEYGEN_OK)
+      break;
+  }
+
+  /* 5. copy over results to return them */
+  if (flFound)
+    mpz_set (mpzPrime, p);
+
+  mpz_clears (n, p, q, temp, mpzLow, mpzDiff, mpzTwo, NULL);
+
+  return nStatus;
+}
+
+
+
+/************************************************************************
+ * fnSafe_primes_init -- The odd primes below SAFE_SIEVE_LIMIT for
+ *                       fnCreate_safe_prime, once for the run.
+ ***********************************************************************/
+void fnSafe_primes_init (void)
+{
+  unsigned char  *pchComp;
+  unsigned long   nPrime, nRes;
+
+
+  pchComp      = (unsigned char *) calloc (SAFE_SIEVE_LIMIT, 1);
+  pnSafePrimes = (unsigned long *) malloc (SAFE_SIEVE_LIMIT / 2 * \
+                                           sizeof (long));
+  for (nPrime = 3; nPrime < SAFE_SIEVE_LIMIT; nPrime += 2) {
+    if (pchComp[nPrime])
+      continue;
+    pnSafePrimes[nSafePrimes++] = nPrime;
+    for (nRes = nPrime * nPrime; nRes < SAFE_SIEVE_LIMIT; nRes += 2 * nPrime)
+      pchComp[nRes] = 1;
+  }
+  free (pchComp);
 }
 
 
@@ -243,6 +932,9 @@ BOOL fnCreate_pseudo_prime (mpz_t mpzPrime, mpz_t mpzE, mpz_t mpzCompare, \
  * fnCompute_exponent_d -- Find mpdD and check the size.  
  *
  * Remark - Do the check for exponent D here.  See top of p. 53.
+ *          An e of one limb takes the short way: with k the inverse
+ *          of -phi mod e, d = (1 + k phi) / e exactly, and only
+ *          phi mod e is ever inverted.  The d is the same.
  ***********************************************************************/
 BOOL fnCompute_exponent_d (mpz_t mpzP1, mpz_t mpzE, mpz_t mpzP2, \
      mpz_t mpzD, int nNumBits)
@@ -265,8 +957,20 @@ BOOL fnCompute_exponent_d (mpz_t mpzP1, mpz_t mpzE, mpz_t mpzP2, \
   mpz_sub (temp, temp, mpzP1);
   mpz_sub (temp, temp, mpzP2);
   mpz_add_ui (temp, temp, 1);
-  
-  retval = mpz_invert (n, mpzE, temp);
+
+  if (mpz_fits_ulong_p (mpzE) && mpz_cmp_ui (mpzE, 2) > 0) {
+                                  /* k = (-phi)^{-1} mod e, one limb */
+    mpz_set_ui (n, mpz_fdiv_ui (temp, mpz_get_ui (mpzE)));
+    retval = mpz_invert (n, n, mpzE);
+    if (retval != 0) {
+      mpz_sub (n, mpzE, n);
+      mpz_mul (n, n, temp);
+      mpz_add_ui (n, n, 1);
+      mpz_divexact (n, n, mpzE);
+    }
+  }
+  else
+    retval = mpz_invert (n, mpzE, temp);
 #ifdef DEBUG05
   printf ("      ### The value of d:      ");
   mpz_out_str(stdout, 10, n);
@@ -360,22 +1064,15 @@ BOOL fnGet_rand_seed (int *pnSeed)
 /************************************************************************
  * fnGet_exponent_e -- Get or Create the RSA key e.  
  *
- * Remark - 
+ * Remark - *pflRandom tells the caller which of the two it was.
  ***********************************************************************/
-BOOL fnGet_exponent_e (mpz_t mpzE)
+BOOL fnGet_exponent_e (mpz_t mpzE, BOOL *pflRandom)
 {
   char           line[129];
   char           chIn;
-  mpz_t          mpzBoundE;                /* upper bound for E        */
-  mpz_t          temp;
   unsigned long  nValE;                    /* value of E as a long     */
 
-  /* 1. Initialize the numbers */
-  mpz_inits(mpzBoundE, temp, NULL);
-  mpz_set_ui(temp,0);
-  mpz_set_ui(mpzBoundE, 1);
-
-  /* 2. Options for exponent */
+  /* 1. Options for exponent */
   printf ("\n  --> Options for the exponent e. <--\n");
   printf ("      Choose Y to type an integer\n");
   printf ("      or N to calculate a random number: ");
@@ -390,29 +1087,811 @@ BOOL fnGet_exponent_e (mpz_t mpzE)
     sscanf(line, "%lu", &nValE);
                                             /* copy results for return */
     mpz_set_ui (mpzE, (unsigned long) nValE);
+    *pflRandom = 0;
   }  
   else {  
+    fnRandom_exponent_e (mpzE);
+    *pflRandom = 1;
+  }
+
+  return (0);
+}
+
+
+
+/************************************************************************
+ * fnRandom_exponent_e -- Pseudo random odd e between 2^{16} and 
+ *                        2^{256} from rndState.
+ *
+ * Remark - 
+ ***********************************************************************/
+BOOL fnRandom_exponent_e (mpz_t mpzE)
+{
+  mpz_t          mpzBoundE;                /* upper bound for E        */
+  mpz_t          temp;
+
+  /* 1. Initialize the numbers */
+  mpz_inits(mpzBoundE, temp, NULL);
+  mpz_set_ui(temp,0);
+  mpz_set_ui(mpzBoundE, 1);
+
+  /* 2. Draw until the value is in range */
                                             /* set upper bound for E */
-    mpz_mul_2exp (mpzBoundE, mpzBoundE, 256); 
-    while (1) {
-      mpz_urandomb (temp, rndState, 256);
+  mpz_mul_2exp (mpzBoundE, mpzBoundE, 256); 
+  while (1) {
+    mpz_urandomb (temp, rndState, 256);
                                            /* if even, try again */
-      if (mpz_even_p (temp) != 0) 
-	    continue;
-	                                       /* compare to bounds for E */
-      if (mpz_cmp_ui (temp, 65536) < 0)
-	    continue;
-      else if (mpz_cmp (temp, mpzBoundE) > 0)
-	    continue;
-      else
-        break;
-    }	  
+    if (mpz_even_p (temp) != 0) 
+      continue;
+                                           /* compare to bounds for E */
+    if (mpz_cmp_ui (temp, 65536) < 0)
+      continue;
+    else if (mpz_cmp (temp, mpzBoundE) > 0)
+      continue;
+    else
+      break;
+  }	  
                                             /* copy results for return */
   mpz_set (mpzE, temp);    
-  }
 
   mpz_clears(mpzBoundE, temp, NULL);
 
   return (0);
 }
 
+
+
+/************************************************************************
+ * fnLowhw_exponent_e -- Pseudo random prime e of nWeight set bits
+ *                       between 2^{16} and 2^{256}: the top bit
+ *                       anywhere from 16 to 255, bit 0, and
+ *                       nWeight - 2 more below the top one.
+ *
+ * Remark - e is drawn again until it is prime.  An e with a small
+ *          factor such as 3 rules out a third or more of all primes
+ *          p, and the search of FIPS 186-3 B.3.3 gives up after
+ *          5 nlen / 2 candidates.
+ ***********************************************************************/
+BOOL fnLowhw_exponent_e (mpz_t mpzE, int nWeight)
+{
+  unsigned long  nTop, nBit;
+  int            i;
+
+
+  do {
+    nTop = E_BITS_MIN - 1 + gmp_urandomm_ui (rndState, \
+                                             E_BITS_MAX - E_BITS_MIN + 1);
+    mpz_set_ui (mpzE, 1);
+    mpz_setbit (mpzE, nTop);
+    for (i = 2; i < nWeight; ) {
+      nBit = 1 + gmp_urandomm_ui (rndState, nTop - 1);
+      if (mpz_tstbit (mpzE, nBit))
+        continue;
+      mpz_setbit (mpzE, nBit);
+      i++;
+    }
+  } while (mpz_probab_prime_p (mpzE, NUMTESTS) == 0);
+
+  return (0);
+}
+
+
+
+/************************************************************************
+ * fnBits_exponent_e -- Pseudo random prime e of exactly nBits bits,
+ *                      prime for the reason given above.
+ ***********************************************************************/
+BOOL fnBits_exponent_e (mpz_t mpzE, int nBits)
+{
+  do {
+    mpz_urandomb (mpzE, rndState, nBits - 1);
+    mpz_setbit (mpzE, nBits - 1);
+    mpz_setbit (mpzE, 0);
+  } while (mpz_probab_prime_p (mpzE, NUMTESTS) == 0);
+
+  return (0);
+}
+
+
+
+/************************************************************************
+ * fnParse_e_policy -- Read an exponent choice: a number, 'f4' for
+ *                     65537, 'random', 'lowhw[:W]' or 'bits:N'.
+ *                     Returns 0, or -1 if the text is none of these.
+ ***********************************************************************/
+int fnParse_e_policy (const char *pszSpec, E_POLICY *pPolicy)
+{
+  const char  *pchNum;
+  char        *pchEnd;
+
+
+  pPolicy->nValE = 0;
+  if (strcmp (pszSpec, "random") == 0) {
+    pPolicy->nKind = E_POLICY_RANDOM;
+    return 0;
+  }
+
+  pPolicy->nKind = E_POLICY_FIXED;
+  pchNum = pszSpec;
+  if (strcmp (pszSpec, "f4") == 0 || strcmp (pszSpec, "F4") == 0) {
+    pPolicy->nValE = 65537;
+    return 0;
+  }
+  if (strcmp (pszSpec, "lowhw") == 0) {
+    pPolicy->nKind = E_POLICY_LOWHW;
+    pPolicy->nValE = E_LOWHW_DEFAULT;
+    return 0;
+  }
+  if (strncmp (pszSpec, "lowhw:", 6) == 0) {
+    pPolicy->nKind = E_POLICY_LOWHW;
+    pchNum = pszSpec + 6;
+  }
+  else if (strncmp (pszSpec, "bits:", 5) == 0) {
+    pPolicy->nKind = E_POLICY_BITS;
+    pchNum = pszSpec + 5;
+  }
+  pPolicy->nValE = strtoul (pchNum, &pchEnd, 10);
+  if (*pchNum == '\0' || *pchEnd != '\0' || !fnValid_e_policy (pPolicy))
+    return -1;
+
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnValid_e_policy -- Can keys be made with this policy?  A fixed e
+ *                     must be odd and above 1; a weight between 3 and
+ *                     E_LOWHW_MAX, a length between E_BITS_MIN and
+ *                     E_BITS_MAX.
+ ***********************************************************************/
+BOOL fnValid_e_policy (const E_POLICY *pPolicy)
+{
+  switch (pPolicy->nKind) {
+    case E_POLICY_FIXED:
+      return pPolicy->nValE >= 3 && (pPolicy->nValE & 1) != 0;
+    case E_POLICY_RANDOM:
+      return 1;
+    case E_POLICY_LOWHW:
+      return pPolicy->nValE >= 3 && pPolicy->nValE <= E_LOWHW_MAX;
+    case E_POLICY_BITS:
+      return pPolicy->nValE >= E_BITS_MIN && pPolicy->nValE <= E_BITS_MAX;
+  }
+
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnFormat_e_policy -- The policy as fnParse_e_policy reads it.
+ ***********************************************************************/
+void fnFormat_e_policy (const E_POLICY *pPolicy, char *pchBuf, size_t nSize)
+{
+  switch (pPolicy->nKind) {
+    case E_POLICY_RANDOM:
+      snprintf (pchBuf, nSize, "random");
+      break;
+    case E_POLICY_LOWHW:
+      snprintf (pchBuf, nSize, "lowhw:%lu", pPolicy->nValE);
+      break;
+    case E_POLICY_BITS:
+      snprintf (pchBuf, nSize, "bits:%lu", pPolicy->nValE);
+      break;
+    default:
+      snprintf (pchBuf, nSize, "%lu", pPolicy->nValE);
+  }
+}
+
+
+
+/************************************************************************
+ * fnCost_e_policy -- Modular multiplications of one public operation
+ *                    x^e mod n, square and multiply from the top bit,
+ *                    on average over the e the policy draws.
+ *
+ * Remark - A random e has about 255 bits and half of them set.  A
+ *          'lowhw' e of L bits is kept about 1 / L of the time, as
+ *          often as it is prime, so short ones are the more likely.
+ ***********************************************************************/
+double fnCost_e_policy (const E_POLICY *pPolicy)
+{
+  unsigned long  nE = pPolicy->nValE;
+  int            nBits = 0, nWeight = 0;
+  double         dOdds = 0;
+
+
+  switch (pPolicy->nKind) {
+    case E_POLICY_RANDOM:
+      return (E_BITS_MAX - 2) + (E_BITS_MAX - 1) / 2.0;
+    case E_POLICY_LOWHW:
+      for (nBits = E_BITS_MIN; nBits <= E_BITS_MAX; nBits++)
+        dOdds += 1.0 / nBits;
+      return (E_BITS_MAX - E_BITS_MIN + 1) / dOdds - 1 + (nE - 1);
+    case E_POLICY_BITS:
+      return (nE - 1) + nE / 2.0;
+  }
+
+  for (; nE != 0; nE >>= 1) {
+    nBits++;
+    nWeight += nE & 1;
+  }
+  return (nBits - 1) + (nWeight - 1);
+}
+
+
+
+/************************************************************************
+ * fnMake_exponent_e -- The e of one key under pPolicy.
+ *
+ * Remark - Random choices draw from rndState, in the same way as the
+ *          interactive program.
+ ***********************************************************************/
+BOOL fnMake_exponent_e (mpz_t mpzE, const E_POLICY *pPolicy)
+{
+  if (pPolicy->nKind == E_POLICY_RANDOM)
+    return fnRandom_exponent_e (mpzE);
+  if (pPolicy->nKind == E_POLICY_LOWHW)
+    return fnLowhw_exponent_e (mpzE, (int) pPolicy->nValE);
+  if (pPolicy->nKind == E_POLICY_BITS)
+    return fnBits_exponent_e (mpzE, (int) pPolicy->nValE);
+
+  mpz_set_ui (mpzE, pPolicy->nValE);
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnSmall_prime_e -- e itself if it is a prime below E_FOLD_MAX, 0 if
+ *                    not.  For such an e, gcd (p - 1, e) = 1 is just
+ *                    p mod e != 1, one division by a word, or a
+ *                    residue class struck out in a sieve.
+ *
+ * Remark - 65537 is answered without a primality test.
+ ***********************************************************************/
+unsigned long fnSmall_prime_e (mpz_t mpzE)
+{
+  if (mpzE == NULL || mpz_cmp_ui (mpzE, E_FOLD_MAX) >= 0)
+    return 0;
+  if (mpz_cmp_ui (mpzE, E_F4) == 0)
+    return E_F4;
+  if (mpz_cmp_ui (mpzE, 2) <= 0 || mpz_probab_prime_p (mpzE, NUMTESTS) == 0)
+    return 0;
+
+  return mpz_get_ui (mpzE);
+}
+
+
+
+/************************************************************************
+ * fnWorker_init -- Per thread set up for threads that make keys.
+ *
+ * Remark - The random state is allocated outside of any arena scope.
+ *          Each key reseeds it (see fnBulk_seed_key).
+ ***********************************************************************/
+void fnWorker_init (void)
+{
+  gmp_randinit_default (rndState);
+}
+
+
+
+/************************************************************************
+ * fnWorker_exit -- Undo fnWorker_init and give back arena chunks.
+ ***********************************************************************/
+void fnWorker_exit (void)
+{
+  gmp_randclear (rndState);
+  fnArena_thread_release ();
+}
+
+
+
+/************************************************************************
+ * fnGenerate_keypair -- Both primes and d for one key with the
+ *                       exponent e already chosen.
+ *
+ * Remark - nBitLen is the length of the modulus, each prime gets
+ *          half of it.  The primes come from the engine of the run
+ *          (gen_engine.h), and with a prime index open none was
+ *          handed out before (gen_dedup.h).
+ ***********************************************************************/
+int fnGenerate_keypair (mpz_t mpzP1, mpz_t mpzP2, mpz_t mpzD, \
+    mpz_t mpzE, int nBitLen)
+{
+  PRIME_ENGINE_FN  pfnFind  = fnEngine_current ()->pfnFind;
+  int              nHalfLen = nBitLen / 2;
+  int              nStatus;
+
+
+  /* 1. Produce first pseudo random prime of bit length n/2 */
+  fnMemprof_phase (MEM_PHASE_P);
+  nStatus = fnDedup_find (pfnFind, mpzP1, mpzE, mpzP2, nHalfLen, \
+                          NUMTESTS, 0);
+
+  /* 2. Produce second pseudo random prime of bit length n/2 */
+  fnMemprof_phase (MEM_PHASE_Q);
+  if (nStatus == KEYGEN_OK)
+    nStatus = fnDedup_find (pfnFind, mpzP2, mpzE, mpzP1, nHalfLen, \
+                            NUMTESTS, 1);
+
+  /* 3. Find the exponent d  */
+  fnMemprof_phase (MEM_PHASE_D);
+  if (nStatus == KEYGEN_OK)
+    fnCompute_exponent_d (mpzP1, mpzE, mpzP2, mpzD, nHalfLen);
+
+  /* 4. Pairwise consistency test, when it is on (gen_pct.h) */
+  if (nStatus == KEYGEN_OK && fnPct_enabled ())
+    nStatus = fnPct_check (mpzE, mpzP1, mpzP2, mpzD);
+
+  fnMemprof_phase (MEM_PHASE_OTHER);
+  return nStatus;
+}
+
+
+
+/************************************************************************
+ * fnGenerate_safe_keypair -- As fnGenerate_keypair, with safe primes.
+ ***********************************************************************/
+int fnGenerate_safe_keypair (mpz_t mpzP1, mpz_t mpzP2, mpz_t mpzD, \
+    mpz_t mpzE, int nBitLen)
+{
+  int  nHalfLen = nBitLen / 2;
+  int  nStatus;
+
+
+  fnMemprof_phase (MEM_PHASE_P);
+  nStatus = fnDedup_find (fnCreate_safe_prime, mpzP1, mpzE, mpzP2, \
+                          nHalfLen, NUMTESTS, 0);
+
+  fnMemprof_phase (MEM_PHASE_Q);
+  if (nStatus == KEYGEN_OK)
+    nStatus = fnDedup_find (fnCreate_safe_prime, mpzP2, mpzE, mpzP1, \
+                            nHalfLen, NUMTESTS, 1);
+
+  fnMemprof_phase (MEM_PHASE_D);
+  if (nStatus == KEYGEN_OK)
+    fnCompute_exponent_d (mpzP1, mpzE, mpzP2, mpzD, nHalfLen);
+  if (nStatus == KEYGEN_OK && fnPct_enabled ())
+    nStatus = fnPct_check (mpzE, mpzP1, mpzP2, mpzD);
+
+  fnMemprof_phase (MEM_PHASE_OTHER);
+  return nStatus;
+}
+
+
+
+/************************************************************************
+ * fnKeygen_status_text -- A few words for a KEYGEN_STATUS.
+ ***********************************************************************/
+const char *fnKeygen_status_text (int nStatus)
+{
+  switch (nStatus) {
+    case KEYGEN_OK:         return "ok";
+    case KEYGEN_EXHAUSTED:  return "no prime found";
+    case KEYGEN_CANCELLED:  return "cancelled";
+    case KEYGEN_DEADLINE:   return "deadline passed";
+    case KEYGEN_PCT_FAILED: return "pairwise test failed";
+    default:                return "unknown status";
+  }
+}
+
+
+
+/************************************************************************
+ * fnSoak_test -- Generate nKeys more keys without printing them and
+ *                watch the resident set size for drift.
+ *
+ * Remark - pPolicy gives the e of every key.  The first
+ *          tenth of the run is warm up; RSS growth after that of
+ *          more than SOAK_DRIFT_PCT percent (and at least 
+ *          SOAK_DRIFT_KB) is reported as drift.
+ ***********************************************************************/
+BOOL fnSoak_test (int nBitLen, const E_POLICY *pPolicy, long nKeys)
+{
+  mpz_t   mpzP1, mpzP2, mpzE, mpzD;
+  char   *pchBuf;                          /* serialized numbers       */
+  long    k, nStep, nWarm;
+  long    nRss, nBase = -1, nMax = 0;
+  time_t  nStart;
+
+
+  /* 1. One buffer for the output phase, big enough for d and */
+  /*    for an e of up to E_BITS_MAX bits in hex               */
+  pchBuf = (char *) malloc ((nBitLen > E_BITS_MAX ? nBitLen : E_BITS_MAX) \
+                            / 4 + 16);
+  nStep  = nKeys / SOAK_SAMPLES > 0 ? nKeys / SOAK_SAMPLES : 1;
+  nWarm  = nKeys / 10;
+  nStart = time (NULL);
+
+  printf ("\n  --> Soak test: %ld keys of %d bits <--\n", nKeys, nBitLen);
+  printf ("      %10s %12s\n", "keys", "RSS KB");
+
+  /* 2. Same steps as main, each key in its own arena scope */
+  for (k = 1; k <= nKeys; k++) {
+    fnArena_begin ();
+    mpz_inits(mpzP1, mpzP2, mpzE, mpzD, NULL);
+
+    fnMemprof_phase (MEM_PHASE_E);
+    fnMake_exponent_e (mpzE, pPolicy);
+
+    if (fnGenerate_keypair (mpzP1, mpzP2, mpzD, mpzE, nBitLen) != KEYGEN_OK) {
+      printf ("   ### FAILURE creating prime\n");
+      exit(1);
+    }
+
+    fnMemprof_phase (MEM_PHASE_OUTPUT);
+    mpz_get_str (pchBuf, 16, mpzE);
+    mpz_get_str (pchBuf, 16, mpzP1);
+    mpz_get_str (pchBuf, 16, mpzP2);
+    mpz_get_str (pchBuf, 16, mpzD);
+
+    mpz_clears(mpzP1, mpzP2, mpzE, mpzD, NULL);
+    fnArena_end ();
+    fnMemprof_key_done ();
+
+    /* 3. Sample the RSS now and then, after warm up it should */
+    /*    stay flat                                             */
+    if (k % nStep == 0 || k == nKeys) {
+      nRss = fnMemprof_rss_kb ();
+      printf ("      %10ld %12ld\n", k, nRss);
+      if (k > nWarm && nBase < 0)
+        nBase = nRss;
+      if (nRss > nMax)
+        nMax = nRss;
+    }
+  }
+  free (pchBuf);
+
+  /* 4. Verdict */
+  printf ("      %ld keys in %ld s, RSS after warm up %ld KB, max %ld KB\n", \
+          nKeys, (long) (time (NULL) - nStart), nBase, nMax);
+  if (nBase > 0 && nMax - nBase > SOAK_DRIFT_KB &&
+      (nMax - nBase) * 100 > nBase * SOAK_DRIFT_PCT) {
+    printf ("   ### WARNING: RSS drift of %ld KB after warm up\n", \
+            nMax - nBase);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnPrint_primes -- Print nCount primes of nNumBits bits, one per line,
+ *                   pulled one at a time from a PRIME_ITER.  Returns
+ *                   the exit status.
+ *
+ * Remark - A fixed e in pPolicy gives gcd (p - 1, e) = 1.  Numbers are
+ *          hex unless nFormat says otherwise, as in bulk mode.
+ ***********************************************************************/
+int fnPrint_primes (int nNumBits, long nCount, const E_POLICY *pPolicy, \
+    int nPrime, unsigned long nSeed, int nFormat)
+{
+  PRIME_ITER  *pIter;
+  mpz_t        mpzE, mpzPrime;
+  long         k, nWindows, nTests, nSeen = 0;
+  time_t       nStart;
+
+
+  /* 1. The iterator, seeded as key 0 of a bulk run */
+  mpz_init (mpzE);
+  mpz_init2 (mpzPrime, nNumBits + GMP_NUMB_BITS);   /* no arena growth */
+  if (pPolicy->nKind == E_POLICY_FIXED)
+    mpz_set_ui (mpzE, pPolicy->nValE);
+  pIter = fnPrimes_open (nNumBits, pPolicy->nKind == E_POLICY_FIXED ? \
+                         mpzE : NULL, nPrime, NUMTESTS);
+  if (pIter == NULL) {
+    fprintf (stderr, "%s: primes need at least %d bits\n", program_name, \
+             PRIMES_MIN_BITS);
+    mpz_clears (mpzE, mpzPrime, NULL);
+    return 1;
+  }
+  gmp_randinit_default (rndState);
+  fnBulk_seed_key (nSeed, 0);
+
+  /* 2. Only as many as asked for */
+  nStart = time (NULL);
+  for (k = 0; k < nCount; k++) {
+    fnArena_begin ();
+    fnPrimes_next (pIter, mpzPrime);
+    while (fnDedup_add (mpzPrime) && ++nSeen <= fnDedup_primes ())
+      fnPrimes_next (pIter, mpzPrime);
+    if (nSeen > fnDedup_primes ()) {
+      fprintf (stderr, "   ### more primes seen than the index holds, " \
+               "it is full\n");
+      fnArena_end ();
+      break;
+    }
+    fnPrint_number (mpzPrime, nFormat == FMT_DEFAULT ? FMT_HEX : nFormat, \
+                    nNumBits);
+    printf ("\n");
+    fnArena_end ();
+  }
+
+  fnPrimes_stats (pIter, &nWindows, &nTests);
+  fprintf (stderr, "\n  --> %ld primes of %d bits in %ld s: %ld windows, " \
+           "%ld candidates tested <--\n", nCount, nNumBits, \
+           (long) (time (NULL) - nStart), nWindows, nTests);
+
+  fnPrimes_close (pIter);
+  gmp_randclear (rndState);
+  mpz_clears (mpzE, mpzPrime, NULL);
+  fnArena_thread_release ();
+
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnPrint_range -- Print every prime of the interval pszRange, 'LO,HI'
+ *                  or 'LO,+LEN', or the next prime after pszNext.
+ *
+ * Remark - A fixed e in pPolicy gives gcd (p - 1, e) = 1.  Numbers are
+ *          hex unless nFormat says otherwise, as in primes mode.
+ ***********************************************************************/
+int fnPrint_range (const char *pszRange, const char *pszNext, \
+    const E_POLICY *pPolicy, int nNumTests, int nThreads, int nFormat)
+{
+  RANGE_STATS  stats;
+  mpz_t        mpzLow, mpzHigh, mpzE;
+  char        *pszLow, *pchComma;
+  int          nRet = 0;
+
+
+  mpz_inits (mpzLow, mpzHigh, mpzE, NULL);
+  if (pPolicy->nKind == E_POLICY_FIXED)
+    mpz_set_ui (mpzE, pPolicy->nValE);
+  if (nFormat == FMT_DEFAULT)
+    nFormat = FMT_HEX;
+
+  /* 1. The next prime, on its own */
+  if (pszNext != NULL) {
+    if (fnRange_parse (mpzLow, pszNext) != 0) {
+      fprintf (stderr, "%s: bad number '%s'\n", program_name, pszNext);
+      mpz_clears (mpzLow, mpzHigh, mpzE, NULL);
+      return 1;
+    }
+    fnRange_next_prime (mpzHigh, mpzLow, pPolicy->nKind == E_POLICY_FIXED \
+                        ? mpzE : NULL, nNumTests);
+    fnPrint_range_prime (mpzHigh, &nFormat);
+  }
+
+  /* 2. LO,HI with HI relative to LO after a + */
+  if (pszRange != NULL) {
+    pszLow = strdup (pszRange);
+    if ((pchComma = strchr (pszLow, ',')) == NULL)
+      nRet = -1;
+    else {
+      *pchComma++ = '\0';
+      nRet = fnRange_parse (mpzLow, pszLow);
+      if (nRet == 0 && *pchComma == '+') {
+        nRet = fnRange_parse (mpzHigh, pchComma + 1);
+        mpz_add (mpzHigh, mpzHigh, mpzLow);
+      }
+      else if (nRet == 0)
+        nRet = fnRange_parse (mpzHigh, pchComma);
+    }
+    free (pszLow);
+    if (nRet != 0) {
+      fprintf (stderr, "%s: bad interval '%s', want LO,HI or LO,+LEN\n", \
+               program_name, pszRange);
+      mpz_clears (mpzLow, mpzHigh, mpzE, NULL);
+      return 1;
+    }
+
+    /* 3. In order, as the workers finish the segments */
+    if (fnRange_primes (mpzLow, mpzHigh, pPolicy->nKind == E_POLICY_FIXED ? \
+                        mpzE : NULL, nNumTests, nThreads, \
+                        fnPrint_range_prime, &nFormat, &stats) != 0) {
+      fprintf (stderr, "%s: interval '%s' is too long\n", program_name, \
+               pszRange);
+      nRet = 1;
+    }
+    else
+      fprintf (stderr, "\n  --> %ld primes in %.3f s: %ld segments, %ld " \
+               "candidates tested <--\n", stats.nPrimes, stats.dSecs, \
+               stats.nSegments, stats.nTests);
+  }
+
+  mpz_clears (mpzLow, mpzHigh, mpzE, NULL);
+  fnArena_thread_release ();
+
+  return nRet;
+}
+
+
+
+/************************************************************************
+ * fnPrint_range_prime -- RANGE_OUT_FN of fnPrint_range, one prime per
+ *                        line in the format *pArg.
+ ***********************************************************************/
+void fnPrint_range_prime (mpz_t mpzPrime, void *pArg)
+{
+  fnPrint_number (mpzPrime, *(int *) pArg, 0);
+  printf ("\n");
+}
+
+
+
+/************************************************************************
+ * fnPrint_number -- Print mpzX to stdout, in decimal unless another
+ *                   format was asked for.
+ *
+ * Remark - Decimal uses the power table for nBitLen, which is built
+ *          on the first call and reused after that.
+ ***********************************************************************/
+void fnPrint_number (mpz_t mpzX, int nFormat, int nBitLen)
+{
+  char             *pchText;
+  unsigned char    *pchScratch;
+  const DEC_TABLE  *pTab;
+  DEC_SCRATCH       s;
+  size_t            nBits, nLen;
+
+
+  nBits = mpz_sizeinbase (mpzX, 2);
+  if (nBits < (size_t) nBitLen)
+    nBits = nBitLen;
+
+  /* 1. Decimal, the default */
+  if (nFormat == FMT_DEFAULT || nFormat == FMT_DECIMAL) {
+    pTab    = fnDecimal_table ((int) nBits);
+    pchText = (char *) malloc (DEC_TEXT_LEN (pTab->nBits) + 2);
+    fnDecimal_scratch_init (&s, pTab);
+    nLen = fnDecimal_format (pchText, mpzX, pTab, &s);
+    fnDecimal_scratch_clear (&s);
+  }
+
+  /* 2. Hex or base64 */
+  else {
+    pchScratch = (unsigned char *) malloc (nBits / 8 + 16);
+    pchText    = (char *) malloc (ENCODE_HEX_LEN (nBits / 8 + 16) + 4);
+    nLen = fnEncode_mpz (pchText, pchScratch, mpzX, nFormat);
+    free (pchScratch);
+  }
+
+  fwrite (pchText, 1, nLen, stdout);
+  free (pchText);
+}
+
+
+
+/************************************************************************
+ * fnPrint_e_costs -- Multiplications per public operation of the
+ *                    usual e policies and pPolicy (NULL ok), and
+ *                    what each costs against 65537.
+ ***********************************************************************/
+void fnPrint_e_costs (const E_POLICY *pPolicy)
+{
+  static const char  *apszSpecs[] = { "f4", "3", "lowhw:3", "lowhw:5", \
+                                      "bits:17", "bits:32", "bits:64", \
+                                      "random", NULL };
+  E_POLICY   ePolicy, eF4;
+  char       achE[32];
+  double     dF4;
+  int        i;
+
+
+  fnParse_e_policy ("f4", &eF4);
+  dF4 = fnCost_e_policy (&eF4);
+  printf ("\n  --> Public operation cost of e, x^e mod n <--\n");
+  printf ("      %-10s %10s %8s\n", "e", "mod mults", "vs f4");
+  for (i = 0; apszSpecs[i] != NULL || pPolicy != NULL; ) {
+    if (apszSpecs[i] != NULL)
+      fnParse_e_policy (apszSpecs[i++], &ePolicy);
+    else {
+      ePolicy = *pPolicy;                  /* -e, last */
+      pPolicy = NULL;
+    }
+    fnFormat_e_policy (&ePolicy, achE, sizeof (achE));
+    printf ("      %-10s %10.1f %7.2fx\n", achE, fnCost_e_policy (&ePolicy), \
+            fnCost_e_policy (&ePolicy) / dF4);
+  }
+}
+
+
+
+/************************************************************************
+ * fnUsage -- Describe the command line options.
+ *
+ * Remark - Without options the program asks for everything.
+ ***********************************************************************/
+void fnUsage (void)
+{
+  printf ("Usage: %s [options]\n", program_name);
+  printf ("  --arena[=KB]     carve GMP temporaries from a per-thread arena\n");
+  printf ("                   reset after each key (chunk size in KB)\n");
+  printf ("  --arena-stats    as --arena, and print allocation counters\n");
+  printf ("  --secure-arena   as --arena, and wipe all key material once\n");
+  printf ("                   when the key is finished\n");
+  printf ("  --hugepages      back the secure arena with huge pages\n");
+  printf ("  --mlock          lock the secure arena in memory\n");
+  printf ("  --mem-report     count GMP allocations per phase of the key\n");
+  printf ("                   and print them with the RSS high water mark\n");
+  printf ("  --soak=N         then generate N more keys quietly and report\n");
+  printf ("                   drift of the resident set size\n");
+  printf ("  -b, --bits=N     key size (nlen), instead of asking\n");
+  printf ("  -s, --seed=S     random seed, instead of asking\n");
+  printf ("  -e, --e=E        public exponent, a number, 'f4' or 'random',\n");
+  printf ("                   'lowhw[:W]' random with W bits set (default\n");
+  printf ("                   %d) or 'bits:N' random of N bits, %d to %d\n", \
+          E_LOWHW_DEFAULT, E_BITS_MIN, E_BITS_MAX);
+  printf ("  --e-cost         the public operation cost of each e policy\n");
+  printf ("  --pct            pairwise consistency test of every key, with\n");
+  printf ("                   the CRT form of d (gen_pct.h)\n");
+  printf ("  -n, --count=N    bulk mode: N keys, one line each, as\n");
+  printf ("                   'index bits e n p q d' in hexadecimal\n");
+  printf ("  -t, --threads=T  key generation threads in bulk mode\n");
+  printf ("  -o, --out=FILE   bulk output file (default stdout)\n");
+  printf ("  --shm=PATH       bulk keys go to a shared memory ring for a\n");
+  printf ("                   consumer process (see gen_consume)\n");
+  printf ("  --shm-slots=N    keys the ring holds (default %d)\n", \
+          SHM_SLOTS_DEFAULT);
+  printf ("  --checkpoint=F   write bulk lines in index order and note the\n");
+  printf ("                   progress in F, so the run can be resumed\n");
+  printf ("  --checkpoint-every=N  keys between checkpoints (default %d)\n", \
+          CKPT_EVERY_DEFAULT);
+  printf ("  --resume         continue the run of --checkpoint=F where it\n");
+  printf ("                   stopped; the other options are taken from F\n");
+  printf ("  --buffer=KB      size of each bulk output buffer\n");
+  printf ("  --direct         open the bulk output with O_DIRECT\n");
+  printf ("  --no-uring       write with pwritev instead of io_uring\n");
+  printf ("  -f, --format=F   numbers as dec, hex, base64 or base64url (JWK);\n");
+  printf ("                   the default is decimal here, hex in bulk\n");
+  printf ("  --stream         co-process mode: read 'id nlen [e]' lines on\n");
+  printf ("                   stdin, answer 'id nlen e n p q d' on stdout\n");
+  printf ("                   as each key is done (-t threads)\n");
+  printf ("  --reorder        answer streamed requests in request order\n");
+  printf ("  --jobs=FILE      make the keys of a job file, one job per line\n");
+  printf ("                   as CSV 'size,count[,e[,prime]]' or JSON, prime\n");
+  printf ("                   'probable' or 'safe'; dearest keys first\n");
+  printf ("  --dedup=FILE     never hand out a prime that is in the index\n");
+  printf ("                   (not with --checkpoint)\n");
+  printf ("                   FILE, made if new; every prime is added\n");
+  printf ("  --dedup-fp=P     false positive rate of a new index (%g)\n", \
+          DEDUP_FP_DEFAULT);
+  printf ("  --dedup-capacity=N  primes a new index is sized for (%ld)\n", \
+          DEDUP_CAP_DEFAULT);
+  printf ("  --dedup-merge=SRC  OR the index SRC into --dedup=FILE, exit\n");
+  printf ("  --audit=FILE     test every key of a bulk hex file again (-t\n");
+  printf ("                   threads, -o report); one JSON line per failed\n");
+  printf ("                   key and a summary, exit 1 if any failed\n");
+  printf ("  --audit-reps=N   primality reps of the audit (default %d, BPSW)\n", \
+          AUDIT_REPS_DEFAULT);
+  printf ("  --audit-e-min=E  least e the audit allows (default %lu, FIPS\n", \
+          AUDIT_E_MIN_FIPS);
+  printf ("                   186-4); 3 for keys made with -e 3\n");
+  printf ("  --enum=LO,HI     print every prime p with LO <= p < HI in\n");
+  printf ("                   order, one per line, sieved in segments by\n");
+  printf ("                   -t threads; HI may be +LEN, and numbers are\n");
+  printf ("                   sums like 2^1023+0x1f-7; a fixed -e gives\n");
+  printf ("                   gcd (p - 1, e) = 1\n");
+  printf ("  --enum-reps=N    primality reps of --enum and --next-prime\n");
+  printf ("                   (default %d)\n", NUMTESTS);
+  printf ("  --next-prime=X   print the least prime above X (and -e)\n");
+  printf ("  --primes=COUNT   print COUNT primes of -b bits, one per line,\n");
+  printf ("                   made one at a time from a sieve window\n");
+  printf ("  --safe           with --primes, safe primes p = 2q + 1\n");
+  printf ("  --engine=NAME    prime search for the keys, one of\n");
+  fnEngine_list (stdout);
+  printf ("  --compat=legacy  the keys of the legacy engine for every seed,\n");
+  printf ("                   bit for bit, from the faster compat engine\n");
+  printf ("  --kat            check both against known keys and exit\n");
+  printf ("  --ab=A,B         compare engines A and B on the primes of -n\n");
+  printf ("                   keys (default 100) of -b bits (default 2048),\n");
+  printf ("                   same seeds for both, and print their speed\n");
+  printf ("  --daemon=PATH    serve keypair and prime requests on a Unix\n");
+  printf ("                   socket (see gen_daemon.h, gen_client)\n");
+  printf ("  --pool=N         primes kept ready per size (default %d)\n", \
+          DAEMON_POOL_DEFAULT);
+  printf ("  --pool-bits=L    key sizes to fill pools for at start, as\n");
+  printf ("                   a comma separated list\n");
+  printf ("  --max-pending=N  queued jobs before answering busy\n");
+  printf ("  --deadline=MS    stream and daemon requests give up after MS\n");
+  printf ("                   milliseconds and are answered with an error\n");
+  printf ("  -h, --help       this text\n");
+}
@@ -0,0 +1,96 @@
+/**********************************************************************
+ * gen_pair_pseudo.h -- Shared declarations for the pseudo prime
+ *                      pair generator.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- The random state is per thread, so that every worker
+ *           of the bulk mode draws from its own stream.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_PAIR_PSEUDO_H
+#define GEN_PAIR_PSEUDO_H
+
+#include <gmp.h>
+
+
+     /******** #defines and typedefs  ********/
+typedef int      BOOL;
+#define NUMTESTS (50)
+#define SAFE_SIEVE_LIMIT  (16384)     /* sieve bound for safe primes   */
+#define SAFE_WINDOW       (4096)      /* candidates per random start   */
+#define E_F4              (65537UL)   /* the e of almost every key     */
+#define E_FOLD_MAX        (1UL << 31) /* prime e below: p mod e != 1   */
+
+#define E_LOWHW_DEFAULT   (3)         /* set bits of a 'lowhw' e       */
+#define E_LOWHW_MAX       (16)
+#define E_BITS_MIN        (17)        /* e >= 2^{16} (FIPS 186-3)      */
+#define E_BITS_MAX        (256)       /* e < 2^{256}                   */
+
+typedef enum {
+  E_POLICY_FIXED = 0,                 /* the value nValE               */
+  E_POLICY_RANDOM,                    /* odd, 2^{16} <= e < 2^{256}    */
+  E_POLICY_LOWHW,                     /* prime, nValE bits set         */
+  E_POLICY_BITS                       /* prime, exactly nValE bits     */
+} E_KIND;
+
+typedef struct {
+  int            nKind;               /* E_KIND                        */
+  unsigned long  nValE;               /* e, weight or length by nKind  */
+} E_POLICY;
+
+typedef enum {
+  KEYGEN_OK = 0,
+  KEYGEN_EXHAUSTED,                   /* 5 nlen / 2 candidates failed  */
+  KEYGEN_CANCELLED,                   /* see gen_cancel.h              */
+  KEYGEN_DEADLINE,
+  KEYGEN_PCT_FAILED                   /* see gen_pct.h                 */
+} KEYGEN_STATUS;
+
+typedef enum {
+  PRIME_PROBABLE = 0,                 /* FIPS 186-3 B.3.3              */
+  PRIME_SAFE                          /* p = 2q + 1, q prime           */
+} PRIME_TYPE;
+
+typedef struct {                      /* one key asked of the library  */
+  int            nBitLen;             /* modulus length                */
+  E_POLICY       ePolicy;             /* e of the key                  */
+  int            nPrime;              /* PRIME_TYPE                    */
+  long           nTimeoutMs;          /* 0 is none                     */
+} KEY_PARAMS;
+
+
+     /******** globals in gen_pair_pseudo.c ********/
+extern char                      *program_name;
+extern __thread gmp_randstate_t   rndState;
+extern __thread long              nCandidates;  /* numbers put through a   */
+                                                /* primality test          */
+
+
+     /******** functions in gen_pair_pseudo.c ********/
+int   fnCreate_pseudo_prime (mpz_t mpzPrime, mpz_t mpzE, mpz_t mpzCompare, \
+      int nNumBits, int nNumTests, BOOL flTestDiff );
+int   fnCreate_safe_prime (mpz_t mpzPrime, mpz_t mpzE, mpz_t mpzCompare, \
+      int nNumBits, int nNumTests, BOOL flTestDiff);
+BOOL  fnCompute_exponent_d (mpz_t mpzP1, mpz_t mpzE, mpz_t mpzP2, \
+      mpz_t mpzD, int nNumBits);
+BOOL  fnRandom_exponent_e (mpz_t mpzE);
+BOOL  fnLowhw_exponent_e (mpz_t mpzE, int nWeight);
+BOOL  fnBits_exponent_e (mpz_t mpzE, int nBits);
+int   fnGenerate_keypair (mpz_t mpzP1, mpz_t mpzP2, mpz_t mpzD, \
+      mpz_t mpzE, int nBitLen);
+int   fnGenerate_safe_keypair (mpz_t mpzP1, mpz_t mpzP2, mpz_t mpzD, \
+      mpz_t mpzE, int nBitLen);
+int   fnParse_e_policy (const char *pszSpec, E_POLICY *pPolicy);
+BOOL  fnValid_e_policy (const E_POLICY *pPolicy);
+void  fnFormat_e_policy (const E_POLICY *pPolicy, char *pchBuf, size_t nSize);
+double  fnCost_e_policy (const E_POLICY *pPolicy);
+BOOL  fnMake_exponent_e (mpz_t mpzE, const E_POLICY *pPolicy);
+unsigned long  fnSmall_prime_e (mpz_t mpzE);
+void  fnWorker_init (void);
+const char  *fnKeygen_status_text (int nStatus);
+void  fnWorker_exit (void);
+
+#endif
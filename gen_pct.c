@@ -0,0 +1,109 @@
+/**********************************************************************
+ * gen_pct.c -- Pairwise consistency test of a finished key.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- The message is made from n, not drawn from rndState, so
+ *           turning the test on does not change any key.  The counts
+ *           and the time are kept with atomic adds, any number of
+ *           workers test at once.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+#include "gen_cancel.h"
+#include "gen_pct.h"
+
+
+     /******** globals in this file   ********/
+static BOOL       flPct;                    /* set before any worker */
+static long       nPctPassed, nPctFailed;
+static long long  nPctNs;                   /* time in fnPct_check   */
+
+
+
+
+/************************************************************************
+ * fnPct_enable -- Test every key from now on, or stop.  Call it
+ *                 before the workers start.
+ ***********************************************************************/
+void fnPct_enable (BOOL flOn)
+{
+  flPct = flOn;
+}
+
+
+
+/************************************************************************
+ * fnPct_enabled -- Is the test on?
+ ***********************************************************************/
+BOOL fnPct_enabled (void)
+{
+  return flPct;
+}
+
+
+
+/************************************************************************
+ * fnPct_check -- Encrypt m with (n, e), decrypt with the CRT form of
+ *                d and compare.  Returns KEYGEN_OK, or
+ *                KEYGEN_PCT_FAILED.
+ ***********************************************************************/
+int fnPct_check (mpz_t mpzE, mpz_t mpzP1, mpz_t mpzP2, mpz_t mpzD)
+{
+  mpz_t      n, m, c, mpzDP, mpzDQ, mpzQInv, m1, m2;
+  long long  nStart = fnCancel_now_ns ();
+  BOOL       flOk;
+
+
+  mpz_inits (n, m, c, mpzDP, mpzDQ, mpzQInv, m1, m2, NULL);
+
+  /* 1. m = n / 2 rounded down, neither 0, 1 nor -1 mod p or q */
+  mpz_mul (n, mpzP1, mpzP2);
+  mpz_tdiv_q_2exp (m, n, 1);
+
+  /* 2. The CRT parts of d, and the public operation */
+  mpz_sub_ui (c, mpzP1, 1);
+  mpz_mod (mpzDP, mpzD, c);
+  mpz_sub_ui (c, mpzP2, 1);
+  mpz_mod (mpzDQ, mpzD, c);
+  flOk = mpz_invert (mpzQInv, mpzP2, mpzP1) != 0;
+  mpz_powm (c, m, mpzE, n);
+
+  /* 3. m1 = c^dP mod p, m2 = c^dQ mod q, m = m2 + q (qInv (m1 - m2) mod p) */
+  if (flOk) {
+    mpz_powm (m1, c, mpzDP, mpzP1);
+    mpz_powm (m2, c, mpzDQ, mpzP2);
+    mpz_sub (m1, m1, m2);
+    mpz_mul (m1, m1, mpzQInv);
+    mpz_mod (m1, m1, mpzP1);
+    mpz_mul (m1, m1, mpzP2);
+    mpz_add (m1, m1, m2);
+    flOk = mpz_cmp (m1, m) == 0;
+  }
+
+  mpz_clears (n, m, c, mpzDP, mpzDQ, mpzQInv, m1, m2, NULL);
+
+  __atomic_fetch_add (flOk ? &nPctPassed : &nPctFailed, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add (&nPctNs, fnCancel_now_ns () - nStart, __ATOMIC_RELAXED);
+
+  return flOk ? KEYGEN_OK : KEYGEN_PCT_FAILED;
+}
+
+
+
+/************************************************************************
+ * fnPct_report -- The keys tested so far, and the time per key.
+ ***********************************************************************/
+void fnPct_report (FILE *fp)
+{
+  long  nTested = nPctPassed + nPctFailed;
+
+
+  fprintf (fp, "      pairwise tests: %ld passed, %ld failed, %.3f ms per key\n", \
+           nPctPassed, nPctFailed, nTested > 0 ? nPctNs / 1e6 / nTested : 0.0);
+}
@@ -0,0 +1,37 @@
+/**********************************************************************
+ * gen_pct.h -- Pairwise consistency test of a finished key.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- With the test on, every key made through
+ *           fnGenerate_keypair, fnGenerate_safe_keypair, the batch
+ *           API or the daemon's pools is checked once d is known:
+ *           c = m^e mod n with the public key, then m recovered from
+ *           c with the CRT parts of d, dP = d mod (p - 1),
+ *           dQ = d mod (q - 1) and qInv = q^{-1} mod p.  A key that
+ *           fails comes back as KEYGEN_PCT_FAILED.
+ *
+ *           The private half costs two exponentiations at half the
+ *           size, about a quarter of m^d mod n, and e of 65537 makes
+ *           the public half almost free.  Each worker tests its own
+ *           keys, so bulk runs test on all their threads.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_PCT_H
+#define GEN_PCT_H
+
+#include <stdio.h>
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+
+
+     /******** functions in gen_pct.c ********/
+void  fnPct_enable (BOOL flOn);
+BOOL  fnPct_enabled (void);
+int   fnPct_check (mpz_t mpzE, mpz_t mpzP1, mpz_t mpzP2, mpz_t mpzD);
+void  fnPct_report (FILE *fp);
+
+#endif
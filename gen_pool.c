@@ -0,0 +1,228 @@
+/**********************************************************************
+ * gen_pool.c -- Fixed size pool of worker threads with a task queue.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- One mutex guards a singly linked FIFO per priority.  A
+ *           task takes seconds (a key), so the queue is never the
+ *           bottleneck.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "gen_pool.h"
+
+
+     /******** #defines and typedefs  ********/
+typedef struct POOL_TASK {
+  struct POOL_TASK  *pNext;
+  POOL_FN            pfnTask;
+  void              *pArg;
+} POOL_TASK;
+
+struct POOL {
+  int               nThreads;
+  pthread_t        *pThreads;
+  void            (*pfnInit) (void);
+  void            (*pfnExit) (void);
+  POOL_TASK        *apHead[POOL_PRIO_COUNT];   /* queued tasks         */
+  POOL_TASK        *apTail[POOL_PRIO_COUNT];
+  int               nQueued;          /* all priorities               */
+  int               nBusy;            /* tasks being run              */
+  int               flStop;           /* workers should exit          */
+  pthread_mutex_t   mtx;
+  pthread_cond_t    cvWork;           /* a task was queued            */
+  pthread_cond_t    cvIdle;           /* queue empty, nobody busy     */
+};
+
+
+     /******** functions in this file ********/
+static void  *fnPool_worker (void *pArg);
+static POOL_TASK  *fnPool_take (POOL *pPool);
+
+
+
+/************************************************************************
+ * fnPool_create -- Start nThreads workers.  pfnInit and pfnExit may
+ *                  be NULL.
+ ***********************************************************************/
+POOL *fnPool_create (int nThreads, void (*pfnInit) (void), \
+      void (*pfnExit) (void))
+{
+  POOL  *pPool;
+  int    i;
+
+
+  pPool = (POOL *) calloc (1, sizeof (POOL));
+  pPool->nThreads = nThreads > 0 ? nThreads : 1;
+  pPool->pfnInit  = pfnInit;
+  pPool->pfnExit  = pfnExit;
+  pthread_mutex_init (&pPool->mtx, NULL);
+  pthread_cond_init (&pPool->cvWork, NULL);
+  pthread_cond_init (&pPool->cvIdle, NULL);
+
+  pPool->pThreads = (pthread_t *) malloc (pPool->nThreads * sizeof (pthread_t));
+  for (i = 0; i < pPool->nThreads; i++)
+    pthread_create (&pPool->pThreads[i], NULL, fnPool_worker, pPool);
+
+  return pPool;
+}
+
+
+
+/************************************************************************
+ * fnPool_submit -- Queue pfnTask (pArg) for the next free worker.
+ ***********************************************************************/
+void fnPool_submit (POOL *pPool, POOL_FN pfnTask, void *pArg)
+{
+  fnPool_submit_prio (pPool, POOL_PRIO_HIGH, pfnTask, pArg);
+}
+
+
+
+/************************************************************************
+ * fnPool_submit_prio -- Queue pfnTask (pArg) behind the tasks of the
+ *                       same priority.
+ ***********************************************************************/
+void fnPool_submit_prio (POOL *pPool, POOL_PRIO nPrio, POOL_FN pfnTask, \
+     void *pArg)
+{
+  POOL_TASK  *pTask;
+
+
+  pTask = (POOL_TASK *) malloc (sizeof (POOL_TASK));
+  pTask->pNext   = NULL;
+  pTask->pfnTask = pfnTask;
+  pTask->pArg    = pArg;
+
+  pthread_mutex_lock (&pPool->mtx);
+  if (pPool->apTail[nPrio] != NULL)
+    pPool->apTail[nPrio]->pNext = pTask;
+  else
+    pPool->apHead[nPrio] = pTask;
+  pPool->apTail[nPrio] = pTask;
+  pPool->nQueued++;
+  pthread_cond_signal (&pPool->cvWork);
+  pthread_mutex_unlock (&pPool->mtx);
+}
+
+
+
+/************************************************************************
+ * fnPool_wait -- Block until every submitted task has finished.
+ ***********************************************************************/
+void fnPool_wait (POOL *pPool)
+{
+  pthread_mutex_lock (&pPool->mtx);
+  while (pPool->nQueued > 0 || pPool->nBusy > 0)
+    pthread_cond_wait (&pPool->cvIdle, &pPool->mtx);
+  pthread_mutex_unlock (&pPool->mtx);
+}
+
+
+
+/************************************************************************
+ * fnPool_destroy -- Finish the queued tasks, stop the workers and
+ *                   free the pool.
+ ***********************************************************************/
+void fnPool_destroy (POOL *pPool)
+{
+  int  i;
+
+
+  fnPool_wait (pPool);
+
+  pthread_mutex_lock (&pPool->mtx);
+  pPool->flStop = 1;
+  pthread_cond_broadcast (&pPool->cvWork);
+  pthread_mutex_unlock (&pPool->mtx);
+
+  for (i = 0; i < pPool->nThreads; i++)
+    pthread_join (pPool->pThreads[i], NULL);
+
+  free (pPool->pThreads);
+  pthread_mutex_destroy (&pPool->mtx);
+  pthread_cond_destroy (&pPool->cvWork);
+  pthread_cond_destroy (&pPool->cvIdle);
+  free (pPool);
+}
+
+
+
+/************************************************************************
+ * fnPool_threads -- Number of workers.
+ ***********************************************************************/
+int fnPool_threads (const POOL *pPool)
+{
+  return pPool->nThreads;
+}
+
+
+
+/************************************************************************
+ * fnPool_worker -- Thread body.
+ ***********************************************************************/
+static void *fnPool_worker (void *pArg)
+{
+  POOL       *pPool = (POOL *) pArg;
+  POOL_TASK  *pTask;
+
+
+  if (pPool->pfnInit != NULL)
+    pPool->pfnInit ();
+
+  pthread_mutex_lock (&pPool->mtx);
+  while (1) {
+    /* 1. Next task, or stop */
+    while (pPool->nQueued == 0 && !pPool->flStop)
+      pthread_cond_wait (&pPool->cvWork, &pPool->mtx);
+    if (pPool->nQueued == 0)
+      break;
+    pTask = fnPool_take (pPool);
+    pPool->nBusy++;
+    pthread_mutex_unlock (&pPool->mtx);
+
+    /* 2. Run it */
+    pTask->pfnTask (pTask->pArg);
+    free (pTask);
+
+    /* 3. Tell fnPool_wait when everything is done */
+    pthread_mutex_lock (&pPool->mtx);
+    pPool->nBusy--;
+    if (pPool->nQueued == 0 && pPool->nBusy == 0)
+      pthread_cond_broadcast (&pPool->cvIdle);
+  }
+  pthread_mutex_unlock (&pPool->mtx);
+
+  if (pPool->pfnExit != NULL)
+    pPool->pfnExit ();
+
+  return NULL;
+}
+
+
+
+/************************************************************************
+ * fnPool_take -- Unlink the first task of the highest priority that
+ *                has one.  The mutex is held and nQueued > 0.
+ ***********************************************************************/
+static POOL_TASK *fnPool_take (POOL *pPool)
+{
+  POOL_TASK  *pTask;
+  int         nPrio;
+
+
+  for (nPrio = 0; pPool->apHead[nPrio] == NULL; nPrio++)
+    ;
+  pTask = pPool->apHead[nPrio];
+  pPool->apHead[nPrio] = pTask->pNext;
+  if (pPool->apHead[nPrio] == NULL)
+    pPool->apTail[nPrio] = NULL;
+  pPool->nQueued--;
+
+  return pTask;
+}
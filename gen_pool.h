@@ -0,0 +1,42 @@
+/**********************************************************************
+ * gen_pool.h -- Fixed size pool of worker threads with a task queue.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- Tasks run in the order they were submitted, except that
+ *           a free worker always takes a POOL_PRIO_HIGH task before
+ *           any POOL_PRIO_LOW one.  Running tasks are not interrupted.
+ *           The init and exit hooks run once in every worker, which
+ *           is where per thread GMP state is set up (see
+ *           fnWorker_init).
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_POOL_H
+#define GEN_POOL_H
+
+
+     /******** #defines and typedefs  ********/
+typedef void  (*POOL_FN) (void *pArg);
+
+typedef enum {
+  POOL_PRIO_HIGH = 0,                 /* someone is waiting for it    */
+  POOL_PRIO_LOW,                      /* background work              */
+  POOL_PRIO_COUNT
+} POOL_PRIO;
+
+typedef struct POOL  POOL;
+
+
+     /******** functions in gen_pool.c ********/
+POOL  *fnPool_create (int nThreads, void (*pfnInit) (void), \
+       void (*pfnExit) (void));
+void   fnPool_submit (POOL *pPool, POOL_FN pfnTask, void *pArg);
+void   fnPool_submit_prio (POOL *pPool, POOL_PRIO nPrio, POOL_FN pfnTask, \
+       void *pArg);
+void   fnPool_wait (POOL *pPool);
+void   fnPool_destroy (POOL *pPool);
+int    fnPool_threads (const POOL *pPool);
+
+#endif
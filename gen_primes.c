@@ -0,0 +1,403 @@
+/**********************************************************************
+ * gen_primes.c -- Lazy, endless source of random probable primes of
+ *                 one size, and the sieve tables behind it.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- The window is sieved as fnCreate_safe_prime does it: for
+ *           every odd prime s below PRIMES_SIEVE_LIMIT the k with
+ *           s | n + step k are struck out, k = (s - n mod s) / step
+ *           mod s, with the inverse of step mod s worked out once
+ *           when the table is made.  Safe primes also strike
+ *           s | (p - 1) / 2, that is p = 1 mod s, and so does a
+ *           fixed prime e below E_FOLD_MAX (fnSmall_prime_e), after
+ *           which gcd (p - 1, e) needs no test.
+ *
+ *           The bounds are those of FIPS 186-3 B.3.3: exactly
+ *           nNumBits bits, p^2 >= 2^{2 nNumBits - 1},
+ *           gcd (p - 1, e) = 1 and, for the second prime of a key,
+ *           |p - q| > 2^{nNumBits - 100}.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+#include "gen_cancel.h"
+#include "gen_primes.h"
+
+
+     /******** #defines and typedefs  ********/
+struct PRIME_TABLE {
+  int              nNumBits;
+  int              nPrime;            /* PRIME_TYPE                   */
+  unsigned long    nStep;             /* 2, or 4 for safe primes      */
+  int              nSieve;            /* odd primes in pnSieve        */
+  unsigned long   *pnSieve;
+  unsigned long   *pnInv;             /* 1 / nStep mod pnSieve[i]     */
+  mpz_t            mpzLow;            /* least p allowed              */
+  mpz_t            mpzDiff;           /* |p - q| must be above this   */
+  mpz_t            mpzTwo;            /* Fermat base                  */
+};
+
+struct PRIME_ITER {
+  PRIME_TABLE     *pTab;
+  int              nNumTests;
+  BOOL             flE;               /* mpzE given                   */
+  mpz_t            mpzE;
+  mpz_t            n, p, q, temp;     /* window start, candidate      */
+  unsigned long    nSmallE;           /* e struck out, or 0           */
+  int              k;                 /* next candidate of the window */
+  unsigned char    achStruck[PRIMES_WINDOW];
+  long             nWindows, nTests;
+};
+
+
+     /******** functions in this file ********/
+static int  fnPrimes_window (const PRIME_TABLE *pTab, mpz_t n, \
+            unsigned char *pchStruck, unsigned long nSmallE);
+static int  fnPrimes_test (const PRIME_TABLE *pTab, mpz_t p, mpz_t mpzE, \
+            mpz_t q, mpz_t temp, int nNumTests);
+
+
+
+
+/************************************************************************
+ * fnPrimes_table -- Sieve primes, inverses and bounds for primes of
+ *                   nNumBits bits of type nPrime (PRIME_TYPE).  NULL
+ *                   if nNumBits is too small.  Read only once made,
+ *                   any number of threads may share it.
+ ***********************************************************************/
+PRIME_TABLE *fnPrimes_table (int nNumBits, int nPrime)
+{
+  PRIME_TABLE    *pTab;
+  unsigned char  *pchComp;
+  unsigned long   nS, nRes, nInv2;
+
+
+  if (nNumBits < PRIMES_MIN_BITS)
+    return NULL;
+
+  pTab = (PRIME_TABLE *) calloc (1, sizeof (PRIME_TABLE));
+  pTab->nNumBits = nNumBits;
+  pTab->nPrime   = nPrime;
+  pTab->nStep    = nPrime == PRIME_SAFE ? 4 : 2;
+
+  /* 1. Odd sieve primes, and 1 / step mod each */
+  pchComp = (unsigned char *) calloc (PRIMES_SIEVE_LIMIT, 1);
+  pTab->pnSieve = (unsigned long *) malloc (PRIMES_SIEVE_LIMIT / 2 * \
+                                            sizeof (unsigned long));
+  pTab->pnInv   = (unsigned long *) malloc (PRIMES_SIEVE_LIMIT / 2 * \
+                                            sizeof (unsigned long));
+  for (nS = 3; nS < PRIMES_SIEVE_LIMIT; nS += 2) {
+    if (pchComp[nS])
+      continue;
+    for (nRes = nS * nS; nRes < PRIMES_SIEVE_LIMIT; nRes += 2 * nS)
+      pchComp[nRes] = 1;
+    nInv2 = (nS + 1) / 2;
+    pTab->pnInv[pTab->nSieve]     = pTab->nStep == 2 ? nInv2 : \
+                                    nInv2 * nInv2 % nS;
+    pTab->pnSieve[pTab->nSieve++] = nS;
+  }
+  free (pchComp);
+
+  /* 2. p^2 >= 2^{2 nNumBits - 1}, |p - q| > 2^{nNumBits - 100} */
+  mpz_inits (pTab->mpzLow, pTab->mpzDiff, NULL);
+  mpz_setbit (pTab->mpzLow, 2 * nNumBits - 1);
+  mpz_sqrt (pTab->mpzLow, pTab->mpzLow);
+  mpz_add_ui (pTab->mpzLow, pTab->mpzLow, 1);
+  mpz_setbit (pTab->mpzDiff, nNumBits <= 100 ? 0 : nNumBits - 100);
+  mpz_init_set_ui (pTab->mpzTwo, 2);
+
+  return pTab;
+}
+
+
+
+/************************************************************************
+ * fnPrimes_table_free -- Free a table made by fnPrimes_table.
+ ***********************************************************************/
+void fnPrimes_table_free (PRIME_TABLE *pTab)
+{
+  if (pTab == NULL)
+    return;
+
+  mpz_clears (pTab->mpzLow, pTab->mpzDiff, pTab->mpzTwo, NULL);
+  free (pTab->pnSieve);
+  free (pTab->pnInv);
+  free (pTab);
+}
+
+
+
+/************************************************************************
+ * fnPrimes_find -- One prime of the table's kind into mpzPrime: the
+ *                  first survivor of the window after a random start
+ *                  that passes, a new start when the window runs out.
+ *                  mpzE may be NULL; with mpzCompare the prime is also
+ *                  far enough from it to be the second of a key.
+ *                  Returns KEYGEN_OK, or what fnCancel_check said.
+ ***********************************************************************/
+int fnPrimes_find (const PRIME_TABLE *pTab, mpz_t mpzPrime, mpz_t mpzE, \
+    mpz_t mpzCompare, int nNumTests)
+{
+  unsigned char  achStruck[PRIMES_WINDOW];
+  mpz_t          n, p, q, temp;
+  unsigned long  nSmallE;
+  int            k = PRIMES_WINDOW;
+  int            nStatus = KEYGEN_OK;
+
+
+  mpz_inits (n, p, q, temp, NULL);
+  nSmallE = fnSmall_prime_e (mpzE);
+
+  while (1) {
+    /* 1. A fresh window when this one is used up */
+    if (k >= PRIMES_WINDOW) {
+      if ((nStatus = fnPrimes_window (pTab, n, achStruck, nSmallE)) != \
+          KEYGEN_OK)
+        break;
+      k = 0;
+    }
+
+    /* 2. The first survivor that is a prime far enough from q */
+    for (; k < PRIMES_WINDOW; k++) {
+      if (achStruck[k])
+        continue;
+      if ((nStatus = fnCancel_check ()) != KEYGEN_OK)
+        break;
+      mpz_add_ui (p, n, pTab->nStep * k);
+      if (mpz_sizeinbase (p, 2) != (size_t) pTab->nNumBits) {
+        k = PRIMES_WINDOW;                 /* ran past nNumBits */
+        break;
+      }
+      if (mpzCompare != NULL) {
+        mpz_sub (temp, p, mpzCompare);
+        mpz_abs (temp, temp);
+        if (mpz_cmp (temp, pTab->mpzDiff) <= 0)
+          continue;
+      }
+      nStatus = fnPrimes_test (pTab, p, nSmallE != 0 ? NULL : mpzE, q, \
+                               temp, nNumTests);
+      if (nStatus != KEYGEN_EXHAUSTED)
+        break;
+    }
+    if (k < PRIMES_WINDOW)
+      break;                               /* found, or cancelled */
+  }
+
+  /* 3. copy over results to return them */
+  if (nStatus == KEYGEN_OK)
+    mpz_set (mpzPrime, p);
+  mpz_clears (n, p, q, temp, NULL);
+
+  return nStatus;
+}
+
+
+
+/************************************************************************
+ * fnPrimes_open -- An iterator over primes of nNumBits bits, with
+ *                  gcd (p - 1, mpzE) = 1 unless mpzE is NULL.  nPrime
+ *                  is a PRIME_TYPE.  NULL if nNumBits is too small.
+ ***********************************************************************/
+PRIME_ITER *fnPrimes_open (int nNumBits, mpz_t mpzE, int nPrime, \
+            int nNumTests)
+{
+  PRIME_ITER   *pIter;
+  PRIME_TABLE  *pTab;
+
+
+  if ((pTab = fnPrimes_table (nNumBits, nPrime)) == NULL)
+    return NULL;
+
+  pIter = (PRIME_ITER *) calloc (1, sizeof (PRIME_ITER));
+  pIter->pTab      = pTab;
+  pIter->nNumTests = nNumTests;
+  pIter->flE       = mpzE != NULL;
+  pIter->nSmallE   = fnSmall_prime_e (mpzE);
+  pIter->k         = PRIMES_WINDOW;          /* no window yet */
+  if (pIter->flE)
+    mpz_init_set (pIter->mpzE, mpzE);
+  else
+    mpz_init (pIter->mpzE);
+                                  /* sized up front, so the pulls never */
+                                  /* reallocate them in an arena scope  */
+  mpz_init2 (pIter->n, nNumBits + GMP_NUMB_BITS);
+  mpz_init2 (pIter->p, nNumBits + GMP_NUMB_BITS);
+  mpz_init2 (pIter->q, nNumBits + GMP_NUMB_BITS);
+  mpz_init2 (pIter->temp, nNumBits + GMP_NUMB_BITS);
+
+  return pIter;
+}
+
+
+
+/************************************************************************
+ * fnPrimes_next -- The next prime of the iterator into mpzPrime.
+ *                  Returns KEYGEN_OK, or what fnCancel_check said; a
+ *                  cancelled call can be repeated and goes on where
+ *                  it stopped.
+ ***********************************************************************/
+int fnPrimes_next (PRIME_ITER *pIter, mpz_t mpzPrime)
+{
+  const PRIME_TABLE  *pTab = pIter->pTab;
+  int                 nStatus;
+
+
+  while (1) {
+    /* 1. A fresh window when this one is used up */
+    if (pIter->k >= PRIMES_WINDOW) {
+      if ((nStatus = fnPrimes_window (pTab, pIter->n, pIter->achStruck, \
+                                      pIter->nSmallE)) != KEYGEN_OK)
+        return nStatus;
+      pIter->k = 0;
+      pIter->nWindows++;
+    }
+
+    /* 2. Go on through the survivors of the window */
+    for (; pIter->k < PRIMES_WINDOW; pIter->k++) {
+      if (pIter->achStruck[pIter->k])
+        continue;
+      if ((nStatus = fnCancel_check ()) != KEYGEN_OK)
+        return nStatus;
+      mpz_add_ui (pIter->p, pIter->n, pTab->nStep * pIter->k);
+      if (mpz_sizeinbase (pIter->p, 2) != (size_t) pTab->nNumBits) {
+        pIter->k = PRIMES_WINDOW;          /* ran past nNumBits */
+        break;
+      }
+
+      pIter->nTests++;
+      nStatus = fnPrimes_test (pTab, pIter->p, pIter->flE && \
+                               pIter->nSmallE == 0 ? pIter->mpzE : NULL, \
+                               pIter->q, pIter->temp, pIter->nNumTests);
+      if (nStatus == KEYGEN_CANCELLED || nStatus == KEYGEN_DEADLINE)
+        return nStatus;
+      if (nStatus == KEYGEN_OK) {
+        pIter->k++;
+        mpz_set (mpzPrime, pIter->p);
+        return KEYGEN_OK;
+      }
+    }
+  }
+}
+
+
+
+/************************************************************************
+ * fnPrimes_stats -- Windows sieved and candidates tested so far.
+ ***********************************************************************/
+void fnPrimes_stats (const PRIME_ITER *pIter, long *pnWindows, long *pnTests)
+{
+  *pnWindows = pIter->nWindows;
+  *pnTests   = pIter->nTests;
+}
+
+
+
+/************************************************************************
+ * fnPrimes_close -- Free the iterator.
+ ***********************************************************************/
+void fnPrimes_close (PRIME_ITER *pIter)
+{
+  if (pIter == NULL)
+    return;
+
+  mpz_clears (pIter->mpzE, pIter->n, pIter->p, pIter->q, pIter->temp, NULL);
+  fnPrimes_table_free (pIter->pTab);
+  free (pIter);
+}
+
+
+
+/************************************************************************
+ * fnPrimes_window -- Draw a random start n and sieve the window after
+ *                    it into pchStruck.
+ ***********************************************************************/
+static int fnPrimes_window (const PRIME_TABLE *pTab, mpz_t n, \
+           unsigned char *pchStruck, unsigned long nSmallE)
+{
+  unsigned long  nS, nRes, nInv, k;
+  int            i, nStatus;
+
+
+  /* 1. Random start, odd (3 mod 4 for safe primes), above mpzLow */
+  do {
+    if ((nStatus = fnCancel_check ()) != KEYGEN_OK)
+      return nStatus;
+    mpz_urandomb (n, rndState, pTab->nNumBits - 1);
+    mpz_setbit (n, pTab->nNumBits - 1);
+    mpz_setbit (n, 0);
+    if (pTab->nPrime == PRIME_SAFE)
+      mpz_setbit (n, 1);
+  } while (mpz_cmp (n, pTab->mpzLow) < 0);
+
+  /* 2. Strike out p = 0 mod s, and for safe primes p = 1 mod s */
+  memset (pchStruck, 0, PRIMES_WINDOW);
+  for (i = 0; i < pTab->nSieve; i++) {
+    nS   = pTab->pnSieve[i];
+    nInv = pTab->pnInv[i];
+    nRes = mpz_fdiv_ui (n, nS);
+    for (k = (nS - nRes) % nS * nInv % nS; k < PRIMES_WINDOW; k += nS)
+      pchStruck[k] = 1;
+    if (pTab->nPrime != PRIME_SAFE)
+      continue;
+    for (k = (nS + 1 - nRes) % nS * nInv % nS; k < PRIMES_WINDOW; k += nS)
+      pchStruck[k] = 1;
+  }
+
+  /* 3. And p = 1 mod a prime e, the one way gcd (p - 1, e) fails */
+  if (nSmallE != 0) {
+    nRes = mpz_fdiv_ui (n, nSmallE);
+    nInv = (nSmallE + 1) / 2;                /* 1 / 2 mod e */
+    if (pTab->nStep == 4)
+      nInv = nInv * nInv % nSmallE;
+    for (k = (nSmallE + 1 - nRes) % nSmallE * nInv % nSmallE; \
+         k < PRIMES_WINDOW; k += nSmallE)
+      pchStruck[k] = 1;
+  }
+
+  return KEYGEN_OK;
+}
+
+
+
+/************************************************************************
+ * fnPrimes_test -- Test candidate p, q and temp are scratch.  KEYGEN_OK
+ *                  if it is a prime of the table's kind with
+ *                  gcd (p - 1, e) = 1, KEYGEN_EXHAUSTED if not, or
+ *                  what fnCancel_check said between the tests.
+ ***********************************************************************/
+static int fnPrimes_test (const PRIME_TABLE *pTab, mpz_t p, mpz_t mpzE, \
+           mpz_t q, mpz_t temp, int nNumTests)
+{
+  int  nStatus;
+
+
+  if (mpzE != NULL) {
+    mpz_sub_ui (temp, p, 1);
+    mpz_gcd (temp, temp, mpzE);
+    if (mpz_cmp_ui (temp, 1) != 0)
+      return KEYGEN_EXHAUSTED;
+  }
+
+  /* Safe primes: a Fermat test of q weeds out most before the full */
+  /* tests of q and p                                               */
+  nCandidates++;
+  if (pTab->nPrime == PRIME_SAFE) {
+    mpz_tdiv_q_2exp (q, p, 1);
+    mpz_sub_ui (temp, q, 1);
+    mpz_powm (temp, pTab->mpzTwo, temp, q);
+    if (mpz_cmp_ui (temp, 1) != 0 || mpz_probab_prime_p (q, nNumTests) == 0)
+      return KEYGEN_EXHAUSTED;
+    if ((nStatus = fnCancel_check ()) != KEYGEN_OK)
+      return nStatus;
+  }
+
+  return mpz_probab_prime_p (p, nNumTests) >= 1 ? KEYGEN_OK : \
+         KEYGEN_EXHAUSTED;
+}
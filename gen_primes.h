@@ -0,0 +1,64 @@
+/**********************************************************************
+ * gen_primes.h -- Lazy, endless source of random probable primes of
+ *                 one size, and the sieve tables behind it.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- fnPrimes_next hands out one prime per call and keeps its
+ *           place: a random start n and a sieve over the PRIMES_WINDOW
+ *           candidates n + step k after it, step 2 (4 for safe
+ *           primes).  The next call goes on at the following k of the
+ *           same window, so the sieving is paid once per window, not
+ *           once per prime.  A new random start is drawn when the
+ *           window runs out.  Nothing is made ahead of the calls.
+ *
+ *           Primes taken from one window lie within 2^{14} of each
+ *           other.  They are fine as a stream of primes of a size,
+ *           but never take both primes of a key from one iterator.
+ *
+ *           The random numbers come from the calling thread's
+ *           rndState, and a CANCEL_TOKEN it installed is honoured, as
+ *           in fnCreate_pseudo_prime.  One thread at a time per
+ *           iterator.  Open and close it outside of arena scopes;
+ *           fnPrimes_next may be called inside one.
+ *
+ *           A PRIME_TABLE holds what does not depend on the start:
+ *           the sieve primes, the inverses of the step and the bounds
+ *           of the size.  fnPrimes_find makes one prime with a table
+ *           that any number of threads share, as the batch API does
+ *           (gen_batch.h).
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_PRIMES_H
+#define GEN_PRIMES_H
+
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+
+
+     /******** #defines and typedefs  ********/
+#define PRIMES_MIN_BITS     (32)         /* above the sieve primes      */
+#define PRIMES_WINDOW       (4096)       /* candidates per random start */
+#define PRIMES_SIEVE_LIMIT  (16384)      /* odd sieve primes below this */
+
+typedef struct PRIME_TABLE  PRIME_TABLE;
+typedef struct PRIME_ITER   PRIME_ITER;
+
+
+     /******** functions in gen_primes.c ********/
+PRIME_TABLE *fnPrimes_table (int nNumBits, int nPrime);
+void         fnPrimes_table_free (PRIME_TABLE *pTab);
+int          fnPrimes_find (const PRIME_TABLE *pTab, mpz_t mpzPrime, \
+             mpz_t mpzE, mpz_t mpzCompare, int nNumTests);
+
+PRIME_ITER  *fnPrimes_open (int nNumBits, mpz_t mpzE, int nPrime, \
+             int nNumTests);
+int          fnPrimes_next (PRIME_ITER *pIter, mpz_t mpzPrime);
+void         fnPrimes_stats (const PRIME_ITER *pIter, long *pnWindows, \
+             long *pnTests);
+void         fnPrimes_close (PRIME_ITER *pIter);
+
+#endif
@@ -0,0 +1,440 @@
+/**********************************************************************
+ * gen_range.c -- Every probable prime of an interval, in order, and
+ *                the next probable prime after a number.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- Segment i holds the odd numbers start + 2 j, j below
+ *           RANGE_SEGMENT, with start = first + 2 RANGE_SEGMENT i.
+ *           For a sieve prime s, s | start + 2 j for j = (s - start
+ *           mod s) / 2 mod s, and every s-th j after it; one
+ *           mpz_fdiv_ui per sieve prime and segment, so any worker
+ *           can take any segment.  A sieve prime that lies in the
+ *           interval is not struck out itself.
+ *
+ *           The segments finished ahead of the oldest one wait in a
+ *           ring of slots, as the offsets j of their primes.  The
+ *           calling thread empties the slots in segment order; a
+ *           worker whose segment would need a slot still in use
+ *           waits for it.
+ *
+ *           At 1024 bits the odd primes below 2^22 leave about 7% of
+ *           the odd numbers for the tester, against 12% for those
+ *           below 2^14 that random search sieves with, and sieving a
+ *           segment costs about a tenth of testing its survivors.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+#include "gen_pool.h"
+#include "gen_cancel.h"
+#include "gen_range.h"
+
+
+     /******** #defines and typedefs  ********/
+typedef struct {                      /* a finished segment           */
+  BOOL          flDone;
+  long          nCount;               /* primes in it                 */
+  unsigned     *pnOff;                /* their j                      */
+} RANGE_SLOT;
+
+typedef struct {
+  mpz_t             mpzFirst;         /* odd start of segment 0       */
+  mpz_t             mpzE;             /* gcd test, unless nSmallE     */
+  BOOL              flE;
+  unsigned long     nSmallE;          /* e struck out in the sieve    */
+  unsigned long     nLastOdd;         /* odd numbers, last segment    */
+  long              nSegments;
+  int               nNumTests;
+  long              nNext;            /* next segment, shared         */
+  long              nEmitted;         /* segments handed out, mutex   */
+  long              nTests;           /* atomic                       */
+  int               nSlots;
+  RANGE_SLOT       *pSlots;
+  pthread_mutex_t   mutex;
+  pthread_cond_t    cvSlot;           /* a slot was filled or emptied */
+} RANGE_RUN;
+
+
+     /******** globals in this file   ********/
+static unsigned       *pnSieve;             /* odd primes below limit */
+static int             nSieve;
+static int             nNextSieve;          /* those for next prime   */
+static pthread_once_t  onceSieve = PTHREAD_ONCE_INIT;
+
+
+     /******** functions in this file ********/
+static void  fnRange_sieve_init (void);
+static void  fnRange_sieve (mpz_t mpzStart, unsigned long nOdd, int nPrimes, \
+             unsigned long nSmallE, unsigned char *pchStruck);
+static BOOL  fnRange_test (mpz_t p, mpz_t mpzE, mpz_t temp, int nNumTests);
+static void  fnRange_drain (void *pArg);
+
+
+
+/************************************************************************
+ * fnRange_primes -- Every probable prime p with mpzLow <= p < mpzHigh,
+ *                   and gcd (p - 1, mpzE) = 1 unless mpzE is NULL,
+ *                   to pfnOut in increasing order.  pStats may be
+ *                   NULL.  Returns 0, or -1 for an interval too long.
+ ***********************************************************************/
+int fnRange_primes (mpz_t mpzLow, mpz_t mpzHigh, mpz_t mpzE, \
+    int nNumTests, int nThreads, RANGE_OUT_FN pfnOut, void *pArg, \
+    RANGE_STATS *pStats)
+{
+  RANGE_RUN     run;
+  RANGE_SLOT   *pSlot;
+  POOL         *pPool;
+  mpz_t         mpzOdd, p;
+  long long     nStart = fnCancel_now_ns ();
+  long          i, j, nPrimes = 0;
+
+
+  pthread_once (&onceSieve, fnRange_sieve_init);
+  memset (&run, 0, sizeof (run));
+  mpz_inits (run.mpzFirst, run.mpzE, mpzOdd, p, NULL);
+  run.nNumTests = nNumTests;
+  if ((run.flE = mpzE != NULL)) {
+    mpz_set (run.mpzE, mpzE);
+    run.nSmallE = fnSmall_prime_e (mpzE);
+  }
+
+  /* 1. 2 on its own, then the odd numbers from max (mpzLow, 3) */
+  if (mpz_cmp_ui (mpzLow, 2) <= 0 && mpz_cmp_ui (mpzHigh, 2) > 0) {
+    mpz_set_ui (p, 2);
+    pfnOut (p, pArg);
+    nPrimes++;
+  }
+  if (mpz_cmp_ui (mpzLow, 3) < 0)
+    mpz_set_ui (run.mpzFirst, 3);
+  else
+    mpz_set (run.mpzFirst, mpzLow);
+  if (mpz_even_p (run.mpzFirst))
+    mpz_add_ui (run.mpzFirst, run.mpzFirst, 1);
+
+  /* 2. (high - first + 1) / 2 odd numbers, in segments */
+  mpz_sub (mpzOdd, mpzHigh, run.mpzFirst);
+  if (mpz_sgn (mpzOdd) > 0) {
+    mpz_add_ui (mpzOdd, mpzOdd, 1);
+    mpz_tdiv_q_2exp (mpzOdd, mpzOdd, 1);
+    run.nLastOdd = mpz_fdiv_ui (mpzOdd, RANGE_SEGMENT);
+    mpz_cdiv_q_ui (mpzOdd, mpzOdd, RANGE_SEGMENT);
+    if (!mpz_fits_slong_p (mpzOdd)) {
+      mpz_clears (run.mpzFirst, run.mpzE, mpzOdd, p, NULL);
+      return -1;
+    }
+    run.nSegments = mpz_get_si (mpzOdd);
+  }
+  if (run.nLastOdd == 0)
+    run.nLastOdd = RANGE_SEGMENT;
+
+  /* 3. The workers sieve and test, this thread hands out in order */
+  if (nThreads <= 0)
+    nThreads = 1;
+  run.nSlots = RANGE_AHEAD * nThreads;
+  run.pSlots = (RANGE_SLOT *) calloc (run.nSlots, sizeof (RANGE_SLOT));
+  for (i = 0; i < run.nSlots; i++)
+    run.pSlots[i].pnOff = (unsigned *) malloc (RANGE_SEGMENT * \
+                                               sizeof (unsigned));
+  pthread_mutex_init (&run.mutex, NULL);
+  pthread_cond_init (&run.cvSlot, NULL);
+
+  pPool = fnPool_create (nThreads, fnWorker_init, fnWorker_exit);
+  for (i = 0; i < nThreads; i++)
+    fnPool_submit (pPool, fnRange_drain, &run);
+
+  for (i = 0; i < run.nSegments; i++) {
+    pSlot = &run.pSlots[i % run.nSlots];
+    pthread_mutex_lock (&run.mutex);
+    while (!pSlot->flDone)
+      pthread_cond_wait (&run.cvSlot, &run.mutex);
+    pthread_mutex_unlock (&run.mutex);
+
+    mpz_set_ui (mpzOdd, (unsigned long) i);
+    mpz_mul_ui (mpzOdd, mpzOdd, 2UL * RANGE_SEGMENT);
+    mpz_add (mpzOdd, mpzOdd, run.mpzFirst);
+    for (j = 0; j < pSlot->nCount; j++) {
+      mpz_add_ui (p, mpzOdd, 2UL * pSlot->pnOff[j]);
+      pfnOut (p, pArg);
+    }
+    nPrimes += pSlot->nCount;
+
+    pthread_mutex_lock (&run.mutex);
+    pSlot->flDone = 0;
+    run.nEmitted  = i + 1;
+    pthread_cond_broadcast (&run.cvSlot);
+    pthread_mutex_unlock (&run.mutex);
+  }
+  fnPool_destroy (pPool);
+
+  if (pStats != NULL) {
+    pStats->nSegments = run.nSegments;
+    pStats->nTests    = run.nTests;
+    pStats->nPrimes   = nPrimes;
+    pStats->dSecs     = (fnCancel_now_ns () - nStart) / 1e9;
+  }
+
+  for (i = 0; i < run.nSlots; i++)
+    free (run.pSlots[i].pnOff);
+  free (run.pSlots);
+  pthread_mutex_destroy (&run.mutex);
+  pthread_cond_destroy (&run.cvSlot);
+  mpz_clears (run.mpzFirst, run.mpzE, mpzOdd, p, NULL);
+
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnRange_next_prime -- The least probable prime above mpzX, with
+ *                       gcd (p - 1, mpzE) = 1 unless mpzE is NULL,
+ *                       into mpzPrime.  Returns 0.
+ ***********************************************************************/
+int fnRange_next_prime (mpz_t mpzPrime, mpz_t mpzX, mpz_t mpzE, \
+    int nNumTests)
+{
+  unsigned char  achStruck[RANGE_NEXT_SEGMENT];
+  mpz_t          mpzStart, p, temp;
+  unsigned long  nSmallE = fnSmall_prime_e (mpzE);
+  unsigned long  j;
+
+
+  pthread_once (&onceSieve, fnRange_sieve_init);
+  if (mpz_cmp_ui (mpzX, 2) < 0) {
+    mpz_set_ui (mpzPrime, 2);
+    return 0;
+  }
+  mpz_inits (mpzStart, p, temp, NULL);
+
+  /* 1. The odd numbers above mpzX, a segment at a time */
+  mpz_add_ui (mpzStart, mpzX, 1);
+  if (mpz_even_p (mpzStart))
+    mpz_add_ui (mpzStart, mpzStart, 1);
+  while (1) {
+    fnRange_sieve (mpzStart, RANGE_NEXT_SEGMENT, nNextSieve, nSmallE, \
+                   achStruck);
+
+    /* 2. The first survivor that passes */
+    for (j = 0; j < RANGE_NEXT_SEGMENT; j++) {
+      if (achStruck[j])
+        continue;
+      mpz_add_ui (p, mpzStart, 2 * j);
+      if (fnRange_test (p, nSmallE != 0 ? NULL : mpzE, temp, nNumTests))
+        break;
+    }
+    if (j < RANGE_NEXT_SEGMENT)
+      break;
+    mpz_add_ui (mpzStart, mpzStart, 2 * RANGE_NEXT_SEGMENT);
+  }
+
+  mpz_set (mpzPrime, p);
+  mpz_clears (mpzStart, p, temp, NULL);
+
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnRange_parse -- A sum of terms, each a decimal number, 0x and a
+ *                  hex number, or B^K, into mpzX, as in
+ *                  2^1023+2^32-1.  Returns 0, or -1 if it is not one.
+ ***********************************************************************/
+int fnRange_parse (mpz_t mpzX, const char *psz)
+{
+  char           achNum[1024];
+  const char    *pch = psz;
+  mpz_t          mpzTerm;
+  unsigned long  nBase, nExp;
+  size_t         nLen;
+  int            nSign = 1, nRet = 0;
+
+
+  mpz_init (mpzTerm);
+  mpz_set_ui (mpzX, 0);
+  if (*pch == '-' || *pch == '+')
+    nSign = *pch++ == '-' ? -1 : 1;
+
+  while (nRet == 0) {
+    /* 1. One term: B^K, hex or decimal */
+    nLen = strcspn (pch, "+-");
+    if (nLen == 0 || nLen >= sizeof (achNum)) {
+      nRet = -1;
+      break;
+    }
+    memcpy (achNum, pch, nLen);
+    achNum[nLen] = '\0';
+    if (sscanf (achNum, "%lu^%lu", &nBase, &nExp) == 2 && \
+        strspn (achNum, "0123456789^") == nLen)
+      mpz_ui_pow_ui (mpzTerm, nBase, nExp);
+    else if (nLen > 2 && achNum[0] == '0' && tolower (achNum[1]) == 'x')
+      nRet = mpz_set_str (mpzTerm, achNum + 2, 16);
+    else
+      nRet = mpz_set_str (mpzTerm, achNum, 10);
+    if (nRet != 0)
+      break;
+
+    /* 2. Into the sum, then the next sign or the end */
+    if (nSign > 0)
+      mpz_add (mpzX, mpzX, mpzTerm);
+    else
+      mpz_sub (mpzX, mpzX, mpzTerm);
+    pch += nLen;
+    if (*pch == '\0')
+      break;
+    nSign = *pch++ == '-' ? -1 : 1;
+  }
+
+  mpz_clear (mpzTerm);
+
+  return nRet == 0 ? 0 : -1;
+}
+
+
+
+/************************************************************************
+ * fnRange_sieve_init -- The odd primes below RANGE_SIEVE_LIMIT, once.
+ ***********************************************************************/
+static void fnRange_sieve_init (void)
+{
+  unsigned char  *pchComp;
+  unsigned long   nS, nRes;
+
+
+  pchComp = (unsigned char *) calloc (RANGE_SIEVE_LIMIT, 1);
+  pnSieve = (unsigned *) malloc (RANGE_SIEVE_LIMIT / 4 * sizeof (unsigned));
+  for (nS = 3; nS < RANGE_SIEVE_LIMIT; nS += 2) {
+    if (pchComp[nS])
+      continue;
+    for (nRes = nS * nS; nRes < RANGE_SIEVE_LIMIT; nRes += 2 * nS)
+      pchComp[nRes] = 1;
+    if (nS < RANGE_NEXT_LIMIT)
+      nNextSieve++;
+    pnSieve[nSieve++] = (unsigned) nS;
+  }
+  free (pchComp);
+}
+
+
+
+/************************************************************************
+ * fnRange_sieve -- Strike out in pchStruck the j below nOdd with
+ *                  mpzStart + 2 j divisible by one of the first
+ *                  nPrimes sieve primes (but not equal to it), or
+ *                  1 mod nSmallE if that is not 0.
+ ***********************************************************************/
+static void fnRange_sieve (mpz_t mpzStart, unsigned long nOdd, int nPrimes, \
+            unsigned long nSmallE, unsigned char *pchStruck)
+{
+  unsigned long  nS, nRes, j;
+  unsigned long  nSmall = 0;              /* mpzStart, if below 2^22 */
+  int            i;
+
+
+  memset (pchStruck, 0, nOdd);
+  if (mpz_cmp_ui (mpzStart, RANGE_SIEVE_LIMIT) < 0)
+    nSmall = mpz_get_ui (mpzStart);
+
+  /* 1. s | start + 2 j, j = (s - start mod s) (s + 1) / 2 mod s */
+  for (i = 0; i < nPrimes; i++) {
+    nS   = pnSieve[i];
+    nRes = mpz_fdiv_ui (mpzStart, nS);
+    j    = (nS - nRes) % nS * ((nS + 1) / 2) % nS;
+    if (nSmall != 0 && nSmall + 2 * j == nS)
+      j += nS;                            /* s itself is prime */
+    for (; j < nOdd; j += nS)
+      pchStruck[j] = 1;
+  }
+
+  /* 2. start + 2 j = 1 mod e, the one way gcd (p - 1, e) fails */
+  if (nSmallE != 0) {
+    nRes = mpz_fdiv_ui (mpzStart, nSmallE);
+    for (j = (nSmallE + 1 - nRes) % nSmallE * ((nSmallE + 1) / 2) % \
+             nSmallE; j < nOdd; j += nSmallE)
+      pchStruck[j] = 1;
+  }
+}
+
+
+
+/************************************************************************
+ * fnRange_test -- The tester of fnCreate_pseudo_prime: gcd (p - 1, e)
+ *                 = 1 if mpzE is not NULL, then mpz_probab_prime_p.
+ ***********************************************************************/
+static BOOL fnRange_test (mpz_t p, mpz_t mpzE, mpz_t temp, int nNumTests)
+{
+  if (mpzE != NULL) {
+    mpz_sub_ui (temp, p, 1);
+    mpz_gcd (temp, temp, mpzE);
+    if (mpz_cmp_ui (temp, 1) != 0)
+      return 0;
+  }
+  nCandidates++;
+
+  return mpz_probab_prime_p (p, nNumTests) >= 1;
+}
+
+
+
+/************************************************************************
+ * fnRange_drain -- Pool task: segments until none are left, each
+ *                  into its slot once the slot is free.
+ ***********************************************************************/
+static void fnRange_drain (void *pArg)
+{
+  RANGE_RUN      *pRun = (RANGE_RUN *) pArg;
+  RANGE_SLOT     *pSlot;
+  unsigned char   achStruck[RANGE_SEGMENT];
+  mpz_t           mpzStart, p, temp;
+  unsigned long   j, nOdd;
+  long            nSeg, nTests;
+
+
+  mpz_inits (mpzStart, p, temp, NULL);
+  while ((nSeg = __atomic_fetch_add (&pRun->nNext, 1, __ATOMIC_RELAXED))
+         < pRun->nSegments) {
+
+    /* 1. Wait for the slot, so at most nSlots segments are ahead */
+    pSlot = &pRun->pSlots[nSeg % pRun->nSlots];
+    pthread_mutex_lock (&pRun->mutex);
+    while (nSeg >= pRun->nEmitted + pRun->nSlots)
+      pthread_cond_wait (&pRun->cvSlot, &pRun->mutex);
+    pthread_mutex_unlock (&pRun->mutex);
+
+    /* 2. Sieve the segment, test the survivors in order */
+    mpz_set_ui (mpzStart, (unsigned long) nSeg);
+    mpz_mul_ui (mpzStart, mpzStart, 2UL * RANGE_SEGMENT);
+    mpz_add (mpzStart, mpzStart, pRun->mpzFirst);
+    nOdd = nSeg == pRun->nSegments - 1 ? pRun->nLastOdd : RANGE_SEGMENT;
+    fnRange_sieve (mpzStart, nOdd, nSieve, pRun->nSmallE, achStruck);
+
+    pSlot->nCount = 0;
+    nTests = 0;
+    for (j = 0; j < nOdd; j++) {
+      if (achStruck[j])
+        continue;
+      nTests++;
+      mpz_add_ui (p, mpzStart, 2 * j);
+      if (fnRange_test (p, pRun->flE && pRun->nSmallE == 0 ? pRun->mpzE : \
+                        NULL, temp, pRun->nNumTests))
+        pSlot->pnOff[pSlot->nCount++] = (unsigned) j;
+    }
+    __atomic_fetch_add (&pRun->nTests, nTests, __ATOMIC_RELAXED);
+
+    /* 3. Done, for the calling thread to hand out */
+    pthread_mutex_lock (&pRun->mutex);
+    pSlot->flDone = 1;
+    pthread_cond_broadcast (&pRun->cvSlot);
+    pthread_mutex_unlock (&pRun->mutex);
+  }
+  mpz_clears (mpzStart, p, temp, NULL);
+}
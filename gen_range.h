@@ -0,0 +1,62 @@
+/**********************************************************************
+ * gen_range.h -- Every probable prime of an interval, in order, and
+ *                the next probable prime after a number.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- A systematic sweep in place of the random starts of
+ *           fnCreate_pseudo_prime, with its tester: the interval is
+ *           cut into segments of RANGE_SEGMENT odd numbers, each
+ *           sieved by the odd primes below RANGE_SIEVE_LIMIT in a
+ *           byte map that stays in the L1 cache, and the survivors
+ *           go through mpz_probab_prime_p with nNumTests.  With an e
+ *           the primes also have gcd (p - 1, e) = 1, struck out in
+ *           the sieve for a prime e as gen_primes.c does.
+ *
+ *           fnRange_primes shares the segments among nThreads pool
+ *           workers and hands the primes to pfnOut in increasing
+ *           order on the calling thread, as soon as every segment
+ *           before theirs is done.  At most RANGE_AHEAD segments per
+ *           worker are held waiting for an earlier one.
+ *
+ *           fnRange_next_prime sieves smaller segments with fewer
+ *           primes, since it stops at the first prime.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_RANGE_H
+#define GEN_RANGE_H
+
+#include <stdio.h>
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+
+
+     /******** #defines and typedefs  ********/
+#define RANGE_SEGMENT       (1 << 15)   /* odd numbers per segment     */
+#define RANGE_SIEVE_LIMIT   (1 << 22)   /* sieve primes for a sweep    */
+#define RANGE_NEXT_SEGMENT  (1 << 12)   /* odd numbers, next prime     */
+#define RANGE_NEXT_LIMIT    (1 << 16)   /* sieve primes, next prime    */
+#define RANGE_AHEAD         (4)         /* segments per worker         */
+
+typedef void  (*RANGE_OUT_FN) (mpz_t mpzPrime, void *pArg);
+
+typedef struct {
+  long       nSegments;
+  long       nTests;                  /* survivors of the sieve       */
+  long       nPrimes;
+  double     dSecs;
+} RANGE_STATS;
+
+
+     /******** functions in gen_range.c ********/
+int   fnRange_primes (mpz_t mpzLow, mpz_t mpzHigh, mpz_t mpzE, \
+      int nNumTests, int nThreads, RANGE_OUT_FN pfnOut, void *pArg, \
+      RANGE_STATS *pStats);
+int   fnRange_next_prime (mpz_t mpzPrime, mpz_t mpzX, mpz_t mpzE, \
+      int nNumTests);
+int   fnRange_parse (mpz_t mpzX, const char *psz);
+
+#endif
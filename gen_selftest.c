@@ -0,0 +1,398 @@
+/**********************************************************************
+ * gen_selftest.c -- Self test of the generator as a library, linked
+ *                   against libgen_pair.a.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- gen_selftest        run every check, exit 1 if any fails
+ *           gen_selftest bench [N] time N keys, 1024 and 2048 bits in
+ *                                turn, made by fnBatch_generate and
+ *                                one by one, both on one thread
+ *
+ *           The checks drive the public APIs the way an outside
+ *           program would: futures of gen_async.h taken from the
+ *           eventfd, through a callback, cancelled and past their
+ *           deadline, and a mixed batch of gen_batch.h made on one
+ *           and on several threads.  Every key that comes back is
+ *           checked: n = pq of nlen bits, e d = 1 mod lcm (p - 1,
+ *           q - 1), and p, q probable primes.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <time.h>
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+#include "gen_bulk.h"
+#include "gen_async.h"
+#include "gen_batch.h"
+
+
+     /******** #defines and typedefs  ********/
+#define TEST_SEED        (1)
+#define TEST_REPS        (25)        /* primality reps of the checks   */
+#define TEST_FUTURES     (3)         /* taken from the eventfd         */
+#define TEST_SLOW_BITS   (4096)      /* safe key that will not finish  */
+#define TEST_DEADLINE_MS (50)
+#define TEST_BATCH       (6)         /* requests in the checked batch  */
+#define TEST_BENCH_KEYS  (40)        /* keys timed by default          */
+
+typedef struct {
+  int   nBitLen;
+  int   nStatus;
+  BOOL  flKeyOk;
+  int   nCalls;                       /* callbacks run                */
+} CB_RESULT;
+
+
+     /******** globals in this file   ********/
+static int  nChecks, nFailed;
+
+
+     /******** functions in this file ********/
+static void  fnTest_result (const char *pszWhat, BOOL flOk);
+static BOOL  fnTest_key (mpz_t mpzE, mpz_t mpzN, mpz_t mpzP1, \
+             mpz_t mpzP2, mpz_t mpzD, int nBitLen);
+static BOOL  fnTest_future_key (KEY_FUTURE *pFut, int nBitLen);
+static void  fnTest_async (void);
+static void  fnTest_callback (KEY_FUTURE *pFut, void *pArg);
+static void  fnTest_batch (void);
+static int   fnTest_bench (int nKeys);
+static double  fnTest_secs (const struct timespec *pTsStart);
+
+
+
+/*************** main -- entry point **********************/
+int main (int argc, char *argv[])
+{
+  int  nKeys;
+
+
+  program_name = argv[0];
+  if (argc > 1 && strcmp (argv[1], "bench") == 0) {
+    nKeys = argc > 2 ? atoi (argv[2]) : TEST_BENCH_KEYS;
+    if (argc <= 3 && nKeys > 0)
+      return fnTest_bench (nKeys);
+  }
+  if (argc > 1) {
+    printf ("Usage: %s [bench [N]]\n", program_name);
+    return 1;
+  }
+
+  fnWorker_init ();                     /* for the keys made here */
+  fnTest_async ();
+  fnTest_batch ();
+  fnWorker_exit ();
+
+  printf ("\n  %d of %d checks passed\n", nChecks - nFailed, nChecks);
+  return nFailed == 0 ? 0 : 1;
+}
+
+
+
+/************************************************************************
+ * fnTest_result -- Count and print one check.
+ ***********************************************************************/
+static void fnTest_result (const char *pszWhat, BOOL flOk)
+{
+  nChecks++;
+  if (!flOk)
+    nFailed++;
+  printf ("  %-52s %s\n", pszWhat, flOk ? "ok" : "FAILED");
+  fflush (stdout);
+}
+
+
+
+/************************************************************************
+ * fnTest_key -- 1 if e, n, p, q, d are a good key of nBitLen bits.
+ ***********************************************************************/
+static BOOL fnTest_key (mpz_t mpzE, mpz_t mpzN, mpz_t mpzP1, \
+            mpz_t mpzP2, mpz_t mpzD, int nBitLen)
+{
+  mpz_t  mpzT, mpzL, mpzQ1;
+  BOOL   flOk;
+
+
+  mpz_inits (mpzT, mpzL, mpzQ1, NULL);
+  mpz_mul (mpzT, mpzP1, mpzP2);
+  flOk = mpz_cmp (mpzT, mpzN) == 0 && \
+         mpz_sizeinbase (mpzN, 2) == (size_t) nBitLen;
+
+  mpz_sub_ui (mpzL, mpzP1, 1);
+  mpz_sub_ui (mpzQ1, mpzP2, 1);
+  mpz_lcm (mpzL, mpzL, mpzQ1);
+  mpz_mul (mpzT, mpzE, mpzD);
+  mpz_mod (mpzT, mpzT, mpzL);
+  flOk = flOk && mpz_cmp_ui (mpzT, 1) == 0 && \
+         mpz_probab_prime_p (mpzP1, TEST_REPS) != 0 && \
+         mpz_probab_prime_p (mpzP2, TEST_REPS) != 0;
+
+  mpz_clears (mpzT, mpzL, mpzQ1, NULL);
+  return flOk;
+}
+
+
+
+/************************************************************************
+ * fnTest_future_key -- 1 if the future holds a good key of nBitLen.
+ ***********************************************************************/
+static BOOL fnTest_future_key (KEY_FUTURE *pFut, int nBitLen)
+{
+  mpz_t  mpzE, mpzN, mpzP1, mpzP2, mpzD;
+  BOOL   flOk;
+
+
+  mpz_inits (mpzE, mpzN, mpzP1, mpzP2, mpzD, NULL);
+  flOk = fnFuture_get (pFut, mpzE, mpzN, mpzP1, mpzP2, mpzD) == KEYGEN_OK \
+         && fnTest_key (mpzE, mpzN, mpzP1, mpzP2, mpzD, nBitLen);
+  mpz_clears (mpzE, mpzN, mpzP1, mpzP2, mpzD, NULL);
+
+  return flOk;
+}
+
+
+
+/************************************************************************
+ * fnTest_async -- Futures of gen_async.h.
+ *
+ * Remark - Request k uses the seed S + k * 2^{64}, so request 0 must
+ *          give the key fnBulk_seed_key makes here for key 0.
+ ***********************************************************************/
+static void fnTest_async (void)
+{
+  static const int  anBits[TEST_FUTURES] = { 512, 768, 1024 };
+  ASYNC_KEYGEN     *pAsync;
+  KEY_FUTURE       *apFut[TEST_FUTURES], *pFut, *pSlow;
+  KEY_PARAMS        params;
+  CB_RESULT         cb;
+  struct pollfd     pfd;
+  mpz_t             mpzE, mpzN, mpzP1, mpzP2, mpzD, mpzN0;
+  BOOL              flOk;
+  int               i, nDone, nWait;
+
+
+  printf ("\n  --> gen_async.h <--\n");
+  pAsync = fnAsync_create (2, 8, TEST_SEED);
+  if (pAsync == NULL) {
+    fnTest_result ("fnAsync_create", 0);
+    return;
+  }
+
+  /* 1. Futures without a callback, taken as the eventfd wakes us */
+  memset (&params, 0, sizeof (params));
+  params.ePolicy.nKind = E_POLICY_FIXED;
+  params.ePolicy.nValE = E_F4;
+  params.nPrime        = PRIME_PROBABLE;
+  for (i = 0; i < TEST_FUTURES; i++) {
+    params.nBitLen = anBits[i];
+    apFut[i] = fnAsync_keypair (pAsync, &params, NULL, NULL);
+  }
+  pfd.fd     = fnAsync_fd (pAsync);
+  pfd.events = POLLIN;
+  for (nDone = 0; nDone < TEST_FUTURES && poll (&pfd, 1, 60000) > 0; )
+    while ((pFut = fnAsync_next_done (pAsync)) != NULL)
+      nDone++;
+  fnTest_result ("futures come back through the eventfd", \
+                 nDone == TEST_FUTURES);
+  for (flOk = 1, i = 0; i < TEST_FUTURES; i++)
+    flOk = flOk && fnTest_future_key (apFut[i], anBits[i]);
+  fnTest_result ("their keys are good", flOk);
+
+  /* 2. Request 0 is the key of seed S + 0 * 2^{64} */
+  mpz_inits (mpzE, mpzN, mpzP1, mpzP2, mpzD, mpzN0, NULL);
+  fnBulk_seed_key (TEST_SEED, 0);
+  fnMake_exponent_e (mpzE, &params.ePolicy);
+  fnGenerate_keypair (mpzP1, mpzP2, mpzD, mpzE, anBits[0]);
+  mpz_mul (mpzN0, mpzP1, mpzP2);
+  fnFuture_get (apFut[0], mpzE, mpzN, mpzP1, mpzP2, mpzD);
+  fnTest_result ("request 0 is the key of its seed", \
+                 mpz_cmp (mpzN, mpzN0) == 0);
+  mpz_clears (mpzE, mpzN, mpzP1, mpzP2, mpzD, mpzN0, NULL);
+  for (i = 0; i < TEST_FUTURES; i++)
+    fnFuture_free (apFut[i]);
+
+  /* 3. A callback on the worker, which owns the future */
+  memset (&cb, 0, sizeof (cb));
+  cb.nBitLen     = 1024;
+  params.nBitLen = cb.nBitLen;
+  params.ePolicy.nKind = E_POLICY_RANDOM;
+  fnAsync_keypair (pAsync, &params, fnTest_callback, &cb);
+  for (nWait = 0; __atomic_load_n (&cb.nCalls, __ATOMIC_ACQUIRE) == 0 && \
+                  nWait < 6000; nWait++)
+    poll (NULL, 0, 10);
+  fnTest_result ("a callback runs once with a good key", \
+                 __atomic_load_n (&cb.nCalls, __ATOMIC_ACQUIRE) == 1 && \
+                 cb.nStatus == KEYGEN_OK && cb.flKeyOk);
+
+  /* 4. A deadline and a cancel stop searches that would run long */
+  params.nBitLen       = TEST_SLOW_BITS;
+  params.ePolicy.nKind = E_POLICY_FIXED;
+  params.nPrime        = PRIME_SAFE;
+  params.nTimeoutMs    = TEST_DEADLINE_MS;
+  pSlow = fnAsync_keypair (pAsync, &params, NULL, NULL);
+  fnTest_result ("a safe 4096-bit key stops at a 50 ms deadline", \
+                 fnFuture_status (pSlow) == KEYGEN_DEADLINE);
+  fnFuture_free (pSlow);
+
+  params.nTimeoutMs = 0;
+  pSlow = fnAsync_keypair (pAsync, &params, NULL, NULL);
+  fnFuture_cancel (pSlow);
+  fnTest_result ("a cancelled future says so and holds no key", \
+                 fnFuture_status (pSlow) == KEYGEN_CANCELLED && \
+                 !fnTest_future_key (pSlow, TEST_SLOW_BITS));
+  fnFuture_free (pSlow);
+
+  /* 5. Bad requests are refused at once */
+  params.nBitLen = 100;
+  fnTest_result ("a 100-bit request is refused", \
+                 fnAsync_keypair (pAsync, &params, NULL, NULL) == NULL);
+
+  fnAsync_destroy (pAsync);
+}
+
+
+
+/************************************************************************
+ * fnTest_callback -- KEY_CALLBACK, on a worker thread.
+ ***********************************************************************/
+static void fnTest_callback (KEY_FUTURE *pFut, void *pArg)
+{
+  CB_RESULT  *pCb = (CB_RESULT *) pArg;
+
+
+  pCb->nStatus = fnFuture_status (pFut);
+  pCb->flKeyOk = fnTest_future_key (pFut, pCb->nBitLen);
+  fnFuture_free (pFut);
+  __atomic_add_fetch (&pCb->nCalls, 1, __ATOMIC_RELEASE);
+}
+
+
+
+/************************************************************************
+ * fnTest_batch -- A mixed batch of gen_batch.h.
+ *
+ * Remark - The last request is bad, it must come back with nStatus -1
+ *          and be the one key counted as failed.  The batch depends
+ *          only on the seed and the requests, so one thread and three
+ *          must give the same moduli.
+ ***********************************************************************/
+static void fnTest_batch (void)
+{
+  static const int  anBits[TEST_BATCH] = { 512, 1024, 768, 512, 1024, 100 };
+  KEY_PARAMS        aReqs[TEST_BATCH];
+  KEY_PAIR          aKeys1[TEST_BATCH], aKeys3[TEST_BATCH];
+  int               i, nBad1, nBad3;
+  BOOL              flOk, flSame;
+
+
+  printf ("\n  --> gen_batch.h <--\n");
+
+  /* 1. Fixed and random e, probable and safe primes, one bad size */
+  memset (aReqs, 0, sizeof (aReqs));
+  for (i = 0; i < TEST_BATCH; i++) {
+    aReqs[i].nBitLen        = anBits[i];
+    aReqs[i].ePolicy.nKind  = i % 3 == 2 ? E_POLICY_RANDOM : E_POLICY_FIXED;
+    aReqs[i].ePolicy.nValE  = E_F4;
+    aReqs[i].nPrime         = i == 3 ? PRIME_SAFE : PRIME_PROBABLE;
+  }
+
+  nBad1 = fnBatch_generate (aReqs, aKeys1, TEST_BATCH, 1, TEST_SEED);
+  nBad3 = fnBatch_generate (aReqs, aKeys3, TEST_BATCH, 3, TEST_SEED);
+  fnTest_result ("only the bad request fails, with nStatus -1", \
+                 nBad1 == 1 && nBad3 == 1 && \
+                 aKeys1[TEST_BATCH - 1].nStatus == -1);
+
+  /* 2. Every good key checks out, whatever the thread count */
+  for (flOk = 1, flSame = 1, i = 0; i < TEST_BATCH - 1; i++) {
+    flOk = flOk && aKeys1[i].nStatus == KEYGEN_OK && \
+           fnTest_key (aKeys1[i].mpzE, aKeys1[i].mpzN, aKeys1[i].mpzP1, \
+                       aKeys1[i].mpzP2, aKeys1[i].mpzD, anBits[i]);
+    flSame = flSame && mpz_cmp (aKeys1[i].mpzN, aKeys3[i].mpzN) == 0;
+  }
+  fnTest_result ("the batch keys are good", flOk);
+  fnTest_result ("one thread and three make the same batch", flSame);
+
+  fnBatch_clear (aKeys1, TEST_BATCH);
+  fnBatch_clear (aKeys3, TEST_BATCH);
+}
+
+
+
+/************************************************************************
+ * fnTest_bench -- Time nKeys keys made by fnBatch_generate and made
+ *                 one by one, on one thread.  1 if a key failed.
+ *
+ * Remark - Both make probable-prime keys with e = F4, 1024 and 2048
+ *          bits in turn, seeded the same way.  The primes differ (the
+ *          batch sieves a window, the per-key search draws every
+ *          candidate), so compare the times of long runs only.
+ ***********************************************************************/
+static int fnTest_bench (int nKeys)
+{
+  KEY_PARAMS       *aReqs;
+  KEY_PAIR         *aKeys;
+  struct timespec   tsStart;
+  mpz_t             mpzE, mpzP1, mpzP2, mpzD;
+  double            dBatch, dSingle;
+  int               i, nBad;
+
+
+  /* 1. The batch */
+  aReqs = (KEY_PARAMS *) calloc (nKeys, sizeof (KEY_PARAMS));
+  aKeys = (KEY_PAIR *) malloc (nKeys * sizeof (KEY_PAIR));
+  for (i = 0; i < nKeys; i++) {
+    aReqs[i].nBitLen       = i % 2 == 0 ? 1024 : 2048;
+    aReqs[i].ePolicy.nKind = E_POLICY_FIXED;
+    aReqs[i].ePolicy.nValE = E_F4;
+    aReqs[i].nPrime        = PRIME_PROBABLE;
+  }
+  clock_gettime (CLOCK_MONOTONIC, &tsStart);
+  nBad = fnBatch_generate (aReqs, aKeys, nKeys, 1, TEST_SEED);
+  dBatch = fnTest_secs (&tsStart);
+  fnBatch_clear (aKeys, nKeys);
+  free (aKeys);
+
+  /* 2. The same requests one by one */
+  fnWorker_init ();
+  mpz_inits (mpzE, mpzP1, mpzP2, mpzD, NULL);
+  clock_gettime (CLOCK_MONOTONIC, &tsStart);
+  for (i = 0; i < nKeys; i++) {
+    fnBulk_seed_key (TEST_SEED, i);
+    fnMake_exponent_e (mpzE, &aReqs[i].ePolicy);
+    if (fnGenerate_keypair (mpzP1, mpzP2, mpzD, mpzE, \
+                            aReqs[i].nBitLen) != KEYGEN_OK)
+      nBad++;
+  }
+  dSingle = fnTest_secs (&tsStart);
+  mpz_clears (mpzE, mpzP1, mpzP2, mpzD, NULL);
+  fnWorker_exit ();
+  free (aReqs);
+
+  printf ("  %d keys of 1024 and 2048 bits on one thread\n", nKeys);
+  printf ("    fnBatch_generate  %8.2f s\n", dBatch);
+  printf ("    one by one        %8.2f s\n", dSingle);
+  if (nBad)
+    printf ("  %d key%s failed\n", nBad, nBad == 1 ? "" : "s");
+  return nBad == 0 ? 0 : 1;
+}
+
+
+
+/************************************************************************
+ * fnTest_secs -- Seconds since tsStart, on the monotonic clock.
+ ***********************************************************************/
+static double fnTest_secs (const struct timespec *pTsStart)
+{
+  struct timespec  tsNow;
+
+
+  clock_gettime (CLOCK_MONOTONIC, &tsNow);
+  return (tsNow.tv_sec - pTsStart->tv_sec) + \
+         (tsNow.tv_nsec - pTsStart->tv_nsec) / 1e9;
+}
@@ -0,0 +1,396 @@
+/**********************************************************************
+ * gen_shm.c -- Ring of finished keys in shared memory.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- A producer claims a sequence number with one atomic add,
+ *           writes the key into the slot and publishes it by storing
+ *           the next sequence number; the consumer gives the slot
+ *           back the same way.  Neither side makes a system call
+ *           unless it has to wait: a side that runs out of slots (or
+ *           of keys) spins SHM_SPIN times, then announces itself in
+ *           the waiters count and sleeps on a futex, and only then
+ *           does the other side call FUTEX_WAKE.
+ *
+ *           The modulus is multiplied straight into the slot with
+ *           mpn_mul; e, p, q and d are copied in limb by limb, which
+ *           is all the serialization there is.  The consumer reads
+ *           the limbs in place (see fnShm_key_num).
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <gmp.h>
+
+#include "gen_shm.h"
+
+
+     /******** #defines and typedefs  ********/
+#define SHM_SPIN        (2000)      /* checks before sleeping          */
+#define SHM_ALIGN       (64)        /* slots start on a cache line     */
+
+#define LOAD(p)         __atomic_load_n ((p), __ATOMIC_SEQ_CST)
+#define STORE(p, v)     __atomic_store_n ((p), (v), __ATOMIC_SEQ_CST)
+#define ADD(p, n)       __atomic_fetch_add ((p), (n), __ATOMIC_SEQ_CST)
+
+struct SHM_RING {
+  SHM_HEADER     *pHdr;
+  unsigned char  *pchSlots;
+  size_t          nMapLen;
+  int             flProducer;
+  char           *pszPath;            /* producer removes it at close */
+};
+
+
+     /******** functions in this file ********/
+static SHM_KEY  *fnShm_slot (SHM_RING *pRing, uint64_t nPos);
+static void      fnShm_wait (uint32_t *pFutex, uint32_t *pWaiters, \
+                 const uint64_t *pWatch, uint64_t nWant, \
+                 const uint32_t *pflDone, uint64_t *pnSleeps);
+static void      fnShm_wake (uint32_t *pFutex, uint32_t *pWaiters, int nHow);
+static void      fnShm_copy (SHM_KEY *pKey, mp_limb_t **ppDst, SHM_NUM nWhich, \
+                 mpz_t mpzX);
+
+
+
+/************************************************************************
+ * fnShm_create -- Create (or replace) the ring file for keys of
+ *                 nBitLen bits and map it.  NULL on failure.
+ ***********************************************************************/
+SHM_RING *fnShm_create (const char *pszPath, int nBitLen, int nSlots)
+{
+  SHM_RING    *pRing;
+  SHM_HEADER  *pHdr;
+  size_t       nLimbs, nSlotBytes, nHdrBytes;
+  int          fd, i, nPow;
+
+
+  /* 1. Sizes: slots a power of two, each big enough for the */
+  /*    largest key of nBitLen bits                          */
+  for (nPow = 1; nPow < nSlots; nPow <<= 1)
+    ;
+  nLimbs     = SHM_E_LIMBS + 2 * (nBitLen / GMP_NUMB_BITS + 1) + \
+               2 * (nBitLen / 2 / GMP_NUMB_BITS + 1);
+  nSlotBytes = (sizeof (SHM_KEY) + nLimbs * sizeof (mp_limb_t) + \
+                SHM_ALIGN - 1) & ~(size_t) (SHM_ALIGN - 1);
+  nHdrBytes  = (sizeof (SHM_HEADER) + SHM_ALIGN - 1) & ~(size_t) (SHM_ALIGN - 1);
+
+  /* 2. A new file and its mapping.  Never reuse the old one, a */
+  /*    consumer may still have it mapped                        */
+  unlink (pszPath);
+  fd = open (pszPath, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 || ftruncate (fd, nHdrBytes + nPow * nSlotBytes) != 0) {
+    perror (pszPath);
+    if (fd >= 0)
+      close (fd);
+    return NULL;
+  }
+
+  pRing = (SHM_RING *) calloc (1, sizeof (SHM_RING));
+  pRing->nMapLen = nHdrBytes + nPow * nSlotBytes;
+  pRing->pHdr    = (SHM_HEADER *) mmap (NULL, pRing->nMapLen, PROT_READ | \
+                                        PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  if (pRing->pHdr == MAP_FAILED) {
+    perror ("mmap");
+    free (pRing);
+    return NULL;
+  }
+  pRing->pchSlots   = (unsigned char *) pRing->pHdr + nHdrBytes;
+  pRing->flProducer = 1;
+  pRing->pszPath    = strdup (pszPath);
+
+  /* 3. Every slot starts free for the first lap, the magic goes */
+  /*    in last so a waiting consumer sees a finished header     */
+  pHdr = pRing->pHdr;
+  pHdr->nVersion   = SHM_VERSION;
+  pHdr->nSlots     = nPow;
+  pHdr->nSlotBytes = nSlotBytes;
+  pHdr->nBitLen    = nBitLen;
+  pHdr->nLimbBits  = GMP_NUMB_BITS;
+  for (i = 0; i < nPow; i++)
+    fnShm_slot (pRing, i)->nSeq = i;
+  STORE (&pHdr->nMagic, SHM_MAGIC);
+
+  return pRing;
+}
+
+
+
+/************************************************************************
+ * fnShm_attach -- Map a ring made by fnShm_create, waiting up to
+ *                 nWaitMs for the producer to create it.
+ ***********************************************************************/
+SHM_RING *fnShm_attach (const char *pszPath, int nWaitMs)
+{
+  SHM_RING    *pRing;
+  SHM_HEADER  *pHdr;
+  struct stat  st;
+  int          fd = -1, nMs;
+
+
+  /* 1. Wait for the file and a finished header */
+  for (nMs = 0; ; nMs += 10) {
+    if (fd < 0)
+      fd = open (pszPath, O_RDWR);
+    if (fd >= 0 && fstat (fd, &st) == 0 &&
+        (size_t) st.st_size >= sizeof (SHM_HEADER)) {
+      pHdr = (SHM_HEADER *) mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, \
+                                  MAP_SHARED, fd, 0);
+      if (pHdr != MAP_FAILED && LOAD (&pHdr->nMagic) == SHM_MAGIC)
+        break;
+      if (pHdr != MAP_FAILED)
+        munmap (pHdr, st.st_size);
+    }
+    if (nMs >= nWaitMs) {
+      fprintf (stderr, "%s: no key ring\n", pszPath);
+      if (fd >= 0)
+        close (fd);
+      return NULL;
+    }
+    usleep (10000);
+  }
+  close (fd);
+
+  /* 2. The layout must be ours */
+  if (pHdr->nVersion != SHM_VERSION || pHdr->nLimbBits != GMP_NUMB_BITS) {
+    fprintf (stderr, "%s: key ring of another version\n", pszPath);
+    munmap (pHdr, st.st_size);
+    return NULL;
+  }
+
+  pRing = (SHM_RING *) calloc (1, sizeof (SHM_RING));
+  pRing->pHdr     = pHdr;
+  pRing->nMapLen  = st.st_size;
+  pRing->pchSlots = (unsigned char *) pHdr + \
+                    ((sizeof (SHM_HEADER) + SHM_ALIGN - 1) & \
+                     ~(size_t) (SHM_ALIGN - 1));
+
+  return pRing;
+}
+
+
+
+/************************************************************************
+ * fnShm_close -- Unmap the ring.  The producer first tells the
+ *                consumer that no more keys will come and removes
+ *                the file, so no later consumer attaches to a
+ *                finished ring.
+ ***********************************************************************/
+void fnShm_close (SHM_RING *pRing)
+{
+  if (pRing->flProducer) {
+    STORE (&pRing->pHdr->flDone, 1);
+    fnShm_wake (&pRing->pHdr->nDataFutex, &pRing->pHdr->nDataWaiters, 1);
+    unlink (pRing->pszPath);
+    free (pRing->pszPath);
+  }
+
+  munmap (pRing->pHdr, pRing->nMapLen);
+  free (pRing);
+}
+
+
+
+/************************************************************************
+ * fnShm_header -- The shared header, for its counters.
+ ***********************************************************************/
+SHM_HEADER *fnShm_header (SHM_RING *pRing)
+{
+  return pRing->pHdr;
+}
+
+
+
+/************************************************************************
+ * fnShm_put_key -- Producer: place one key in the next slot, waiting
+ *                  while the ring is full.  Returns 0.
+ ***********************************************************************/
+int fnShm_put_key (SHM_RING *pRing, long nIndex, int nBitLen, \
+    mpz_t mpzE, mpz_t mpzP1, mpz_t mpzP2, mpz_t mpzD)
+{
+  SHM_HEADER  *pHdr = pRing->pHdr;
+  SHM_KEY     *pKey;
+  mp_limb_t   *pDst;
+  mpz_ptr      pBig, pSmall;
+  uint64_t     nPos;
+  size_t       nN;
+
+
+  /* 1. Claim a sequence number, wait for its slot to come back */
+  nPos = ADD (&pHdr->nHead, 1);
+  pKey = fnShm_slot (pRing, nPos);
+  if (LOAD (&pKey->nSeq) != nPos)
+    fnShm_wait (&pHdr->nSpaceFutex, &pHdr->nSpaceWaiters, &pKey->nSeq, \
+                nPos, NULL, &pHdr->nFullWaits);
+
+  /* 2. The numbers, n multiplied in place */
+  pKey->nIndex  = nIndex;
+  pKey->nBitLen = nBitLen;
+  pDst = pKey->aLimbs;
+  fnShm_copy (pKey, &pDst, SHM_E, mpzE);
+
+  pBig   = mpz_size (mpzP1) >= mpz_size (mpzP2) ? mpzP1 : mpzP2;
+  pSmall = pBig == mpzP1 ? mpzP2 : mpzP1;
+  nN     = mpz_size (pBig) + mpz_size (pSmall);
+  mpn_mul (pDst, mpz_limbs_read (pBig), mpz_size (pBig), \
+           mpz_limbs_read (pSmall), mpz_size (pSmall));
+  if (pDst[nN - 1] == 0)
+    nN--;
+  pKey->anLimbs[SHM_N] = (uint16_t) nN;
+  pDst += nN;
+
+  fnShm_copy (pKey, &pDst, SHM_P, mpzP1);
+  fnShm_copy (pKey, &pDst, SHM_Q, mpzP2);
+  fnShm_copy (pKey, &pDst, SHM_D, mpzD);
+
+  /* 3. Publish */
+  STORE (&pKey->nSeq, nPos + 1);
+  fnShm_wake (&pHdr->nDataFutex, &pHdr->nDataWaiters, 1);
+
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnShm_next -- Consumer: the next key, waiting while the ring is
+ *               empty.  NULL once the producer is done and every key
+ *               has been taken.
+ ***********************************************************************/
+SHM_KEY *fnShm_next (SHM_RING *pRing)
+{
+  SHM_HEADER  *pHdr = pRing->pHdr;
+  SHM_KEY     *pKey;
+  uint64_t     nPos = pHdr->nTail;
+
+
+  pKey = fnShm_slot (pRing, nPos);
+  while (LOAD (&pKey->nSeq) != nPos + 1) {
+    if (LOAD (&pHdr->flDone) && LOAD (&pHdr->nHead) <= nPos)
+      return NULL;
+    fnShm_wait (&pHdr->nDataFutex, &pHdr->nDataWaiters, &pKey->nSeq, \
+                nPos + 1, &pHdr->flDone, &pHdr->nEmptyWaits);
+  }
+
+  return pKey;
+}
+
+
+
+/************************************************************************
+ * fnShm_release -- Consumer: give the slot of pKey back.  Keys are
+ *                  released in the order fnShm_next returned them.
+ ***********************************************************************/
+void fnShm_release (SHM_RING *pRing, SHM_KEY *pKey)
+{
+  SHM_HEADER  *pHdr = pRing->pHdr;
+
+
+  STORE (&pHdr->nTail, pHdr->nTail + 1);
+  STORE (&pKey->nSeq, pKey->nSeq - 1 + pHdr->nSlots);
+  fnShm_wake (&pHdr->nSpaceFutex, &pHdr->nSpaceWaiters, INT_MAX);
+}
+
+
+
+/************************************************************************
+ * fnShm_key_num -- A read only mpz_t over one number of pKey, no copy.
+ *                  Valid until the key is released.
+ ***********************************************************************/
+mpz_srcptr fnShm_key_num (mpz_t mpzView, const SHM_KEY *pKey, SHM_NUM nWhich)
+{
+  const mp_limb_t  *pLimbs = pKey->aLimbs;
+  int               i;
+
+
+  for (i = 0; i < (int) nWhich; i++)
+    pLimbs += pKey->anLimbs[i];
+
+  return mpz_roinit_n (mpzView, pLimbs, pKey->anLimbs[nWhich]);
+}
+
+
+
+/************************************************************************
+ * fnShm_slot -- The slot of sequence number nPos.
+ ***********************************************************************/
+static SHM_KEY *fnShm_slot (SHM_RING *pRing, uint64_t nPos)
+{
+  return (SHM_KEY *) (pRing->pchSlots + (nPos & (pRing->pHdr->nSlots - 1)) * \
+                      pRing->pHdr->nSlotBytes);
+}
+
+
+
+/************************************************************************
+ * fnShm_wait -- Wait until *pWatch is nWant (or *pflDone is set).
+ *
+ * Remark - The waiter reads the futex word, announces itself, then
+ *          looks once more before sleeping; the other side changes
+ *          what is watched, bumps the futex word, then looks for
+ *          waiters.  With sequentially consistent atomics one of the
+ *          two always sees the other, so no wake up is lost.
+ ***********************************************************************/
+static void fnShm_wait (uint32_t *pFutex, uint32_t *pWaiters, \
+            const uint64_t *pWatch, uint64_t nWant, \
+            const uint32_t *pflDone, uint64_t *pnSleeps)
+{
+  uint32_t  nVal;
+  int       i;
+
+
+  for (i = 0; i < SHM_SPIN; i++)
+    if (LOAD (pWatch) == nWant || (pflDone != NULL && LOAD (pflDone)))
+      return;
+
+  while (LOAD (pWatch) != nWant && (pflDone == NULL || !LOAD (pflDone))) {
+    nVal = LOAD (pFutex);
+    ADD (pWaiters, 1);
+    if (LOAD (pWatch) != nWant && (pflDone == NULL || !LOAD (pflDone))) {
+      ADD (pnSleeps, 1);
+      syscall (SYS_futex, pFutex, FUTEX_WAIT, nVal, NULL, NULL, 0);
+    }
+    ADD (pWaiters, -1);
+  }
+}
+
+
+
+/************************************************************************
+ * fnShm_wake -- Bump the futex word and wake up to nHow sleepers, if
+ *               there are any.
+ ***********************************************************************/
+static void fnShm_wake (uint32_t *pFutex, uint32_t *pWaiters, int nHow)
+{
+  ADD (pFutex, 1);
+  if (LOAD (pWaiters) != 0)
+    syscall (SYS_futex, pFutex, FUTEX_WAKE, nHow, NULL, NULL, 0);
+}
+
+
+
+/************************************************************************
+ * fnShm_copy -- Copy the limbs of mpzX to *ppDst and move it on.
+ ***********************************************************************/
+static void fnShm_copy (SHM_KEY *pKey, mp_limb_t **ppDst, SHM_NUM nWhich, \
+            mpz_t mpzX)
+{
+  size_t  nLimbs = mpz_size (mpzX);
+
+
+  mpn_copyi (*ppDst, mpz_limbs_read (mpzX), nLimbs);
+  pKey->anLimbs[nWhich] = (uint16_t) nLimbs;
+  *ppDst += nLimbs;
+}
@@ -0,0 +1,80 @@
+/**********************************************************************
+ * gen_shm.h -- Ring of finished keys in shared memory, for a consumer
+ *              process on the same host.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- The file (usually under /dev/shm) holds a SHM_HEADER and
+ *           nSlots slots of nSlotBytes.  A slot holds one SHM_KEY: the
+ *           limbs of e, n, p, q and d one after the other, least
+ *           significant limb first, with their counts in anLimbs.
+ *
+ *           Any number of producer threads and one consumer.  Slot
+ *           ownership passes through the slot's sequence number:
+ *           sequence pos is free for the producer of pos when nSeq is
+ *           pos, and ready for the consumer when nSeq is pos + 1.
+ *           Futexes are only touched when a side has gone to sleep.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_SHM_H
+#define GEN_SHM_H
+
+#include <stdint.h>
+#include <gmp.h>
+
+
+     /******** #defines and typedefs  ********/
+#define SHM_MAGIC           (0x4d485347u)  /* "GSHM"                   */
+#define SHM_VERSION         (1)
+#define SHM_SLOTS_DEFAULT   (256)
+#define SHM_E_LIMBS         (256 / GMP_NUMB_BITS + 1)  /* random e     */
+
+typedef enum {
+  SHM_E = 0, SHM_N, SHM_P, SHM_Q, SHM_D, SHM_NUMS
+} SHM_NUM;
+
+typedef struct {
+  uint32_t  nMagic;                   /* written last by the producer */
+  uint32_t  nVersion;
+  uint32_t  nSlots;                   /* a power of two               */
+  uint32_t  nSlotBytes;
+  uint32_t  nBitLen;                  /* modulus length of the run    */
+  uint32_t  nLimbBits;                /* GMP_NUMB_BITS of the producer */
+  uint64_t  nHead   __attribute__ ((aligned (64)));  /* claimed        */
+  uint64_t  nTail   __attribute__ ((aligned (64)));  /* consumed       */
+  uint32_t  nDataFutex __attribute__ ((aligned (64)));
+  uint32_t  nDataWaiters;             /* consumer is asleep           */
+  uint32_t  nSpaceFutex __attribute__ ((aligned (64)));
+  uint32_t  nSpaceWaiters;            /* producers asleep             */
+  uint32_t  flDone;                   /* no more keys will come       */
+  uint64_t  nFullWaits;               /* producer sleeps, for stats   */
+  uint64_t  nEmptyWaits;              /* consumer sleeps, for stats   */
+} SHM_HEADER;
+
+typedef struct {
+  uint64_t   nSeq;                    /* ring protocol, see above     */
+  uint64_t   nIndex;                  /* key index in the run         */
+  uint32_t   nBitLen;
+  uint16_t   anLimbs[SHM_NUMS];       /* e, n, p, q, d                */
+  mp_limb_t  aLimbs[];
+} SHM_KEY;
+
+typedef struct SHM_RING  SHM_RING;
+
+
+     /******** functions in gen_shm.c ********/
+SHM_RING    *fnShm_create (const char *pszPath, int nBitLen, int nSlots);
+SHM_RING    *fnShm_attach (const char *pszPath, int nWaitMs);
+void         fnShm_close (SHM_RING *pRing);
+SHM_HEADER  *fnShm_header (SHM_RING *pRing);
+
+int          fnShm_put_key (SHM_RING *pRing, long nIndex, int nBitLen, \
+             mpz_t mpzE, mpz_t mpzP1, mpz_t mpzP2, mpz_t mpzD);
+SHM_KEY     *fnShm_next (SHM_RING *pRing);
+void         fnShm_release (SHM_RING *pRing, SHM_KEY *pKey);
+mpz_srcptr   fnShm_key_num (mpz_t mpzView, const SHM_KEY *pKey, \
+             SHM_NUM nWhich);
+
+#endif
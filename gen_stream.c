@@ -0,0 +1,307 @@
+/**********************************************************************
+ * gen_stream.c -- Streaming co-process mode.  One long lived process
+ *                 answers key requests read from a pipe.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- The reader thread parses requests and queues them on the
+ *           worker pool; it blocks once STREAM_WINDOW requests are
+ *           unanswered, so a fast producer cannot run the process out
+ *           of memory.  A worker formats its answer (gen_bulk.c) and
+ *           writes it at once, so answers arrive in completion order.
+ *           With --reorder they are held back in a window of slots
+ *           and written in request order instead.
+ *
+ *           Every answer is flushed, the other end of the pipe can
+ *           act on it while later keys are still being searched.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <gmp.h>
+
+#include "gen_pair_pseudo.h"
+#include "gen_cancel.h"
+#include "gen_arena.h"
+#include "gen_memprof.h"
+#include "gen_bulk.h"
+#include "gen_pool.h"
+#include "gen_stream.h"
+
+
+     /******** #defines and typedefs  ********/
+typedef struct STREAM_RUN  STREAM_RUN;
+
+typedef struct {
+  STREAM_RUN   *pRun;
+  long          nSeq;                 /* position in the stream       */
+  char          achId[64];            /* tag of the answer            */
+  int           nBitLen;
+  E_POLICY      ePolicy;
+  CANCEL_TOKEN  tok;                  /* deadline from receipt        */
+  char         *pchOut;               /* the answer line              */
+  size_t        nOutLen;
+  int           flError;              /* pchOut is an error answer    */
+} STREAM_REQ;
+
+struct STREAM_RUN {
+  const STREAM_OPTS  *pOpts;
+  FILE               *fpOut;
+  int                 nWindow;
+  STREAM_REQ        **ppSlots;        /* --reorder: answers by nSeq   */
+  long                nNextOut;       /* --reorder: next to write     */
+  long                nAnswered;      /* answers written              */
+  long                nKeys, nErrors;
+  int                 flFailed;       /* output is gone               */
+  pthread_mutex_t     mtx;
+  pthread_cond_t      cvRoom;         /* an answer was written        */
+};
+
+
+     /******** globals in this file   ********/
+static int                nStreamFormat;     /* for the worker hook   */
+static __thread KEY_FMT   streamFmt;         /* each worker's own     */
+
+
+     /******** functions in this file ********/
+static void  fnStream_worker_init (void);
+static void  fnStream_worker_exit (void);
+static void  fnStream_key (void *pArg);
+static void  fnStream_error (STREAM_REQ *pReq, const char *pszMsg);
+static void  fnStream_answer (STREAM_REQ *pReq);
+static void  fnStream_write (STREAM_RUN *pRun, STREAM_REQ *pReq);
+
+
+
+/************************************************************************
+ * fnStream_run -- Answer requests from fpIn on fpOut until end of
+ *                 file.  Returns 0 when every answer was written.
+ ***********************************************************************/
+int fnStream_run (const STREAM_OPTS *pOpts, FILE *fpIn, FILE *fpOut)
+{
+  STREAM_RUN   run;
+  STREAM_REQ  *pReq;
+  POOL        *pPool;
+  char         line[STREAM_LINE_MAX + 2];
+  char         achE[64];
+  char        *pch;
+  long         nSeq = 0;
+  int          nFields, c;
+  int          nEndLen, nEnd;               /* offsets after nlen, e */
+
+
+  memset (&run, 0, sizeof (run));
+  run.pOpts   = pOpts;
+  run.fpOut   = fpOut;
+  run.nWindow = pOpts->nWindow > 0 ? pOpts->nWindow : STREAM_WINDOW;
+  if (pOpts->flReorder)
+    run.ppSlots = (STREAM_REQ **) calloc (run.nWindow, sizeof (STREAM_REQ *));
+  pthread_mutex_init (&run.mtx, NULL);
+  pthread_cond_init (&run.cvRoom, NULL);
+
+  /* 1. Workers, each with its own random state and formatter */
+  nStreamFormat = pOpts->nFormat;
+  pPool = fnPool_create (pOpts->nThreads, fnStream_worker_init, \
+                         fnStream_worker_exit);
+
+  while (fgets (line, sizeof (line), fpIn) != NULL) {
+    /* 2. Skip blank lines and comments */
+    for (pch = line; *pch == ' ' || *pch == '\t'; pch++)
+      ;
+    if (*pch == '\n' || *pch == '\0' || *pch == '#')
+      continue;
+
+    /* 3. Wait for room in the window */
+    pthread_mutex_lock (&run.mtx);
+    while (nSeq - run.nAnswered >= run.nWindow && !run.flFailed)
+      pthread_cond_wait (&run.cvRoom, &run.mtx);
+    pthread_mutex_unlock (&run.mtx);
+    if (run.flFailed)
+      break;
+
+    /* 4. Parse 'id nlen [e]' */
+    pReq = (STREAM_REQ *) calloc (1, sizeof (STREAM_REQ));
+    pReq->pRun = &run;
+    pReq->nSeq = nSeq++;
+    achE[0] = '\0';
+    nEndLen = nEnd = 0;
+    nFields = sscanf (pch, "%63s %d%n %63s%n", pReq->achId, \
+                      &pReq->nBitLen, &nEndLen, achE, &nEnd);
+    if (nFields == 2)
+      nEnd = nEndLen;
+
+    if (strchr (line, '\n') == NULL && !feof (fpIn)) {
+      while ((c = fgetc (fpIn)) != EOF && c != '\n')
+        ;
+      fnStream_error (pReq, "line too long");
+    }
+    else if (nFields < 2 || strchr (" \t\r\n", pch[nEndLen]) == NULL ||
+             pch[nEnd + strspn (pch + nEnd, " \t\r\n")] != '\0')
+      fnStream_error (pReq, "expected 'id nlen [e]'");
+    else if (pReq->nBitLen < STREAM_MIN_BITS ||
+             pReq->nBitLen > STREAM_MAX_BITS || pReq->nBitLen % 2 != 0)
+      fnStream_error (pReq, "nlen must be even and in range");
+    else if (nFields == 3 && fnParse_e_policy (achE, &pReq->ePolicy) != 0)
+      fnStream_error (pReq, "bad exponent");
+    else {
+      if (nFields == 2)
+        pReq->ePolicy.nKind = E_POLICY_RANDOM;
+      fnCancel_init (&pReq->tok, pOpts->nDeadlineMs);
+      pReq->pchOut = (char *) malloc (KEY_RECORD_LEN (pReq->nBitLen) + \
+                                      sizeof (pReq->achId));
+      fnPool_submit (pPool, fnStream_key, pReq);
+    }
+  }
+
+  /* 5. End of input, answer what is still in flight */
+  fnPool_destroy (pPool);
+
+  fprintf (stderr, "\n  --> Stream: %ld keys, %ld errors <--\n", \
+           run.nKeys, run.nErrors);
+
+  free (run.ppSlots);
+  pthread_mutex_destroy (&run.mtx);
+  pthread_cond_destroy (&run.cvRoom);
+
+  return run.flFailed ? 1 : 0;
+}
+
+
+
+/************************************************************************
+ * fnStream_worker_init -- Pool hook, outside of any arena scope.
+ ***********************************************************************/
+static void fnStream_worker_init (void)
+{
+  fnWorker_init ();
+  fnKeyfmt_init (&streamFmt, nStreamFormat, STREAM_MAX_BITS);
+}
+
+
+
+/************************************************************************
+ * fnStream_worker_exit -- Pool hook.
+ ***********************************************************************/
+static void fnStream_worker_exit (void)
+{
+  fnKeyfmt_clear (&streamFmt);
+  fnWorker_exit ();
+}
+
+
+
+/************************************************************************
+ * fnStream_key -- Pool task: one key, the same steps as main.
+ ***********************************************************************/
+static void fnStream_key (void *pArg)
+{
+  STREAM_REQ  *pReq = (STREAM_REQ *) pArg;
+  mpz_t        mpzP1, mpzP2, mpzE, mpzD, mpzN;
+  int          nStatus;
+
+
+  fnCancel_use (&pReq->tok);
+  fnArena_begin ();
+  fnBulk_seed_key (pReq->pRun->pOpts->nSeed, pReq->nSeq);
+  mpz_inits (mpzP1, mpzP2, mpzE, mpzD, mpzN, NULL);
+
+  fnMemprof_phase (MEM_PHASE_E);
+  fnMake_exponent_e (mpzE, &pReq->ePolicy);
+
+  nStatus = fnGenerate_keypair (mpzP1, mpzP2, mpzD, mpzE, pReq->nBitLen);
+
+  fnMemprof_phase (MEM_PHASE_OUTPUT);
+  if (nStatus == KEYGEN_OK) {
+    mpz_mul (mpzN, mpzP1, mpzP2);
+    pReq->nOutLen = fnKeyfmt_record (pReq->pchOut, &streamFmt, pReq->achId, \
+                                     pReq->nBitLen, mpzE, mpzN, mpzP1, \
+                                     mpzP2, mpzD);
+  }
+
+  mpz_clears (mpzP1, mpzP2, mpzE, mpzD, mpzN, NULL);
+  fnArena_end ();
+  fnMemprof_key_done ();
+  fnCancel_use (NULL);
+
+  if (nStatus != KEYGEN_OK) {
+    free (pReq->pchOut);
+    fnStream_error (pReq, fnKeygen_status_text (nStatus));
+    return;
+  }
+
+  fnStream_answer (pReq);
+}
+
+
+
+/************************************************************************
+ * fnStream_error -- Answer a bad or failed request with
+ *                   'id error message'.
+ ***********************************************************************/
+static void fnStream_error (STREAM_REQ *pReq, const char *pszMsg)
+{
+  if (pReq->achId[0] == '\0')
+    strcpy (pReq->achId, "-");
+  pReq->flError = 1;
+  pReq->pchOut  = (char *) malloc (sizeof (pReq->achId) + strlen (pszMsg) + 16);
+  pReq->nOutLen = sprintf (pReq->pchOut, "%s error %s\n", pReq->achId, pszMsg);
+
+  fnStream_answer (pReq);
+}
+
+
+
+/************************************************************************
+ * fnStream_answer -- Write a finished answer, or park it until the
+ *                    answers before it are written (--reorder).
+ ***********************************************************************/
+static void fnStream_answer (STREAM_REQ *pReq)
+{
+  STREAM_RUN  *pRun = pReq->pRun;
+
+
+  pthread_mutex_lock (&pRun->mtx);
+  if (pReq->flError)
+    pRun->nErrors++;
+  else
+    pRun->nKeys++;
+
+  if (pRun->ppSlots == NULL)
+    fnStream_write (pRun, pReq);
+  else {
+    /* The reader keeps nSeq within nWindow of nNextOut, so the */
+    /* slot is free                                             */
+    pRun->ppSlots[pReq->nSeq % pRun->nWindow] = pReq;
+    while ((pReq = pRun->ppSlots[pRun->nNextOut % pRun->nWindow]) != NULL) {
+      pRun->ppSlots[pRun->nNextOut % pRun->nWindow] = NULL;
+      pRun->nNextOut++;
+      fnStream_write (pRun, pReq);
+    }
+  }
+
+  pthread_cond_signal (&pRun->cvRoom);
+  pthread_mutex_unlock (&pRun->mtx);
+}
+
+
+
+/************************************************************************
+ * fnStream_write -- Write and free one answer, the mutex is held.
+ ***********************************************************************/
+static void fnStream_write (STREAM_RUN *pRun, STREAM_REQ *pReq)
+{
+  if (!pRun->flFailed &&
+      (fwrite (pReq->pchOut, 1, pReq->nOutLen, pRun->fpOut) != pReq->nOutLen ||
+       fflush (pRun->fpOut) != 0)) {
+    fprintf (stderr, "%s: stream output failed\n", program_name);
+    pRun->flFailed = 1;
+  }
+  pRun->nAnswered++;
+
+  free (pReq->pchOut);
+  free (pReq);
+}
@@ -0,0 +1,46 @@
+/**********************************************************************
+ * gen_stream.h -- Streaming co-process mode.  Requests are read from
+ *                 stdin one line each and answered on stdout by the
+ *                 worker pool, tagged with the request id.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- A request is 'id nlen [e]', where e is a number, 'f4' or
+ *           'random' (the default).  The answer is one line
+ *           'id nlen e n p q d', or 'id error message'.  A request
+ *           not answered nDeadlineMs after it was read is answered
+ *           'id error deadline passed'.
+ *
+ *           Request k of the stream (counting from 0, including bad
+ *           ones) uses the seed S + k * 2^{64}, as key k of a bulk
+ *           run would.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_STREAM_H
+#define GEN_STREAM_H
+
+#include <stdio.h>
+
+
+     /******** #defines and typedefs  ********/
+#define STREAM_MIN_BITS      (128)       /* smallest nlen accepted       */
+#define STREAM_MAX_BITS      (16384)     /* largest nlen accepted        */
+#define STREAM_WINDOW        (64)        /* requests in flight           */
+#define STREAM_LINE_MAX      (256)       /* longest request line         */
+
+typedef struct {
+  unsigned long   nSeed;              /* stream seed S                */
+  int             nThreads;           /* key generation threads       */
+  int             nFormat;            /* OUT_FORMAT of the numbers    */
+  int             flReorder;          /* answer in request order      */
+  int             nWindow;            /* 0 means STREAM_WINDOW        */
+  long            nDeadlineMs;        /* per request from receipt, 0 none */
+} STREAM_OPTS;
+
+
+     /******** functions in gen_stream.c ********/
+int  fnStream_run (const STREAM_OPTS *pOpts, FILE *fpIn, FILE *fpOut);
+
+#endif
@@ -0,0 +1,716 @@
+/**********************************************************************
+ * gen_writer.c -- Output stage for bulk runs.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- The buffers form a ring.  Producers fill the current one
+ *           under a mutex and split a record across two buffers when
+ *           it does not fit, so every buffer but the last is written
+ *           as exactly nBufSize bytes (which O_DIRECT needs).  Each
+ *           buffer gets its file offset when it is started, so
+ *           completions may arrive in any order.  fnWriter_sync hands
+ *           over a buffer early and the next one starts right after
+ *           it; from then on O_DIRECT is off.
+ *
+ *           The writer thread takes every full buffer at once and
+ *           submits them in one io_uring_enter (or one pwritev),
+ *           while the producers go on with the next buffer.
+ *
+ *           io_uring is driven through the raw system calls so that
+ *           no extra library is needed; if io_uring_setup fails the
+ *           writer silently uses pwritev.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING
+#endif
+#endif
+
+#include "gen_writer.h"
+
+
+     /******** #defines and typedefs  ********/
+#define BUF_FREE     (0)              /* available to producers       */
+#define BUF_FILLING  (1)              /* the one producers append to  */
+#define BUF_FULL     (2)              /* waiting for the writer       */
+#define BUF_BUSY     (3)              /* being written                */
+
+typedef struct {
+  unsigned char  *pData;              /* WRITER_ALIGN aligned         */
+  size_t          nLen;               /* bytes filled                 */
+  off_t           nOffset;            /* where they go in the file    */
+  int             nState;             /* BUF_ value                   */
+} WBUF;
+
+#ifdef HAVE_IO_URING
+typedef struct {
+  int                    fd;          /* ring file descriptor         */
+  unsigned              *pSqHead, *pSqTail, *pSqMask, *pSqArray;
+  unsigned              *pCqHead, *pCqTail, *pCqMask;
+  struct io_uring_sqe   *pSqes;
+  struct io_uring_cqe   *pCqes;
+  void                  *pSqMap, *pCqMap;
+  size_t                 nSqMap, nCqMap, nSqeMap;
+} URING;
+#endif
+
+struct WRITER {
+  int              fd;                /* output file                  */
+  int              flOwnFd;           /* close fd at the end          */
+  int              flSeekable;        /* pwrite / io_uring possible   */
+  int              flDirect;          /* opened with O_DIRECT         */
+  int              flUring;           /* ring is set up               */
+  size_t           nBufSize;
+  int              nBufs;
+  WBUF            *pBufs;
+  int              nCur;              /* buffer being filled          */
+  int              nNextWrite;        /* oldest buffer not yet taken  */
+  off_t            nFileOff;          /* offset of the next buffer    */
+  off_t            nDoneOff;          /* everything before is written */
+  int              flClosing;
+  int              nError;            /* errno of a failed write      */
+  pthread_t        thread;
+  pthread_mutex_t  mtx;
+  pthread_cond_t   cvFull;            /* writer waits on this         */
+  pthread_cond_t   cvFree;            /* producers wait on this       */
+  WRITER_STATS     stats;
+#ifdef HAVE_IO_URING
+  URING            ring;
+#endif
+};
+
+
+     /******** functions in this file ********/
+static void  *fnWriter_thread (void *pArg);
+static int    fnWriter_flush (WRITER *pW, int *pnIdx, int nCount);
+static int    fnWriter_pwrite_all (int fd, const unsigned char *p, \
+              size_t nLen, off_t nOff);
+#ifdef HAVE_IO_URING
+static int    fnUring_setup (URING *pRing, unsigned nEntries);
+static void   fnUring_close (URING *pRing);
+static int    fnUring_write (WRITER *pW, int *pnIdx, int nCount);
+#endif
+
+
+
+/************************************************************************
+ * fnWriter_open -- Open pszPath (NULL or "-" is stdout) and start the
+ *                  writer thread.  Returns NULL on failure.
+ *
+ * Remark - nBufSize is rounded up to WRITER_ALIGN; 0 and nBufs of 0
+ *          select the defaults.
+ ***********************************************************************/
+WRITER *fnWriter_open (const char *pszPath, int nFlags, size_t nBufSize, \
+        int nBufs)
+{
+  return fnWriter_open_at (pszPath, nFlags, nBufSize, nBufs, -1);
+}
+
+
+
+/************************************************************************
+ * fnWriter_open_at -- As fnWriter_open, but keep the first nStart
+ *                     bytes of the file and append after them.  The
+ *                     file is cut to nStart.  nStart < 0 truncates.
+ *
+ * Remark - Buffers stay aligned in the file: the bytes from the last
+ *          WRITER_ALIGN boundary up to nStart are read back into the
+ *          first buffer and written again.
+ ***********************************************************************/
+WRITER *fnWriter_open_at (const char *pszPath, int nFlags, \
+        size_t nBufSize, int nBufs, off_t nStart)
+{
+  WRITER  *pW;
+  int      i, nOpen;
+  off_t    nPos, nAligned = 0;
+
+
+  pW = (WRITER *) calloc (1, sizeof (WRITER));
+  if (nBufSize == 0)
+    nBufSize = WRITER_BUF_DEFAULT;
+  pW->nBufSize = (nBufSize + WRITER_ALIGN - 1) & ~((size_t) WRITER_ALIGN - 1);
+  pW->nBufs    = nBufs > 1 ? nBufs : WRITER_NBUF_DEFAULT;
+
+  /* 1. The file */
+  if (pszPath == NULL || strcmp (pszPath, "-") == 0) {
+    pW->fd = STDOUT_FILENO;
+  }
+  else {
+    nOpen  = nStart < 0 ? O_WRONLY | O_CREAT | O_TRUNC : O_RDWR | O_CREAT;
+    pW->fd = open (pszPath, nOpen | \
+                   ((nFlags & WRITER_F_DIRECT) ? O_DIRECT : 0), 0644);
+    if (pW->fd < 0 && (nFlags & WRITER_F_DIRECT)) {
+      fprintf (stderr, "   ### WARNING: O_DIRECT refused, using the page cache\n");
+      pW->fd = open (pszPath, nOpen, 0644);
+    }
+    else
+      pW->flDirect = (nFlags & WRITER_F_DIRECT) != 0;
+    if (pW->fd < 0) {
+      perror (pszPath);
+      free (pW);
+      return NULL;
+    }
+    pW->flOwnFd = 1;
+  }
+  nPos = lseek (pW->fd, 0, SEEK_CUR);
+  pW->flSeekable = nPos >= 0;
+  pW->nFileOff   = nPos >= 0 ? nPos : 0;
+
+  /* 1a. Appending: cut the file, and start at an aligned offset */
+  if (nStart >= 0) {
+    if (!pW->flSeekable || ftruncate (pW->fd, nStart) != 0) {
+      fprintf (stderr, "%s: cannot resume at offset %ld\n", pszPath, \
+               (long) nStart);
+      close (pW->fd);
+      free (pW);
+      return NULL;
+    }
+    nAligned     = nStart & ~((off_t) WRITER_ALIGN - 1);
+    pW->nFileOff = nAligned;
+  }
+  pW->nDoneOff = pW->nFileOff;
+
+  /* 2. The buffers, the first one is ready to be filled */
+  pW->pBufs = (WBUF *) calloc (pW->nBufs, sizeof (WBUF));
+  for (i = 0; i < pW->nBufs; i++) {
+    if (posix_memalign ((void **) &pW->pBufs[i].pData, WRITER_ALIGN, \
+                        pW->nBufSize) != 0) {
+      fprintf (stderr, "   ### ERROR: out of memory for output buffers\n");
+      exit (1);
+    }
+  }
+  pW->pBufs[0].nState  = BUF_FILLING;
+  pW->pBufs[0].nOffset = pW->nFileOff;
+  pW->nFileOff        += pW->nBufSize;
+  if (nStart > nAligned) {
+    pW->pBufs[0].nLen = nStart - nAligned;
+    if (pread (pW->fd, pW->pBufs[0].pData, WRITER_ALIGN, nAligned) != \
+        (ssize_t) pW->pBufs[0].nLen) {        /* O_DIRECT: whole block */
+      perror (pszPath);
+      exit (1);
+    }
+  }
+
+  /* 3. The way full buffers reach the disk */
+  pW->stats.pszMethod = pW->flSeekable ? "pwritev" : "writev";
+#ifdef HAVE_IO_URING
+  if (pW->flSeekable && !(nFlags & WRITER_F_NO_URING) &&
+      fnUring_setup (&pW->ring, (unsigned) pW->nBufs) == 0) {
+    pW->flUring = 1;
+    pW->stats.pszMethod = "io_uring";
+  }
+#endif
+
+  /* 4. The writer thread */
+  pthread_mutex_init (&pW->mtx, NULL);
+  pthread_cond_init (&pW->cvFull, NULL);
+  pthread_cond_init (&pW->cvFree, NULL);
+  pthread_create (&pW->thread, NULL, fnWriter_thread, pW);
+
+  return pW;
+}
+
+
+
+/************************************************************************
+ * fnWriter_put -- Append one record.  Returns 0, or -1 after a write
+ *                 error (the error was already reported).
+ ***********************************************************************/
+int fnWriter_put (WRITER *pW, const char *pchRec, size_t nLen)
+{
+  WBUF    *pB;
+  size_t   n;
+
+
+  pthread_mutex_lock (&pW->mtx);
+  pW->stats.nRecords++;
+
+  while (nLen > 0 && pW->nError == 0) {
+    pB = &pW->pBufs[pW->nCur];
+
+    /* 1. Start the next buffer, waiting only if the ring is full */
+    if (pB->nState != BUF_FILLING) {
+      if (pB->nState != BUF_FREE) {
+        pW->stats.nStalls++;
+        while (pB->nState != BUF_FREE && pW->nError == 0)
+          pthread_cond_wait (&pW->cvFree, &pW->mtx);
+        if (pW->nError != 0)
+          break;
+      }
+      pB->nState  = BUF_FILLING;
+      pB->nLen    = 0;
+      pB->nOffset = pW->nFileOff;
+      pW->nFileOff += pW->nBufSize;
+    }
+
+    /* 2. Copy what fits */
+    n = pW->nBufSize - pB->nLen;
+    if (n > nLen)
+      n = nLen;
+    memcpy (pB->pData + pB->nLen, pchRec, n);
+    pB->nLen += n;
+    pchRec   += n;
+    nLen     -= n;
+
+    /* 3. A full buffer goes to the writer */
+    if (pB->nLen == pW->nBufSize) {
+      pB->nState = BUF_FULL;
+      pW->nCur   = (pW->nCur + 1) % pW->nBufs;
+      pthread_cond_signal (&pW->cvFull);
+    }
+  }
+
+  pthread_mutex_unlock (&pW->mtx);
+  return pW->nError == 0 ? 0 : -1;
+}
+
+
+
+/************************************************************************
+ * fnWriter_sync -- Hand the partly filled buffer to the writer thread
+ *                  now, so every record put so far reaches the file
+ *                  without waiting for a full buffer.  Returns 0, or
+ *                  -1 after a write error.
+ ***********************************************************************/
+int fnWriter_sync (WRITER *pW)
+{
+  WBUF  *pB;
+
+
+  pthread_mutex_lock (&pW->mtx);
+  pB = &pW->pBufs[pW->nCur];
+  if (pB->nState == BUF_FILLING && pB->nLen > 0) {
+    pB->nState   = BUF_FULL;
+    pW->nFileOff = pB->nOffset + pB->nLen;    /* next buffer follows */
+    pW->nCur     = (pW->nCur + 1) % pW->nBufs;
+    pthread_cond_signal (&pW->cvFull);
+  }
+  pthread_mutex_unlock (&pW->mtx);
+
+  return pW->nError == 0 ? 0 : -1;
+}
+
+
+
+/************************************************************************
+ * fnWriter_close -- Write what is left, stop the thread and close the
+ *                   file.  Returns 0 when every byte was written.
+ ***********************************************************************/
+int fnWriter_close (WRITER *pW, WRITER_STATS *pStats)
+{
+  WBUF  *pB;
+  int    i, nError;
+
+
+  /* 1. The partly filled buffer is the last one */
+  pthread_mutex_lock (&pW->mtx);
+  pB = &pW->pBufs[pW->nCur];
+  if (pB->nState == BUF_FILLING) {
+    pB->nState = pB->nLen > 0 ? BUF_FULL : BUF_FREE;
+    pW->nCur   = (pW->nCur + 1) % pW->nBufs;
+  }
+  pW->flClosing = 1;
+  pthread_cond_signal (&pW->cvFull);
+  pthread_mutex_unlock (&pW->mtx);
+
+  pthread_join (pW->thread, NULL);
+
+  /* 2. Release everything */
+#ifdef HAVE_IO_URING
+  if (pW->flUring)
+    fnUring_close (&pW->ring);
+#endif
+  if (pW->flOwnFd)
+    close (pW->fd);
+  for (i = 0; i < pW->nBufs; i++)
+    free (pW->pBufs[i].pData);
+  free (pW->pBufs);
+  pthread_mutex_destroy (&pW->mtx);
+  pthread_cond_destroy (&pW->cvFull);
+  pthread_cond_destroy (&pW->cvFree);
+
+  if (pStats != NULL)
+    *pStats = pW->stats;
+  nError = pW->nError;
+  free (pW);
+
+  return nError == 0 ? 0 : -1;
+}
+
+
+
+/************************************************************************
+ * fnWriter_done_offset -- File offset up to which every byte has
+ *                         been written.  Buffers are written in file
+ *                         order, so this only grows.
+ ***********************************************************************/
+off_t fnWriter_done_offset (WRITER *pW)
+{
+  off_t  nOff;
+
+
+  pthread_mutex_lock (&pW->mtx);
+  nOff = pW->nDoneOff;
+  pthread_mutex_unlock (&pW->mtx);
+
+  return nOff;
+}
+
+
+
+/************************************************************************
+ * fnWriter_print_stats -- One summary block for a bulk run.
+ ***********************************************************************/
+void fnWriter_print_stats (FILE *fp, const WRITER_STATS *pStats)
+{
+  fprintf (fp, "\n  --> Output writer (%s) <--\n", pStats->pszMethod);
+  fprintf (fp, "      records:                %lu\n", pStats->nRecords);
+  fprintf (fp, "      bytes written:          %lu\n", pStats->nBytes);
+  fprintf (fp, "      buffers written:        %lu\n", pStats->nWrites);
+  fprintf (fp, "      submissions:            %lu\n", pStats->nSubmits);
+  fprintf (fp, "      producer stalls:        %lu\n", pStats->nStalls);
+}
+
+
+
+/************************************************************************
+ * fnWriter_thread -- Take every full buffer in ring order, write them
+ *                    and hand them back.
+ ***********************************************************************/
+static void *fnWriter_thread (void *pArg)
+{
+  WRITER  *pW = (WRITER *) pArg;
+  int     *pnIdx;
+  int      nCount, i, nError;
+
+
+  pnIdx = (int *) malloc (pW->nBufs * sizeof (int));
+
+  pthread_mutex_lock (&pW->mtx);
+  while (1) {
+    /* 1. Wait for work */
+    while (pW->pBufs[pW->nNextWrite].nState != BUF_FULL && !pW->flClosing)
+      pthread_cond_wait (&pW->cvFull, &pW->mtx);
+
+    /* 2. Take all consecutive full buffers */
+    nCount = 0;
+    while (nCount < pW->nBufs &&
+           pW->pBufs[pW->nNextWrite].nState == BUF_FULL) {
+      pW->pBufs[pW->nNextWrite].nState = BUF_BUSY;
+      pnIdx[nCount++] = pW->nNextWrite;
+      pW->nNextWrite  = (pW->nNextWrite + 1) % pW->nBufs;
+    }
+    if (nCount == 0 && pW->flClosing)
+      break;
+    pthread_mutex_unlock (&pW->mtx);
+
+    /* 3. Write them without holding the lock */
+    nError = fnWriter_flush (pW, pnIdx, nCount);
+
+    /* 4. Hand them back */
+    pthread_mutex_lock (&pW->mtx);
+    for (i = 0; i < nCount; i++) {
+      pW->stats.nBytes += pW->pBufs[pnIdx[i]].nLen;
+      if (nError == 0)
+        pW->nDoneOff = pW->pBufs[pnIdx[i]].nOffset + pW->pBufs[pnIdx[i]].nLen;
+      pW->pBufs[pnIdx[i]].nState = BUF_FREE;
+      pW->pBufs[pnIdx[i]].nLen   = 0;
+    }
+    pW->stats.nWrites += nCount;
+    if (nError != 0 && pW->nError == 0) {
+      pW->nError = nError;
+      errno = nError;
+      perror ("   ### ERROR: writing output");
+    }
+    pthread_cond_broadcast (&pW->cvFree);
+  }
+  pthread_mutex_unlock (&pW->mtx);
+
+  free (pnIdx);
+  return NULL;
+}
+
+
+
+/************************************************************************
+ * fnWriter_flush -- Write nCount buffers.  Returns 0 or an errno.
+ *
+ * Remark - A buffer shorter than nBufSize is the last one or one that
+ *          fnWriter_sync handed over; with O_DIRECT it is written
+ *          after clearing the flag, and so is everything after it.
+ ***********************************************************************/
+static int fnWriter_flush (WRITER *pW, int *pnIdx, int nCount)
+{
+  struct iovec  iov[64];
+  WBUF         *pB;
+  ssize_t       nDone;
+  size_t        nTotal;
+  int           i, n;
+
+
+  if (nCount == 0)
+    return 0;
+
+  /* 1. A short buffer and O_DIRECT do not mix */
+  for (i = 0; i < nCount && pW->flDirect; i++) {
+    pB = &pW->pBufs[pnIdx[i]];
+    if (pB->nLen % WRITER_ALIGN != 0) {
+      fcntl (pW->fd, F_SETFL, fcntl (pW->fd, F_GETFL) & ~O_DIRECT);
+      pW->flDirect = 0;
+    }
+  }
+
+#ifdef HAVE_IO_URING
+  if (pW->flUring)
+    return fnUring_write (pW, pnIdx, nCount);
+#endif
+
+  /* 2. The buffers are consecutive in the file, one call for all */
+  for (i = 0; i < nCount; i += n) {
+    nTotal = 0;
+    for (n = 0; n < 64 && i + n < nCount; n++) {
+      pB = &pW->pBufs[pnIdx[i + n]];
+      iov[n].iov_base = pB->pData;
+      iov[n].iov_len  = pB->nLen;
+      nTotal += pB->nLen;
+    }
+    pW->stats.nSubmits++;
+    if (pW->flSeekable)
+      nDone = pwritev (pW->fd, iov, n, pW->pBufs[pnIdx[i]].nOffset);
+    else
+      nDone = writev (pW->fd, iov, n);
+    if (nDone < 0)
+      return errno;
+
+    /* 3. Rare short write, finish buffer by buffer */
+    if ((size_t) nDone < nTotal) {
+      int  k;
+      for (k = 0; k < n; k++) {
+        pB = &pW->pBufs[pnIdx[i + k]];
+        if ((size_t) nDone >= pB->nLen) {
+          nDone -= pB->nLen;
+          continue;
+        }
+        if (pW->flSeekable) {
+          if (fnWriter_pwrite_all (pW->fd, pB->pData + nDone, \
+                                   pB->nLen - nDone, pB->nOffset + nDone) != 0)
+            return errno;
+        }
+        else if (fnWriter_pwrite_all (pW->fd, pB->pData + nDone, \
+                                      pB->nLen - nDone, -1) != 0)
+          return errno;
+        nDone = 0;
+      }
+    }
+  }
+
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnWriter_pwrite_all -- Write all nLen bytes, at nOff or (when nOff
+ *                        is negative) at the current position.
+ ***********************************************************************/
+static int fnWriter_pwrite_all (int fd, const unsigned char *p, \
+       size_t nLen, off_t nOff)
+{
+  ssize_t  n;
+
+
+  while (nLen > 0) {
+    n = nOff >= 0 ? pwrite (fd, p, nLen, nOff) : write (fd, p, nLen);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    p    += n;
+    nLen -= n;
+    if (nOff >= 0)
+      nOff += n;
+  }
+
+  return 0;
+}
+
+
+
+#ifdef HAVE_IO_URING
+/************************************************************************
+ * fnUring_setup -- Create a ring with nEntries submission slots and
+ *                  map its queues.  Returns 0, or -1 when io_uring is
+ *                  not available.
+ ***********************************************************************/
+static int fnUring_setup (URING *pRing, unsigned nEntries)
+{
+  struct io_uring_params  p;
+  unsigned char          *pSq, *pCq;
+
+
+  memset (&p, 0, sizeof (p));
+  memset (pRing, 0, sizeof (URING));
+
+  /* 1. The ring itself */
+  pRing->fd = (int) syscall (__NR_io_uring_setup, nEntries, &p);
+  if (pRing->fd < 0)
+    return -1;
+
+  /* 2. Submission and completion queues, one mapping if possible */
+  pRing->nSqMap = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+  pRing->nCqMap = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (pRing->nCqMap > pRing->nSqMap)
+      pRing->nSqMap = pRing->nCqMap;
+    pRing->nCqMap = 0;
+  }
+  pRing->pSqMap = mmap (NULL, pRing->nSqMap, PROT_READ | PROT_WRITE, \
+                        MAP_SHARED | MAP_POPULATE, pRing->fd, IORING_OFF_SQ_RING);
+  if (pRing->pSqMap == MAP_FAILED) {
+    close (pRing->fd);
+    return -1;
+  }
+  if (pRing->nCqMap == 0)
+    pRing->pCqMap = pRing->pSqMap;
+  else {
+    pRing->pCqMap = mmap (NULL, pRing->nCqMap, PROT_READ | PROT_WRITE, \
+                          MAP_SHARED | MAP_POPULATE, pRing->fd, IORING_OFF_CQ_RING);
+    if (pRing->pCqMap == MAP_FAILED) {
+      munmap (pRing->pSqMap, pRing->nSqMap);
+      close (pRing->fd);
+      return -1;
+    }
+  }
+
+  /* 3. The submission entries */
+  pRing->nSqeMap = p.sq_entries * sizeof (struct io_uring_sqe);
+  pRing->pSqes = (struct io_uring_sqe *) mmap (NULL, pRing->nSqeMap, \
+                 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, \
+                 pRing->fd, IORING_OFF_SQES);
+  if (pRing->pSqes == MAP_FAILED) {
+    if (pRing->nCqMap != 0)
+      munmap (pRing->pCqMap, pRing->nCqMap);
+    munmap (pRing->pSqMap, pRing->nSqMap);
+    close (pRing->fd);
+    return -1;
+  }
+
+  pSq = (unsigned char *) pRing->pSqMap;
+  pCq = (unsigned char *) pRing->pCqMap;
+  pRing->pSqHead  = (unsigned *) (pSq + p.sq_off.head);
+  pRing->pSqTail  = (unsigned *) (pSq + p.sq_off.tail);
+  pRing->pSqMask  = (unsigned *) (pSq + p.sq_off.ring_mask);
+  pRing->pSqArray = (unsigned *) (pSq + p.sq_off.array);
+  pRing->pCqHead  = (unsigned *) (pCq + p.cq_off.head);
+  pRing->pCqTail  = (unsigned *) (pCq + p.cq_off.tail);
+  pRing->pCqMask  = (unsigned *) (pCq + p.cq_off.ring_mask);
+  pRing->pCqes    = (struct io_uring_cqe *) (pCq + p.cq_off.cqes);
+
+  return 0;
+}
+
+
+
+/************************************************************************
+ * fnUring_close -- Unmap the queues and close the ring.
+ ***********************************************************************/
+static void fnUring_close (URING *pRing)
+{
+  munmap (pRing->pSqes, pRing->nSqeMap);
+  if (pRing->nCqMap != 0)
+    munmap (pRing->pCqMap, pRing->nCqMap);
+  munmap (pRing->pSqMap, pRing->nSqMap);
+  close (pRing->fd);
+}
+
+
+
+/************************************************************************
+ * fnUring_write -- Queue one write per buffer, submit them with a
+ *                  single io_uring_enter and reap all completions.
+ *
+ * Remark - nCount never exceeds the number of buffers, which is the
+ *          size the ring was created with.
+ ***********************************************************************/
+static int fnUring_write (WRITER *pW, int *pnIdx, int nCount)
+{
+  URING                *pRing = &pW->ring;
+  struct io_uring_sqe  *pSqe;
+  struct io_uring_cqe  *pCqe;
+  WBUF                 *pB;
+  unsigned              nTail, nHead, nSlot;
+  int                   i, nDone, nError = 0;
+  long                  nRet;
+
+
+  /* 1. Fill the submission entries */
+  nTail = *pRing->pSqTail;
+  for (i = 0; i < nCount; i++) {
+    pB    = &pW->pBufs[pnIdx[i]];
+    nSlot = nTail & *pRing->pSqMask;
+    pSqe  = &pRing->pSqes[nSlot];
+    memset (pSqe, 0, sizeof (*pSqe));
+    pSqe->opcode    = IORING_OP_WRITE;
+    pSqe->fd        = pW->fd;
+    pSqe->addr      = (unsigned long) pB->pData;
+    pSqe->len       = (unsigned) pB->nLen;
+    pSqe->off       = (unsigned long long) pB->nOffset;
+    pSqe->user_data = (unsigned long long) pnIdx[i];
+    pRing->pSqArray[nSlot] = nSlot;
+    nTail++;
+  }
+  __atomic_store_n (pRing->pSqTail, nTail, __ATOMIC_RELEASE);
+
+  /* 2. Submit all and wait for all */
+  pW->stats.nSubmits++;
+  do
+    nRet = syscall (__NR_io_uring_enter, pRing->fd, nCount, nCount, \
+                    IORING_ENTER_GETEVENTS, NULL, 0);
+  while (nRet < 0 && errno == EINTR);
+  if (nRet < 0)
+    return errno;
+
+  /* 3. Reap, finishing short writes synchronously */
+  nDone = 0;
+  while (nDone < nCount) {
+    nHead = *pRing->pCqHead;
+    if (nHead == __atomic_load_n (pRing->pCqTail, __ATOMIC_ACQUIRE)) {
+      nRet = syscall (__NR_io_uring_enter, pRing->fd, 0, 1, \
+                      IORING_ENTER_GETEVENTS, NULL, 0);
+      if (nRet < 0 && errno != EINTR)
+        return errno;
+      continue;
+    }
+    pCqe = &pRing->pCqes[nHead & *pRing->pCqMask];
+    pB   = &pW->pBufs[(int) pCqe->user_data];
+    if (pCqe->res < 0)
+      nError = -pCqe->res;
+    else if ((size_t) pCqe->res < pB->nLen &&
+             fnWriter_pwrite_all (pW->fd, pB->pData + pCqe->res, \
+                                  pB->nLen - pCqe->res, \
+                                  pB->nOffset + pCqe->res) != 0)
+      nError = errno;
+    __atomic_store_n (pRing->pCqHead, nHead + 1, __ATOMIC_RELEASE);
+    nDone++;
+  }
+
+  return nError;
+}
+#endif
@@ -0,0 +1,54 @@
+/**********************************************************************
+ * gen_writer.h -- Output stage for bulk runs.  Key generation
+ *                 threads copy finished records into large aligned
+ *                 buffers; a dedicated thread writes full buffers.
+ *
+ * Copyright 2022 Jesse I. Deutsch
+ *
+ * Remark -- Full buffers are submitted with io_uring when the kernel
+ *           offers it, otherwise with pwritev (or writev for pipes).
+ *           A producer only waits when every buffer is full.
+ *
+ * $Id:$
+ *********************************************************************/
+
+#ifndef GEN_WRITER_H
+#define GEN_WRITER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+
+     /******** #defines and typedefs  ********/
+#define WRITER_BUF_DEFAULT   (1024 * 1024)  /* bytes per buffer        */
+#define WRITER_NBUF_DEFAULT  (2)            /* double buffered         */
+#define WRITER_ALIGN         (4096)         /* buffer / O_DIRECT unit  */
+
+#define WRITER_F_DIRECT      (0x01)   /* open the file with O_DIRECT  */
+#define WRITER_F_NO_URING    (0x02)   /* force the pwritev path       */
+
+typedef struct {
+  unsigned long  nRecords;            /* records accepted             */
+  unsigned long  nBytes;              /* bytes written to the file    */
+  unsigned long  nWrites;             /* buffers written              */
+  unsigned long  nSubmits;            /* io_uring_enter / pwritev     */
+  unsigned long  nStalls;             /* producers that had to wait   */
+  const char    *pszMethod;           /* "io_uring", "pwritev", ...   */
+} WRITER_STATS;
+
+typedef struct WRITER  WRITER;
+
+
+     /******** functions in gen_writer.c ********/
+WRITER  *fnWriter_open (const char *pszPath, int nFlags, size_t nBufSize, \
+         int nBufs);
+WRITER  *fnWriter_open_at (const char *pszPath, int nFlags, \
+         size_t nBufSize, int nBufs, off_t nStart);
+int      fnWriter_put (WRITER *pW, const char *pchRec, size_t nLen);
+int      fnWriter_sync (WRITER *pW);
+off_t    fnWriter_done_offset (WRITER *pW);
+int      fnWriter_close (WRITER *pW, WRITER_STATS *pStats);
+void     fnWriter_print_stats (FILE *fp, const WRITER_STATS *pStats);
+
+#endif